@@ -4,6 +4,7 @@
 #include "commands/config_command.h"
 #include "commands/model_commands.h"
 #include "commands/cmd_command.h"
+#include "commands/logs_command.h"
 #include "tinylog/tinylog.h"
 #include <iostream>
 #include <algorithm>
@@ -12,15 +13,15 @@ namespace parallax {
 namespace cli {
 
 CommandParser::CommandParser() {
-    info_log("parallax cmd enter");
+    info_log("[CLI] parallax cmd enter");
     InitializeBuiltinCommands();
 }
 
-CommandParser::~CommandParser() { info_log("parallax cmd exit"); }
+CommandParser::~CommandParser() { info_log("[CLI] parallax cmd exit"); }
 
 int CommandParser::Parse(int argc, char* argv[]) {
     if (argc < 1) {
-        error_log("Invalid argument count");
+        error_log("[CLI] Invalid argument count");
         return 1;
     }
 
@@ -60,14 +61,14 @@ int CommandParser::Parse(int argc, char* argv[]) {
         args.emplace_back(argv[i]);
     }
 
-    info_log("Executing command: %s with %d arguments", command_name.c_str(),
-             static_cast<int>(args.size()));
+    info_log("[CLI] Executing command: %s with %d arguments",
+             command_name.c_str(), static_cast<int>(args.size()));
 
     // Execute command
     try {
         return command->handler(args);
     } catch (const std::exception& e) {
-        error_log("Command execution failed: %s", e.what());
+        error_log("[CLI] Command execution failed: %s", e.what());
         std::cerr << "Error executing command '" << command_name
                   << "': " << e.what() << std::endl;
         return 1;
@@ -174,6 +175,14 @@ void CommandParser::InitializeBuiltinCommands() {
                         auto result = cmd_cmd.Execute(args);
                         return static_cast<int>(result);
                     });
+
+    // Register logs command (offline log file tools)
+    RegisterCommand("logs", "Inspect parallax log files",
+                    [](const std::vector<std::string>& args) -> int {
+                        parallax::commands::LogsCommand logs_cmd;
+                        auto result = logs_cmd.Execute(args);
+                        return static_cast<int>(result);
+                    });
 }
 
 }  // namespace cli
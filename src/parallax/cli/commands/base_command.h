@@ -6,6 +6,7 @@
 #include <memory>
 #include <unordered_map>
 #include "utils/utils.h"
+#include "utils/probe_cache.h"
 #include "utils/process.h"
 #include "config/config_manager.h"
 #include "tinylog/tinylog.h"
@@ -139,10 +140,11 @@ class BaseCommand : public ICommand {
     bool IsAdmin() { return parallax::utils::IsAdmin(); }
 
     bool CheckWSLEnvironment(const CommandContext& context) {
+        // Shares its cached result with UbuntuInstaller::IsUbuntuInstalled
         std::string stdout_output, stderr_output;
-        int exit_code = parallax::utils::ExecCommandEx(
-            "powershell.exe -Command \"wsl --list --quiet\"", 30, stdout_output,
-            stderr_output, false, true);
+        int exit_code = parallax::utils::ExecProbeCommand(
+            "powershell.exe -Command \"wsl --list --quiet\"", 60, 30,
+            stdout_output, stderr_output, true);
 
         if (exit_code != 0) {
             return false;
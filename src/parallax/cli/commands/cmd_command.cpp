@@ -45,7 +45,7 @@ CommandResult CmdCommand::ExecuteImpl(const CommandContext& context) {
     // Build complete command
     std::string full_command = BuildCommand(context, options);
 
-    info_log("Executing command: %s", full_command.c_str());
+    info_log("[CLI] Executing command: %s", full_command.c_str());
 
     // Display execution information
     if (options.use_venv) {
@@ -162,7 +162,8 @@ bool CmdCommand::ExecuteCommand(const CommandContext& context,
     int exit_code = wsl_process.Execute(full_command);
 
     if (exit_code != 0) {
-        error_log("Command execution failed with exit code: %d", exit_code);
+        error_log("[CLI] Command execution failed with exit code: %d",
+                  exit_code);
         return false;
     }
 
@@ -95,12 +95,32 @@ void ConfigCommand::ShowHelpImpl() {
     std::cout << "  proxy_url           HTTP/SOCKS proxy URL (e.g., "
                  "http://127.0.0.1:7890)\n";
     std::cout << "  wsl_distro          WSL distribution name (default: "
-                 "Ubuntu-24.04)\n\n";
+                 "Ubuntu-24.04)\n";
+    std::cout << "  log_level           Log levels, global and per module "
+                 "(e.g., info,ENV=debug,WSL=warn)\n";
+    std::cout << "                      Modules: ENV, PROC, WSL, CFG, CLI. "
+                 "PARALLAX_LOG overrides it.\n";
+    std::cout << "  wsl_shell_session   Run WSL commands in one long-lived "
+                 "shell, on or off\n";
+    std::cout << "                      (default: off)\n";
+    std::cout << "  probe_cache         Reuse results of system probes: "
+                 "memory, disk\n";
+    std::cout << "                      (also across runs) or off (default: "
+                 "memory)\n";
+    std::cout << "  shutdown_grace      Seconds a stopped command gets after "
+                 "SIGINT and after\n";
+    std::cout << "                      SIGTERM before it is killed (default: "
+                 "3,2)\n";
+    std::cout << "  log_recorder        KB per thread of DEBUG records kept "
+                 "in memory and\n";
+    std::cout << "                      written before errors, 0 is off "
+                 "(default: 0)\n\n";
     std::cout << "Options:\n";
     std::cout << "  --help, -h          Show this help message\n\n";
     std::cout << "Examples:\n";
     std::cout << "  parallax config set proxy_url http://127.0.0.1:7890\n";
     std::cout << "  parallax config get proxy_url\n";
+    std::cout << "  parallax config set log_level ENV=debug,WSL=warn\n";
     std::cout << "  parallax config list\n";
     std::cout << "  parallax config reset\n";
 }
@@ -124,12 +144,18 @@ int ConfigCommand::SetConfigValue(const std::string& key,
         std::cout << "  wsl_linux_distro" << std::endl;
         std::cout << "  wsl_installer_url" << std::endl;
         std::cout << "  wsl_kernel_url" << std::endl;
+        std::cout << "  log_level" << std::endl;
+        std::cout << "  wsl_shell_session" << std::endl;
+        std::cout << "  probe_cache" << std::endl;
+        std::cout << "  shutdown_grace" << std::endl;
+        std::cout << "  log_recorder" << std::endl;
         return 1;
     }
 
     // Check if value is empty (for non-proxy_url keys, empty values are not
     // allowed)
-    if (key != parallax::config::KEY_PROXY_URL && IsEmptyValue(value)) {
+    if (key != parallax::config::KEY_PROXY_URL &&
+        key != parallax::config::KEY_LOG_LEVEL && IsEmptyValue(value)) {
         std::cout << "Error: Configuration value cannot be empty for key '"
                   << key << "'" << std::endl;
         std::cout
@@ -138,6 +164,46 @@ int ConfigCommand::SetConfigValue(const std::string& key,
         return 1;
     }
 
+    // Level lists are applied right away, which also validates them
+    if (key == parallax::config::KEY_LOG_LEVEL &&
+        set_log_module_levels(value.c_str()) != 0) {
+        std::cout << "Error: Invalid log level list: " << value << std::endl;
+        std::cout << "Expected e.g. 'info,ENV=debug,WSL=warn' with modules "
+                     "ENV, PROC, WSL, CFG, CLI"
+                  << std::endl;
+        return 1;
+    }
+
+    if (key == parallax::config::KEY_WSL_SHELL_SESSION && value != "on" &&
+        value != "off") {
+        std::cout << "Error: wsl_shell_session must be 'on' or 'off'"
+                  << std::endl;
+        return 1;
+    }
+
+    if (key == parallax::config::KEY_PROBE_CACHE && value != "memory" &&
+        value != "disk" && value != "off") {
+        std::cout << "Error: probe_cache must be 'memory', 'disk' or 'off'"
+                  << std::endl;
+        return 1;
+    }
+
+    parallax::utils::ShutdownPolicy shutdown;
+    if (key == parallax::config::KEY_SHUTDOWN_GRACE &&
+        !parallax::utils::ShutdownPolicy::Parse(value, shutdown)) {
+        std::cout << "Error: shutdown_grace must be '<interrupt seconds>,"
+                     "<terminate seconds>', e.g. '3,2'"
+                  << std::endl;
+        return 1;
+    }
+
+    if (key == parallax::config::KEY_LOG_RECORDER &&
+        value.find_first_not_of("0123456789") != std::string::npos) {
+        std::cout << "Error: log_recorder must be a number of KB, 0 for off"
+                  << std::endl;
+        return 1;
+    }
+
     try {
         // Set new value
         config_manager.SetConfigValue(key, value);
@@ -151,13 +217,14 @@ int ConfigCommand::SetConfigValue(const std::string& key,
         std::cout << "Configuration updated successfully:" << std::endl;
         std::cout << "  " << key << " = " << value << std::endl;
 
-        info_log("Configuration updated: %s = %s", key.c_str(), value.c_str());
+        info_log("[CLI] Configuration updated: %s = %s", key.c_str(),
+                 value.c_str());
 
         return 0;
     } catch (const std::exception& e) {
         std::cout << "Error: Failed to update configuration: " << e.what()
                   << std::endl;
-        error_log("Failed to update configuration: %s", e.what());
+        error_log("[CLI] Failed to update configuration: %s", e.what());
         return 1;
     }
 }
@@ -212,7 +279,7 @@ int ConfigCommand::ResetConfig() {
         std::cout << "Configuration reset to default values successfully."
                   << std::endl;
 
-        info_log("Configuration reset to defaults by user");
+        info_log("[CLI] Configuration reset to defaults by user");
 
         return 0;
     } catch (const std::exception& e) {
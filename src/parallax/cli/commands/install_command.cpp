@@ -1,12 +1,36 @@
 #include "install_command.h"
 #include "environment/environment_installer.h"
 #include "tinylog/tinylog.h"
+#include <windows.h>
 #include <iostream>
 #include <iomanip>
+#include <mutex>
 
 namespace parallax {
 namespace commands {
 
+// Installer stopped by Ctrl+C while InstallAllComponents() runs. The
+// handler runs on a thread of its own and holds the mutex while it uses
+// the installer, which is only cleared under it.
+static std::mutex s_installer_mutex;
+static environment::EnvironmentInstaller* s_installer = nullptr;
+
+// The first Ctrl+C stops the installation: the command in flight is
+// stopped with everything it started and the remaining steps are skipped.
+// Another one while that is under way ends parallax the usual way.
+static BOOL WINAPI InstallCtrlHandler(DWORD ctrl_type) {
+    if (ctrl_type != CTRL_C_EVENT && ctrl_type != CTRL_BREAK_EVENT) {
+        return FALSE;
+    }
+    std::lock_guard<std::mutex> lock(s_installer_mutex);
+    if (!s_installer || s_installer->IsStopped()) {
+        return FALSE;
+    }
+    std::cerr << "\n[Ctrl+C] Stopping installation...\n" << std::flush;
+    s_installer->Stop();
+    return TRUE;
+}
+
 InstallCommand::InstallCommand() = default;
 InstallCommand::~InstallCommand() = default;
 
@@ -91,10 +115,28 @@ void InstallCommand::ShowHelpImpl() {
 int InstallCommand::InstallAllComponents() {
     environment::EnvironmentInstaller installer;
 
+    {
+        std::lock_guard<std::mutex> lock(s_installer_mutex);
+        s_installer = &installer;
+    }
+    if (!SetConsoleCtrlHandler(InstallCtrlHandler, TRUE)) {
+        error_log("[CLI] Failed to set console control handler");
+    }
     auto result = installer.InstallEnvironment(ProgressCallback);
+    SetConsoleCtrlHandler(InstallCtrlHandler, FALSE);
+    {
+        std::lock_guard<std::mutex> lock(s_installer_mutex);
+        s_installer = nullptr;
+    }
 
     DisplayResults(result);
 
+    if (installer.IsStopped()) {
+        std::cout << "\n[STOPPED] Installation interrupted.\n";
+        std::cout << "Run 'parallax install' again to continue.\n";
+        return 1;
+    }
+
     // Return appropriate exit code based on installation results
     bool all_success = true;
     for (const auto& comp_result : result.component_results) {
@@ -0,0 +1,289 @@
+#include "logs_command.h"
+#include "tinylog/binary_log.h"
+#include "tinylog/tinylog.h"
+#include "utils/utils.h"
+#include <windows.h>
+#include <stdlib.h>
+#include <iostream>
+
+namespace parallax {
+namespace commands {
+
+namespace {
+
+const char* const kTextLogName = "parallax.log";
+const char* const kBinaryLogName = "parallax.blog";
+const int kMaxLogSegments = 50;
+
+// No subcommand, or options only: query the log
+bool IsQuery(const std::vector<std::string>& args) {
+    return args.empty() || (!args[0].empty() && args[0][0] == '-');
+}
+
+}  // namespace
+
+CommandResult LogsCommand::ValidateArgsImpl(CommandContext& context) {
+    if (IsQuery(context.args)) {
+        QueryOptions options;
+        if (!ParseQueryArguments(context.args, options)) {
+            return CommandResult::InvalidArgs;
+        }
+        return CommandResult::Success;
+    }
+
+    if (context.args[0] != "decode") {
+        this->ShowError("Unknown logs subcommand: " + context.args[0]);
+        this->ShowError("Run 'parallax logs --help' for usage information.");
+        return CommandResult::InvalidArgs;
+    }
+
+    DecodeOptions options;
+    if (!ParseDecodeArguments(context.args, options)) {
+        return CommandResult::InvalidArgs;
+    }
+
+    return CommandResult::Success;
+}
+
+CommandResult LogsCommand::ExecuteImpl(const CommandContext& context) {
+    if (IsQuery(context.args)) {
+        QueryOptions options;
+        ParseQueryArguments(context.args, options);
+        return Query(options);
+    }
+
+    DecodeOptions options;
+    ParseDecodeArguments(context.args, options);
+    return Decode(options);
+}
+
+void LogsCommand::ShowHelpImpl() {
+    std::cout << "Usage: parallax logs [options]\n";
+    std::cout << "       parallax logs decode [options] [file...]\n\n";
+    std::cout << "Print the records of the parallax log, oldest first.\n\n";
+    std::cout << "Options:\n";
+    std::cout << "  --since <time>       Only records at or after time\n";
+    std::cout << "  --until <time>       Only records at or before time\n";
+    std::cout << "  --level <level>      Most verbose level shown: crit, "
+                 "error, warn, info, debug\n";
+    std::cout << "  --grep <text>        Only records containing text\n";
+    std::cout << "  -f, --follow         Keep printing new records as they "
+                 "are written\n";
+    std::cout << "  --file <file>        Read this log instead of the one "
+                 "next to parallax.exe\n";
+    std::cout << "  --binary             The log file holds binary records\n";
+    std::cout << "  --help, -h           Show this help message\n\n";
+    std::cout << "Times are local: \"2024-05-01 13:00[:00[.000]]\", "
+                 "\"2024-05-01\", \"13:00\" (today)\n";
+    std::cout << "or a duration before now such as 90s, 15m, 2h, 1d. "
+                 "Rotated segments are\n";
+    std::cout << "skipped using their time index (.idx) where possible.\n\n";
+    std::cout << "The binary log (" << kBinaryLogName
+              << ") is read when PARALLAX_LOG_FORMAT=binary is set.\n";
+    std::cout << "Following is supported for text logs only.\n\n";
+    std::cout << "Decode subcommand:\n";
+    std::cout << "Convert binary log files to the text log format.\n\n";
+    std::cout << "Options:\n";
+    std::cout << "  -o, --output <file>  Write decoded lines to file instead "
+                 "of stdout\n";
+    std::cout << "  --help, -h           Show this help message\n\n";
+    std::cout << "Without file arguments all segments of " << kBinaryLogName
+              << " next to parallax.exe are\n";
+    std::cout << "decoded, oldest first. Compressed segments (.gz) are read "
+                 "directly.\n\n";
+    std::cout << "Binary logging is enabled by setting the environment "
+                 "variable\n";
+    std::cout << "PARALLAX_LOG_FORMAT=binary before starting parallax.\n\n";
+    std::cout << "Examples:\n";
+    std::cout << "  parallax logs --since 1h --level warn\n";
+    std::cout << "  parallax logs --since \"2024-05-01 13:00\" --until 13:30 "
+                 "--grep wsl\n";
+    std::cout << "  parallax logs -f --level info\n";
+    std::cout << "  parallax logs decode\n";
+    std::cout << "  parallax logs decode parallax.blog.1 -o parallax.txt\n";
+}
+
+bool LogsCommand::ParseDecodeArguments(const std::vector<std::string>& args,
+                                       DecodeOptions& options) {
+    // args[0] is the subcommand
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+
+        if (arg == "-o" || arg == "--output") {
+            if (i + 1 >= args.size()) {
+                this->ShowError(arg + " requires a file name");
+                return false;
+            }
+            options.output_path = args[++i];
+        } else if (!arg.empty() && arg[0] == '-') {
+            this->ShowError("Unknown option: " + arg);
+            return false;
+        } else {
+            options.files.push_back(arg);
+        }
+    }
+
+    return true;
+}
+
+bool LogsCommand::ParseQueryArguments(const std::vector<std::string>& args,
+                                      QueryOptions& options) {
+    tinylog::LogQueryOptions& query = options.query;
+
+    // Same choice of log as at startup (see main.cpp)
+    const char* log_format = getenv("PARALLAX_LOG_FORMAT");
+    query.binary = log_format && _stricmp(log_format, "binary") == 0;
+    query.max_segments = kMaxLogSegments;
+
+    std::string file;
+    uint64_t now_ms = tinylog::LogTimeNow();
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+
+        if (arg == "-f" || arg == "--follow") {
+            options.follow = true;
+        } else if (arg == "--binary") {
+            query.binary = true;
+        } else if (arg == "--since" || arg == "--until" || arg == "--level" ||
+                   arg == "--grep" || arg == "--file") {
+            if (i + 1 >= args.size()) {
+                this->ShowError(arg + " requires a value");
+                return false;
+            }
+            const std::string& value = args[++i];
+
+            if (arg == "--since" || arg == "--until") {
+                uint64_t time_ms = tinylog::ParseLogQueryTime(value, now_ms);
+                if (time_ms == 0) {
+                    this->ShowError("Invalid time for " + arg + ": " + value);
+                    return false;
+                }
+                (arg == "--since" ? query.since_ms : query.until_ms) = time_ms;
+            } else if (arg == "--level") {
+                query.level = tinylog::ParseLogLevel(value);
+                if (query.level < 0) {
+                    this->ShowError("Invalid log level: " + value);
+                    return false;
+                }
+            } else if (arg == "--grep") {
+                query.grep = value;
+            } else {
+                file = value;
+            }
+        } else {
+            this->ShowError("Unknown option: " + arg);
+            this->ShowError(
+                "Run 'parallax logs --help' for usage information.");
+            return false;
+        }
+    }
+
+    if (options.follow && query.binary) {
+        this->ShowError("--follow is not supported for binary logs, use "
+                        "'parallax logs decode'");
+        return false;
+    }
+    if (query.since_ms > 0 && query.until_ms > 0 &&
+        query.since_ms > query.until_ms) {
+        this->ShowError("--since is later than --until");
+        return false;
+    }
+
+    query.filename = file.empty()
+                         ? parallax::utils::JoinPath(
+                               parallax::utils::GetAppBinDir(),
+                               query.binary ? kBinaryLogName : kTextLogName)
+                         : file;
+    return true;
+}
+
+CommandResult LogsCommand::Query(const QueryOptions& options) {
+    // Make sure records written by this process are on disk as well
+    tinylog_flush();
+
+    tinylog::LogQuery query(options.query);
+    std::string error;
+    CommandResult result = CommandResult::Success;
+
+    // Plain -f behaves like tail -f: only records written from now on
+    const tinylog::LogQueryOptions& filter = options.query;
+    bool filtered = filter.since_ms > 0 || filter.until_ms > 0 ||
+                    filter.level < 4 || !filter.grep.empty();
+    if (!options.follow || filtered) {
+        if (!query.Run(stdout, error)) {
+            this->ShowError(error);
+            result = CommandResult::ExecutionError;
+        }
+        fflush(stdout);
+    }
+
+    if (options.follow && !query.Follow(stdout, error)) {
+        this->ShowError(error);
+        return CommandResult::ExecutionError;
+    }
+    return result;
+}
+
+CommandResult LogsCommand::Decode(const DecodeOptions& options) {
+    std::vector<std::string> files = options.files;
+    if (files.empty()) {
+        files = GetDefaultBinaryLogFiles();
+        if (files.empty()) {
+            this->ShowError(std::string("No binary log files found (") +
+                            kBinaryLogName + ")");
+            return CommandResult::ExecutionError;
+        }
+    }
+
+    FILE* out = stdout;
+    if (!options.output_path.empty()) {
+        out = fopen(options.output_path.c_str(), "w");
+        if (!out) {
+            this->ShowError("Failed to open output file: " +
+                            options.output_path);
+            return CommandResult::ExecutionError;
+        }
+    }
+
+    // Make sure records written by this process are on disk as well
+    tinylog_flush();
+
+    CommandResult result = CommandResult::Success;
+    for (const auto& file : files) {
+        std::string error;
+        if (!tinylog::DecodeBinaryLog(file, out, error)) {
+            this->ShowError(error);
+            result = CommandResult::ExecutionError;
+        }
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    } else {
+        fflush(stdout);
+    }
+
+    return result;
+}
+
+std::vector<std::string> LogsCommand::GetDefaultBinaryLogFiles() {
+    std::string base =
+        parallax::utils::JoinPath(parallax::utils::GetAppBinDir(),
+                                  kBinaryLogName);
+
+    std::vector<std::string> files;
+    for (int i = kMaxLogSegments; i >= 0; --i) {
+        std::string name = (i > 0) ? base + "." + std::to_string(i) : base;
+        if (GetFileAttributesA(name.c_str()) != INVALID_FILE_ATTRIBUTES) {
+            files.push_back(name);
+        } else if (i > 0 && GetFileAttributesA((name + ".gz").c_str()) !=
+                                INVALID_FILE_ATTRIBUTES) {
+            // Rotated segments are usually compressed
+            files.push_back(name + ".gz");
+        }
+    }
+    return files;
+}
+
+}  // namespace commands
+}  // namespace parallax
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "base_command.h"
+#include "tinylog/log_query.h"
+#include <vector>
+#include <string>
+
+namespace parallax {
+namespace commands {
+
+// Logs command - query and offline tools for parallax log files
+class LogsCommand : public BaseCommand<LogsCommand> {
+ public:
+    std::string GetName() const override { return "logs"; }
+    std::string GetDescription() const override {
+        return "Inspect parallax log files";
+    }
+
+    EnvironmentRequirements GetEnvironmentRequirements() {
+        // Log files are read locally, no special environment required
+        EnvironmentRequirements req;
+        return req;
+    }
+
+    CommandResult ValidateArgsImpl(CommandContext& context);
+    CommandResult ExecuteImpl(const CommandContext& context);
+    void ShowHelpImpl();
+
+ private:
+    struct QueryOptions {
+        tinylog::LogQueryOptions query;
+        bool follow = false;
+    };
+
+    struct DecodeOptions {
+        std::vector<std::string> files;
+        std::string output_path;
+    };
+
+    bool ParseDecodeArguments(const std::vector<std::string>& args,
+                              DecodeOptions& options);
+    CommandResult Decode(const DecodeOptions& options);
+
+    bool ParseQueryArguments(const std::vector<std::string>& args,
+                             QueryOptions& options);
+    CommandResult Query(const QueryOptions& options);
+
+    // Segments of the default binary log, oldest first
+    std::vector<std::string> GetDefaultBinaryLogFiles();
+};
+
+}  // namespace commands
+}  // namespace parallax
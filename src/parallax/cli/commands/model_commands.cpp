@@ -31,7 +31,7 @@ bool ModelRunCommand::IsParallaxProcessRunning(const CommandContext& context) {
 
     // pgrep returns 0 if matching process is found, returns 1 if not found
     if (exit_code == 0) {
-        info_log("Parallax process found: %s", stdout_output.c_str());
+        info_log("[CLI] Parallax process found: %s", stdout_output.c_str());
     }
     return exit_code == 0;
 }
@@ -54,7 +54,8 @@ bool ModelRunCommand::RunParallaxScript(const CommandContext& context) {
 
     std::string wsl_command = BuildWSLCommand(context, full_command);
 
-    info_log("Executing Parallax launch command: %s", wsl_command.c_str());
+    info_log("[CLI] Executing Parallax launch command: %s",
+             wsl_command.c_str());
 
     WSLProcess wsl_process;
     int exit_code = wsl_process.Execute(wsl_command);
@@ -108,7 +109,7 @@ CommandResult ModelJoinCommand::ExecuteImpl(const CommandContext& context) {
 
     std::string wsl_command = BuildWSLCommand(context, full_command);
 
-    info_log("Executing cluster join command: %s", wsl_command.c_str());
+    info_log("[CLI] Executing cluster join command: %s", wsl_command.c_str());
 
     // Use WSLProcess to execute command for real-time output
     WSLProcess wsl_process;
@@ -196,7 +197,7 @@ CommandResult ModelChatCommand::ExecuteImpl(const CommandContext& context) {
 
     std::string wsl_command = BuildWSLCommand(context, full_command);
 
-    info_log("Executing chat interface command: %s", wsl_command.c_str());
+    info_log("[CLI] Executing chat interface command: %s", wsl_command.c_str());
 
     // Use WSLProcess to execute command for real-time output
     WSLProcess wsl_process;
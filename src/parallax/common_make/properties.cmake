@@ -4,6 +4,16 @@ else()
     ADD_DEFINITIONS(-DMACRO_FILE="" -DMACRO_FUNCTION="" -DMACRO_LINE=0)
 endif()
 
+# Least severe log level compiled in, tinylog macros above it become no-ops
+set(PARALLAX_MIN_LOG_LEVEL "DEBUG" CACHE STRING "Least severe log level compiled into parallax")
+set_property(CACHE PARALLAX_MIN_LOG_LEVEL PROPERTY STRINGS DEBUG INFO WARN ERROR CRIT)
+set(TINYLOG_LEVELS CRIT ERROR WARN INFO DEBUG)
+list(FIND TINYLOG_LEVELS "${PARALLAX_MIN_LOG_LEVEL}" TINYLOG_COMPILED_LEVEL)
+if(TINYLOG_COMPILED_LEVEL EQUAL -1)
+    message(FATAL_ERROR "Invalid PARALLAX_MIN_LOG_LEVEL: ${PARALLAX_MIN_LOG_LEVEL}")
+endif()
+ADD_DEFINITIONS(-DTINYLOG_COMPILED_LEVEL=${TINYLOG_COMPILED_LEVEL})
+
 if(NOT DEFINED TARGET_TYPE)
     get_target_property(TARGET_TYPE ${PROJECT_NAME} TYPE)
 endif()
@@ -15,6 +15,11 @@ const std::string KEY_WSL_LINUX_DISTRO = "wsl_linux_distro";
 const std::string KEY_WSL_INSTALLER_URL = "wsl_installer_url";
 const std::string KEY_WSL_KERNEL_URL = "wsl_kernel_url";
 const std::string KEY_PARALLAX_GIT_REPO_URL = "parallax_git_repo_url";
+const std::string KEY_LOG_LEVEL = "log_level";
+const std::string KEY_WSL_SHELL_SESSION = "wsl_shell_session";
+const std::string KEY_PROBE_CACHE = "probe_cache";
+const std::string KEY_SHUTDOWN_GRACE = "shutdown_grace";
+const std::string KEY_LOG_RECORDER = "log_recorder";
 
 // Default configuration file name
 const std::string ConfigManager::DEFAULT_CONFIG_PATH = "parallax_config.txt";
@@ -55,7 +60,8 @@ void ConfigManager::InitDefaultConfig() {
         "wsl_update_x64.msi";
     config_values_[KEY_PARALLAX_GIT_REPO_URL] =
         "https://github.com/GradientHQ/parallax.git";
-    // proxy_url has no default value
+    // proxy_url, log_level, wsl_shell_session, probe_cache, shutdown_grace
+    // and log_recorder have no default value
 }
 
 // Load configuration file
@@ -86,7 +92,7 @@ bool ConfigManager::LoadConfigInternal(const std::string& config_path) {
     std::ifstream file(config_path);
     if (!file.is_open()) {
         // If file doesn't exist, create default configuration file
-        info_log("Config file not found, creating default config: %s",
+        info_log("[CFG] Config file not found, creating default config: %s",
                  config_path.c_str());
         return SaveConfig(config_path);
     }
@@ -122,13 +128,13 @@ bool ConfigManager::LoadConfigInternal(const std::string& config_path) {
 
         if (config_values_[key].empty()) {
             config_values_[key] = default_value;
-            info_log(
-                "Protected builtin config key '%s' restored to default value",
-                key.c_str());
+            info_log("[CFG] Protected builtin config key '%s' restored to "
+                     "default value",
+                     key.c_str());
         }
     }
 
-    info_log("Config loaded successfully from %s", config_path.c_str());
+    info_log("[CFG] Config loaded successfully from %s", config_path.c_str());
     return true;
 }
 
@@ -141,7 +147,7 @@ bool ConfigManager::SaveConfig(const std::string& config_path) {
     // Open file
     std::ofstream file(path_to_save);
     if (!file.is_open()) {
-        error_log("Failed to open config file for writing: %s",
+        error_log("[CFG] Failed to open config file for writing: %s",
                   path_to_save.c_str());
         return false;
     }
@@ -162,7 +168,7 @@ bool ConfigManager::SaveConfig(const std::string& config_path) {
         config_path_ = config_path;
     }
 
-    info_log("Config saved successfully to %s", path_to_save.c_str());
+    info_log("[CFG] Config saved successfully to %s", path_to_save.c_str());
     return true;
 }
 
@@ -288,8 +294,10 @@ bool ConfigManager::HasConfigValue(const std::string& key) const {
 // Check if it's a valid configuration key
 bool ConfigManager::IsValidConfigKey(const std::string& key) const {
     static const std::set<std::string> valid_keys = {
-        KEY_PROXY_URL, KEY_WSL_LINUX_DISTRO, KEY_WSL_INSTALLER_URL,
-        KEY_WSL_KERNEL_URL, KEY_PARALLAX_GIT_REPO_URL};
+        KEY_PROXY_URL,      KEY_WSL_LINUX_DISTRO,      KEY_WSL_INSTALLER_URL,
+        KEY_WSL_KERNEL_URL, KEY_PARALLAX_GIT_REPO_URL, KEY_LOG_LEVEL,
+        KEY_WSL_SHELL_SESSION, KEY_PROBE_CACHE, KEY_SHUTDOWN_GRACE,
+        KEY_LOG_RECORDER};
 
     return valid_keys.find(key) != valid_keys.end();
 }
@@ -305,7 +313,7 @@ void ConfigManager::ResetToDefaults() {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
     config_values_.clear();
     InitDefaultConfig();
-    info_log("Configuration reset to default values");
+    info_log("[CFG] Configuration reset to default values");
 }
 
 // Get all configuration items (for list command)
@@ -12,6 +12,11 @@ extern const std::string KEY_WSL_LINUX_DISTRO;
 extern const std::string KEY_WSL_INSTALLER_URL;
 extern const std::string KEY_WSL_KERNEL_URL;
 extern const std::string KEY_PARALLAX_GIT_REPO_URL;
+extern const std::string KEY_LOG_LEVEL;
+extern const std::string KEY_WSL_SHELL_SESSION;
+extern const std::string KEY_PROBE_CACHE;
+extern const std::string KEY_SHUTDOWN_GRACE;
+extern const std::string KEY_LOG_RECORDER;
 
 // Configuration file manager class
 class ConfigManager {
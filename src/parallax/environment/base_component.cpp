@@ -10,7 +10,7 @@ namespace environment {
 
 // ExecutionContext implementation
 ExecutionContext::ExecutionContext()
-    : silent_mode_(false), stop_requested_(false) {
+    : use_wsl_shell_session_(false), silent_mode_(false) {
     // Set temporary directory to system temporary directory
     char temp_path[MAX_PATH];
     DWORD result = GetTempPathA(MAX_PATH, temp_path);
@@ -24,14 +24,19 @@ ExecutionContext::ExecutionContext()
         parallax::config::ConfigManager::GetInstance().GetConfigValue(
             parallax::config::KEY_WSL_LINUX_DISTRO);
 
+    use_wsl_shell_session_ =
+        parallax::config::ConfigManager::GetInstance().GetConfigValue(
+            parallax::config::KEY_WSL_SHELL_SESSION) == "on";
+
     // Get proxy URL from utils
     proxy_url_ = parallax::utils::GetProxyUrl();
 
     info_log(
         "[ENV] ExecutionContext initialized. Temp directory: %s, Ubuntu "
-        "version: %s, Proxy URL: %s",
+        "version: %s, Proxy URL: %s, WSL shell session: %s",
         temp_directory_.c_str(), ubuntu_version_.c_str(),
-        proxy_url_.empty() ? "none" : proxy_url_.c_str());
+        proxy_url_.empty() ? "none" : proxy_url_.c_str(),
+        use_wsl_shell_session_ ? "on" : "off");
 }
 
 void ExecutionContext::ReportProgress(const std::string& step,
@@ -46,13 +51,24 @@ void ExecutionContext::SetProgressCallback(ProgressCallback callback) {
     progress_callback_ = callback;
 }
 
-void ExecutionContext::RequestStop() { stop_requested_ = true; }
+void ExecutionContext::RequestStop() { stop_token_.Cancel(); }
 
 bool ExecutionContext::IsStopRequested() const {
-    return stop_requested_.load();
+    return stop_token_.IsCancelled();
+}
+
+void ExecutionContext::ResetStop() { stop_token_.Reset(); }
+
+ExecutionContext::DeadlineScope::DeadlineScope(ExecutionContext& context,
+                                               int64_t budget_ms)
+    : context_(context), previous_(context.deadline_) {
+    context_.deadline_ =
+        previous_.Min(parallax::utils::Deadline::In(budget_ms));
 }
 
-void ExecutionContext::ResetStop() { stop_requested_ = false; }
+ExecutionContext::DeadlineScope::~DeadlineScope() {
+    context_.deadline_ = previous_;
+}
 
 // BaseEnvironmentComponent implementation
 BaseEnvironmentComponent::BaseEnvironmentComponent(
@@ -85,14 +101,27 @@ ComponentResult BaseEnvironmentComponent::CreateWarningResult(
 
 void BaseEnvironmentComponent::LogOperationStart(
     const std::string& operation) const {
+    operation_start_ms_ = GetTickCount64();
     info_log("[ENV] %s %s", operation.c_str(), GetComponentName().c_str());
 }
 
 void BaseEnvironmentComponent::LogOperationResult(
     const std::string& operation, const ComponentResult& result) const {
-    info_log("[ENV] %s %s result: status=%s, message=%s", operation.c_str(),
-             GetComponentName().c_str(), StatusToString(result.status).c_str(),
-             result.message.c_str());
+    unsigned long long duration_ms =
+        operation_start_ms_ ? GetTickCount64() - operation_start_ms_ : 0;
+
+    // The log file keeps the line existing tools match, the JSON-lines file
+    // gets the fields of the structured record
+    info_kv_msg(TINYLOG_MODULE_ENV, "component_result",
+                ("[ENV] " + operation + " " + GetComponentName() +
+                 " result: status=" + StatusToString(result.status) +
+                 ", message=" + result.message)
+                    .c_str(),
+                {"operation", operation}, {"component", GetComponentName()},
+                {"duration_ms", duration_ms},
+                {"error_code", result.error_code},
+                {"status", StatusToString(result.status)},
+                {"message", result.message});
 }
 
 bool BaseEnvironmentComponent::IsStopRequested() const {
@@ -4,6 +4,7 @@
 #include <functional>
 #include <atomic>
 #include <memory>
+#include "utils/cancellation.h"
 
 namespace parallax {
 namespace environment {
@@ -72,15 +73,45 @@ class ExecutionContext {
                         int progress_percent);
     void SetProgressCallback(ProgressCallback callback);
 
-    // Stop mechanism
+    // Stop mechanism. RequestStop() cancels the stop token, which the
+    // commands in flight watch as well; it may come from any thread.
     void RequestStop();
     bool IsStopRequested() const;
     void ResetStop();
+    const utils::CancellationToken& GetStopToken() const {
+        return stop_token_;
+    }
+
+    // Deadline of the step that runs, see DeadlineScope. Never outside of
+    // any step.
+    const utils::Deadline& GetDeadline() const { return deadline_; }
+
+    /**
+     * @brief Budget of a step, for as long as it exists
+     *
+     * The context's deadline becomes the earlier of the current one and
+     * budget_ms from now, so a nested step gets at most what its parent
+     * has left. The previous deadline comes back at the end of the scope.
+     * Steps run one at a time, scopes nest.
+     */
+    class DeadlineScope {
+     public:
+        DeadlineScope(ExecutionContext& context, int64_t budget_ms);
+        ~DeadlineScope();
+
+        DeadlineScope(const DeadlineScope&) = delete;
+        DeadlineScope& operator=(const DeadlineScope&) = delete;
+
+     private:
+        ExecutionContext& context_;
+        utils::Deadline previous_;
+    };
 
     // Configuration access
     const std::string& GetTempDirectory() const { return temp_directory_; }
     const std::string& GetUbuntuVersion() const { return ubuntu_version_; }
     const std::string& GetProxyUrl() const { return proxy_url_; }
+    bool UseWSLShellSession() const { return use_wsl_shell_session_; }
 
     // Silent mode
     void SetSilentMode(bool silent) { silent_mode_ = silent; }
@@ -90,8 +121,10 @@ class ExecutionContext {
     std::string temp_directory_;
     std::string ubuntu_version_;
     std::string proxy_url_;
+    bool use_wsl_shell_session_;
     bool silent_mode_;
-    std::atomic<bool> stop_requested_;
+    utils::CancellationToken stop_token_;
+    utils::Deadline deadline_;
     ProgressCallback progress_callback_;
 };
 
@@ -121,6 +154,10 @@ class BaseEnvironmentComponent : public IEnvironmentComponent {
     void LogOperationResult(const std::string& operation,
                             const ComponentResult& result) const;
     bool IsStopRequested() const;
+
+ private:
+    // GetTickCount64() of the last LogOperationStart, for duration_ms
+    mutable unsigned long long operation_start_ms_ = 0;
 };
 
 }  // namespace environment
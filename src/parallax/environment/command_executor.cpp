@@ -1,6 +1,8 @@
 #include "command_executor.h"
 #include "base_component.h"
+#include "utils/probe_cache.h"
 #include "utils/process.h"
+#include "utils/shell_session.h"
 #include "utils/utils.h"
 #include "tinylog/tinylog.h"
 #include <windows.h>
@@ -9,19 +11,30 @@ namespace parallax {
 namespace environment {
 
 CommandExecutor::CommandExecutor(std::shared_ptr<ExecutionContext> context)
-    : context_(context) {}
+    : context_(context), session_start_failures_(0) {
+    if (context_->UseWSLShellSession()) {
+        // Same user and shell as BuildWSLCommand, without the rc files that
+        // bash -c does not read either
+        wsl_session_.reset(new utils::ShellSession(
+            {"wsl", "-d", context_->GetUbuntuVersion(), "-u", "root", "--exec",
+             "bash", "--noprofile", "--norc"}));
+    }
+}
+
+CommandExecutor::~CommandExecutor() {}
 
 std::pair<int, std::string> CommandExecutor::ExecutePowerShell(
-    const std::string& command, int timeout_seconds) {
+    const std::string& command, int timeout_seconds, int cache_ttl_seconds) {
     // Check if stop has been requested
     if (context_->IsStopRequested()) {
         return {-1, "Operation interrupted by stop request"};
     }
 
     std::string stdout_output, stderr_output;
-    int exit_code = parallax::utils::ExecCommandEx(
-        "powershell.exe -Command \"" + command + "\"", timeout_seconds,
-        stdout_output, stderr_output, false, true);
+    int exit_code = parallax::utils::ExecProbeCommand(
+        "powershell.exe -Command \"" + command + "\"", cache_ttl_seconds,
+        timeout_seconds, stdout_output, stderr_output, true,
+        context_->GetStopToken(), context_->GetDeadline());
 
     // Handle PowerShell output encoding (usually UTF-16)
     std::string utf8_stdout =
@@ -39,9 +52,11 @@ std::pair<int, std::string> CommandExecutor::ExecutePowerShell(
     }
 
     // Add error logging - record detailed information when PowerShell command
-    // execution fails
+    // execution fails (probe commands in polling loops fail routinely, so
+    // the site is rate limited)
     if (exit_code != 0) {
-        error_log(
+        error_log_limited(
+            2, 20,
             "[ENV] PowerShell command failed - Command: %s, Exit code: %d, "
             "Output: %s",
             command.c_str(), exit_code, combined_output.c_str());
@@ -58,7 +73,8 @@ std::pair<int, std::string> CommandExecutor::ExecutePowerShell(
 }
 
 std::pair<int, std::string> CommandExecutor::ExecuteWSL(
-    const std::string& command, int timeout_seconds) {
+    const std::string& command, int timeout_seconds,
+    const utils::CapturePolicy& capture) {
     // Check if stop has been requested
     if (context_->IsStopRequested()) {
         return {-1, "Operation interrupted by stop request"};
@@ -71,9 +87,16 @@ std::pair<int, std::string> CommandExecutor::ExecuteWSL(
     debug_log("[ENV] WSL command: %s", wsl_command.c_str());
 
     std::string stdout_output, stderr_output;
-    int exit_code = parallax::utils::ExecCommandEx(wsl_command, timeout_seconds,
-                                                   stdout_output, stderr_output,
-                                                   false, true);
+    utils::CaptureInfo stdout_info, stderr_info;
+    int exit_code = 0;
+    utils::Deadline deadline = CommandDeadline(timeout_seconds);
+    if (!ExecuteInWSLSession(command, deadline, capture, exit_code,
+                             stdout_output, stderr_output, stdout_info,
+                             stderr_info)) {
+        exit_code = parallax::utils::ExecCommandUntil(
+            wsl_command, deadline, context_->GetStopToken(), stdout_output,
+            stderr_output, true, capture, &stdout_info, &stderr_info);
+    }
 
     // Handle WSL output encoding
     std::string utf8_stdout =
@@ -97,10 +120,27 @@ std::pair<int, std::string> CommandExecutor::ExecuteWSL(
         combined_output += utf8_stderr;
     }
 
+    // The full output of a failed command stays for whoever looks into it
+    if (!stdout_info.spill_path.empty()) {
+        if (exit_code == 0) {
+            DeleteFileA(stdout_info.spill_path.c_str());
+        } else {
+            combined_output += "\nFull stdout: " + stdout_info.spill_path;
+        }
+    }
+    if (!stderr_info.spill_path.empty()) {
+        if (exit_code == 0) {
+            DeleteFileA(stderr_info.spill_path.c_str());
+        } else {
+            combined_output += "\nFull stderr: " + stderr_info.spill_path;
+        }
+    }
+
     // Add error logging - record detailed information when WSL command
-    // execution fails
+    // execution fails (rate limited like the PowerShell variant)
     if (exit_code != 0) {
-        error_log(
+        error_log_limited(
+            2, 20,
             "[ENV] WSL command failed - Command: %s, Exit code: %d, Output: %s",
             command.c_str(), exit_code, combined_output.c_str());
     }
@@ -115,6 +155,71 @@ std::pair<int, std::string> CommandExecutor::ExecuteWSL(
     return {exit_code, combined_output};
 }
 
+utils::Deadline CommandExecutor::CommandDeadline(int timeout_seconds) const {
+    return utils::Deadline::In(timeout_seconds * 1000LL)
+        .Min(context_->GetDeadline());
+}
+
+bool CommandExecutor::ExecuteInWSLSession(
+    const std::string& command, const utils::Deadline& deadline,
+    const utils::CapturePolicy& capture, int& exit_code,
+    std::string& stdout_output, std::string& stderr_output,
+    utils::CaptureInfo& stdout_info, utils::CaptureInfo& stderr_info) {
+    if (!wsl_session_ ||
+        session_start_failures_.load() >= kMaxSessionStartFailures ||
+        deadline.HasPassed()) {
+        return false;
+    }
+
+    // The session shell takes the place of the shell wsl.exe runs the
+    // command line with, so the command gets the same bash -c "..." around
+    // it and is expanded the same way
+    int timeout_ms = deadline.ToTimeoutMs();
+    utils::ShellSessionResult result =
+        wsl_session_->Run("bash -c \"" + command + "\"", timeout_ms, capture,
+                          context_->GetStopToken());
+    switch (result.status) {
+        case utils::ShellSessionStatus::kNotRun:
+            if (++session_start_failures_ >= kMaxSessionStartFailures) {
+                error_log("[ENV] WSL shell session unavailable, using one "
+                          "wsl.exe per command: %s",
+                          result.error.c_str());
+            } else {
+                warn_log("[ENV] WSL shell session did not start: %s",
+                         result.error.c_str());
+            }
+            return false;
+        case utils::ShellSessionStatus::kCompleted:
+            exit_code = result.exit_code;
+            break;
+        case utils::ShellSessionStatus::kTimedOut:
+            // Same report as ExecCommandEx, the session restarts next time
+            exit_code = -2;
+            result.stderr_output = "cmd is auto killed, timeout: " +
+                                   std::to_string(timeout_ms) + " ms\n>" +
+                                   result.stderr_output;
+            break;
+        case utils::ShellSessionStatus::kCancelled:
+            exit_code = -3;
+            result.stderr_output = "cmd is terminated by cancellation\n>" +
+                                   result.stderr_output;
+            break;
+        case utils::ShellSessionStatus::kLost:
+            // Not repeated with wsl.exe, the command may have done part of
+            // its work
+            exit_code = -1;
+            result.stderr_output = "WSL shell session ended: " + result.error +
+                                   "\n" + result.stderr_output;
+            break;
+    }
+    session_start_failures_ = 0;
+    stdout_output.swap(result.stdout_output);
+    stderr_output.swap(result.stderr_output);
+    stdout_info = result.stdout_info;
+    stderr_info = result.stderr_info;
+    return true;
+}
+
 bool CommandExecutor::IsWindowsFeatureEnabled(const std::string& feature_name) {
     std::string cmd = "Get-WindowsOptionalFeature -Online -FeatureName " +
                       feature_name + " | Select-Object -ExpandProperty State";
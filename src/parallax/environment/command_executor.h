@@ -1,10 +1,17 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <utility>
 #include <memory>
+#include "utils/cancellation.h"
+#include "utils/output_capture.h"
 
 namespace parallax {
+namespace utils {
+class ShellSession;
+}  // namespace utils
+
 namespace environment {
 
 class ExecutionContext;
@@ -14,29 +21,45 @@ class ExecutionContext;
  *
  * This class provides unified command execution capabilities for both
  * PowerShell and WSL commands with proper error handling and encoding.
+ *
+ * With the wsl_shell_session setting on, WSL commands are sent to one bash
+ * kept running in the distribution instead of starting wsl.exe for each of
+ * them, and run one at a time. A command falls back to its own wsl.exe when
+ * that shell cannot be started.
+ *
+ * Commands end by the deadline of the step they run in at the latest and
+ * are stopped as soon as a stop is requested on the context, rather than
+ * when they are done.
  */
 class CommandExecutor {
  public:
     explicit CommandExecutor(std::shared_ptr<ExecutionContext> context);
-    ~CommandExecutor() = default;
+    ~CommandExecutor();
 
     /**
      * @brief Execute a PowerShell command
      * @param command The PowerShell command to execute
      * @param timeout_seconds Timeout in seconds (default: 300)
+     * @param cache_ttl_seconds For probes that only read system state: reuse
+     * a result up to this old from the ProbeCache (default: 0, always run)
      * @return Pair of (exit_code, combined_output)
      */
     std::pair<int, std::string> ExecutePowerShell(const std::string& command,
-                                                  int timeout_seconds = 300);
+                                                  int timeout_seconds = 300,
+                                                  int cache_ttl_seconds = 0);
 
     /**
      * @brief Execute a WSL command
-     * @param command The command to execute in WSL
+     * @param command The command to execute in WSL (run as bash -c "...")
      * @param timeout_seconds Timeout in seconds (default: 300)
+     * @param capture How much of the output is kept (default: all of it).
+     * Spill files are deleted when the command succeeds, on failure their
+     * paths are appended to the output.
      * @return Pair of (exit_code, combined_output)
      */
-    std::pair<int, std::string> ExecuteWSL(const std::string& command,
-                                           int timeout_seconds = 300);
+    std::pair<int, std::string> ExecuteWSL(
+        const std::string& command, int timeout_seconds = 300,
+        const utils::CapturePolicy& capture = utils::CapturePolicy());
 
     /**
      * @brief Check if a Windows feature is enabled
@@ -61,7 +84,25 @@ class CommandExecutor {
     bool DownloadFile(const std::string& url, const std::string& local_path);
 
  private:
+    // Deadline of a command given timeout_seconds, within the one of the
+    // step it runs in
+    utils::Deadline CommandDeadline(int timeout_seconds) const;
+
+    // Run command in the shell session, false if it did not run there
+    bool ExecuteInWSLSession(const std::string& command,
+                             const utils::Deadline& deadline,
+                             const utils::CapturePolicy& capture,
+                             int& exit_code, std::string& stdout_output,
+                             std::string& stderr_output,
+                             utils::CaptureInfo& stdout_info,
+                             utils::CaptureInfo& stderr_info);
+
+    // Shell starts that may fail in a row before the session is given up
+    static const int kMaxSessionStartFailures = 3;
+
     std::shared_ptr<ExecutionContext> context_;
+    std::unique_ptr<utils::ShellSession> wsl_session_;
+    std::atomic<int> session_start_failures_;
 };
 
 }  // namespace environment
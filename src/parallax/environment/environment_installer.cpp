@@ -4,6 +4,7 @@
 #include "system_checker.h"
 #include "windows_feature_manager.h"
 #include "software_installer.h"
+#include "utils/probe_cache.h"
 #include "utils/utils.h"
 #include "tinylog/tinylog.h"
 
@@ -230,6 +231,13 @@ EnvironmentResult EnvironmentInstaller::InstallEnvironment(
             component_it->second, false);  // Check only
         result.component_results.push_back(comp_result);
 
+        // A step cut short by the stop request fails, that is not the
+        // reason to report
+        if (context_->IsStopRequested()) {
+            result.overall_message = "Installation interrupted by stop request";
+            return result;
+        }
+
         if (comp_result.status == InstallationStatus::kFailed) {
             info_log(ENV_LOG_PREFIX "System component check failed: %s",
                      comp_result.message.c_str());
@@ -237,11 +245,6 @@ EnvironmentResult EnvironmentInstaller::InstallEnvironment(
                 "System requirement not met: " + comp_result.message;
             return result;
         }
-
-        if (context_->IsStopRequested()) {
-            result.overall_message = "Installation interrupted by stop request";
-            return result;
-        }
     }
 
     // Phase 2: Windows Features
@@ -258,6 +261,11 @@ EnvironmentResult EnvironmentInstaller::InstallEnvironment(
             ExecuteComponentOperation(component_it->second, true);  // Install
         result.component_results.push_back(comp_result);
 
+        if (context_->IsStopRequested()) {
+            result.overall_message = "Installation interrupted by stop request";
+            return result;
+        }
+
         if (comp_result.status == InstallationStatus::kFailed) {
             info_log(ENV_LOG_PREFIX "Windows feature installation failed: %s",
                      comp_result.message.c_str());
@@ -265,11 +273,6 @@ EnvironmentResult EnvironmentInstaller::InstallEnvironment(
                 "Windows feature installation failed: " + comp_result.message;
             return result;
         }
-
-        if (context_->IsStopRequested()) {
-            result.overall_message = "Installation interrupted by stop request";
-            return result;
-        }
     }
 
     // Check for reboot requirements after Windows features
@@ -292,6 +295,11 @@ EnvironmentResult EnvironmentInstaller::InstallEnvironment(
             ExecuteComponentOperation(component_it->second, true);  // Install
         result.component_results.push_back(comp_result);
 
+        if (context_->IsStopRequested()) {
+            result.overall_message = "Installation interrupted by stop request";
+            return result;
+        }
+
         if (comp_result.status == InstallationStatus::kFailed) {
             info_log(ENV_LOG_PREFIX "Software installation failed: %s",
                      comp_result.message.c_str());
@@ -299,11 +307,6 @@ EnvironmentResult EnvironmentInstaller::InstallEnvironment(
                 "Software installation failed: " + comp_result.message;
             return result;
         }
-
-        if (context_->IsStopRequested()) {
-            result.overall_message = "Installation interrupted by stop request";
-            return result;
-        }
     }
 
     context_->ReportProgress("install_complete", "Installation completed", 100);
@@ -348,8 +351,25 @@ ComponentResult EnvironmentInstaller::ExecuteComponentOperation(
     ReportComponentProgress(component->GetComponentType(),
                             perform_installation ? "Installing" : "Checking");
 
+    // Probe results from before an installation step may no longer hold,
+    // neither for its own checks nor for the steps after it
+    if (perform_installation) {
+        parallax::utils::ProbeCache::GetInstance().Invalidate();
+    }
     ComponentResult result =
         perform_installation ? component->Install() : component->Check();
+    if (perform_installation) {
+        parallax::utils::ProbeCache::GetInstance().Invalidate();
+    }
+
+    // Debug records that led up to the failure, kept in memory while the
+    // log level is INFO
+    if (result.status == InstallationStatus::kFailed) {
+        std::string reason =
+            ComponentToString(result.component) + " " +
+            (perform_installation ? "installation" : "check") + " failed";
+        tinylog_dump_flight_recorder(reason.c_str());
+    }
 
     if (callback) {
         callback(result);
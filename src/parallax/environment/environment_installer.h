@@ -99,6 +99,8 @@ class EnvironmentInstaller {
 
     // Configuration methods
     void SetSilentMode(bool silent);
+    // Stop the operation that runs, its command in flight included. May be
+    // called from another thread, e.g. a console control handler.
     void Stop();
     bool IsStopped() const;
     void ResetStop();
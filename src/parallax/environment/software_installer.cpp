@@ -109,22 +109,33 @@ ComponentResult CudaToolkitInstaller::Install() {
     for (const auto& [step_name, cmd, timeout, use_realtime] : commands) {
         info_log("[ENV] CUDA Toolkit installation step: %s", step_name.c_str());
 
+        // Real-time steps keep to their timeout as well
+        ExecutionContext::DeadlineScope step_scope(*context_,
+                                                   timeout * 1000LL);
         int cmd_exit_code = 0;
+        std::string step_output;
         if (use_realtime) {
             // Use WSLProcess to get real-time output
             std::string wsl_cmd = parallax::utils::BuildWSLCommand(
                 context_->GetUbuntuVersion(), cmd);
             WSLProcess wsl_process;
-            cmd_exit_code = wsl_process.Execute(wsl_cmd);
+            cmd_exit_code = wsl_process.Execute(
+                wsl_cmd, context_->GetStopToken(), context_->GetDeadline());
         } else {
-            // Use regular execution method
-            auto [exit_code, output] = executor_->ExecuteWSL(cmd, timeout);
+            // Use regular execution method. Package installs print a lot,
+            // the start and end of it are enough for the failure message.
+            auto [exit_code, output] = executor_->ExecuteWSL(
+                cmd, timeout, parallax::utils::CapturePolicy::Spill(8 * 1024));
             cmd_exit_code = exit_code;
+            step_output = output;
         }
 
         if (cmd_exit_code != 0) {
             std::string error_msg =
                 "Failed at step '" + step_name + "': " + cmd;
+            if (!step_output.empty()) {
+                error_msg += "\n" + step_output;
+            }
             ComponentResult result = CreateFailureResult(error_msg, 21);
             LogOperationResult("Installing", result);
             return result;
@@ -236,8 +247,8 @@ ComponentResult CargoInstaller::Install() {
     }
 
     // Perform installation
-    auto [install_code, install_output] =
-        executor_->ExecuteWSL(install_cmd, 600);
+    auto [install_code, install_output] = executor_->ExecuteWSL(
+        install_cmd, 600, parallax::utils::CapturePolicy::Spill());
     if (install_code != 0) {
         ComponentResult result = CreateFailureResult(
             "Failed to install Rust: " + install_output, 22);
@@ -330,8 +341,8 @@ ComponentResult NinjaInstaller::Install() {
                                 "\" -o Acquire::https::proxy=\"" + proxy_url +
                                 "\" install -y ninja-build";
 
-    auto [install_code, install_output] =
-        executor_->ExecuteWSL(install_cmd, 300);
+    auto [install_code, install_output] = executor_->ExecuteWSL(
+        install_cmd, 300, parallax::utils::CapturePolicy::Spill());
 
     ComponentResult result =
         (install_code != 0)
@@ -45,8 +45,8 @@ ComponentResult PipUpgradeManager::Install() {
                       "\" -o Acquire::https::proxy=\"" + proxy_url +
                       "\" install -y python3-pip";
 
-        auto [install_code, install_output] =
-            executor_->ExecuteWSL(install_pip_cmd, 300);
+        auto [install_code, install_output] = executor_->ExecuteWSL(
+            install_pip_cmd, 300, parallax::utils::CapturePolicy::Spill());
         if (install_code != 0) {
             ComponentResult result = CreateFailureResult(
                 "Failed to install python3-pip: " + install_output, 24);
@@ -66,8 +66,8 @@ ComponentResult PipUpgradeManager::Install() {
             " --upgrade pip --break-system-packages --ignore-installed";
     }
 
-    auto [upgrade_code, upgrade_output] =
-        executor_->ExecuteWSL(upgrade_cmd, 300);
+    auto [upgrade_code, upgrade_output] = executor_->ExecuteWSL(
+        upgrade_cmd, 300, parallax::utils::CapturePolicy::Spill());
 
     ComponentResult result =
         (upgrade_code != 0)
@@ -299,22 +299,33 @@ ComponentResult ParallaxProjectInstaller::ExecuteCommandSequence(
         info_log("[ENV] %s step: %s", operation_name.c_str(),
                  step_name.c_str());
 
+        // The step's timeout covers it whether it runs in WSLProcess or not
+        ExecutionContext::DeadlineScope step_scope(*context_,
+                                                   timeout * 1000LL);
         int cmd_exit_code = 0;
+        std::string step_output;
         if (use_realtime) {
             // Use WSLProcess to get real-time output
             std::string wsl_cmd = parallax::utils::BuildWSLCommand(
                 context_->GetUbuntuVersion(), cmd);
             WSLProcess wsl_process;
-            cmd_exit_code = wsl_process.Execute(wsl_cmd);
+            cmd_exit_code = wsl_process.Execute(
+                wsl_cmd, context_->GetStopToken(), context_->GetDeadline());
         } else {
-            // Use regular execution method
-            auto [exit_code, output] = executor_->ExecuteWSL(cmd, timeout);
+            // Use regular execution method. Package installs print a lot,
+            // the start and end of it are enough for the failure message.
+            auto [exit_code, output] = executor_->ExecuteWSL(
+                cmd, timeout, parallax::utils::CapturePolicy::Spill(8 * 1024));
             cmd_exit_code = exit_code;
+            step_output = output;
         }
 
         if (cmd_exit_code != 0) {
             std::string error_msg =
                 "Failed at step '" + step_name + "': " + cmd;
+            if (!step_output.empty()) {
+                error_msg += "\n" + step_output;
+            }
             return CreateFailureResult(error_msg, 25);
         }
     }
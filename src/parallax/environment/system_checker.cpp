@@ -1,6 +1,7 @@
 #include "system_checker.h"
 #include "environment_installer.h"
 #include "utils/utils.h"
+#include "utils/probe_cache.h"
 #include "utils/process.h"
 #include "tinylog/tinylog.h"
 #include <windows.h>
@@ -248,11 +249,12 @@ NvidiaDriverChecker::NvidiaDriverChecker(
 ComponentResult NvidiaDriverChecker::Check() {
     LogOperationStart("Checking");
 
-    // Check if NVIDIA driver is installed through nvidia-smi command
+    // Check if NVIDIA driver is installed through nvidia-smi command (the
+    // same probe as in GetCUDAInfo, one run answers both)
     std::string stdout_output, stderr_output;
-    int exit_code = parallax::utils::ExecCommandEx(
+    int exit_code = parallax::utils::ExecProbeCommand(
         "nvidia-smi --query-gpu=driver_version --format=csv,noheader,nounits",
-        30, stdout_output, stderr_output, false, true);
+        300, 30, stdout_output, stderr_output, true);
 
     if (exit_code == 0 && !stdout_output.empty()) {
         // Parse driver version information
@@ -403,15 +403,12 @@ bool WSLPackageInstaller::WaitForWSLServiceStart(int timeout_seconds) {
             CloseServiceHandle(hSCManager);
         }
 
-        // Wait 1 second then retry
-        Sleep(1000);
-        elapsed_seconds++;
-
-        // Check if stop is requested
-        if (IsStopRequested()) {
+        // Wait 1 second then retry, a stop request ends the wait at once
+        if (context_->GetStopToken().WaitFor(1000)) {
             info_log("[ENV] WSL service wait interrupted by stop request");
             return false;
         }
+        elapsed_seconds++;
     }
 
     info_log(
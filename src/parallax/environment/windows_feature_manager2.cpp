@@ -313,8 +313,8 @@ ComponentResult UbuntuInstaller::Install() {
         ubuntu_install_timeout, stdout_output, stderr_output,
         [self]() -> bool {
             // Check if Ubuntu is installed, if installed then terminate command
-            // execution
-            return self->CheckUbuntuInstalled();
+            // execution. A stop request ends it as well.
+            return self->IsStopRequested() || self->CheckUbuntuInstalled();
         },
         false, false);
 
@@ -385,9 +385,10 @@ bool UbuntuInstaller::IsUbuntuInstalled() {
         return false;
     }
 
-    // Use wsl --list --quiet to check if Ubuntu is in the distribution list
+    // Use wsl --list --quiet to check if Ubuntu is in the distribution list,
+    // a list up to a minute old will do
     auto [list_exit_code, list_output] =
-        executor_->ExecutePowerShell("wsl --list --quiet");
+        executor_->ExecutePowerShell("wsl --list --quiet", 300, 60);
     bool ubuntu_installed =
         (list_exit_code == 0 &&
          list_output.find(context_->GetUbuntuVersion()) != std::string::npos);
@@ -402,6 +403,7 @@ bool UbuntuInstaller::IsUbuntuInstalled() {
 bool UbuntuInstaller::CheckUbuntuInstalled() {
     // Check if Ubuntu is installed (for callback function)
     // Don't use class member functions to avoid thread safety issues
+    // Not cached, it watches the list change while Ubuntu is being installed
 
     // Use wsl --list --quiet to check if Ubuntu is in the distribution list
     auto [list_exit_code, list_output] =
@@ -1,20 +1,133 @@
 #include "cli/command_parser.h"
+#include "config/config_manager.h"
 #include "tinylog/tinylog.h"
+#include "utils/probe_cache.h"
+#include "utils/process.h"
 #include "utils/utils.h"
 #include <iostream>
+#include <stdlib.h>
+#include <string.h>
 #include <windows.h>
 
 int main(int argc, char* argv[]) {
     // Set console output to UTF-8
     SetConsoleOutputCP(CP_UTF8);
 
+    // PARALLAX_LOG_FORMAT=binary switches to the compact binary log, read it
+    // with 'parallax logs decode'
+    const char* log_format = getenv("PARALLAX_LOG_FORMAT");
+    bool binary_log = log_format && _stricmp(log_format, "binary") == 0;
+    if (binary_log) {
+        set_log_format(TINYLOG_FORMAT_BINARY);
+    }
+
+    // PARALLAX_LOG_FILE_MODE=mapped writes the log through a preallocated
+    // file mapping instead of stdio
+    const char* log_file_mode = getenv("PARALLAX_LOG_FILE_MODE");
+    if (log_file_mode && _stricmp(log_file_mode, "mapped") == 0) {
+        set_log_file_mode(TINYLOG_FILE_MAPPED);
+    }
+
     // Build log file path (under exe running path)
     std::string log_path = parallax::utils::JoinPath(
-        parallax::utils::GetAppBinDir(), "parallax.log");
+        parallax::utils::GetAppBinDir(),
+        binary_log ? "parallax.blog" : "parallax.log");
+
+    // PARALLAX_LOG_JSON=1 additionally writes parallax.jsonl, one JSON object
+    // per record, for ingestion by fleet tooling
+    const char* log_json = getenv("PARALLAX_LOG_JSON");
+    if (log_json && strcmp(log_json, "1") == 0) {
+        set_log_json_file(parallax::utils::JoinPath(
+                              parallax::utils::GetAppBinDir(), "parallax.jsonl")
+                              .c_str());
+    }
 
-    // Initialize logging system
-    tinylog_init(log_path.c_str(), 1024 * 1024 * 10, 5, 0,
-                 1);  // 10MB, 5 files, no console output, synchronous write
+    // Rotated segments are gzipped in the background (text logs shrink about
+    // 20x), so 50 segments fit in the disk budget that 5 plain ones used
+    set_log_rotate_compression(1);
+
+    // Initialize logging system. Records are written by a background thread,
+    // the crash handler writes out whatever is still buffered if the process
+    // dies on a fatal signal or unhandled SEH exception.
+    tinylog_init(log_path.c_str(), 1024 * 1024 * 10, 50, 0,
+                 0);  // 10MB, 50 files, no console output, asynchronous write
+    tinylog_install_crash_handler();
+
+    // PARALLAX_LOG_FORWARD=\\.\pipe\<name> also streams every record to a
+    // local collector listening on that pipe
+    const char* log_forward = getenv("PARALLAX_LOG_FORWARD");
+    if (log_forward && *log_forward) {
+        tinylog_add_forward_sink(log_forward, 0, 4);
+    }
+
+    // PARALLAX_LOG_SHIP=<address> ships compressed batches to the fleet
+    // collector agent (tcp:host:port or a pipe name) instead of having it
+    // tail the rotating log. Batches are spooled to parallax.spool, at most
+    // 16MB, while the agent is down.
+    const char* log_ship = getenv("PARALLAX_LOG_SHIP");
+    if (log_ship && *log_ship) {
+        tinylog_add_shipping_sink(
+            log_ship, 0, 1,
+            parallax::utils::JoinPath(parallax::utils::GetAppBinDir(),
+                                      "parallax.spool")
+                .c_str(),
+            16 * 1024 * 1024, 4);
+    }
+
+    // Debug records can be kept in memory and written to the log ahead of
+    // errors and failed components. Off by default, as it formats every
+    // DEBUG record; log_recorder=<KB per thread> in the config file or
+    // PARALLAX_LOG_RECORDER on top of it turn it on.
+    std::string log_recorder =
+        parallax::config::ConfigManager::GetInstance().GetConfigValue(
+            parallax::config::KEY_LOG_RECORDER);
+    const char* log_recorder_env = getenv("PARALLAX_LOG_RECORDER");
+    if (log_recorder_env) {
+        log_recorder = log_recorder_env;
+    }
+    if (!log_recorder.empty()) {
+        set_log_flight_recorder(atoi(log_recorder.c_str()) * 1024);
+    }
+
+    // Log levels per module, e.g. "info,ENV=debug,WSL=warn": log_level from
+    // the config file, then PARALLAX_LOG on top of it
+    std::string log_levels =
+        parallax::config::ConfigManager::GetInstance().GetConfigValue(
+            parallax::config::KEY_LOG_LEVEL);
+    if (!log_levels.empty() && set_log_module_levels(log_levels.c_str()) != 0) {
+        warn_log("[CFG] Invalid entries in log_level: %s", log_levels.c_str());
+    }
+    const char* log_env = getenv("PARALLAX_LOG");
+    if (log_env && set_log_module_levels(log_env) != 0) {
+        warn_log("[CFG] Invalid entries in PARALLAX_LOG: %s", log_env);
+    }
+
+    // Results of probes such as wsl --list and nvidia-smi are reused for a
+    // while; probe_cache=disk keeps them in parallax.probes for later runs
+    std::string probe_cache =
+        parallax::config::ConfigManager::GetInstance().GetConfigValue(
+            parallax::config::KEY_PROBE_CACHE);
+    if (probe_cache == "off") {
+        parallax::utils::ProbeCache::GetInstance().SetEnabled(false);
+    } else if (probe_cache == "disk") {
+        parallax::utils::ProbeCache::GetInstance().SetStorePath(
+            parallax::utils::JoinPath(parallax::utils::GetAppBinDir(),
+                                      "parallax.probes"));
+    }
+
+    // Stopped commands and servers get SIGINT, then SIGTERM, then SIGKILL
+    std::string shutdown_grace =
+        parallax::config::ConfigManager::GetInstance().GetConfigValue(
+            parallax::config::KEY_SHUTDOWN_GRACE);
+    parallax::utils::ShutdownPolicy shutdown;
+    if (!shutdown_grace.empty()) {
+        if (parallax::utils::ShutdownPolicy::Parse(shutdown_grace, shutdown)) {
+            parallax::utils::ShutdownPolicy::SetDefault(shutdown);
+        } else {
+            warn_log("[CFG] Invalid shutdown_grace: %s",
+                     shutdown_grace.c_str());
+        }
+    }
 
     // Build argument string
     std::string args_str =
@@ -30,10 +143,12 @@ int main(int argc, char* argv[]) {
         return parser.Parse(argc, argv);
     } catch (const std::exception& e) {
         error_log("Unhandled exception: %s", e.what());
+        tinylog_flush();
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     } catch (...) {
         error_log("Unknown exception occurred");
+        tinylog_flush();
         std::cerr << "Unknown error occurred" << std::endl;
         return 1;
     }
@@ -0,0 +1,300 @@
+#include "test_util.h"
+#include "tinylog/gzip_stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <atomic>
+#include <random>
+#include <string>
+#include <vector>
+
+// The gzip codec against zlib: streams of GzipWriter inflate with zlib, and
+// GunzipData reads zlib's stored, fixed and dynamic blocks and headers
+
+using namespace tinylog;
+
+namespace {
+
+// Inputs that exercise the matcher: nothing to match, long runs, matches
+// at the far end of the window, and log text
+std::vector<std::string> Inputs() {
+    std::vector<std::string> inputs;
+    inputs.push_back("");
+    inputs.push_back("x");
+    inputs.push_back("abcabcabcabcabcabcabcabc");
+    inputs.push_back(std::string(300000, '\0'));
+
+    std::mt19937 random(9);
+    std::string noise(200000, '\0');
+    for (char& c : noise) {
+        c = static_cast<char>(random());
+    }
+    inputs.push_back(noise);
+
+    // A random block repeated at distances of 32767 and 32768 bytes
+    std::string far = noise.substr(0, 32767);
+    inputs.push_back(far + far + far + "z" + far.substr(0, 1000));
+
+    std::string log;
+    for (int i = 0; log.size() < 1000000; i++) {
+        log += "[1234-5678:" + std::to_string(i) +
+               "] 2026-10-16 12:00:00.000 [INFO] - request " +
+               std::to_string(random() % 1000) + " done in " +
+               std::to_string(random() % 100) + " ms\n";
+    }
+    inputs.push_back(log);
+    return inputs;
+}
+
+std::string OwnGzip(const std::string& data, size_t chunk) {
+    std::string out;
+    GzipWriter writer;
+    CHECK(writer.Open(&out));
+    for (size_t pos = 0; pos < data.size(); pos += chunk) {
+        size_t len = data.size() - pos < chunk ? data.size() - pos : chunk;
+        CHECK(writer.Write(data.data() + pos, len));
+    }
+    CHECK(writer.Close());
+    return out;
+}
+
+// Inflate a single gzip member with zlib, false unless it ends cleanly with
+// a matching CRC and size
+bool ZlibGunzip(const std::string& in, std::string& out) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+        return false;
+    }
+    stream.next_in =
+        reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    stream.avail_in = static_cast<uInt>(in.size());
+
+    out.clear();
+    char buffer[65536];
+    int result;
+    do {
+        stream.next_out = reinterpret_cast<Bytef*>(buffer);
+        stream.avail_out = sizeof(buffer);
+        result = inflate(&stream, Z_NO_FLUSH);
+        out.append(buffer, sizeof(buffer) - stream.avail_out);
+    } while (result == Z_OK);
+    bool whole = result == Z_STREAM_END && stream.avail_in == 0;
+    inflateEnd(&stream);
+    return whole;
+}
+
+// One gzip member from zlib. Z_FULL_FLUSH every flush_every bytes adds the
+// empty stored blocks of a sync point.
+std::string ZlibGzip(const std::string& data, int level, int strategy,
+                     gz_header* header = nullptr, size_t flush_every = 0) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    CHECK_EQ(deflateInit2(&stream, level, Z_DEFLATED, 16 + MAX_WBITS, 8,
+                          strategy),
+             Z_OK);
+    if (header) {
+        CHECK_EQ(deflateSetHeader(&stream, header), Z_OK);
+    }
+
+    std::string out;
+    char buffer[65536];
+    size_t step = flush_every ? flush_every : data.size();
+    size_t pos = 0;
+    int flush;
+    do {
+        size_t len = std::min(step, data.size() - pos);
+        stream.next_in = reinterpret_cast<Bytef*>(
+            const_cast<char*>(data.data() + pos));
+        stream.avail_in = static_cast<uInt>(len);
+        pos += len;
+        flush = pos == data.size() ? Z_FINISH : Z_FULL_FLUSH;
+        do {
+            stream.next_out = reinterpret_cast<Bytef*>(buffer);
+            stream.avail_out = sizeof(buffer);
+            deflate(&stream, flush);
+            out.append(buffer, sizeof(buffer) - stream.avail_out);
+        } while (stream.avail_out == 0);
+    } while (flush != Z_FINISH);
+    deflateEnd(&stream);
+    return out;
+}
+
+void TestOwnRoundTrip() {
+    for (const std::string& data : Inputs()) {
+        for (size_t chunk : {1000000, 65536, 4093}) {
+            std::string gz = OwnGzip(data, chunk);
+            CHECK(IsGzipData(gz));
+            std::string out, error;
+            CHECK(GunzipData(gz, out, error));
+            CHECK(out == data);
+        }
+    }
+
+    // Byte by byte on a smaller input
+    std::string data = Inputs().back().substr(0, 50000);
+    std::string out, error;
+    CHECK(GunzipData(OwnGzip(data, 1), out, error));
+    CHECK(out == data);
+}
+
+void TestZlibReadsOwnStream() {
+    for (const std::string& data : Inputs()) {
+        std::string gz = OwnGzip(data, 65536);
+        std::string out;
+        CHECK(ZlibGunzip(gz, out));
+        CHECK(out == data);
+    }
+
+    // The memory writer is reused between batches by the shipper
+    GzipWriter writer;
+    for (const std::string& data : Inputs()) {
+        std::string gz, out;
+        CHECK(GzipData(writer, data.data(), data.size(), gz));
+        CHECK(ZlibGunzip(gz, out));
+        CHECK(out == data);
+    }
+}
+
+void TestReadsZlibStreams() {
+    struct Variant {
+        int level;
+        int strategy;
+    };
+    // Level 0 gives stored blocks, Z_FIXED fixed Huffman blocks and the
+    // others dynamic ones
+    const Variant variants[] = {{0, Z_DEFAULT_STRATEGY},
+                                {1, Z_DEFAULT_STRATEGY},
+                                {6, Z_DEFAULT_STRATEGY},
+                                {9, Z_DEFAULT_STRATEGY},
+                                {6, Z_FIXED},
+                                {6, Z_HUFFMAN_ONLY},
+                                {6, Z_RLE}};
+    for (const std::string& data : Inputs()) {
+        for (const Variant& variant : variants) {
+            std::string out, error;
+            CHECK(GunzipData(ZlibGzip(data, variant.level, variant.strategy),
+                             out, error));
+            CHECK(out == data);
+        }
+
+        // Sync points between the blocks
+        std::string out, error;
+        CHECK(GunzipData(ZlibGzip(data, 6, Z_DEFAULT_STRATEGY, nullptr,
+                                  10000),
+                         out, error));
+        CHECK(out == data);
+    }
+}
+
+void TestZlibHeaderAndMembers() {
+    // Optional header fields: extra, name, comment and header CRC
+    std::string data = Inputs().back().substr(0, 100000);
+    char extra[] = "AB\x04\x00test";
+    char name[] = "parallax.1.log";
+    char comment[] = "rotated segment";
+    gz_header header;
+    memset(&header, 0, sizeof(header));
+    header.extra = reinterpret_cast<Bytef*>(extra);
+    header.extra_len = 8;
+    header.name = reinterpret_cast<Bytef*>(name);
+    header.comment = reinterpret_cast<Bytef*>(comment);
+    header.hcrc = 1;
+    std::string out, error;
+    CHECK(GunzipData(ZlibGzip(data, 6, Z_DEFAULT_STRATEGY, &header), out,
+                     error));
+    CHECK(out == data);
+
+    // Concatenated members are joined, as gzip -d does
+    std::string first = data.substr(0, 40000);
+    std::string second = data.substr(40000);
+    CHECK(GunzipData(ZlibGzip(first, 6, Z_DEFAULT_STRATEGY) +
+                         OwnGzip(second, 65536),
+                     out, error));
+    CHECK(out == data);
+}
+
+void TestRejectsDamagedStreams() {
+    std::string data = Inputs().back().substr(0, 20000);
+    std::string gz = OwnGzip(data, 65536);
+    std::string out, error;
+
+    std::string bad_crc = gz;
+    bad_crc[bad_crc.size() - 8] ^= 1;
+    CHECK(!GunzipData(bad_crc, out, error));
+    CHECK(!error.empty());
+
+    for (size_t cut : {gz.size() - 1, gz.size() - 8, gz.size() / 2,
+                       static_cast<size_t>(12)}) {
+        error.clear();
+        CHECK(!GunzipData(gz.substr(0, cut), out, error));
+        CHECK(!error.empty());
+    }
+
+    std::string corrupt = gz;
+    for (size_t i = 20; i < 40; i++) {
+        corrupt[i] = static_cast<char>(0xFF);
+    }
+    CHECK(!GunzipData(corrupt, out, error));
+    CHECK(!GunzipData("plain text, not gzip", out, error));
+}
+
+void TestRotatedSegment() {
+    // GzipFile output reads back with ReadLogFile and with zlib's gzread
+    char dir[] = "/tmp/parallax-gzip-XXXXXX";
+    CHECK(mkdtemp(dir) != nullptr);
+    std::string src = std::string(dir) + "/parallax.log";
+    std::string dst = src + ".gz";
+    std::string data = Inputs().back();
+    FILE* file = fopen(src.c_str(), "wb");
+    CHECK(file != nullptr);
+    if (!file) {
+        return;
+    }
+    fwrite(data.data(), 1, data.size(), file);
+    fclose(file);
+
+    CHECK(GzipFile(src, dst));
+    std::string read, error;
+    CHECK(ReadLogFile(dst, read, error));
+    CHECK(read == data);
+
+    gzFile gz = gzopen(dst.c_str(), "rb");
+    CHECK(gz != nullptr);
+    read.clear();
+    char buffer[65536];
+    int n;
+    while (gz && (n = gzread(gz, buffer, sizeof(buffer))) > 0) {
+        read.append(buffer, n);
+    }
+    if (gz) {
+        gzclose(gz);
+    }
+    CHECK(read == data);
+
+    // Plain segments are read as they are
+    CHECK(ReadLogFile(src, read, error));
+    CHECK(read == data);
+
+    // A cancelled compression reports failure
+    std::atomic<bool> cancel(true);
+    CHECK(!GzipFile(src, dst, &cancel));
+
+    unlink(src.c_str());
+    unlink(dst.c_str());
+    rmdir(dir);
+}
+
+}  // namespace
+
+int main() {
+    RUN_TEST(TestOwnRoundTrip);
+    RUN_TEST(TestZlibReadsOwnStream);
+    RUN_TEST(TestReadsZlibStreams);
+    RUN_TEST(TestZlibHeaderAndMembers);
+    RUN_TEST(TestRejectsDamagedStreams);
+    RUN_TEST(TestRotatedSegment);
+    return parallax_test::Finish();
+}
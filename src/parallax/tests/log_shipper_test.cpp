@@ -0,0 +1,368 @@
+#include "test_util.h"
+#include "tinylog/gzip_stream.h"
+#include "tinylog/log_shipper.h"
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ShippingSink against a stub collector on a Unix domain socket: batches
+// arrive whole and in order, the spool is replayed once the collector is
+// up, and a full queue or spool drops records and counts them
+
+using namespace tinylog;
+using parallax_test::ElapsedMs;
+
+namespace {
+
+std::string MakeTempDir() {
+    char path[] = "/tmp/parallax-shipper-XXXXXX";
+    return mkdtemp(path) ? path : "/tmp";
+}
+
+uint64_t FileSize(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? info.st_size : 0;
+}
+
+/**
+ * @brief Collector that accepts one connection at a time and keeps the
+ * lines of every complete frame
+ *
+ * Frames are checked the way a collector would: magic, version, record
+ * count against the lines of the (decompressed) payload. The partial frame
+ * of a closed connection is discarded.
+ */
+class StubCollector {
+ public:
+    explicit StubCollector(const std::string& path)
+        : path_(path), listener_(-1), stop_(false), bad_frames_(0) {}
+
+    ~StubCollector() { Stop(); }
+
+    bool Start() {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, path_.c_str(), path_.size());
+        unlink(path_.c_str());
+
+        listener_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener_ < 0 ||
+            bind(listener_, reinterpret_cast<struct sockaddr*>(&addr),
+                 sizeof(addr)) != 0 ||
+            listen(listener_, 4) != 0) {
+            return false;
+        }
+        thread_ = std::thread(&StubCollector::Run, this);
+        return true;
+    }
+
+    void Stop() {
+        stop_ = true;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        if (listener_ >= 0) {
+            close(listener_);
+            listener_ = -1;
+            unlink(path_.c_str());
+        }
+    }
+
+    // Wait up to timeout_ms for count lines, returns the lines received
+    std::vector<std::string> WaitForLines(size_t count, int timeout_ms) {
+        auto start = std::chrono::steady_clock::now();
+        while (ElapsedMs(start) < timeout_ms) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (lines_.size() >= count) {
+                    break;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        return lines_;
+    }
+
+    int GetBadFrames() const { return bad_frames_.load(); }
+
+ private:
+    bool Wait(int fd) {
+        struct pollfd entry = {fd, POLLIN, 0};
+        return poll(&entry, 1, 50) > 0;
+    }
+
+    void Run() {
+        while (!stop_) {
+            if (!Wait(listener_)) {
+                continue;
+            }
+            int connection = accept(listener_, nullptr, nullptr);
+            if (connection >= 0) {
+                Receive(connection);
+                close(connection);
+            }
+        }
+    }
+
+    void Receive(int connection) {
+        std::string buffer;
+        char data[16384];
+        while (!stop_) {
+            if (!Wait(connection)) {
+                continue;
+            }
+            ssize_t n = recv(connection, data, sizeof(data), 0);
+            if (n <= 0) {
+                return;
+            }
+            buffer.append(data, n);
+            ParseFrames(buffer);
+        }
+    }
+
+    void ParseFrames(std::string& buffer) {
+        size_t pos = 0;
+        ShipFrameHeader header;
+        while (buffer.size() - pos >= sizeof(header)) {
+            memcpy(&header, buffer.data() + pos, sizeof(header));
+            if (buffer.size() - pos - sizeof(header) < header.payload_len) {
+                break;
+            }
+            std::string payload =
+                buffer.substr(pos + sizeof(header), header.payload_len);
+            pos += sizeof(header) + header.payload_len;
+            AddFrame(header, payload);
+        }
+        buffer.erase(0, pos);
+    }
+
+    void AddFrame(const ShipFrameHeader& header, const std::string& payload) {
+        std::string text = payload;
+        std::string error;
+        if (memcmp(header.magic, "PLXB", 4) != 0 ||
+            header.version != kShipFrameVersion ||
+            ((header.flags & kShipFlagGzip) &&
+             !GunzipData(payload, text, error))) {
+            bad_frames_++;
+            return;
+        }
+
+        std::vector<std::string> lines;
+        size_t start = 0;
+        size_t end;
+        while ((end = text.find('\n', start)) != std::string::npos) {
+            lines.push_back(text.substr(start, end - start));
+            start = end + 1;
+        }
+        if (start != text.size() || lines.size() != header.records) {
+            bad_frames_++;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        lines_.insert(lines_.end(), lines.begin(), lines.end());
+    }
+
+    const std::string path_;
+    int listener_;
+    std::atomic<bool> stop_;
+    std::thread thread_;
+    std::atomic<int> bad_frames_;
+    std::mutex mutex_;
+    std::vector<std::string> lines_;
+};
+
+std::string Line(int n) { return "record " + std::to_string(n); }
+
+void WriteRecords(ShippingSink& sink, int first, int count) {
+    for (int n = first; n < first + count; n++) {
+        std::string text = Line(n) + "\n";
+        LogRecord record;
+        memset(&record, 0, sizeof(record));
+        record.text = text.c_str();
+        record.text_len = text.size();
+        sink.Write(record);
+    }
+}
+
+// Lines are "record <n>" for first, first + 1, ... with no gaps
+bool InSequence(const std::vector<std::string>& lines, int first) {
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (lines[i] != Line(first + static_cast<int>(i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ShippingOptions Options(const std::string& dir) {
+    ShippingOptions options;
+    options.address = dir + "/collector.sock";
+    options.batch_bytes = 4096;  // Several frames per test
+    options.batch_delay_ms = 20;
+    return options;
+}
+
+void TestDelivery() {
+    std::string dir = MakeTempDir();
+    for (bool compress : {true, false}) {
+        ShippingOptions options = Options(dir);
+        options.compress = compress;
+        StubCollector collector(options.address);
+        CHECK(collector.Start());
+
+        ShippingSink sink(options);
+        WriteRecords(sink, 0, 2000);
+        sink.Flush();
+        CHECK_EQ(sink.GetShippedCount(), 2000u);
+        CHECK_EQ(sink.GetDroppedCount(), 0u);
+        sink.Close();
+
+        std::vector<std::string> lines = collector.WaitForLines(2000, 5000);
+        CHECK_EQ(lines.size(), 2000u);
+        CHECK(InSequence(lines, 0));
+        CHECK_EQ(collector.GetBadFrames(), 0);
+    }
+    rmdir(dir.c_str());
+}
+
+void TestSpoolReplay() {
+    std::string dir = MakeTempDir();
+    ShippingOptions options = Options(dir);
+    options.spool_path = dir + "/spool";
+
+    // Collector down: every batch goes to the spool
+    ShippingSink sink(options);
+    WriteRecords(sink, 0, 1000);
+    sink.Flush();
+    CHECK_EQ(sink.GetShippedCount(), 0u);
+    CHECK_EQ(sink.GetDroppedCount(), 0u);
+    CHECK(FileSize(options.spool_path) > 0);
+
+    // Once it is up the spool goes out first, without new records, on the
+    // idle retry
+    StubCollector collector(options.address);
+    CHECK(collector.Start());
+    std::vector<std::string> lines = collector.WaitForLines(1000, 5000);
+    CHECK_EQ(lines.size(), 1000u);
+    CHECK(InSequence(lines, 0));
+
+    // New records follow the replayed ones
+    WriteRecords(sink, 1000, 500);
+    sink.Flush();
+    CHECK_EQ(sink.GetShippedCount(), 1500u);
+    sink.Close();
+    lines = collector.WaitForLines(1500, 5000);
+    CHECK_EQ(lines.size(), 1500u);
+    CHECK(InSequence(lines, 0));
+    CHECK_EQ(FileSize(options.spool_path), 0u);
+    CHECK_EQ(collector.GetBadFrames(), 0);
+
+    collector.Stop();
+    unlink(options.spool_path.c_str());
+    rmdir(dir.c_str());
+}
+
+void TestSpoolSurvivesRestart() {
+    std::string dir = MakeTempDir();
+    ShippingOptions options = Options(dir);
+    options.spool_path = dir + "/spool";
+    {
+        ShippingSink sink(options);
+        WriteRecords(sink, 0, 300);
+    }
+    CHECK(FileSize(options.spool_path) > 0);
+
+    // The next sink sends the spool of the earlier one before its own
+    StubCollector collector(options.address);
+    CHECK(collector.Start());
+    ShippingSink sink(options);
+    WriteRecords(sink, 300, 200);
+    sink.Flush();
+    CHECK_EQ(sink.GetShippedCount(), 500u);
+    sink.Close();
+
+    std::vector<std::string> lines = collector.WaitForLines(500, 5000);
+    CHECK_EQ(lines.size(), 500u);
+    CHECK(InSequence(lines, 0));
+
+    collector.Stop();
+    unlink(options.spool_path.c_str());
+    rmdir(dir.c_str());
+}
+
+void TestDropOnFullQueue() {
+    // A small queue and a slow batch: Write() drops instead of waiting, and
+    // what is not dropped arrives once and in order
+    std::string dir = MakeTempDir();
+    ShippingOptions options = Options(dir);
+    options.queue_size = 4096;
+    options.batch_delay_ms = 200;
+    StubCollector collector(options.address);
+    CHECK(collector.Start());
+
+    const int kRecords = 20000;
+    ShippingSink sink(options);
+    auto start = std::chrono::steady_clock::now();
+    WriteRecords(sink, 0, kRecords);
+    CHECK(ElapsedMs(start) < 2000);
+    sink.Flush();
+    uint64_t shipped = sink.GetShippedCount();
+    uint64_t dropped = sink.GetDroppedCount();
+    sink.Close();
+
+    CHECK(dropped > 0);
+    CHECK_EQ(shipped + dropped, static_cast<uint64_t>(kRecords));
+    std::vector<std::string> lines = collector.WaitForLines(shipped, 5000);
+    CHECK_EQ(lines.size(), shipped);
+    int last = -1;
+    for (const std::string& line : lines) {
+        int n = atoi(line.c_str() + strlen("record "));
+        CHECK(n > last);
+        last = n;
+    }
+    collector.Stop();
+    rmdir(dir.c_str());
+}
+
+void TestDropOnFullSpool() {
+    // Collector down and room for about one frame in the spool
+    std::string dir = MakeTempDir();
+    ShippingOptions options = Options(dir);
+    options.spool_path = dir + "/spool";
+    options.spool_max_bytes = 6000;
+    options.compress = false;
+
+    ShippingSink sink(options);
+    WriteRecords(sink, 0, 1000);
+    sink.Flush();
+    sink.Close();
+    CHECK(sink.GetDroppedCount() > 0);
+    CHECK(sink.GetDroppedCount() < 1000u);
+    CHECK(FileSize(options.spool_path) <= options.spool_max_bytes);
+
+    unlink(options.spool_path.c_str());
+    rmdir(dir.c_str());
+}
+
+}  // namespace
+
+int main() {
+    RUN_TEST(TestDelivery);
+    RUN_TEST(TestSpoolReplay);
+    RUN_TEST(TestSpoolSurvivesRestart);
+    RUN_TEST(TestDropOnFullQueue);
+    RUN_TEST(TestDropOnFullSpool);
+    return parallax_test::Finish();
+}
@@ -0,0 +1,167 @@
+#include "test_util.h"
+#include "utils/output_capture.h"
+#include <stdio.h>
+#include <random>
+#include <string>
+
+// OutputCapture: the head and tail ring of kHeadTail, spill files and the
+// UTF-16 cut of Finish()
+
+using namespace parallax::utils;
+
+namespace {
+
+std::string Capture(const CapturePolicy& policy, const std::string& data,
+                    size_t chunk, CaptureInfo* info) {
+    OutputCapture capture(policy, "test");
+    for (size_t pos = 0; pos < data.size(); pos += chunk) {
+        size_t len = data.size() - pos < chunk ? data.size() - pos : chunk;
+        capture.Append(data.data() + pos, len);
+    }
+    std::string output;
+    capture.Finish(output, info);
+    return output;
+}
+
+std::string Marker(uint64_t omitted) {
+    return "\n... [" + std::to_string(omitted) + " bytes omitted] ...\n";
+}
+
+std::string Utf16(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        out += c;
+        out += '\0';
+    }
+    return out;
+}
+
+std::string ReadFile(const std::string& path) {
+    std::string data;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return data;
+    }
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.append(buffer, n);
+    }
+    fclose(file);
+    return data;
+}
+
+void TestAllAndDiscard() {
+    std::string data = "line 1\nline 2\n";
+    CaptureInfo info;
+    CHECK_EQ(Capture(CapturePolicy::All(), data, 3, &info), data);
+    CHECK_EQ(info.total_bytes, data.size());
+    CHECK_EQ(info.omitted_bytes, 0u);
+
+    CHECK_EQ(Capture(CapturePolicy::Discard(), data, 3, &info), "");
+    CHECK_EQ(info.total_bytes, data.size());
+    CHECK_EQ(info.omitted_bytes, data.size());
+}
+
+void TestHeadTailWithinLimit() {
+    CaptureInfo info;
+    CHECK_EQ(Capture(CapturePolicy::HeadTail(16), "0123456789", 4, &info),
+             "0123456789");
+    CHECK_EQ(info.omitted_bytes, 0u);
+}
+
+void TestHeadTailRing() {
+    // 8 bytes of head, 8 of tail; chunks of 3 wrap the ring repeatedly
+    std::string data;
+    for (int i = 0; i < 100; i++) {
+        data += static_cast<char>('a' + i % 26);
+    }
+    std::string expected = data.substr(0, 8) + Marker(84) + data.substr(92);
+    for (size_t chunk : {1, 3, 7, 8, 9, 100}) {
+        CaptureInfo info;
+        CHECK_EQ(Capture(CapturePolicy::HeadTail(16), data, chunk, &info),
+                 expected);
+        CHECK_EQ(info.total_bytes, 100u);
+        CHECK_EQ(info.omitted_bytes, 84u);
+    }
+}
+
+void TestHeadTailMatchesReference() {
+    std::mt19937 random(7);
+    for (int iteration = 0; iteration < 500; iteration++) {
+        size_t keep = random() % 64;
+        size_t head = (keep & ~static_cast<size_t>(1)) / 2 &
+                      ~static_cast<size_t>(1);
+        size_t tail = (keep & ~static_cast<size_t>(1)) - head;
+
+        std::string data(random() % 300, '\0');
+        for (char& c : data) {
+            c = static_cast<char>('a' + random() % 26);
+        }
+        size_t chunk = 1 + random() % 40;
+
+        std::string expected = data;
+        if (data.size() > head + tail) {
+            uint64_t omitted = data.size() - head - tail;
+            expected = data.substr(0, head) + Marker(omitted) +
+                       data.substr(data.size() - tail);
+        }
+        CHECK_EQ(Capture(CapturePolicy::HeadTail(keep), data, chunk, nullptr),
+                 expected);
+    }
+}
+
+void TestUtf16OddCut() {
+    // 4 bytes of head and 6 of tail. 27 bytes leave 17 omitted, an odd
+    // count that would start the tail in the middle of a character.
+    std::string data = Utf16("ABCDEFGHIJKLM") + "Z";
+    CaptureInfo info;
+    std::string output =
+        Capture(CapturePolicy::HeadTail(10), data, 5, &info);
+    CHECK_EQ(output, Utf16("AB") + Utf16(Marker(18)) + Utf16("LM") + "Z");
+    CHECK_EQ(info.omitted_bytes, 18u);
+
+    // Even count: the tail is kept whole
+    data = Utf16("ABCDEFGHIJKLM");
+    output = Capture(CapturePolicy::HeadTail(10), data, 4, &info);
+    CHECK_EQ(output, Utf16("AB") + Utf16(Marker(16)) + Utf16("KLM"));
+    CHECK_EQ(info.omitted_bytes, 16u);
+}
+
+void TestSpill() {
+    std::string data(10000, 'x');
+    for (size_t i = 0; i < data.size(); i += 100) {
+        data[i] = '\n';
+    }
+    CaptureInfo info;
+    std::string output = Capture(CapturePolicy::Spill(64), data, 333, &info);
+    CHECK_EQ(output, data.substr(0, 32) + Marker(10000 - 64) +
+                         data.substr(10000 - 32));
+    CHECK(!info.spill_path.empty());
+    CHECK_EQ(ReadFile(info.spill_path), data);
+    remove(info.spill_path.c_str());
+
+    // No file for a stream that fits
+    output = Capture(CapturePolicy::Spill(64), "short", 2, &info);
+    CHECK_EQ(output, "short");
+    CHECK(info.spill_path.empty());
+
+    // A directory that does not exist: no spill, the kept output stays
+    CapturePolicy policy = CapturePolicy::Spill(64);
+    policy.spill_dir = "/nonexistent/parallax-test";
+    output = Capture(policy, data, 1000, &info);
+    CHECK_EQ(output.size(), 64 + Marker(10000 - 64).size());
+    CHECK(info.spill_path.empty());
+}
+
+}  // namespace
+
+int main() {
+    RUN_TEST(TestAllAndDiscard);
+    RUN_TEST(TestHeadTailWithinLimit);
+    RUN_TEST(TestHeadTailRing);
+    RUN_TEST(TestHeadTailMatchesReference);
+    RUN_TEST(TestUtf16OddCut);
+    RUN_TEST(TestSpill);
+    return parallax_test::Finish();
+}
@@ -0,0 +1,359 @@
+#include "test_util.h"
+#include "utils/cancellation.h"
+#include "utils/process.h"
+#include <signal.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+// Process and the POSIX backend: arguments, environment, exit codes,
+// stdin, and stopping whole process trees on timeout and cancel
+
+using namespace parallax::utils;
+using parallax_test::ElapsedMs;
+
+namespace {
+
+// Short grace periods, the ladder takes at most 600 ms before the kill
+ProcessOptions Options(const std::string& command) {
+    ProcessOptions options;
+    options.command = command;
+    options.shutdown.interrupt_grace_ms = 300;
+    options.shutdown.terminate_grace_ms = 300;
+    return options;
+}
+
+bool IsGone(pid_t pid) { return kill(pid, 0) != 0 && errno == ESRCH; }
+
+void TestArgvIsPassedVerbatim() {
+    ProcessOptions options;
+    options.argv = {"printf", "%s|%s", "has space", "q\"uote"};
+    std::string out, err;
+    ProcessResult result = CaptureProcess(options, out, err);
+    CHECK(result.status == ProcessStatus::kExited);
+    CHECK_EQ(result.exit_code, 0);
+    CHECK_EQ(out, "has space|q\"uote");
+}
+
+void TestCwdAndEnvironment() {
+    ProcessOptions options = Options("pwd; echo \"$PARALLAX_TEST_VAR\"");
+    options.cwd = "/";
+    options.env = {{"PARALLAX_TEST_VAR", "value"}};
+    std::string out, err;
+    ProcessResult result = CaptureProcess(options, out, err);
+    CHECK_EQ(result.exit_code, 0);
+    CHECK_EQ(out, "/\nvalue\n");
+}
+
+void TestExitCodes() {
+    std::string out, err;
+    ProcessResult result = CaptureProcess(Options("echo oops >&2; exit 3"),
+                                          out, err);
+    CHECK(result.status == ProcessStatus::kExited);
+    CHECK_EQ(result.exit_code, 3);
+    CHECK_EQ(err, "oops\n");
+
+    // Ended by a signal: 128 + the signal number, like shells report it
+    result = CaptureProcess(Options("kill -TERM $$"), out, err);
+    CHECK(result.status == ProcessStatus::kExited);
+    CHECK_EQ(result.exit_code, 128 + SIGTERM);
+}
+
+void TestMissingProgram() {
+    ProcessOptions options;
+    options.argv = {"/nonexistent/parallax-test"};
+    std::string out, err;
+    ProcessResult result = CaptureProcess(options, out, err);
+    CHECK(result.status == ProcessStatus::kFailedToStart);
+    CHECK(!result.error.empty());
+}
+
+void TestStdinRoundTrip() {
+    ProcessOptions options;
+    options.argv = {"cat"};
+    options.pipe_stdin = true;
+    std::string got;
+    options.on_stdout = [&](const char* data, size_t len) {
+        got.append(data, len);
+    };
+
+    Process process;
+    CHECK(process.Start(options));
+    for (int i = 0; i < 3; i++) {
+        std::string line = "line" + std::to_string(i) + "\n";
+        CHECK(process.WriteInput(line.data(), line.size()));
+        auto start = std::chrono::steady_clock::now();
+        while (got.size() < (i + 1) * line.size() && ElapsedMs(start) < 5000) {
+            process.Poll(1000);
+        }
+    }
+    process.CloseInput();
+    ProcessResult result = process.Wait();
+    CHECK(result.status == ProcessStatus::kExited);
+    CHECK_EQ(got, "line0\nline1\nline2\n");
+}
+
+void TestTimeoutStopsTree() {
+    // The background sleeps outlive the shell unless the group is stopped
+    ProcessOptions options =
+        Options("sleep 30 & echo $!; sleep 30 & echo $!; wait");
+    options.timeout_ms = 300;
+    std::string out, err;
+    auto start = std::chrono::steady_clock::now();
+    ProcessResult result = CaptureProcess(options, out, err);
+    CHECK(result.status == ProcessStatus::kTimedOut);
+    CHECK(ElapsedMs(start) < 3000);
+
+    pid_t first = 0, second = 0;
+    CHECK_EQ(sscanf(out.c_str(), "%d %d", &first, &second), 2);
+    CHECK(first > 0 && IsGone(first));
+    CHECK(second > 0 && IsGone(second));
+}
+
+void TestShutdownLadder() {
+    // Interrupt ignored, terminate ends the shell with its own exit code
+    ProcessOptions options = Options(
+        "trap '' INT; trap 'exit 7' TERM; echo ready; "
+        "while :; do sleep 0.05; done");
+    options.timeout_ms = 300;
+    std::string out, err;
+    ProcessResult result = CaptureProcess(options, out, err);
+    CHECK(result.status == ProcessStatus::kTimedOut);
+    CHECK_EQ(result.exit_code, 7);
+    CHECK_EQ(out, "ready\n");
+
+    // Interrupt and terminate ignored by a grandchild: killed
+    options = Options("sh -c 'trap \"\" INT TERM; sleep 30; :' & echo $!; "
+                      "trap '' INT TERM; wait");
+    options.timeout_ms = 300;
+    out.clear();
+    auto start = std::chrono::steady_clock::now();
+    result = CaptureProcess(options, out, err);
+    CHECK(result.status == ProcessStatus::kTimedOut);
+    CHECK(ElapsedMs(start) < 5000);
+    pid_t grandchild = 0;
+    CHECK_EQ(sscanf(out.c_str(), "%d", &grandchild), 1);
+    CHECK(grandchild > 0 && IsGone(grandchild));
+}
+
+void TestContinuousOutput() {
+    // A child that never stops writing: each Poll() returns after a bounded
+    // amount of output, so the timeout is still enforced
+    uint64_t delivered = 0;
+    ProcessOptions options = Options("exec yes");
+    options.timeout_ms = 300;
+    options.on_stdout = [&](const char*, size_t len) { delivered += len; };
+
+    Process process;
+    CHECK(process.Start(options));
+    auto start = std::chrono::steady_clock::now();
+    while (delivered == 0 && ElapsedMs(start) < 5000) {
+        CHECK(process.Poll(-1));
+    }
+    CHECK(delivered > 0 && delivered <= 64 * 1024);
+
+    ProcessResult result = process.Wait();
+    CHECK(result.status == ProcessStatus::kTimedOut);
+    CHECK(ElapsedMs(start) < 3000);
+}
+
+void TestCancelToken() {
+    CancellationToken token;
+    ProcessOptions options = Options("trap '' INT; sleep 30 & wait");
+    options.cancel_token = token;
+
+    std::thread canceller([token]() mutable {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        token.Cancel();
+    });
+    std::string out, err;
+    auto start = std::chrono::steady_clock::now();
+    ProcessResult result = CaptureProcess(options, out, err);
+    canceller.join();
+
+    // Prompt(): no terminate step, killed after the short interrupt grace
+    CHECK(result.status == ProcessStatus::kCancelled);
+    CHECK(ElapsedMs(start) < 200 + ShutdownPolicy::kPromptGraceMs + 1000);
+}
+
+void TestCancelCallback() {
+    std::atomic<int> polls(0);
+    ProcessOptions options = Options("sleep 30");
+    options.cancel = [&]() { return ++polls >= 3; };
+    std::string out, err;
+    ProcessResult result = CaptureProcess(options, out, err);
+    CHECK(result.status == ProcessStatus::kCancelled);
+    CHECK(polls >= 3);
+}
+
+void TestExecCommandUntil() {
+    std::string out, err;
+    CHECK_EQ(ExecCommandUntil("echo hi", Deadline::In(5000),
+                              CancellationToken::None(), out, err),
+             0);
+    CHECK_EQ(out, "hi\n");
+
+    // Neither is started once the deadline passed or the token was cancelled
+    CHECK_EQ(ExecCommandUntil("echo hi", Deadline::In(0),
+                              CancellationToken::None(), out, err),
+             -2);
+    CancellationToken cancelled;
+    cancelled.Cancel();
+    CHECK_EQ(ExecCommandUntil("echo hi", Deadline::Never(), cancelled, out,
+                              err),
+             -3);
+
+    auto start = std::chrono::steady_clock::now();
+    CHECK_EQ(ExecCommandUntil("sleep 30", Deadline::In(300),
+                              CancellationToken::None(), out, err),
+             -2);
+    CHECK(ElapsedMs(start) < 10000);
+}
+
+void TestDeadline() {
+    CHECK(Deadline::Never().IsNever());
+    CHECK_EQ(Deadline::Never().RemainingMs(), -1);
+    CHECK_EQ(Deadline::Never().ToTimeoutMs(), 0);
+    CHECK(Deadline::In(0).HasPassed());
+    CHECK_EQ(Deadline::In(-5).ToTimeoutMs(), 1);
+
+    Deadline soon = Deadline::In(1000);
+    CHECK(!soon.HasPassed());
+    CHECK(soon.RemainingMs() > 0 && soon.RemainingMs() <= 1000);
+    CHECK_EQ(Deadline::Never().Min(soon).RemainingMs() / 100,
+             soon.RemainingMs() / 100);
+}
+
+// Stand-in for wsl.exe on PATH: runs the Linux command line on the host
+// and counts its starts. Tagged processes that call setsid play the part
+// of the distribution, out of reach of the process group.
+class FakeWSL {
+ public:
+    FakeWSL() {
+        char dir[] = "/tmp/parallax-wsl-XXXXXX";
+        dir_ = mkdtemp(dir) ? dir : "/tmp";
+        program_ = dir_ + "/wsl";
+        FILE* file = fopen(program_.c_str(), "w");
+        if (file) {
+            fputs("#!/bin/sh\n"
+                  "echo x >> \"${0%/*}/starts\"\n"
+                  "while [ $# -gt 0 ]; do\n"
+                  "    case \"$1\" in\n"
+                  "        -d|-u) shift 2 ;;\n"
+                  "        --exec|-e|--) shift; break ;;\n"
+                  "        *) break ;;\n"
+                  "    esac\n"
+                  "done\n"
+                  "exec \"$@\"\n",
+                  file);
+            fclose(file);
+        }
+        chmod(program_.c_str(), 0755);
+        const char* path = getenv("PATH");
+        old_path_ = path ? path : "";
+        setenv("PATH", (dir_ + ":" + old_path_).c_str(), 1);
+    }
+
+    ~FakeWSL() {
+        setenv("PATH", old_path_.c_str(), 1);
+        unlink(program_.c_str());
+        unlink((dir_ + "/starts").c_str());
+        rmdir(dir_.c_str());
+    }
+
+    ProcessOptions Options(const std::string& script) const {
+        ProcessOptions options;
+        options.argv = {program_, "-d", "Test", "--exec", "sh", "-c", script};
+        options.shutdown.interrupt_grace_ms = 500;
+        options.shutdown.terminate_grace_ms = 500;
+        return options;
+    }
+
+    int Starts() const {
+        int starts = 0;
+        FILE* file = fopen((dir_ + "/starts").c_str(), "r");
+        if (file) {
+            int c;
+            while ((c = fgetc(file)) != EOF) {
+                starts += c == '\n';
+            }
+            fclose(file);
+        }
+        return starts;
+    }
+
+ private:
+    std::string dir_;
+    std::string program_;
+    std::string old_path_;
+};
+
+void TestWSLPartStopped() {
+    // The WSL part ignores the interrupt: one wsl.exe per ladder step sends
+    // the signal and waits, none per check and none once it is gone
+    FakeWSL wsl;
+    ProcessOptions options =
+        wsl.Options("setsid sh -c 'trap \"\" INT; exec sleep 30' & "
+                    "echo $!; wait");
+    options.timeout_ms = 300;
+    std::string out;
+    options.on_stdout = [&](const char* data, size_t len) {
+        out.append(data, len);
+    };
+
+    Process process;
+    CHECK(process.Start(options));
+    auto start = std::chrono::steady_clock::now();
+    ProcessResult result = process.Wait();
+    CHECK(result.status == ProcessStatus::kTimedOut);
+    CHECK(ElapsedMs(start) < 5000);
+    pid_t linux_pid = 0;
+    CHECK_EQ(sscanf(out.c_str(), "%d", &linux_pid), 1);
+    CHECK(linux_pid > 0 && IsGone(linux_pid));
+    CHECK_EQ(wsl.Starts(), 1 + 2);
+
+    CHECK(process.Stop());
+    CHECK_EQ(wsl.Starts(), 1 + 2);
+}
+
+void TestWSLPartAlreadyGone() {
+    // Nothing left in WSL once the local part is stopped: a single check
+    FakeWSL wsl;
+    ProcessOptions options = wsl.Options("sleep 30");
+    options.timeout_ms = 300;
+    std::string out, err;
+    ProcessResult result = CaptureProcess(options, out, err);
+    CHECK(result.status == ProcessStatus::kTimedOut);
+    CHECK_EQ(wsl.Starts(), 1 + 1);
+
+    // A WSL command that just ends never starts another wsl.exe
+    result = CaptureProcess(wsl.Options("echo done"), out, err);
+    CHECK_EQ(out, "done\n");
+    CHECK_EQ(wsl.Starts(), 1 + 1 + 1);
+}
+
+int RunTests() {
+    RUN_TEST(TestArgvIsPassedVerbatim);
+    RUN_TEST(TestCwdAndEnvironment);
+    RUN_TEST(TestExitCodes);
+    RUN_TEST(TestMissingProgram);
+    RUN_TEST(TestStdinRoundTrip);
+    RUN_TEST(TestTimeoutStopsTree);
+    RUN_TEST(TestShutdownLadder);
+    RUN_TEST(TestContinuousOutput);
+    RUN_TEST(TestCancelToken);
+    RUN_TEST(TestCancelCallback);
+    RUN_TEST(TestExecCommandUntil);
+    RUN_TEST(TestDeadline);
+    RUN_TEST(TestWSLPartStopped);
+    RUN_TEST(TestWSLPartAlreadyGone);
+    return parallax_test::Finish();
+}
+
+}  // namespace
+
+int main() { return parallax_test::RunReaped(RunTests); }
@@ -0,0 +1,134 @@
+#include "test_util.h"
+#include "utils/cancellation.h"
+#include "utils/shell_session.h"
+#include <string>
+#include <thread>
+
+// ShellSession over a plain /bin/bash: sentinel framing of output and exit
+// codes, and a new shell after timeouts, cancellation and lost shells
+
+using namespace parallax::utils;
+using parallax_test::ElapsedMs;
+
+namespace {
+
+const std::vector<std::string> kBash = {"/bin/bash", "--noprofile",
+                                        "--norc"};
+
+void TestFraming() {
+    ShellSession session(kBash);
+    ShellSessionResult result =
+        session.Run("echo hello; echo oops >&2", 5000);
+    CHECK(result.status == ShellSessionStatus::kCompleted);
+    CHECK_EQ(result.exit_code, 0);
+    CHECK_EQ(result.stdout_output, "hello\n");
+    CHECK_EQ(result.stderr_output, "oops\n");
+
+    // Output without a final newline stays apart from the sentinel
+    result = session.Run("printf abc; printf def >&2", 5000);
+    CHECK_EQ(result.stdout_output, "abc");
+    CHECK_EQ(result.stderr_output, "def");
+
+    result = session.Run("exit 7", 5000);
+    CHECK(result.status == ShellSessionStatus::kCompleted);
+    CHECK_EQ(result.exit_code, 7);
+
+    // Multi-line scripts and quoting reach the shell unchanged
+    result = session.Run("for i in 1 2; do\n  echo \"$i 'x'\"\ndone", 5000);
+    CHECK_EQ(result.stdout_output, "1 'x'\n2 'x'\n");
+
+    // Commands read /dev/null, not the session's command stream
+    result = session.Run("cat; echo done", 5000);
+    CHECK_EQ(result.stdout_output, "done\n");
+
+    // A syntax error fails the command, not the session
+    result = session.Run("echo (", 5000);
+    CHECK(result.status == ShellSessionStatus::kCompleted);
+    CHECK(result.exit_code != 0);
+    result = session.Run("echo still", 5000);
+    CHECK_EQ(result.stdout_output, "still\n");
+
+    // Each command runs in a subshell
+    session.Run("cd /; FOO=bar", 5000);
+    result = session.Run("echo \"$FOO\"", 5000);
+    CHECK_EQ(result.stdout_output, "\n");
+    CHECK_EQ(session.GetStartCount(), 1u);
+}
+
+void TestLargeOutput() {
+    ShellSession session(kBash);
+    ShellSessionResult result =
+        session.Run("head -c 1000000 /dev/zero | tr '\\0' x", 10000);
+    CHECK(result.status == ShellSessionStatus::kCompleted);
+    CHECK_EQ(result.stdout_output, std::string(1000000, 'x'));
+
+    result = session.Run("seq 1 100000", 10000, CapturePolicy::HeadTail(64));
+    CHECK_EQ(result.stdout_output.compare(0, 6, "1\n2\n3\n"), 0);
+    CHECK_EQ(result.stdout_info.total_bytes, 588895u);
+    CHECK_EQ(result.stdout_output.substr(result.stdout_output.size() - 7),
+             "100000\n");
+}
+
+void TestTimeoutRestartsShell() {
+    ShellSession session(kBash);
+    auto start = std::chrono::steady_clock::now();
+    ShellSessionResult result = session.Run("echo part; sleep 30", 300);
+    CHECK(result.status == ShellSessionStatus::kTimedOut);
+    CHECK_EQ(result.stdout_output, "part\n");
+    CHECK(ElapsedMs(start) < 10000);
+
+    result = session.Run("echo back", 5000);
+    CHECK(result.status == ShellSessionStatus::kCompleted);
+    CHECK_EQ(result.stdout_output, "back\n");
+    CHECK_EQ(session.GetStartCount(), 2u);
+}
+
+void TestCancel() {
+    ShellSession session(kBash);
+    CancellationToken token;
+    std::thread canceller([token]() mutable {
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        token.Cancel();
+    });
+    auto start = std::chrono::steady_clock::now();
+    ShellSessionResult result =
+        session.Run("trap '' INT; sleep 30", 0, CapturePolicy(), token);
+    canceller.join();
+    CHECK(result.status == ShellSessionStatus::kCancelled);
+    CHECK(ElapsedMs(start) < 300 + ShutdownPolicy::kPromptGraceMs + 2000);
+
+    result = session.Run("echo back", 5000);
+    CHECK_EQ(result.stdout_output, "back\n");
+}
+
+void TestLostShell() {
+    ShellSession session(kBash);
+    ShellSessionResult result = session.Run("kill -9 $$", 5000);
+    CHECK(result.status == ShellSessionStatus::kLost);
+
+    result = session.Run("echo again", 5000);
+    CHECK(result.status == ShellSessionStatus::kCompleted);
+    CHECK_EQ(result.stdout_output, "again\n");
+}
+
+void TestShellThatDoesNotStart() {
+    ShellSession missing({"/nonexistent/sh"});
+    CHECK(missing.Run("echo x", 1000).status == ShellSessionStatus::kNotRun);
+
+    ShellSession quits({"/bin/sh", "-c", "exit 3"});
+    CHECK(quits.Run("echo x", 1000).status == ShellSessionStatus::kNotRun);
+}
+
+int RunTests() {
+    RUN_TEST(TestFraming);
+    RUN_TEST(TestLargeOutput);
+    RUN_TEST(TestTimeoutRestartsShell);
+    RUN_TEST(TestCancel);
+    RUN_TEST(TestLostShell);
+    RUN_TEST(TestShellThatDoesNotStart);
+    return parallax_test::Finish();
+}
+
+}  // namespace
+
+int main() { return parallax_test::RunReaped(RunTests); }
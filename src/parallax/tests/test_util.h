@@ -0,0 +1,90 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#ifdef __linux__
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Checks for the test programs: a failed check is reported with its
+// location and the program exits non-zero after the remaining tests ran
+
+namespace parallax_test {
+
+inline int& FailureCount() {
+    static int count = 0;
+    return count;
+}
+
+inline void Fail(const char* file, int line, const std::string& what) {
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what.c_str());
+    fflush(stderr);
+    FailureCount()++;
+}
+
+inline int64_t ElapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+inline int Finish() {
+    if (FailureCount() > 0) {
+        printf("%d check(s) failed\n", FailureCount());
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}
+
+#ifdef __linux__
+// Run the tests in a child while this process reaps the orphans of stopped
+// process trees, as init would. Some container inits never reap, and a
+// zombie still counts as a member of its process group.
+inline int RunReaped(int (*run)()) {
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        int result = run();
+        fflush(stdout);
+        _exit(result);
+    }
+    int status = 0;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, 0)) > 0) {
+        if (pid == child) {
+            return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+        }
+    }
+    return 1;
+}
+#else
+inline int RunReaped(int (*run)()) { return run(); }
+#endif
+
+}  // namespace parallax_test
+
+#define CHECK(cond)                                              \
+    do {                                                         \
+        if (!(cond)) {                                           \
+            parallax_test::Fail(__FILE__, __LINE__, #cond);      \
+        }                                                        \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                  \
+    do {                                                                \
+        if (!((a) == (b))) {                                            \
+            parallax_test::Fail(__FILE__, __LINE__, #a " == " #b);      \
+        }                                                               \
+    } while (0)
+
+#define RUN_TEST(test)                        \
+    do {                                      \
+        printf("%s\n", #test);                \
+        fflush(stdout);                       \
+        test();                               \
+    } while (0)
@@ -0,0 +1,98 @@
+#include "tinylog/tinylog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Multi-thread throughput and per call latency of info_log, synchronous
+// (writes under the file lock) against asynchronous (queue and writer
+// thread). Usage: tinylog_bench [records per thread] [threads]
+
+namespace {
+
+struct BenchResult {
+    double records_per_second;
+    double p50_us;
+    double p99_us;
+    double max_us;
+};
+
+BenchResult Run(const std::string& path, int sync_write, int records,
+                int thread_count) {
+    tinylog_init(path.c_str(), 64 << 20, 2, 0, sync_write);
+    set_log_level(3);
+
+    std::vector<std::vector<double>> latencies(thread_count);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < thread_count; t++) {
+        threads.emplace_back([t, records, &latencies]() {
+            std::vector<double>& mine = latencies[t];
+            mine.reserve(records);
+            for (int n = 0; n < records; n++) {
+                auto before = std::chrono::steady_clock::now();
+                info_log("[ENV] bench thread %d record %d of %s", t, n,
+                         "component_check");
+                mine.push_back(std::chrono::duration<double, std::micro>(
+                                   std::chrono::steady_clock::now() - before)
+                                   .count());
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    // Records count once they are in the file
+    tinylog_uninit();
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    std::vector<double> all;
+    for (const std::vector<double>& mine : latencies) {
+        all.insert(all.end(), mine.begin(), mine.end());
+    }
+    std::sort(all.begin(), all.end());
+    BenchResult result;
+    result.records_per_second = all.size() / seconds;
+    result.p50_us = all[all.size() / 2];
+    result.p99_us = all[all.size() * 99 / 100];
+    result.max_us = all.back();
+    unlink(path.c_str());
+    unlink((path + ".idx").c_str());
+    return result;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int records = argc > 1 ? atoi(argv[1]) : 100000;
+    int thread_count = argc > 2 ? atoi(argv[2]) : 4;
+    if (records <= 0 || thread_count <= 0) {
+        fprintf(stderr, "usage: tinylog_bench [records] [threads]\n");
+        return 2;
+    }
+
+    char dir[] = "/tmp/parallax-bench-XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string path = std::string(dir) + "/bench.log";
+
+    printf("%d threads x %d records\n", thread_count, records);
+    printf("%-6s %14s %10s %10s %10s\n", "mode", "records/s", "p50 us",
+           "p99 us", "max us");
+    const char* names[] = {"async", "sync"};
+    for (int sync_write = 0; sync_write <= 1; sync_write++) {
+        BenchResult r = Run(path, sync_write, records, thread_count);
+        printf("%-6s %14.0f %10.2f %10.2f %10.2f\n", names[sync_write],
+               r.records_per_second, r.p50_us, r.p99_us, r.max_us);
+    }
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,267 @@
+#include "test_util.h"
+#include "tinylog/log_queue.h"
+#include "tinylog/tinylog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// tinylog hot path: records from concurrent threads reach the file whole,
+// once and in per-thread order, synchronously and through the queue
+
+namespace {
+
+const int kThreads = 4;
+const int kRecordsPerThread = 5000;
+
+std::string MakeTempDir() {
+    char path[] = "/tmp/parallax-tinylog-XXXXXX";
+    return mkdtemp(path) ? path : "/tmp";
+}
+
+std::vector<std::string> ReadLines(const std::string& path) {
+    std::vector<std::string> lines;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return lines;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        lines.push_back(line);
+    }
+    fclose(file);
+    return lines;
+}
+
+void RemoveLog(const std::string& dir, const std::string& path) {
+    unlink(path.c_str());
+    unlink((path + ".idx").c_str());
+    rmdir(dir.c_str());
+}
+
+void LogFromThreads() {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([t]() {
+            for (int n = 0; n < kRecordsPerThread; n++) {
+                info_log("record t%d n%d", t, n);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// Records of each thread in the order the thread logged them, each once;
+// every record unless gaps are allowed. Returns the number found.
+int CheckRecords(const std::string& path, bool gaps) {
+    int next[kThreads] = {0};
+    int found = 0;
+    for (const std::string& line : ReadLines(path)) {
+        const char* record = strstr(line.c_str(), "[INFO] - record t");
+        int t = -1, n = -1;
+        if (!record ||
+            sscanf(record, "[INFO] - record t%d n%d", &t, &n) != 2) {
+            continue;
+        }
+        CHECK(t >= 0 && t < kThreads);
+        if (t < 0 || t >= kThreads) {
+            continue;
+        }
+        CHECK(gaps ? n >= next[t] : n == next[t]);
+        next[t] = n + 1;
+        found++;
+    }
+    return found;
+}
+
+void TestWrite(int sync_write) {
+    std::string dir = MakeTempDir();
+    std::string path = dir + "/test.log";
+    CHECK_EQ(tinylog_init(path.c_str(), 64 << 20, 2, 0, sync_write), 0);
+    set_log_level(3);
+    LogFromThreads();
+    tinylog_uninit();
+
+    CHECK_EQ(CheckRecords(path, false), kThreads * kRecordsPerThread);
+    RemoveLog(dir, path);
+}
+
+void TestSyncWrite() { TestWrite(1); }
+
+void TestAsyncWrite() { TestWrite(0); }
+
+void TestAsyncDropNewest() {
+    // Records are either written or counted as dropped, never lost silently
+    std::string dir = MakeTempDir();
+    std::string path = dir + "/test.log";
+    set_log_async_options(64 * 1024, TINYLOG_OVERFLOW_DROP_NEWEST);
+    CHECK_EQ(tinylog_init(path.c_str(), 64 << 20, 2, 0, 0), 0);
+    set_log_level(3);
+    LogFromThreads();
+    tinylog_uninit();
+    unsigned long long dropped = get_log_dropped_count();
+    set_log_async_options(4 << 20, TINYLOG_OVERFLOW_BLOCK);
+
+    CHECK_EQ(CheckRecords(path, true) + dropped,
+             static_cast<unsigned long long>(kThreads * kRecordsPerThread));
+    RemoveLog(dir, path);
+}
+
+void TestOversizedEntry() {
+    // An entry larger than the ring is never stored: the drop policies
+    // count it, kBlock hands it back to the caller to write
+    tinylog::LogQueue queue;
+    std::string entry(128 * 1024, 'x');
+    queue.Open(64 * 1024, tinylog::OverflowPolicy::kBlock);
+    CHECK(queue.Push(entry.data(), entry.size()) ==
+          tinylog::PushResult::kTooLarge);
+    CHECK_EQ(queue.GetDroppedCount(), 0u);
+    queue.Close();
+
+    queue.Open(64 * 1024, tinylog::OverflowPolicy::kDropNewest);
+    CHECK(queue.Push(entry.data(), entry.size()) ==
+          tinylog::PushResult::kDropped);
+    CHECK_EQ(queue.GetDroppedCount(), 1u);
+    queue.Close();
+}
+
+void TestAsyncBlockOversizedRecord() {
+    // A record larger than the queue is written in order under kBlock
+    std::string dir = MakeTempDir();
+    std::string path = dir + "/test.log";
+    set_log_async_options(64 * 1024, TINYLOG_OVERFLOW_BLOCK);
+    CHECK_EQ(tinylog_init(path.c_str(), 64 << 20, 2, 0, 0), 0);
+    set_log_level(3);
+    std::string big(200 * 1024, 'b');
+    info_log("before");
+    info_log("big %s", big.c_str());
+    info_log("after");
+    tinylog_uninit();
+    unsigned long long dropped = get_log_dropped_count();
+    set_log_async_options(4 << 20, TINYLOG_OVERFLOW_BLOCK);
+
+    std::string text;
+    FILE* file = fopen(path.c_str(), "rb");
+    CHECK(file != nullptr);
+    if (file) {
+        char buffer[65536];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            text.append(buffer, n);
+        }
+        fclose(file);
+    }
+    CHECK_EQ(dropped, 0ull);
+    size_t before = text.find("[INFO] - before\n");
+    size_t record = text.find("[INFO] - big " + big + "\n");
+    size_t after = text.find("[INFO] - after\n");
+    CHECK(before != std::string::npos);
+    CHECK(record != std::string::npos);
+    CHECK(after != std::string::npos);
+    CHECK(before < record && record < after);
+    RemoveLog(dir, path);
+}
+
+int g_formatted = 0;
+
+int Counted(int value) {
+    g_formatted++;
+    return value;
+}
+
+void TestRecorderKeepsModuleLevels() {
+    // The recorder formats DEBUG records of modules that follow the global
+    // level, a module set to warn skips them, arguments included
+    std::string dir = MakeTempDir();
+    std::string path = dir + "/test.log";
+    CHECK_EQ(tinylog_init(path.c_str(), 64 << 20, 2, 0, 1), 0);
+    set_log_level(3);
+    set_log_flight_recorder(64 * 1024);
+    CHECK_EQ(set_log_module_levels("WSL=warn"), 0);
+
+    g_formatted = 0;
+    debug_log("[WSL] chunk %d", Counted(1));
+    info_log("[WSL] line %d", Counted(2));
+    CHECK_EQ(g_formatted, 0);
+    debug_log("[ENV] step %d", Counted(3));
+    debug_log("kept %d", Counted(4));
+    CHECK_EQ(g_formatted, 2);
+
+    // Without the recorder DEBUG is skipped everywhere below a DEBUG level
+    set_log_flight_recorder(0);
+    g_formatted = 0;
+    debug_log("[ENV] step %d", Counted(5));
+    debug_log("kept %d", Counted(6));
+    CHECK_EQ(g_formatted, 0);
+
+    set_log_module_level(TINYLOG_MODULE_WSL, -1);
+    tinylog_uninit();
+    RemoveLog(dir, path);
+}
+
+std::string ReadAll(const std::string& path) {
+    std::string text;
+    for (const std::string& line : ReadLines(path)) {
+        text += line;
+    }
+    return text;
+}
+
+void TestStructuredRecords() {
+    // A kv record with a message writes that line to the log file and the
+    // fields to the JSON file, and follows the level of its module
+    std::string dir = MakeTempDir();
+    std::string path = dir + "/test.log";
+    std::string json_path = dir + "/test.jsonl";
+    set_log_json_file(json_path.c_str());
+    CHECK_EQ(tinylog_init(path.c_str(), 64 << 20, 2, 0, 1), 0);
+    set_log_level(3);
+
+    info_kv_msg(TINYLOG_MODULE_ENV, "component_result",
+                "[ENV] Check WSL result: status=success, message=ok",
+                {"operation", "Check"}, {"status", "success"},
+                {"duration_ms", 12});
+    info_kv(TINYLOG_MODULE_ENV, "probe", {"name", "wsl"});
+    CHECK_EQ(set_log_module_levels("ENV=warn"), 0);
+    g_formatted = 0;
+    info_kv_msg(TINYLOG_MODULE_ENV, "component_result", "[ENV] skipped",
+                {"value", Counted(1)});
+    info_kv(TINYLOG_MODULE_DEFAULT, "kept", {"value", Counted(2)});
+    CHECK_EQ(g_formatted, 1);
+    set_log_module_level(TINYLOG_MODULE_ENV, -1);
+    tinylog_uninit();
+    set_log_json_file(nullptr);
+
+    std::string text = ReadAll(path);
+    CHECK(text.find("[INFO] - [ENV] Check WSL result: status=success, "
+                    "message=ok\n") != std::string::npos);
+    CHECK(text.find("[INFO] - probe: name=wsl\n") != std::string::npos);
+    CHECK(text.find("skipped") == std::string::npos);
+    CHECK(text.find("kept: value=2") != std::string::npos);
+
+    std::string json = ReadAll(json_path);
+    CHECK(json.find("\"event\":\"component_result\",\"fields\":{"
+                    "\"operation\":\"Check\",\"status\":\"success\","
+                    "\"duration_ms\":12},\"msg\":\"[ENV] Check WSL result: "
+                    "status=success, message=ok\"}") != std::string::npos);
+    unlink(json_path.c_str());
+    RemoveLog(dir, path);
+}
+
+}  // namespace
+
+int main() {
+    RUN_TEST(TestSyncWrite);
+    RUN_TEST(TestAsyncWrite);
+    RUN_TEST(TestAsyncDropNewest);
+    RUN_TEST(TestOversizedEntry);
+    RUN_TEST(TestAsyncBlockOversizedRecord);
+    RUN_TEST(TestRecorderKeepsModuleLevels);
+    RUN_TEST(TestStructuredRecords);
+    return parallax_test::Finish();
+}
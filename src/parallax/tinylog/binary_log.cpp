@@ -0,0 +1,1010 @@
+#include "binary_log.h"
+#include "gzip_stream.h"
+#include "platform.h"
+#include "rotating_file.h"
+#include <string.h>
+#include <atomic>
+#include <map>
+
+namespace tinylog {
+
+namespace {
+
+// Log level strings
+const char* const kPriorities[] = {"CRIT", "ERROR", "WARN",
+                                   "INFO", "DEBUG", "TRACE"};
+
+// printf length modifiers, including the MSVC specific ones
+enum class LengthModifier {
+    kNone,
+    kHH,
+    kH,
+    kL,
+    kLL,
+    kLongDouble,
+    kSizeT,
+    kIntMax,
+    kPtrDiff,
+    kI64,
+    kI32,
+    kWide
+};
+
+// One parsed conversion specification
+struct FormatSpec {
+    std::string flags;
+    int width;      // -1 none, -2 taken from argument
+    int precision;  // -1 none, -2 taken from argument
+    LengthModifier length;
+    char conversion;
+};
+
+// How an argument has to be pulled from the va_list
+enum class ArgKind : uint8_t {
+    kInt,
+    kLong,
+    kLongLong,
+    kSizeT,
+    kIntMax,
+    kPtrDiff,
+    kUInt,
+    kULong,
+    kULongLong,
+    kDouble,
+    kLongDouble,
+    kString,
+    kWString,
+    kPointer,
+    kSkipPointer  // %n, consumed but not recorded
+};
+
+struct CallSite {
+    uint32_t id;
+    int line;
+    const char* file;
+    const char* func;
+    const char* format;
+    bool supported;  // Format only uses conversions the encoder understands
+    std::vector<ArgKind> args;
+};
+
+const size_t kSiteTableSize = 4096;  // Power of two
+std::atomic<CallSite*> g_site_table[kSiteTableSize];
+std::atomic<CallSite*> g_sites_by_id[kSiteTableSize];
+std::atomic<uint32_t> g_next_site_id{1};
+
+// Parse a conversion specification, p points behind '%'. Returns the
+// position after the conversion character or nullptr if malformed.
+const char* ParseSpec(const char* p, FormatSpec& spec) {
+    spec.flags.clear();
+    spec.width = -1;
+    spec.precision = -1;
+    spec.length = LengthModifier::kNone;
+    spec.conversion = 0;
+
+    while (*p && strchr("-+ #0'", *p)) {
+        spec.flags += *p++;
+    }
+
+    if (*p == '*') {
+        spec.width = -2;
+        p++;
+    } else if (*p >= '0' && *p <= '9') {
+        spec.width = 0;
+        while (*p >= '0' && *p <= '9') {
+            spec.width = spec.width * 10 + (*p++ - '0');
+        }
+    }
+
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec.precision = -2;
+            p++;
+        } else {
+            spec.precision = 0;
+            while (*p >= '0' && *p <= '9') {
+                spec.precision = spec.precision * 10 + (*p++ - '0');
+            }
+        }
+    }
+
+    switch (*p) {
+        case 'h':
+            p++;
+            spec.length = LengthModifier::kH;
+            if (*p == 'h') {
+                p++;
+                spec.length = LengthModifier::kHH;
+            }
+            break;
+        case 'l':
+            p++;
+            spec.length = LengthModifier::kL;
+            if (*p == 'l') {
+                p++;
+                spec.length = LengthModifier::kLL;
+            }
+            break;
+        case 'L':
+            p++;
+            spec.length = LengthModifier::kLongDouble;
+            break;
+        case 'z':
+            p++;
+            spec.length = LengthModifier::kSizeT;
+            break;
+        case 'j':
+            p++;
+            spec.length = LengthModifier::kIntMax;
+            break;
+        case 't':
+            p++;
+            spec.length = LengthModifier::kPtrDiff;
+            break;
+        case 'w':
+            p++;
+            spec.length = LengthModifier::kWide;
+            break;
+        case 'I':
+            p++;
+            if (p[0] == '6' && p[1] == '4') {
+                p += 2;
+                spec.length = LengthModifier::kI64;
+            } else if (p[0] == '3' && p[1] == '2') {
+                p += 2;
+                spec.length = LengthModifier::kI32;
+            } else {
+                spec.length = LengthModifier::kSizeT;
+            }
+            break;
+    }
+
+    if (!*p) {
+        return nullptr;
+    }
+    spec.conversion = *p++;
+    return p;
+}
+
+// Map a conversion to the va_arg type, returns false if unsupported
+bool SpecToArgKind(const FormatSpec& spec, ArgKind& kind) {
+    switch (spec.conversion) {
+        case 'd':
+        case 'i':
+            switch (spec.length) {
+                case LengthModifier::kL:
+                    kind = ArgKind::kLong;
+                    break;
+                case LengthModifier::kLL:
+                case LengthModifier::kI64:
+                    kind = ArgKind::kLongLong;
+                    break;
+                case LengthModifier::kSizeT:
+                    kind = ArgKind::kSizeT;
+                    break;
+                case LengthModifier::kIntMax:
+                    kind = ArgKind::kIntMax;
+                    break;
+                case LengthModifier::kPtrDiff:
+                    kind = ArgKind::kPtrDiff;
+                    break;
+                default:
+                    kind = ArgKind::kInt;
+                    break;
+            }
+            return true;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            switch (spec.length) {
+                case LengthModifier::kL:
+                    kind = ArgKind::kULong;
+                    break;
+                case LengthModifier::kLL:
+                case LengthModifier::kI64:
+                    kind = ArgKind::kULongLong;
+                    break;
+                case LengthModifier::kSizeT:
+                    kind = ArgKind::kSizeT;
+                    break;
+                case LengthModifier::kIntMax:
+                    kind = ArgKind::kIntMax;
+                    break;
+                case LengthModifier::kPtrDiff:
+                    kind = ArgKind::kPtrDiff;
+                    break;
+                default:
+                    kind = ArgKind::kUInt;
+                    break;
+            }
+            return true;
+        case 'c':
+        case 'C':
+            kind = ArgKind::kInt;
+            return true;
+        case 's':
+            kind = (spec.length == LengthModifier::kL ||
+                    spec.length == LengthModifier::kWide)
+                       ? ArgKind::kWString
+                       : ArgKind::kString;
+            return true;
+        case 'S':
+            kind = ArgKind::kWString;
+            return true;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            kind = spec.length == LengthModifier::kLongDouble
+                       ? ArgKind::kLongDouble
+                       : ArgKind::kDouble;
+            return true;
+        case 'p':
+            kind = ArgKind::kPointer;
+            return true;
+        case 'n':
+            kind = ArgKind::kSkipPointer;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Work out the argument list of a format string once per call site
+bool ParseFormatArgs(const char* format, std::vector<ArgKind>& args) {
+    const char* p = format;
+    while (*p) {
+        if (*p++ != '%') {
+            continue;
+        }
+        if (*p == '%') {
+            p++;
+            continue;
+        }
+
+        FormatSpec spec;
+        p = ParseSpec(p, spec);
+        if (!p) {
+            return false;
+        }
+
+        if (spec.width == -2) {
+            args.push_back(ArgKind::kInt);
+        }
+        if (spec.precision == -2) {
+            args.push_back(ArgKind::kInt);
+        }
+
+        ArgKind kind;
+        if (!SpecToArgKind(spec, kind)) {
+            return false;
+        }
+        args.push_back(kind);
+    }
+    return true;
+}
+
+// Find or register the call site, lock free after the first call
+CallSite* LookupSite(const char* file, int line, const char* func,
+                     const char* format) {
+    size_t hash = reinterpret_cast<uintptr_t>(format) * 31 +
+                  reinterpret_cast<uintptr_t>(file) * 17 +
+                  static_cast<size_t>(line);
+    hash ^= hash >> 13;
+
+    CallSite* created = nullptr;
+    for (size_t probe = 0; probe < kSiteTableSize; probe++) {
+        std::atomic<CallSite*>& slot =
+            g_site_table[(hash + probe) & (kSiteTableSize - 1)];
+
+        CallSite* site = slot.load(std::memory_order_acquire);
+        if (!site) {
+            if (!created) {
+                uint32_t id = g_next_site_id.fetch_add(1);
+                if (id >= kSiteTableSize) {
+                    return nullptr;  // Table full, caller falls back to text
+                }
+
+                created = new CallSite();
+                created->id = id;
+                created->line = line;
+                created->file = file ? file : "";
+                created->func = func ? func : "";
+                created->format = format;
+                created->supported = ParseFormatArgs(format, created->args);
+                g_sites_by_id[id].store(created, std::memory_order_release);
+            }
+
+            if (slot.compare_exchange_strong(site, created,
+                                             std::memory_order_acq_rel)) {
+                return created;
+            }
+            // Lost the race for this slot, site now holds the winner
+        }
+
+        if (site->format == format && site->file == file &&
+            site->line == line) {
+            // Another thread registered the same site first, the id taken by
+            // our copy stays unused
+            return site;
+        }
+    }
+    return nullptr;
+}
+
+// Bounds checked little endian record builder
+class RecordBuilder {
+ public:
+    RecordBuilder(char* buffer, size_t size)
+        : buffer_(buffer), size_(size), pos_(0), ok_(true), truncated_(0) {}
+
+    void Begin(BinaryRecordType type) {
+        U8(static_cast<uint8_t>(type));
+        U32(0);  // Patched by Finish
+    }
+
+    size_t Finish() {
+        if (!ok_) return 0;
+        uint32_t payload = static_cast<uint32_t>(pos_ - kBinaryRecordHeaderSize);
+        memcpy(buffer_ + 1, &payload, sizeof(payload));
+        return pos_;
+    }
+
+    void U8(uint8_t v) { Bytes(&v, sizeof(v)); }
+    void U16(uint16_t v) { Bytes(&v, sizeof(v)); }
+    void U32(uint32_t v) { Bytes(&v, sizeof(v)); }
+    void U64(uint64_t v) { Bytes(&v, sizeof(v)); }
+
+    void Bytes(const void* data, size_t len) {
+        if (!ok_ || pos_ + len > size_) {
+            ok_ = false;
+            return;
+        }
+        memcpy(buffer_ + pos_, data, len);
+        pos_ += len;
+    }
+
+    // Short string, used for site definitions
+    void Str16(const char* s) {
+        size_t len = strlen(s);
+        if (len > 0xFFFF) len = 0xFFFF;
+        U16(static_cast<uint16_t>(len));
+        Bytes(s, len);
+    }
+
+    // Tagged string argument, truncated to the space that is left while
+    // keeping room for a few numeric arguments behind it
+    void StringArg(const char* s, size_t len) {
+        const size_t reserve = 64;
+        size_t room = size_ > pos_ + 5 + reserve ? size_ - pos_ - 5 - reserve : 0;
+        if (len > room) {
+            truncated_ += len - room + 5 + reserve;  // Enough to keep it
+            len = room;
+        }
+        U8(static_cast<uint8_t>(BinaryArgTag::kString));
+        U32(static_cast<uint32_t>(len));
+        Bytes(s, len);
+    }
+
+    bool Ok() const { return ok_; }
+    // Space that StringArg would have needed to keep all strings whole
+    size_t Truncated() const { return truncated_; }
+
+ private:
+    char* buffer_;
+    size_t size_;
+    size_t pos_;
+    bool ok_;
+    size_t truncated_;
+};
+
+std::string NarrowWide(const wchar_t* ws) {
+    std::string out;
+    for (; *ws; ws++) {
+        out += (*ws < 0x80) ? static_cast<char>(*ws) : '?';
+    }
+    return out;
+}
+
+}  // namespace
+
+size_t EncodeBinaryEvent(char* buffer, size_t size, int priority,
+                         unsigned int idx, const char* file, int line,
+                         const char* func, const char* format, va_list va,
+                         size_t* truncated) {
+    if (!format) return 0;
+
+    CallSite* site = LookupSite(file, line, func, format);
+    if (!site || !site->supported) {
+        return 0;
+    }
+
+    RecordBuilder rb(buffer, size);
+    rb.Begin(BinaryRecordType::kEvent);
+    rb.U32(site->id);
+    rb.U8(static_cast<uint8_t>(priority));
+    rb.U32(CurrentThreadId());
+    rb.U32(idx);
+    rb.U64(FileTimeNow());
+
+    for (ArgKind kind : site->args) {
+        int64_t i = 0;
+        uint64_t u = 0;
+        bool is_signed = false;
+        bool is_unsigned = false;
+
+        switch (kind) {
+            case ArgKind::kInt:
+                i = va_arg(va, int);
+                is_signed = true;
+                break;
+            case ArgKind::kLong:
+                i = va_arg(va, long);
+                is_signed = true;
+                break;
+            case ArgKind::kLongLong:
+                i = va_arg(va, long long);
+                is_signed = true;
+                break;
+            case ArgKind::kIntMax:
+                i = va_arg(va, intmax_t);
+                is_signed = true;
+                break;
+            case ArgKind::kPtrDiff:
+                i = va_arg(va, ptrdiff_t);
+                is_signed = true;
+                break;
+            case ArgKind::kUInt:
+                u = va_arg(va, unsigned int);
+                is_unsigned = true;
+                break;
+            case ArgKind::kULong:
+                u = va_arg(va, unsigned long);
+                is_unsigned = true;
+                break;
+            case ArgKind::kULongLong:
+                u = va_arg(va, unsigned long long);
+                is_unsigned = true;
+                break;
+            case ArgKind::kSizeT:
+                u = va_arg(va, size_t);
+                is_unsigned = true;
+                break;
+            case ArgKind::kDouble: {
+                double d = va_arg(va, double);
+                rb.U8(static_cast<uint8_t>(BinaryArgTag::kDouble));
+                rb.Bytes(&d, sizeof(d));
+                break;
+            }
+            case ArgKind::kLongDouble: {
+                double d = static_cast<double>(va_arg(va, long double));
+                rb.U8(static_cast<uint8_t>(BinaryArgTag::kDouble));
+                rb.Bytes(&d, sizeof(d));
+                break;
+            }
+            case ArgKind::kString: {
+                const char* s = va_arg(va, const char*);
+                if (!s) s = "(null)";
+                rb.StringArg(s, strlen(s));
+                break;
+            }
+            case ArgKind::kWString: {
+                const wchar_t* ws = va_arg(va, const wchar_t*);
+                std::string s = ws ? NarrowWide(ws) : "(null)";
+                rb.StringArg(s.data(), s.size());
+                break;
+            }
+            case ArgKind::kPointer:
+                rb.U8(static_cast<uint8_t>(BinaryArgTag::kPointer));
+                rb.U64(reinterpret_cast<uintptr_t>(va_arg(va, void*)));
+                break;
+            case ArgKind::kSkipPointer:
+                (void)va_arg(va, void*);
+                break;
+        }
+
+        if (is_signed) {
+            rb.U8(static_cast<uint8_t>(BinaryArgTag::kInt));
+            rb.U64(static_cast<uint64_t>(i));
+        } else if (is_unsigned) {
+            rb.U8(static_cast<uint8_t>(BinaryArgTag::kUInt));
+            rb.U64(u);
+        }
+
+        if (!rb.Ok()) {
+            return 0;
+        }
+    }
+
+    if (truncated) {
+        *truncated = rb.Truncated();
+    }
+    return rb.Finish();
+}
+
+size_t EncodeBinaryText(char* buffer, size_t size, int priority,
+                        unsigned int idx, const char* text, size_t len) {
+    RecordBuilder rb(buffer, size);
+    rb.Begin(BinaryRecordType::kText);
+    rb.U8(static_cast<uint8_t>(priority));
+    rb.U32(CurrentThreadId());
+    rb.U32(idx);
+    rb.U64(FileTimeNow());
+    if (len > size - kBinaryTextOverhead) {
+        len = size - kBinaryTextOverhead;
+    }
+    rb.Bytes(text, len);
+    return rb.Finish();
+}
+
+// BinaryLogWriter implementation
+BinaryLogWriter::BinaryLogWriter(RotatingFile& file)
+    : file_(file), generation_(0) {
+    // Sized once, starting a segment must not allocate (crash path)
+    defined_sites_.assign(kSiteTableSize, false);
+}
+
+void BinaryLogWriter::Write(const char* data, size_t len) {
+    WriteRecords(data, len, false);
+}
+
+void BinaryLogWriter::CrashWrite(const char* data, size_t len) {
+    WriteRecords(data, len, true);
+}
+
+void BinaryLogWriter::Put(const char* data, size_t len, bool crash) {
+    if (crash) {
+        file_.CrashWrite(data, len);
+    } else {
+        file_.Append(data, len);
+    }
+}
+
+void BinaryLogWriter::WriteRecords(const char* data, size_t len, bool crash) {
+    size_t offset = 0;
+    while (offset + kBinaryRecordHeaderSize <= len) {
+        uint32_t payload = 0;
+        memcpy(&payload, data + offset + 1, sizeof(payload));
+        size_t record_len = kBinaryRecordHeaderSize + payload;
+        if (offset + record_len > len) {
+            break;  // Truncated input, never produced by the encoder
+        }
+
+        if (!crash) {
+            file_.RotateIfNeeded();
+        }
+        if (file_.GetGeneration() != generation_) {
+            StartSegment(crash);
+        }
+
+        if (static_cast<BinaryRecordType>(data[offset]) ==
+                BinaryRecordType::kEvent &&
+            payload >= sizeof(uint32_t)) {
+            uint32_t site_id = 0;
+            memcpy(&site_id, data + offset + kBinaryRecordHeaderSize,
+                   sizeof(site_id));
+            if (site_id >= defined_sites_.size() || !defined_sites_[site_id]) {
+                DefineSite(site_id, crash);
+            }
+        }
+
+        Put(data + offset, record_len, crash);
+        offset += record_len;
+    }
+}
+
+void BinaryLogWriter::StartSegment(bool crash) {
+    generation_ = file_.GetGeneration();
+    defined_sites_.assign(kSiteTableSize, false);
+
+    if (file_.GetSegmentSize() == 0) {
+        Put(kBinaryLogMagic, sizeof(kBinaryLogMagic), crash);
+    }
+
+    // Local time offset lets the decoder reproduce the text timestamps
+    uint64_t now = FileTimeNow();
+    int64_t utc = static_cast<int64_t>(now);
+    int64_t local = static_cast<int64_t>(ToLocalFileTime(now));
+    int32_t bias_minutes = static_cast<int32_t>((local - utc) / 600000000LL);
+
+    char record[32];
+    RecordBuilder rb(record, sizeof(record));
+    rb.Begin(BinaryRecordType::kSession);
+    rb.U32(CurrentProcessId());
+    rb.U32(static_cast<uint32_t>(bias_minutes));
+    size_t len = rb.Finish();
+    Put(record, len, crash);
+}
+
+void BinaryLogWriter::DefineSite(uint32_t site_id, bool crash) {
+    if (site_id >= kSiteTableSize) return;
+
+    CallSite* site = g_sites_by_id[site_id].load(std::memory_order_acquire);
+    if (!site) return;
+
+    // Definitions normally fit on the stack, the crash path never allocates
+    char stack_record[1024];
+    std::vector<char> heap_record;
+    size_t size = kBinaryRecordHeaderSize + 16 + strlen(site->file) +
+                  strlen(site->func) + strlen(site->format) + 6;
+    char* record = stack_record;
+    if (size > sizeof(stack_record)) {
+        if (crash) return;
+        heap_record.resize(size);
+        record = heap_record.data();
+    }
+
+    RecordBuilder rb(record, size);
+    rb.Begin(BinaryRecordType::kSite);
+    rb.U32(site->id);
+    rb.U32(static_cast<uint32_t>(site->line));
+    rb.Str16(site->file);
+    rb.Str16(site->func);
+    rb.Str16(site->format);
+    size_t len = rb.Finish();
+    if (len > 0) {
+        Put(record, len, crash);
+        defined_sites_[site_id] = true;
+    }
+}
+
+// Decoder
+namespace {
+
+struct SiteDefinition {
+    std::string file;
+    std::string func;
+    std::string format;
+    uint32_t line;
+};
+
+struct DecodedArg {
+    BinaryArgTag tag;
+    int64_t i;
+    uint64_t u;
+    double d;
+    std::string s;
+};
+
+// Bounds checked little endian reader
+class RecordReader {
+ public:
+    RecordReader(const char* data, size_t size)
+        : data_(data), size_(size), pos_(0), ok_(true) {}
+
+    uint8_t U8() {
+        uint8_t v = 0;
+        Bytes(&v, sizeof(v));
+        return v;
+    }
+    uint16_t U16() {
+        uint16_t v = 0;
+        Bytes(&v, sizeof(v));
+        return v;
+    }
+    uint32_t U32() {
+        uint32_t v = 0;
+        Bytes(&v, sizeof(v));
+        return v;
+    }
+    uint64_t U64() {
+        uint64_t v = 0;
+        Bytes(&v, sizeof(v));
+        return v;
+    }
+    std::string Str(size_t len) {
+        if (!ok_ || pos_ + len > size_) {
+            ok_ = false;
+            return std::string();
+        }
+        std::string s(data_ + pos_, len);
+        pos_ += len;
+        return s;
+    }
+    void Bytes(void* out, size_t len) {
+        if (!ok_ || pos_ + len > size_) {
+            ok_ = false;
+            return;
+        }
+        memcpy(out, data_ + pos_, len);
+        pos_ += len;
+    }
+
+    bool AtEnd() const { return pos_ >= size_; }
+    bool Ok() const { return ok_; }
+    size_t Remaining() const { return size_ - pos_; }
+
+ private:
+    const char* data_;
+    size_t size_;
+    size_t pos_;
+    bool ok_;
+};
+
+// "[pid-tid:idx] YYYY-MM-DD HH:MM:SS.mmm [LEVEL] - "
+std::string RenderHeader(uint32_t pid, uint32_t tid, uint32_t idx,
+                         uint64_t filetime, int32_t bias_minutes,
+                         uint8_t level) {
+    uint64_t local = filetime + static_cast<int64_t>(bias_minutes) * 600000000LL;
+    CivilTime st = ToCivilTime(local);
+
+    char header[128];
+    snprintf(header, sizeof(header),
+             "[%u-%u:%u] %04d-%02d-%02d %02d:%02d:%02d.%03d [%s] - ", pid, tid,
+             idx, st.year, st.month, st.day, st.hour, st.minute, st.second,
+             st.millis,
+             level < 6 ? kPriorities[level] : "UNKNOWN");
+    return header;
+}
+
+void AppendFormatted(std::string& out, const char* spec, ...) {
+    char buffer[512];
+    va_list va;
+    va_start(va, spec);
+    int n = vsnprintf(buffer, sizeof(buffer), spec, va);
+    va_end(va);
+
+    if (n < 0) return;
+    if (n < (int)sizeof(buffer)) {
+        out.append(buffer, n);
+        return;
+    }
+
+    // Long string argument, format again into a buffer of the right size
+    std::vector<char> large(n + 1);
+    va_start(va, spec);
+    vsnprintf(large.data(), large.size(), spec, va);
+    va_end(va);
+    out.append(large.data(), n);
+}
+
+// Re-run the printf logic of the original call with the recorded values
+std::string RenderMessage(const std::string& format,
+                          const std::vector<DecodedArg>& args) {
+    std::string out;
+    size_t next = 0;
+    auto next_int = [&]() -> int {
+        if (next >= args.size()) return 0;
+        const DecodedArg& a = args[next++];
+        return a.tag == BinaryArgTag::kUInt ? static_cast<int>(a.u)
+                                            : static_cast<int>(a.i);
+    };
+
+    const char* p = format.c_str();
+    while (*p) {
+        if (*p != '%') {
+            out += *p++;
+            continue;
+        }
+        p++;
+        if (*p == '%') {
+            out += *p++;
+            continue;
+        }
+
+        const char* start = p - 1;
+        FormatSpec spec;
+        const char* end = ParseSpec(p, spec);
+        if (!end) {
+            out += start;
+            break;
+        }
+        p = end;
+
+        std::string rebuilt = "%" + spec.flags;
+        if (spec.width == -2) {
+            rebuilt += std::to_string(next_int());
+        } else if (spec.width >= 0) {
+            rebuilt += std::to_string(spec.width);
+        }
+        if (spec.precision == -2) {
+            rebuilt += "." + std::to_string(next_int());
+        } else if (spec.precision >= 0) {
+            rebuilt += "." + std::to_string(spec.precision);
+        }
+
+        if (spec.conversion == 'n') {
+            next++;
+            continue;
+        }
+        if (next >= args.size()) {
+            out += "<?>";
+            continue;
+        }
+        const DecodedArg& arg = args[next++];
+        int64_t as_int =
+            arg.tag == BinaryArgTag::kUInt ? static_cast<int64_t>(arg.u) : arg.i;
+
+        switch (spec.conversion) {
+            case 'd':
+            case 'i':
+                rebuilt += "lld";
+                AppendFormatted(out, rebuilt.c_str(),
+                                static_cast<long long>(as_int));
+                break;
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X': {
+                uint64_t v = arg.tag == BinaryArgTag::kInt
+                                 ? static_cast<uint64_t>(arg.i)
+                                 : arg.u;
+                // Narrow types print their own width, e.g. %x of -1
+                if (spec.length == LengthModifier::kNone ||
+                    spec.length == LengthModifier::kI32) {
+                    v &= 0xFFFFFFFFull;
+                }
+                rebuilt += "ll";
+                rebuilt += spec.conversion;
+                AppendFormatted(out, rebuilt.c_str(),
+                                static_cast<unsigned long long>(v));
+                break;
+            }
+            case 'c':
+            case 'C':
+                rebuilt += 'c';
+                AppendFormatted(out, rebuilt.c_str(), static_cast<int>(as_int));
+                break;
+            case 's':
+            case 'S':
+                rebuilt += 's';
+                AppendFormatted(out, rebuilt.c_str(), arg.s.c_str());
+                break;
+            case 'p':
+                rebuilt += 'p';
+                AppendFormatted(out, rebuilt.c_str(),
+                                reinterpret_cast<void*>(
+                                    static_cast<uintptr_t>(arg.u)));
+                break;
+            default:
+                rebuilt += spec.conversion;
+                AppendFormatted(out, rebuilt.c_str(), arg.d);
+                break;
+        }
+    }
+    return out;
+}
+
+}  // namespace
+
+bool DecodeBinaryLog(const std::string& path, FILE* out, std::string& error) {
+    std::string text;
+    bool ok = DecodeBinaryLog(path, text, error);
+    fwrite(text.data(), 1, text.size(), out);
+    return ok;
+}
+
+bool DecodeBinaryLog(const std::string& path, std::string& text,
+                     std::string& error) {
+    // Rotated segments may be gzip compressed
+    std::string data;
+    if (!ReadLogFile(path, data, error)) {
+        return false;
+    }
+
+    if (data.size() < sizeof(kBinaryLogMagic) ||
+        memcmp(data.data(), kBinaryLogMagic, sizeof(kBinaryLogMagic)) != 0) {
+        error = path + " is not a binary tinylog file";
+        return false;
+    }
+
+    std::map<uint32_t, SiteDefinition> sites;
+    uint32_t pid = 0;
+    int32_t bias_minutes = 0;
+
+    size_t offset = sizeof(kBinaryLogMagic);
+    while (offset + kBinaryRecordHeaderSize <= data.size()) {
+        uint8_t type = static_cast<uint8_t>(data[offset]);
+        if (type == 0) {
+            break;  // Preallocated tail of a mapped segment after a crash
+        }
+        uint32_t payload = 0;
+        memcpy(&payload, data.data() + offset + 1, sizeof(payload));
+        if (offset + kBinaryRecordHeaderSize + payload > data.size()) {
+            error = path + ": truncated record at offset " +
+                    std::to_string(offset);
+            return false;
+        }
+
+        RecordReader rr(data.data() + offset + kBinaryRecordHeaderSize,
+                        payload);
+        offset += kBinaryRecordHeaderSize + payload;
+
+        switch (static_cast<BinaryRecordType>(type)) {
+            case BinaryRecordType::kSession:
+                pid = rr.U32();
+                bias_minutes = static_cast<int32_t>(rr.U32());
+                sites.clear();
+                break;
+
+            case BinaryRecordType::kSite: {
+                uint32_t id = rr.U32();
+                SiteDefinition def;
+                def.line = rr.U32();
+                def.file = rr.Str(rr.U16());
+                def.func = rr.Str(rr.U16());
+                def.format = rr.Str(rr.U16());
+                if (rr.Ok()) {
+                    sites[id] = def;
+                }
+                break;
+            }
+
+            case BinaryRecordType::kEvent: {
+                uint32_t id = rr.U32();
+                uint8_t level = rr.U8();
+                uint32_t tid = rr.U32();
+                uint32_t idx = rr.U32();
+                uint64_t filetime = rr.U64();
+
+                std::vector<DecodedArg> args;
+                while (rr.Ok() && !rr.AtEnd()) {
+                    DecodedArg arg = {};
+                    arg.tag = static_cast<BinaryArgTag>(rr.U8());
+                    switch (arg.tag) {
+                        case BinaryArgTag::kInt:
+                            arg.i = static_cast<int64_t>(rr.U64());
+                            break;
+                        case BinaryArgTag::kUInt:
+                        case BinaryArgTag::kPointer:
+                            arg.u = rr.U64();
+                            break;
+                        case BinaryArgTag::kDouble:
+                            rr.Bytes(&arg.d, sizeof(arg.d));
+                            break;
+                        case BinaryArgTag::kString:
+                            arg.s = rr.Str(rr.U32());
+                            break;
+                        default:
+                            error = path + ": unknown argument tag";
+                            return false;
+                    }
+                    args.push_back(arg);
+                }
+
+                std::string line =
+                    RenderHeader(pid, tid, idx, filetime, bias_minutes, level);
+                auto it = sites.find(id);
+                if (it != sites.end()) {
+                    line += RenderMessage(it->second.format, args);
+                } else {
+                    line += "<undefined call site " + std::to_string(id) + ">";
+                }
+                line += '\n';
+                text += line;
+                break;
+            }
+
+            case BinaryRecordType::kText: {
+                uint8_t level = rr.U8();
+                uint32_t tid = rr.U32();
+                uint32_t idx = rr.U32();
+                uint64_t filetime = rr.U64();
+                std::string text = rr.Str(rr.Remaining());
+
+                std::string line =
+                    RenderHeader(pid, tid, idx, filetime, bias_minutes, level);
+                line += text;
+                if (text.empty() || text.back() != '\n') {
+                    line += '\n';
+                }
+                text += line;
+                break;
+            }
+
+            default:
+                // Unknown record types are skipped, newer writers may add them
+                break;
+        }
+    }
+
+    return true;
+}
+
+}  // namespace tinylog
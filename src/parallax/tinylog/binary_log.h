@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Binary tinylog format: records carry a call-site id plus the raw argument
+// values, formatting is deferred to the offline decoder
+// ('parallax logs decode').
+//
+// Segment layout (little endian):
+//   "TLOGBIN1"                                   file magic
+//   { u8 type, u32 payload_len, payload }...     records
+//
+// Record payloads:
+//   kSession: u32 pid, i32 utc_bias_minutes
+//   kSite:    u32 site_id, u32 line, str file, str func, str format
+//   kEvent:   u32 site_id, u8 level, u32 tid, u32 idx, u64 filetime, args
+//   kText:    u8 level, u32 tid, u32 idx, u64 filetime, text
+// str is u16 length + bytes, every arg is u8 tag + value.
+//
+// Site ids are only valid within a session. The file writer emits a session
+// record at the start of each segment and for every process that appends to
+// it, and repeats site definitions the first time a site shows up in a
+// segment, so every segment decodes on its own.
+
+namespace tinylog {
+
+class RotatingFile;
+
+enum class BinaryRecordType : uint8_t {
+    kSession = 1,
+    kSite = 2,
+    kEvent = 3,
+    kText = 4
+};
+
+enum class BinaryArgTag : uint8_t {
+    kInt = 1,     // i64
+    kUInt = 2,    // u64
+    kDouble = 3,  // f64
+    kString = 4,  // u32 length + bytes
+    kPointer = 5  // u64
+};
+
+static const char kBinaryLogMagic[8] = {'T', 'L', 'O', 'G',
+                                        'B', 'I', 'N', '1'};
+static const size_t kBinaryRecordHeaderSize = 5;
+
+// Bytes a text record needs besides the text
+static const size_t kBinaryTextOverhead = kBinaryRecordHeaderSize + 17;
+
+// Encode one log call into buffer, returns record length or 0 on failure.
+// String arguments are cut to fit, *truncated (if given) receives how many
+// more bytes the buffer needs to keep them whole (0 if nothing was cut).
+size_t EncodeBinaryEvent(char* buffer, size_t size, int priority,
+                         unsigned int idx, const char* file, int line,
+                         const char* func, const char* format, va_list va,
+                         size_t* truncated = nullptr);
+
+// Encode an already formatted message (used for tinylog's own notices)
+size_t EncodeBinaryText(char* buffer, size_t size, int priority,
+                        unsigned int idx, const char* text, size_t len);
+
+/**
+ * @brief Writes encoded binary records to a rotating file
+ *
+ * Injects the session record and call-site definitions each segment needs
+ * before the events that reference them. Not thread safe, callers serialize
+ * access (same lock as the underlying file).
+ */
+class BinaryLogWriter {
+ public:
+    explicit BinaryLogWriter(RotatingFile& file);
+
+    // data holds one or more complete records
+    void Write(const char* data, size_t len);
+
+    // Crash handlers only: like Write through RotatingFile::CrashWrite,
+    // without rotating or allocating
+    void CrashWrite(const char* data, size_t len);
+
+ private:
+    void WriteRecords(const char* data, size_t len, bool crash);
+    void StartSegment(bool crash);
+    void DefineSite(uint32_t site_id, bool crash);
+    void Put(const char* data, size_t len, bool crash);
+
+    RotatingFile& file_;
+    uint64_t generation_;
+    std::vector<bool> defined_sites_;
+};
+
+// Render a binary log segment as text lines, returns false on malformed input
+bool DecodeBinaryLog(const std::string& path, FILE* out, std::string& error);
+
+// Same, appending the lines to text (records decoded before an error are
+// kept)
+bool DecodeBinaryLog(const std::string& path, std::string& text,
+                     std::string& error);
+
+}  // namespace tinylog
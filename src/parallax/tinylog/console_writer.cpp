@@ -0,0 +1,280 @@
+#include "console_writer.h"
+#include "platform.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_WIN32) && !defined(ENABLE_VIRTUAL_TERMINAL_PROCESSING)
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
+#endif
+
+namespace tinylog {
+
+namespace {
+
+const size_t kBatchBytes = 64 * 1024;   // Max bytes moved out per pop
+const size_t kOutputBytes = 64 * 1024;  // Write once this much is rendered
+const int kFlushDelayMs = 15;           // Collect lines before writing
+const int kIdleWaitMs = 100;
+
+// Entry: u8 priority, u32 text length, text
+const size_t kEntryHeaderSize = 1 + sizeof(uint32_t);
+
+#ifdef _WIN32
+const WORD kDefaultAttributes =
+    FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+
+// Same colors as the former per-line SetConsoleTextAttribute calls
+WORD LevelAttributes(int priority) {
+    switch (priority) {
+        case 0:  // CRIT - red background
+            return FOREGROUND_RED | FOREGROUND_INTENSITY | BACKGROUND_RED;
+        case 1:  // ERROR - red
+            return FOREGROUND_RED | FOREGROUND_INTENSITY;
+        case 2:  // WARN - yellow
+            return FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY;
+        case 4:  // DEBUG - bright white
+            return FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE |
+                   FOREGROUND_INTENSITY;
+        default:  // INFO - white
+            return kDefaultAttributes;
+    }
+}
+#endif
+
+// ANSI equivalent, nullptr keeps the default color
+const char* LevelSequence(int priority) {
+    switch (priority) {
+        case 0:
+            return "\x1b[91;41m";
+        case 1:
+            return "\x1b[91m";
+        case 2:
+            return "\x1b[93m";
+        case 4:
+            return "\x1b[97m";
+        default:
+            return nullptr;
+    }
+}
+
+}  // namespace
+
+ConsoleWriter::ConsoleWriter()
+    : running_(false),
+      mode_(Mode::kPlain),
+      handle_(nullptr),
+      out_priority_(3),
+      reported_drops_(0) {}
+
+ConsoleWriter::~ConsoleWriter() { Stop(); }
+
+void ConsoleWriter::DetectMode() {
+#ifdef _WIN32
+    HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE);
+    handle_ = handle;
+
+    DWORD mode = 0;
+    if (handle == nullptr || handle == INVALID_HANDLE_VALUE ||
+        !GetConsoleMode(handle, &mode)) {
+        mode_ = Mode::kPlain;
+    } else if ((mode & ENABLE_VIRTUAL_TERMINAL_PROCESSING) ||
+               SetConsoleMode(handle,
+                              mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING)) {
+        mode_ = Mode::kVirtualTerminal;
+    } else {
+        mode_ = Mode::kAttributes;  // Before Windows 10
+    }
+#else
+    // ANSI colors on a terminal, none for redirected output
+    handle_ = stdout;
+    mode_ = isatty(fileno(stdout)) ? Mode::kVirtualTerminal : Mode::kPlain;
+#endif
+}
+
+void ConsoleWriter::Start(size_t queue_size) {
+    Stop();
+
+    std::lock_guard<std::mutex> lock(direct_mutex_);
+    DetectMode();
+    out_.clear();
+    reported_drops_ = 0;
+
+    // A slow console must never hold up the logging threads
+    queue_.Open(queue_size, OverflowPolicy::kDropNewest);
+    thread_ = std::thread(&ConsoleWriter::WriterProc, this);
+    running_ = true;
+}
+
+void ConsoleWriter::Stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    queue_.Close();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void ConsoleWriter::Write(int priority, const char* text, size_t len) {
+    if (running_.load(std::memory_order_relaxed)) {
+        char stack_entry[4096 + kEntryHeaderSize];
+        std::string heap_entry;
+        char* entry = stack_entry;
+        if (len + kEntryHeaderSize > sizeof(stack_entry)) {
+            heap_entry.resize(len + kEntryHeaderSize);
+            entry = &heap_entry[0];
+        }
+
+        uint32_t text_len = static_cast<uint32_t>(len);
+        entry[0] = static_cast<char>(priority);
+        memcpy(entry + 1, &text_len, sizeof(text_len));
+        memcpy(entry + kEntryHeaderSize, text, len);
+
+        // Dropped lines are counted by the queue and reported by the writer,
+        // a line larger than the queue is written below after the queued ones
+        PushResult result = queue_.Push(entry, len + kEntryHeaderSize);
+        if (result == PushResult::kTooLarge) {
+            queue_.WaitDrained();
+        } else if (result != PushResult::kClosed) {
+            return;
+        }
+    }
+
+    // Not started or stopping, write synchronously. Rendered into a local
+    // buffer, the writer thread may still be draining.
+    std::lock_guard<std::mutex> lock(direct_mutex_);
+    if (handle_ == nullptr) {
+        DetectMode();
+    }
+    std::string line;
+    RenderLine(line, priority, text, len);
+    WriteText(line, priority);
+}
+
+void ConsoleWriter::Flush() {
+    if (running_) {
+        queue_.WaitDrained();
+    }
+}
+
+void ConsoleWriter::WriterProc() {
+    std::string batch;
+    batch.reserve(kBatchBytes);
+
+    while (true) {
+        batch.clear();
+        if (queue_.PopBatch(batch, kBatchBytes, kIdleWaitMs) == 0) {
+            if (queue_.IsFinished()) {
+                break;
+            }
+            continue;
+        }
+        Render(batch);
+
+        // Coalesce: keep collecting for a short while so that a burst of
+        // lines costs one write and one flush
+        uint64_t deadline = TickMs() + kFlushDelayMs;
+        while (out_.size() < kOutputBytes) {
+            uint64_t now = TickMs();
+            if (now >= deadline) {
+                break;
+            }
+            batch.clear();
+            if (queue_.PopBatch(batch, kBatchBytes,
+                                static_cast<int>(deadline - now)) == 0) {
+                break;
+            }
+            Render(batch);
+        }
+
+        uint64_t drops = queue_.GetDroppedCount();
+        if (drops != reported_drops_) {
+            char notice[96];
+            int len = snprintf(notice, sizeof(notice),
+                               "tinylog: %llu console lines dropped\n",
+                               (unsigned long long)(drops - reported_drops_));
+            Append(2, notice, len);
+            reported_drops_ = drops;
+        }
+
+        WriteOut();
+        queue_.Commit();
+    }
+}
+
+void ConsoleWriter::Render(const std::string& batch) {
+    size_t offset = 0;
+    while (offset + kEntryHeaderSize <= batch.size()) {
+        int priority = static_cast<unsigned char>(batch[offset]);
+        uint32_t len = 0;
+        memcpy(&len, batch.data() + offset + 1, sizeof(len));
+        offset += kEntryHeaderSize;
+        Append(priority, batch.data() + offset, len);
+        offset += len;
+    }
+}
+
+void ConsoleWriter::Append(int priority, const char* text, size_t len) {
+#ifdef _WIN32
+    // Legacy consoles: one attribute change per run of same colored lines
+    if (mode_ == Mode::kAttributes && !out_.empty() &&
+        LevelAttributes(priority) != LevelAttributes(out_priority_)) {
+        WriteOut();
+    }
+#endif
+    out_priority_ = priority;
+    RenderLine(out_, priority, text, len);
+}
+
+void ConsoleWriter::WriteOut() {
+    WriteText(out_, out_priority_);
+    out_.clear();
+}
+
+void ConsoleWriter::RenderLine(std::string& out, int priority,
+                               const char* text, size_t len) const {
+    const char* sequence =
+        mode_ == Mode::kVirtualTerminal ? LevelSequence(priority) : nullptr;
+    if (!sequence) {
+        out.append(text, len);
+        return;
+    }
+
+    // Reset before the newline so that a background color does not fill the
+    // next line
+    size_t body = (len > 0 && text[len - 1] == '\n') ? len - 1 : len;
+    out.append(sequence);
+    out.append(text, body);
+    out.append("\x1b[0m");
+    out.append(text + body, len - body);
+}
+
+void ConsoleWriter::WriteText(const std::string& text, int priority) {
+    if (text.empty()) {
+        return;
+    }
+
+#ifdef _WIN32
+    bool attributes = mode_ == Mode::kAttributes &&
+                      LevelAttributes(priority) != kDefaultAttributes;
+    if (attributes) {
+        SetConsoleTextAttribute(handle_, LevelAttributes(priority));
+    }
+#else
+    (void)priority;
+#endif
+    fwrite(text.data(), 1, text.size(), stdout);
+    fflush(stdout);
+#ifdef _WIN32
+    if (attributes) {
+        SetConsoleTextAttribute(handle_, kDefaultAttributes);
+    }
+#endif
+}
+
+}  // namespace tinylog
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "log_queue.h"
+
+// Console output of tinylog, written by a dedicated thread
+
+namespace tinylog {
+
+/**
+ * @brief Colored console output decoupled from the logging threads
+ *
+ * Lines are queued without blocking (dropped when the queue is full) and
+ * written by a writer thread in batches: one write and one flush per batch,
+ * collected for up to kFlushDelayMs. Colors use ANSI sequences when the
+ * console supports virtual terminal processing; legacy consoles fall back to
+ * SetConsoleTextAttribute per run of same level lines, redirected output is
+ * written without colors.
+ *
+ * Before Start() and after Stop() lines are written synchronously.
+ */
+class ConsoleWriter {
+ public:
+    ConsoleWriter();
+    ~ConsoleWriter();
+
+    void Start(size_t queue_size);
+
+    // Write queued lines and stop the writer thread
+    void Stop();
+
+    // Queue one line (text ends with a newline)
+    void Write(int priority, const char* text, size_t len);
+
+    // Block until queued lines have been written
+    void Flush();
+
+ private:
+    enum class Mode {
+        kPlain,            // Not a console (file, pipe), no colors
+        kVirtualTerminal,  // ANSI color sequences
+        kAttributes        // Legacy console, SetConsoleTextAttribute
+    };
+
+    void DetectMode();
+    void WriterProc();
+
+    // Render queued entries into out_
+    void Render(const std::string& batch);
+
+    // Add one line to out_, writes out_ first when the color of a legacy
+    // console has to change
+    void Append(int priority, const char* text, size_t len);
+    void WriteOut();
+
+    // Render one line for the current mode / write rendered text in the
+    // color of priority (attribute mode only)
+    void RenderLine(std::string& out, int priority, const char* text,
+                    size_t len) const;
+    void WriteText(const std::string& text, int priority);
+
+    LogQueue queue_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::mutex direct_mutex_;  // Serializes synchronous writes
+
+    Mode mode_;
+    void* handle_;  // Console output handle
+
+    // Writer thread state
+    std::string out_;   // Rendered text not yet written
+    int out_priority_;  // Level of the current run (attribute mode)
+    uint64_t reported_drops_;
+};
+
+}  // namespace tinylog
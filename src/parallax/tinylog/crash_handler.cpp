@@ -0,0 +1,88 @@
+#include "tinylog.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <signal.h>
+#include <string.h>
+#include <atomic>
+
+// Fatal exception and signal hooks that write out buffered tinylog records
+// before the process dies (tinylog_crash_flush)
+
+// Async-signal-safe "prefix<number>" rendering
+static void format_reason(char* buffer, size_t size, const char* prefix,
+                          unsigned long value, bool hex) {
+    size_t len = strlen(prefix);
+    if (len >= size) len = size - 1;
+    memcpy(buffer, prefix, len);
+
+    char digits[24];
+    int n = 0;
+    unsigned int base = hex ? 16 : 10;
+    do {
+        digits[n++] = "0123456789ABCDEF"[value % base];
+        value /= base;
+    } while (value > 0 && n < (int)sizeof(digits));
+    if (hex) {
+        while (n < 8) digits[n++] = '0';
+    }
+
+    while (n > 0 && len + 1 < size) {
+        buffer[len++] = digits[--n];
+    }
+    buffer[len] = '\0';
+}
+
+#ifdef _WIN32
+static LPTOP_LEVEL_EXCEPTION_FILTER g_previous_filter = nullptr;
+
+static LONG WINAPI crash_exception_filter(EXCEPTION_POINTERS* info) {
+    char reason[64];
+    unsigned long code =
+        (info && info->ExceptionRecord) ? info->ExceptionRecord->ExceptionCode
+                                        : 0;
+    format_reason(reason, sizeof(reason), "fatal exception 0x", code, true);
+    tinylog_crash_flush(reason);
+
+    // Let the previous filter / Windows Error Reporting handle the crash
+    return g_previous_filter ? g_previous_filter(info)
+                             : EXCEPTION_CONTINUE_SEARCH;
+}
+#endif
+
+static void crash_signal_handler(int sig) {
+    char reason[64];
+    format_reason(reason, sizeof(reason), "fatal signal ", (unsigned long)sig,
+                 false);
+    tinylog_crash_flush(reason);
+
+    // Default action terminates the process (and writes a core dump)
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+// Install crash hooks, later calls do nothing
+void tinylog_install_crash_handler() {
+    static std::atomic<bool> installed{false};
+    if (installed.exchange(true)) {
+        return;
+    }
+
+#ifdef _WIN32
+    g_previous_filter = SetUnhandledExceptionFilter(crash_exception_filter);
+
+    // abort() and std::terminate do not reach the exception filter
+    signal(SIGABRT, crash_signal_handler);
+#else
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = crash_signal_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESETHAND;
+
+    const int signals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+    for (int sig : signals) {
+        sigaction(sig, &action, nullptr);
+    }
+#endif
+}
@@ -0,0 +1,208 @@
+#include "flight_recorder.h"
+#include <string.h>
+#include <algorithm>
+
+namespace tinylog {
+
+// Ring entry: the text, then this trailer. Entries are found by walking
+// back from the newest one, which needs no boundary at the ring start.
+struct FlightEntryTrailer {
+    uint64_t sequence;
+    uint32_t len;
+    int32_t priority;
+};
+
+struct FlightRecorder::ThreadRing {
+    std::vector<char> data;
+    uint64_t head = 0;  // Owner's write position, bytes since creation
+
+    // The owner announces the end of the entry it is about to write in
+    // reserved and moves published past it when done. Readers copy the ring
+    // between loading published and reserved; bytes more than one ring
+    // length behind reserved may have been overwritten meanwhile.
+    std::atomic<uint64_t> reserved{0};
+    std::atomic<uint64_t> published{0};
+
+    uint64_t dumped = 0;  // Entries ending at or below were dumped (mutex_)
+
+    void CopyIn(uint64_t pos, const void* src, size_t len) {
+        size_t offset = static_cast<size_t>(pos % data.size());
+        size_t first = std::min(len, data.size() - offset);
+        memcpy(&data[offset], src, first);
+        if (len > first) {
+            memcpy(&data[0], static_cast<const char*>(src) + first,
+                   len - first);
+        }
+    }
+};
+
+// Retires the ring when the thread exits
+struct ThreadRingHolder {
+    FlightRecorder* recorder = nullptr;
+    FlightRecorder::ThreadRing* ring = nullptr;
+
+    ~ThreadRingHolder() {
+        if (recorder && ring) {
+            recorder->Retire(ring);
+        }
+    }
+};
+
+static thread_local ThreadRingHolder t_ring_holder;
+
+// Copy len bytes at ring position pos out of a snapshot of the ring
+static void CopyOut(const std::vector<char>& snapshot, uint64_t pos,
+                    void* dst, size_t len) {
+    size_t offset = static_cast<size_t>(pos % snapshot.size());
+    size_t first = std::min(len, snapshot.size() - offset);
+    memcpy(dst, &snapshot[offset], first);
+    if (len > first) {
+        memcpy(static_cast<char*>(dst) + first, &snapshot[0], len - first);
+    }
+}
+
+FlightRecorder::FlightRecorder() : capacity_(0), sequence_(0) {}
+
+FlightRecorder::~FlightRecorder() {
+    // Threads still running keep their ring pointer, leave the rings alone
+    // like StagingArea does with its buffers
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (ThreadRing* ring : retired_) {
+        delete ring;
+    }
+    retired_.clear();
+}
+
+void FlightRecorder::SetCapacity(size_t bytes) {
+    capacity_.store(bytes, std::memory_order_relaxed);
+    if (bytes == 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (ThreadRing* ring : retired_) {
+            delete ring;
+        }
+        retired_.clear();
+    }
+}
+
+FlightRecorder::ThreadRing* FlightRecorder::GetThreadRing(size_t capacity) {
+    ThreadRing* ring = t_ring_holder.ring;
+    if (ring && ring->data.size() == capacity) {
+        return ring;
+    }
+
+    // First record of the thread, or the size was changed
+    if (ring) {
+        Retire(ring);
+    }
+    ring = new ThreadRing();
+    ring->data.resize(capacity);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.push_back(ring);
+    }
+    t_ring_holder.recorder = this;
+    t_ring_holder.ring = ring;
+    return ring;
+}
+
+void FlightRecorder::Retire(ThreadRing* ring) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rings_.erase(std::remove(rings_.begin(), rings_.end(), ring),
+                 rings_.end());
+
+    if (ring->published.load(std::memory_order_relaxed) <= ring->dumped ||
+        capacity_.load(std::memory_order_relaxed) == 0) {
+        delete ring;  // Nothing left to dump
+        return;
+    }
+    retired_.push_back(ring);
+    if (retired_.size() > kMaxRetiredRings) {
+        delete retired_.front();
+        retired_.erase(retired_.begin());
+    }
+}
+
+void FlightRecorder::Record(int priority, const char* text, size_t len) {
+    size_t capacity = capacity_.load(std::memory_order_relaxed);
+    const size_t need = len + sizeof(FlightEntryTrailer);
+    if (capacity == 0 || need > capacity / 4) {
+        return;  // Disabled, or a record that would flush most of the ring
+    }
+    ThreadRing* ring = GetThreadRing(capacity);
+
+    FlightEntryTrailer trailer;
+    trailer.sequence = sequence_.fetch_add(1, std::memory_order_relaxed);
+    trailer.len = static_cast<uint32_t>(len);
+    trailer.priority = priority;
+
+    // Announce the overwrite before touching the bytes (seqlock writer)
+    uint64_t pos = ring->head;
+    ring->reserved.store(pos + need, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    ring->CopyIn(pos, text, len);
+    ring->CopyIn(pos + len, &trailer, sizeof(trailer));
+    ring->head = pos + need;
+    ring->published.store(ring->head, std::memory_order_release);
+}
+
+size_t FlightRecorder::Dump(std::vector<FlightRecord>& out) {
+    size_t first = out.size();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (ThreadRing* ring : retired_) {
+            ReadRing(ring, out);
+        }
+        for (ThreadRing* ring : rings_) {
+            ReadRing(ring, out);
+        }
+    }
+
+    std::stable_sort(out.begin() + first, out.end(),
+                     [](const FlightRecord& a, const FlightRecord& b) {
+                         return a.sequence < b.sequence;
+                     });
+    return out.size() - first;
+}
+
+void FlightRecorder::ReadRing(ThreadRing* ring,
+                              std::vector<FlightRecord>& out) {
+    uint64_t end = ring->published.load(std::memory_order_acquire);
+    if (end <= ring->dumped) {
+        return;
+    }
+
+    // The owner may be writing while the ring is copied
+    std::vector<char> snapshot(ring->data);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t reserved = ring->reserved.load(std::memory_order_relaxed);
+
+    const uint64_t capacity = snapshot.size();
+    uint64_t lower = reserved > capacity ? reserved - capacity : 0;
+    lower = std::max(lower, ring->dumped);
+
+    // Walk back from the newest entry until one starts below the intact
+    // part of the snapshot
+    size_t first = out.size();
+    uint64_t pos = end;
+    while (pos >= lower + sizeof(FlightEntryTrailer)) {
+        FlightEntryTrailer trailer;
+        CopyOut(snapshot, pos - sizeof(trailer), &trailer, sizeof(trailer));
+        uint64_t entry_len = sizeof(trailer) + trailer.len;
+        if (pos < lower + entry_len) {
+            break;
+        }
+        pos -= entry_len;
+
+        FlightRecord record;
+        record.sequence = trailer.sequence;
+        record.priority = trailer.priority;
+        record.text.resize(trailer.len);
+        CopyOut(snapshot, pos, &record.text[0], trailer.len);
+        out.push_back(std::move(record));
+    }
+    std::reverse(out.begin() + first, out.end());
+    ring->dumped = end;
+}
+
+}  // namespace tinylog
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// In-memory flight recorder for records below the written log level
+
+namespace tinylog {
+
+// A record taken out of the flight recorder
+struct FlightRecord {
+    uint64_t sequence;  // Order across threads
+    int priority;
+    std::string text;  // Rendered line including header and newline
+};
+
+/**
+ * @brief Keeps the most recent records of every thread in memory until
+ *        something goes wrong
+ *
+ * Each thread appends to a byte ring it owns, without locks or shared
+ * writes apart from a global sequence number; the oldest records are
+ * overwritten. Dump() copies the rings of all threads while their owners
+ * keep writing and discards whatever was overwritten during the copy, so
+ * records are never blocked by a dump. Records already dumped are not
+ * returned again.
+ *
+ * Memory is bounded by the ring size times the number of live threads plus
+ * kMaxRetiredRings, the rings of threads that have exited are kept for the
+ * next dump (a failed child process reader, for example). A process has a
+ * single recorder, the rings are tied to it through thread local storage.
+ */
+class FlightRecorder {
+ public:
+    FlightRecorder();
+    ~FlightRecorder();
+
+    // Ring size per thread, 0 disables recording and frees the retired
+    // rings. Threads switch to the new size with their next record.
+    void SetCapacity(size_t bytes);
+    size_t GetCapacity() const {
+        return capacity_.load(std::memory_order_relaxed);
+    }
+
+    // Append a rendered record to the calling thread's ring
+    void Record(int priority, const char* text, size_t len);
+
+    // Take the records not dumped before from all rings, oldest first.
+    // Returns the number of records appended to out.
+    size_t Dump(std::vector<FlightRecord>& out);
+
+    // Rings of exited threads kept for the next dump
+    static const size_t kMaxRetiredRings = 8;
+
+ private:
+    struct ThreadRing;
+    friend struct ThreadRingHolder;
+
+    ThreadRing* GetThreadRing(size_t capacity);
+    void Retire(ThreadRing* ring);
+    void ReadRing(ThreadRing* ring, std::vector<FlightRecord>& out);
+
+    std::atomic<size_t> capacity_;
+    std::atomic<uint64_t> sequence_;  // Orders records across threads
+
+    std::mutex mutex_;                   // Protects the ring lists
+    std::vector<ThreadRing*> rings_;     // Rings of live threads
+    std::vector<ThreadRing*> retired_;   // Oldest first
+};
+
+}  // namespace tinylog
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+// Compile time validation of tinylog format strings against the argument
+// types of the log call. Used by the log macros in tinylog.h, format strings
+// have to be string literals.
+
+namespace tinylog {
+
+enum class FormatArgClass {
+    kInteger,
+    kFloat,
+    kLongDouble,
+    kString,
+    kWideString,
+    kPointer,
+    kOther  // Class types etc., never valid for printf
+};
+
+struct FormatArgType {
+    FormatArgClass cls;
+    size_t size;  // Integer size after default argument promotion
+};
+
+enum class FormatCheckResult {
+    kOk,
+    kTooFewArgs,
+    kTooManyArgs,
+    kTypeMismatch,
+    kBadConversion
+};
+
+template <typename T>
+constexpr FormatArgType ClassifyFormatArg() {
+    using U = typename std::remove_cv<typename std::decay<T>::type>::type;
+
+    if (std::is_integral<U>::value || std::is_enum<U>::value) {
+        return {FormatArgClass::kInteger,
+                sizeof(U) < sizeof(int) ? sizeof(int) : sizeof(U)};
+    }
+    if (std::is_same<U, long double>::value) {
+        return {FormatArgClass::kLongDouble, sizeof(U)};
+    }
+    if (std::is_floating_point<U>::value) {
+        return {FormatArgClass::kFloat, sizeof(double)};
+    }
+    if (std::is_pointer<U>::value) {
+        using P = typename std::remove_cv<
+            typename std::remove_pointer<U>::type>::type;
+        if (std::is_same<P, char>::value ||
+            std::is_same<P, signed char>::value ||
+            std::is_same<P, unsigned char>::value) {
+            return {FormatArgClass::kString, sizeof(U)};
+        }
+        if (std::is_same<P, wchar_t>::value) {
+            return {FormatArgClass::kWideString, sizeof(U)};
+        }
+        return {FormatArgClass::kPointer, sizeof(U)};
+    }
+    if (std::is_null_pointer<U>::value) {
+        return {FormatArgClass::kPointer, sizeof(void*)};
+    }
+    return {FormatArgClass::kOther, sizeof(U)};
+}
+
+// Walk the format like printf does and compare every conversion with the
+// next argument. args holds count entries.
+constexpr FormatCheckResult CheckFormat(const char* format,
+                                        const FormatArgType* args,
+                                        size_t count) {
+    size_t next = 0;
+    const char* p = format;
+
+    while (*p) {
+        if (*p++ != '%') {
+            continue;
+        }
+        if (*p == '%') {
+            p++;
+            continue;
+        }
+
+        // Flags
+        while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' ||
+               *p == '0' || *p == '\'') {
+            p++;
+        }
+
+        // Width and precision, '*' takes an int argument
+        for (int part = 0; part < 2; part++) {
+            if (part == 1) {
+                if (*p != '.') break;
+                p++;
+            }
+            if (*p == '*') {
+                p++;
+                if (next >= count) return FormatCheckResult::kTooFewArgs;
+                if (args[next].cls != FormatArgClass::kInteger ||
+                    args[next].size != sizeof(int)) {
+                    return FormatCheckResult::kTypeMismatch;
+                }
+                next++;
+            } else {
+                while (*p >= '0' && *p <= '9') p++;
+            }
+        }
+
+        // Length modifier, expected integer size
+        size_t int_size = sizeof(int);
+        bool wide = false;
+        bool long_double = false;
+        switch (*p) {
+            case 'h':
+                p++;
+                if (*p == 'h') p++;
+                break;
+            case 'l':
+                p++;
+                if (*p == 'l') {
+                    p++;
+                    int_size = sizeof(long long);
+                } else {
+                    int_size = sizeof(long);
+                    wide = true;
+                }
+                break;
+            case 'L':
+                p++;
+                long_double = true;
+                break;
+            case 'z':
+                p++;
+                int_size = sizeof(size_t);
+                break;
+            case 'j':
+                p++;
+                int_size = sizeof(intmax_t);
+                break;
+            case 't':
+                p++;
+                int_size = sizeof(ptrdiff_t);
+                break;
+            case 'w':
+                p++;
+                wide = true;
+                break;
+            case 'I':
+                p++;
+                if (p[0] == '6' && p[1] == '4') {
+                    p += 2;
+                    int_size = 8;
+                } else if (p[0] == '3' && p[1] == '2') {
+                    p += 2;
+                    int_size = 4;
+                } else {
+                    int_size = sizeof(size_t);
+                }
+                break;
+            default:
+                break;
+        }
+
+        char conversion = *p;
+        if (!conversion) return FormatCheckResult::kBadConversion;
+        p++;
+
+        if (next >= count) return FormatCheckResult::kTooFewArgs;
+        const FormatArgType& arg = args[next++];
+
+        bool match = false;
+        switch (conversion) {
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                match = arg.cls == FormatArgClass::kInteger &&
+                        arg.size == int_size;
+                break;
+            case 'c':
+            case 'C':
+                match = arg.cls == FormatArgClass::kInteger &&
+                        arg.size == sizeof(int);
+                break;
+            case 's':
+                match = arg.cls == (wide ? FormatArgClass::kWideString
+                                         : FormatArgClass::kString);
+                break;
+            case 'S':
+                match = arg.cls == FormatArgClass::kWideString;
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                match = arg.cls == (long_double ? FormatArgClass::kLongDouble
+                                                : FormatArgClass::kFloat);
+                break;
+            case 'p':
+                match = arg.cls == FormatArgClass::kPointer ||
+                        arg.cls == FormatArgClass::kString ||
+                        arg.cls == FormatArgClass::kWideString;
+                break;
+            default:
+                // %n and unknown conversions are rejected
+                return FormatCheckResult::kBadConversion;
+        }
+
+        if (!match) return FormatCheckResult::kTypeMismatch;
+    }
+
+    return next == count ? FormatCheckResult::kOk
+                         : FormatCheckResult::kTooManyArgs;
+}
+
+// Fails the build if the arguments do not match the format
+template <typename Format, typename... Args>
+constexpr bool ValidateFormat() {
+    // Trailing entry keeps the array non-empty for calls without arguments
+    constexpr FormatArgType types[] = {ClassifyFormatArg<Args>()...,
+                                       {FormatArgClass::kOther, 0}};
+    constexpr FormatCheckResult result =
+        CheckFormat(Format::Get(), types, sizeof...(Args));
+
+    static_assert(result != FormatCheckResult::kTooFewArgs,
+                  "tinylog: format string expects more arguments");
+    static_assert(result != FormatCheckResult::kTooManyArgs,
+                  "tinylog: too many arguments for format string");
+    static_assert(result != FormatCheckResult::kTypeMismatch,
+                  "tinylog: argument type does not match format string");
+    static_assert(result != FormatCheckResult::kBadConversion,
+                  "tinylog: unsupported conversion in format string");
+    return result == FormatCheckResult::kOk;
+}
+
+}  // namespace tinylog
+
+// Wrap a string literal into a unique type so that it can be inspected at
+// compile time, Get() returns the literal
+#define TINYLOG_FORMAT_STRING(format)                           \
+    [] {                                                        \
+        struct TinylogFormat {                                  \
+            static constexpr const char* Get() { return format; } \
+        };                                                      \
+        return TinylogFormat();                                 \
+    }()
@@ -0,0 +1,869 @@
+#include "gzip_stream.h"
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+namespace tinylog {
+
+namespace {
+
+const size_t kWindowSize = 32768;
+const size_t kWindowMask = kWindowSize - 1;
+const int kMinMatch = 3;
+const int kMaxMatch = 258;
+const size_t kLookahead = kMaxMatch + kMinMatch + 1;
+const int kHashBits = 15;
+const size_t kHashSize = 1 << kHashBits;
+const int kMaxChain = 64;
+const size_t kMaxTokens = 16384;
+const size_t kOutputChunk = 64 * 1024;
+
+const int kLitLenCodes = 286;
+const int kDistCodes = 30;
+const int kCodeLenCodes = 19;
+const int kMaxBits = 15;
+const int kMaxCodeLenBits = 7;
+
+const uint16_t kLengthBase[29] = {3,  4,  5,  6,   7,   8,   9,   10,  11, 13,
+                                  15, 17, 19, 23,  27,  31,  35,  43,  51, 59,
+                                  67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                  1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                  4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t kDistBase[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const uint8_t kDistExtra[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Order in which code length code lengths are stored
+const uint8_t kCodeLenOrder[kCodeLenCodes] = {16, 17, 18, 0, 8,  7, 9,
+                                              6,  10, 5,  11, 4, 12, 3,
+                                              13, 2,  14, 1,  15};
+
+uint32_t g_crc_table[256];
+bool g_crc_table_ready = false;
+
+void InitCrcTable() {
+    if (g_crc_table_ready) return;
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        g_crc_table[n] = c;
+    }
+    g_crc_table_ready = true;
+}
+
+// Table is built on first use; identical on every thread, so a concurrent
+// first use only writes the same values twice
+uint32_t UpdateCrc(uint32_t crc, const uint8_t* data, size_t len) {
+    InitCrcTable();
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = g_crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+int LengthCode(int len) {
+    int code = 28;
+    while (kLengthBase[code] > len) code--;
+    return code;
+}
+
+int DistCode(int dist) {
+    int code = 29;
+    while (kDistBase[code] > dist) code--;
+    return code;
+}
+
+// Huffman code lengths for freq, limited to max_bits. At least two symbols
+// get a code so that every decoder accepts the table.
+void BuildLengths(const uint32_t* freq_in, int n, int max_bits,
+                  uint8_t* lengths) {
+    std::vector<uint64_t> freq(freq_in, freq_in + n);
+    int used = 0;
+    for (int i = 0; i < n; i++) {
+        if (freq[i]) used++;
+    }
+    for (int i = 0; i < n && used < 2; i++) {
+        if (!freq[i]) {
+            freq[i] = 1;
+            used++;
+        }
+    }
+
+    while (true) {
+        typedef std::pair<uint64_t, int> Node;
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+        std::vector<int> parent(2 * n, -1);
+        for (int i = 0; i < n; i++) {
+            if (freq[i]) queue.push(Node(freq[i], i));
+        }
+
+        int next = n;
+        while (queue.size() > 1) {
+            Node a = queue.top();
+            queue.pop();
+            Node b = queue.top();
+            queue.pop();
+            parent[a.second] = next;
+            parent[b.second] = next;
+            queue.push(Node(a.first + b.first, next));
+            next++;
+        }
+
+        int longest = 0;
+        for (int i = 0; i < n; i++) {
+            int depth = 0;
+            if (freq[i]) {
+                for (int p = parent[i]; p >= 0; p = parent[p]) depth++;
+            }
+            lengths[i] = static_cast<uint8_t>(depth);
+            longest = std::max(longest, depth);
+        }
+        if (longest <= max_bits) {
+            return;
+        }
+
+        // Flatten the distribution and try again
+        for (int i = 0; i < n; i++) {
+            if (freq[i]) freq[i] = (freq[i] >> 1) | 1;
+        }
+    }
+}
+
+// Canonical codes, bit reversed because DEFLATE writes them MSB first into
+// an LSB first bit stream
+void MakeCodes(const uint8_t* lengths, int n, uint16_t* codes) {
+    int bl_count[kMaxBits + 1] = {0};
+    for (int i = 0; i < n; i++) bl_count[lengths[i]]++;
+    bl_count[0] = 0;
+
+    int next_code[kMaxBits + 1] = {0};
+    int code = 0;
+    for (int bits = 1; bits <= kMaxBits; bits++) {
+        code = (code + bl_count[bits - 1]) << 1;
+        next_code[bits] = code;
+    }
+
+    for (int i = 0; i < n; i++) {
+        int len = lengths[i];
+        if (len == 0) {
+            codes[i] = 0;
+            continue;
+        }
+        int c = next_code[len]++;
+        int reversed = 0;
+        for (int b = 0; b < len; b++) {
+            reversed = (reversed << 1) | (c & 1);
+            c >>= 1;
+        }
+        codes[i] = static_cast<uint16_t>(reversed);
+    }
+}
+
+}  // namespace
+
+// GzipWriter implementation
+GzipWriter::GzipWriter()
+    : file_(nullptr),
+      output_(nullptr),
+      ok_(false),
+      fill_(0),
+      pos_(0),
+      bit_buffer_(0),
+      bit_count_(0),
+      crc_(0),
+      size_(0) {}
+
+GzipWriter::~GzipWriter() {
+    if (file_) {
+        fclose(file_);
+    }
+}
+
+bool GzipWriter::Open(const std::string& path) {
+    file_ = fopen(path.c_str(), "wb");
+    if (!file_) {
+        return false;
+    }
+    Start();
+    return true;
+}
+
+bool GzipWriter::Open(std::string* output) {
+    if (!output) {
+        return false;
+    }
+    output_ = output;
+    Start();
+    return true;
+}
+
+void GzipWriter::Start() {
+    ok_ = true;
+    window_.assign(2 * kWindowSize, 0);
+    head_.assign(kHashSize, -1);
+    prev_.assign(kWindowSize, -1);
+    tokens_.clear();
+    tokens_.reserve(kMaxTokens);
+    bit_buffer_ = 0;
+    bit_count_ = 0;
+    fill_ = 0;
+    pos_ = 0;
+    crc_ = 0;
+    size_ = 0;
+
+    // Header: magic, deflate, no flags, no mtime, unknown OS
+    static const uint8_t header[10] = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 255};
+    out_.assign(reinterpret_cast<const char*>(header), sizeof(header));
+}
+
+bool GzipWriter::Write(const char* data, size_t len) {
+    if (!file_ && !output_) return false;
+
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(data);
+    crc_ = UpdateCrc(crc_, src, len);
+    size_ += static_cast<uint32_t>(len);
+
+    while (len > 0) {
+        if (fill_ == window_.size()) {
+            SlideWindow();
+        }
+        size_t n = std::min(len, window_.size() - fill_);
+        memcpy(&window_[fill_], src, n);
+        fill_ += n;
+        src += n;
+        len -= n;
+        Compress(false);
+    }
+    return ok_;
+}
+
+bool GzipWriter::Close() {
+    if (!file_ && !output_) return false;
+
+    Compress(true);
+    FlushBlock(true);
+    AlignToByte();
+    for (int i = 0; i < 4; i++) PutBits((crc_ >> (8 * i)) & 0xFF, 8);
+    for (int i = 0; i < 4; i++) PutBits((size_ >> (8 * i)) & 0xFF, 8);
+    FlushOutput(true);
+
+    if (output_) {
+        output_ = nullptr;
+        return ok_;
+    }
+    if (fclose(file_) != 0) {
+        ok_ = false;
+    }
+    file_ = nullptr;
+    return ok_;
+}
+
+void GzipWriter::Compress(bool flush) {
+    while (true) {
+        size_t avail = fill_ - pos_;
+        if (avail == 0 || (!flush && avail < kLookahead)) {
+            break;
+        }
+
+        int dist = 0;
+        int len = avail >= (size_t)kMinMatch ? LongestMatch(pos_, avail, &dist)
+                                             : 0;
+        if (avail >= (size_t)kMinMatch) {
+            InsertHash(pos_);
+        }
+
+        // Lazy matching: prefer a longer match starting at the next byte
+        if (len > 0 && len < kMaxMatch && avail > (size_t)len) {
+            int next_dist = 0;
+            int next_len = LongestMatch(pos_ + 1, avail - 1, &next_dist);
+            if (next_len > len) {
+                len = 0;
+            }
+        }
+
+        if (len > 0) {
+            tokens_.push_back(
+                {static_cast<uint16_t>(len), static_cast<uint16_t>(dist)});
+            for (size_t q = pos_ + 1; q < pos_ + len; q++) {
+                if (q + 2 < fill_) InsertHash(q);
+            }
+            pos_ += len;
+        } else {
+            tokens_.push_back({window_[pos_], 0});
+            pos_++;
+        }
+
+        if (tokens_.size() >= kMaxTokens) {
+            FlushBlock(false);
+        }
+    }
+}
+
+int GzipWriter::LongestMatch(size_t pos, size_t avail, int* dist) {
+    if (avail < (size_t)kMinMatch) return 0;
+    int max_len = static_cast<int>(std::min<size_t>(kMaxMatch, avail));
+
+    const uint8_t* w = window_.data();
+    size_t hash =
+        ((w[pos] << 10) ^ (w[pos + 1] << 5) ^ w[pos + 2]) & (kHashSize - 1);
+    int32_t candidate = head_[hash];
+
+    int best = kMinMatch - 1;
+    int chain = kMaxChain;
+    const uint8_t* a = w + pos;
+    while (candidate >= 0 && chain-- > 0) {
+        size_t d = pos - candidate;
+        if (d == 0 || d > kWindowSize) break;
+
+        const uint8_t* b = w + candidate;
+        if (b[best] == a[best] && b[0] == a[0] && b[1] == a[1]) {
+            int len = 0;
+            while (len < max_len && a[len] == b[len]) len++;
+            if (len > best) {
+                best = len;
+                *dist = static_cast<int>(d);
+                if (len >= max_len) break;
+            }
+        }
+
+        // Entries older than the window may have been reused, chains must
+        // always move backwards
+        int32_t next = prev_[candidate & kWindowMask];
+        if (next >= candidate) break;
+        candidate = next;
+    }
+    return best >= kMinMatch ? best : 0;
+}
+
+void GzipWriter::InsertHash(size_t pos) {
+    const uint8_t* w = window_.data();
+    size_t hash =
+        ((w[pos] << 10) ^ (w[pos + 1] << 5) ^ w[pos + 2]) & (kHashSize - 1);
+    prev_[pos & kWindowMask] = head_[hash];
+    head_[hash] = static_cast<int32_t>(pos);
+}
+
+void GzipWriter::SlideWindow() {
+    // Compress() always leaves less than kLookahead bytes behind pos_, so
+    // the lower half has been fully processed
+    memmove(&window_[0], &window_[kWindowSize], fill_ - kWindowSize);
+    fill_ -= kWindowSize;
+    pos_ -= kWindowSize;
+
+    const int32_t shift = static_cast<int32_t>(kWindowSize);
+    for (auto& v : head_) v = v >= shift ? v - shift : -1;
+    for (auto& v : prev_) v = v >= shift ? v - shift : -1;
+}
+
+void GzipWriter::FlushBlock(bool final) {
+    uint32_t lit_freq[kLitLenCodes] = {0};
+    uint32_t dist_freq[kDistCodes] = {0};
+    for (const Token& t : tokens_) {
+        if (t.dist == 0) {
+            lit_freq[t.litlen]++;
+        } else {
+            lit_freq[257 + LengthCode(t.litlen)]++;
+            dist_freq[DistCode(t.dist)]++;
+        }
+    }
+    lit_freq[256] = 1;  // End of block
+
+    uint8_t lit_len[kLitLenCodes];
+    uint8_t dist_len[kDistCodes];
+    BuildLengths(lit_freq, kLitLenCodes, kMaxBits, lit_len);
+    BuildLengths(dist_freq, kDistCodes, kMaxBits, dist_len);
+
+    int hlit = kLitLenCodes;
+    while (hlit > 257 && lit_len[hlit - 1] == 0) hlit--;
+    int hdist = kDistCodes;
+    while (hdist > 1 && dist_len[hdist - 1] == 0) hdist--;
+
+    // Run length encode the code lengths of both tables
+    std::vector<uint8_t> lens(lit_len, lit_len + hlit);
+    lens.insert(lens.end(), dist_len, dist_len + hdist);
+
+    struct CodeLenSymbol {
+        uint8_t symbol;
+        uint8_t extra;
+        uint8_t extra_bits;
+    };
+    std::vector<CodeLenSymbol> symbols;
+    for (size_t i = 0; i < lens.size();) {
+        uint8_t cur = lens[i];
+        size_t run = 1;
+        while (i + run < lens.size() && lens[i + run] == cur) run++;
+        i += run;
+
+        if (cur == 0) {
+            while (run >= 11) {
+                size_t n = std::min<size_t>(run, 138);
+                symbols.push_back({18, static_cast<uint8_t>(n - 11), 7});
+                run -= n;
+            }
+            if (run >= 3) {
+                symbols.push_back({17, static_cast<uint8_t>(run - 3), 3});
+                run = 0;
+            }
+        } else {
+            symbols.push_back({cur, 0, 0});
+            run--;
+            while (run >= 3) {
+                size_t n = std::min<size_t>(run, 6);
+                symbols.push_back({16, static_cast<uint8_t>(n - 3), 2});
+                run -= n;
+            }
+        }
+        while (run > 0) {
+            symbols.push_back({cur, 0, 0});
+            run--;
+        }
+    }
+
+    uint32_t cl_freq[kCodeLenCodes] = {0};
+    for (const auto& s : symbols) cl_freq[s.symbol]++;
+    uint8_t cl_len[kCodeLenCodes];
+    BuildLengths(cl_freq, kCodeLenCodes, kMaxCodeLenBits, cl_len);
+
+    int hclen = kCodeLenCodes;
+    while (hclen > 4 && cl_len[kCodeLenOrder[hclen - 1]] == 0) hclen--;
+
+    uint16_t lit_code[kLitLenCodes];
+    uint16_t dist_code[kDistCodes];
+    uint16_t cl_code[kCodeLenCodes];
+    MakeCodes(lit_len, kLitLenCodes, lit_code);
+    MakeCodes(dist_len, kDistCodes, dist_code);
+    MakeCodes(cl_len, kCodeLenCodes, cl_code);
+
+    // Block header, dynamic Huffman
+    PutBits(final ? 1 : 0, 1);
+    PutBits(2, 2);
+    PutBits(hlit - 257, 5);
+    PutBits(hdist - 1, 5);
+    PutBits(hclen - 4, 4);
+    for (int i = 0; i < hclen; i++) {
+        PutBits(cl_len[kCodeLenOrder[i]], 3);
+    }
+    for (const auto& s : symbols) {
+        PutBits(cl_code[s.symbol], cl_len[s.symbol]);
+        if (s.extra_bits) PutBits(s.extra, s.extra_bits);
+    }
+
+    // Data
+    for (const Token& t : tokens_) {
+        if (t.dist == 0) {
+            PutBits(lit_code[t.litlen], lit_len[t.litlen]);
+            continue;
+        }
+        int lc = LengthCode(t.litlen);
+        PutBits(lit_code[257 + lc], lit_len[257 + lc]);
+        if (kLengthExtra[lc]) {
+            PutBits(t.litlen - kLengthBase[lc], kLengthExtra[lc]);
+        }
+        int dc = DistCode(t.dist);
+        PutBits(dist_code[dc], dist_len[dc]);
+        if (kDistExtra[dc]) {
+            PutBits(t.dist - kDistBase[dc], kDistExtra[dc]);
+        }
+    }
+    PutBits(lit_code[256], lit_len[256]);
+
+    tokens_.clear();
+    FlushOutput(false);
+}
+
+void GzipWriter::PutBits(uint32_t value, int count) {
+    bit_buffer_ |= static_cast<uint64_t>(value) << bit_count_;
+    bit_count_ += count;
+    while (bit_count_ >= 8) {
+        out_.push_back(static_cast<char>(bit_buffer_ & 0xFF));
+        bit_buffer_ >>= 8;
+        bit_count_ -= 8;
+    }
+}
+
+void GzipWriter::AlignToByte() {
+    if (bit_count_ > 0) {
+        PutBits(0, 8 - bit_count_);
+    }
+}
+
+void GzipWriter::FlushOutput(bool force) {
+    if (out_.empty() || (!force && out_.size() < kOutputChunk)) {
+        return;
+    }
+    if (output_) {
+        output_->append(out_);
+    } else if (fwrite(out_.data(), 1, out_.size(), file_) != out_.size()) {
+        ok_ = false;
+    }
+    out_.clear();
+}
+
+bool GzipFile(const std::string& src, const std::string& dst,
+              const std::atomic<bool>* cancel) {
+    FILE* in = fopen(src.c_str(), "rb");
+    if (!in) {
+        return false;
+    }
+
+    GzipWriter writer;
+    bool ok = writer.Open(dst);
+    std::vector<char> chunk(64 * 1024);
+    size_t n;
+    while (ok && (n = fread(chunk.data(), 1, chunk.size(), in)) > 0) {
+        ok = writer.Write(chunk.data(), n);
+        if (cancel && cancel->load(std::memory_order_relaxed)) {
+            ok = false;
+        }
+    }
+    if (ferror(in)) {
+        ok = false;
+    }
+    fclose(in);
+
+    return writer.Close() && ok;
+}
+
+bool GzipData(GzipWriter& writer, const char* data, size_t len,
+              std::string& out) {
+    if (!writer.Open(&out)) {
+        return false;
+    }
+    bool ok = writer.Write(data, len);
+    return writer.Close() && ok;
+}
+
+// Decompression
+namespace {
+
+class BitReader {
+ public:
+    BitReader(const uint8_t* data, size_t size, size_t pos)
+        : data_(data), size_(size), pos_(pos), bits_(0), count_(0),
+          error_(false) {}
+
+    int Bits(int need) {
+        uint32_t value = bits_;
+        while (count_ < need) {
+            if (pos_ >= size_) {
+                error_ = true;
+                return 0;
+            }
+            value |= static_cast<uint32_t>(data_[pos_++]) << count_;
+            count_ += 8;
+        }
+        bits_ = value >> need;
+        count_ -= need;
+        return static_cast<int>(value & ((1u << need) - 1));
+    }
+
+    void AlignToByte() {
+        bits_ = 0;
+        count_ = 0;
+    }
+
+    size_t pos() const { return pos_; }
+    void set_pos(size_t pos) { pos_ = pos; }
+    size_t size() const { return size_; }
+    const uint8_t* data() const { return data_; }
+    bool error() const { return error_ || pos_ > size_; }
+
+ private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_;
+    uint32_t bits_;
+    int count_;
+    bool error_;
+};
+
+struct Huffman {
+    uint16_t count[kMaxBits + 1];
+    uint16_t symbol[288];
+
+    // Returns false for over subscribed code lengths
+    bool Build(const uint8_t* lengths, int n) {
+        memset(count, 0, sizeof(count));
+        for (int i = 0; i < n; i++) count[lengths[i]]++;
+        if (count[0] == n) return true;
+
+        int left = 1;
+        for (int len = 1; len <= kMaxBits; len++) {
+            left <<= 1;
+            left -= count[len];
+            if (left < 0) return false;
+        }
+
+        uint16_t offsets[kMaxBits + 1];
+        offsets[1] = 0;
+        for (int len = 1; len < kMaxBits; len++) {
+            offsets[len + 1] =
+                static_cast<uint16_t>(offsets[len] + count[len]);
+        }
+        for (int i = 0; i < n; i++) {
+            if (lengths[i]) {
+                symbol[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+            }
+        }
+        return true;
+    }
+
+    // Canonical decoding one bit at a time, returns -1 on error
+    int Decode(BitReader& in) const {
+        int code = 0, first = 0, index = 0;
+        for (int len = 1; len <= kMaxBits; len++) {
+            code |= in.Bits(1);
+            int n = count[len];
+            if (code - n < first) {
+                return symbol[index + (code - first)];
+            }
+            index += n;
+            first += n;
+            first <<= 1;
+            code <<= 1;
+            if (in.error()) return -1;
+        }
+        return -1;
+    }
+};
+
+bool InflateCodes(BitReader& in, const Huffman& lencode,
+                  const Huffman& distcode, std::string& out,
+                  size_t member_start) {
+    while (true) {
+        int symbol = lencode.Decode(in);
+        if (symbol < 0 || in.error()) return false;
+        if (symbol < 256) {
+            out.push_back(static_cast<char>(symbol));
+            continue;
+        }
+        if (symbol == 256) return true;
+
+        symbol -= 257;
+        if (symbol >= 29) return false;
+        int len = kLengthBase[symbol] + in.Bits(kLengthExtra[symbol]);
+
+        int dsym = distcode.Decode(in);
+        if (dsym < 0 || dsym >= 30) return false;
+        size_t dist = kDistBase[dsym] + in.Bits(kDistExtra[dsym]);
+        if (in.error() || dist > out.size() - member_start) return false;
+
+        size_t from = out.size() - dist;
+        for (int i = 0; i < len; i++) {
+            out.push_back(out[from + i]);
+        }
+    }
+}
+
+bool InflateDynamic(BitReader& in, std::string& out, size_t member_start) {
+    int nlen = in.Bits(5) + 257;
+    int ndist = in.Bits(5) + 1;
+    int ncode = in.Bits(4) + 4;
+    if (nlen > kLitLenCodes || ndist > kDistCodes) return false;
+
+    uint8_t lengths[kLitLenCodes + kDistCodes] = {0};
+    for (int i = 0; i < ncode; i++) {
+        lengths[kCodeLenOrder[i]] = static_cast<uint8_t>(in.Bits(3));
+    }
+    Huffman clcode;
+    if (!clcode.Build(lengths, kCodeLenCodes)) return false;
+
+    memset(lengths, 0, sizeof(lengths));
+    int index = 0;
+    while (index < nlen + ndist) {
+        int symbol = clcode.Decode(in);
+        if (symbol < 0 || in.error()) return false;
+        if (symbol < 16) {
+            lengths[index++] = static_cast<uint8_t>(symbol);
+            continue;
+        }
+
+        uint8_t value = 0;
+        int repeat;
+        if (symbol == 16) {
+            if (index == 0) return false;
+            value = lengths[index - 1];
+            repeat = 3 + in.Bits(2);
+        } else if (symbol == 17) {
+            repeat = 3 + in.Bits(3);
+        } else {
+            repeat = 11 + in.Bits(7);
+        }
+        if (index + repeat > nlen + ndist) return false;
+        while (repeat--) lengths[index++] = value;
+    }
+
+    Huffman lencode, distcode;
+    if (!lencode.Build(lengths, nlen) ||
+        !distcode.Build(lengths + nlen, ndist)) {
+        return false;
+    }
+    return InflateCodes(in, lencode, distcode, out, member_start);
+}
+
+bool InflateFixed(BitReader& in, std::string& out, size_t member_start) {
+    struct FixedCodes {
+        Huffman lencode;
+        Huffman distcode;
+        FixedCodes() {
+            uint8_t lengths[288];
+            int i = 0;
+            for (; i < 144; i++) lengths[i] = 8;
+            for (; i < 256; i++) lengths[i] = 9;
+            for (; i < 280; i++) lengths[i] = 7;
+            for (; i < 288; i++) lengths[i] = 8;
+            lencode.Build(lengths, 288);
+            for (i = 0; i < 30; i++) lengths[i] = 5;
+            distcode.Build(lengths, 30);
+        }
+    };
+    static const FixedCodes fixed;
+    return InflateCodes(in, fixed.lencode, fixed.distcode, out, member_start);
+}
+
+bool InflateStored(BitReader& in, std::string& out) {
+    in.AlignToByte();
+    size_t pos = in.pos();
+    if (pos + 4 > in.size()) return false;
+
+    const uint8_t* d = in.data() + pos;
+    unsigned len = d[0] | (d[1] << 8);
+    unsigned nlen = d[2] | (d[3] << 8);
+    if (len != (~nlen & 0xFFFF) || pos + 4 + len > in.size()) return false;
+
+    out.append(reinterpret_cast<const char*>(d + 4), len);
+    in.set_pos(pos + 4 + len);
+    return true;
+}
+
+}  // namespace
+
+bool IsGzipData(const std::string& data) {
+    return data.size() >= 2 && static_cast<uint8_t>(data[0]) == 0x1F &&
+           static_cast<uint8_t>(data[1]) == 0x8B;
+}
+
+bool GunzipData(const std::string& in, std::string& out, std::string& error) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(in.data());
+    size_t size = in.size();
+    size_t pos = 0;
+    out.clear();
+
+    while (pos < size) {
+        // Member header
+        if (size - pos < 18 || data[pos] != 0x1F || data[pos + 1] != 0x8B ||
+            data[pos + 2] != 8) {
+            error = "not a gzip stream";
+            return false;
+        }
+        uint8_t flags = data[pos + 3];
+        pos += 10;
+        if (flags & 4) {  // FEXTRA
+            if (pos + 2 > size) break;
+            pos += 2 + (data[pos] | (data[pos + 1] << 8));
+        }
+        if (flags & 8) {  // FNAME
+            while (pos < size && data[pos]) pos++;
+            pos++;
+        }
+        if (flags & 16) {  // FCOMMENT
+            while (pos < size && data[pos]) pos++;
+            pos++;
+        }
+        if (flags & 2) {  // FHCRC
+            pos += 2;
+        }
+        if (pos > size) break;
+
+        size_t member_start = out.size();
+        BitReader reader(data, size, pos);
+        bool last = false;
+        while (!last) {
+            last = reader.Bits(1) != 0;
+            int type = reader.Bits(2);
+            bool ok = false;
+            switch (type) {
+                case 0:
+                    ok = InflateStored(reader, out);
+                    break;
+                case 1:
+                    ok = InflateFixed(reader, out, member_start);
+                    break;
+                case 2:
+                    ok = InflateDynamic(reader, out, member_start);
+                    break;
+                default:
+                    break;
+            }
+            if (!ok || reader.error()) {
+                error = "corrupt deflate data";
+                return false;
+            }
+        }
+
+        // Trailer: CRC32 and size of this member. A stream cut right after
+        // the deflate data has no check at all, it must not pass as whole.
+        pos = reader.pos();
+        if (pos + 8 > size) {
+            error = "truncated gzip stream";
+            return false;
+        }
+        uint32_t crc = data[pos] | (data[pos + 1] << 8) |
+                       (data[pos + 2] << 16) |
+                       (static_cast<uint32_t>(data[pos + 3]) << 24);
+        pos += 8;
+
+        uint32_t actual = UpdateCrc(
+            0, reinterpret_cast<const uint8_t*>(out.data()) + member_start,
+            out.size() - member_start);
+        if (crc != actual) {
+            error = "gzip checksum mismatch";
+            return false;
+        }
+    }
+
+    if (pos != size) {
+        error = "truncated gzip stream";
+        return false;
+    }
+    return true;
+}
+
+bool ReadLogFile(const std::string& path, std::string& data,
+                 std::string& error) {
+    FILE* in = fopen(path.c_str(), "rb");
+    if (!in) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    std::string raw;
+    std::vector<char> chunk(64 * 1024);
+    size_t n;
+    while ((n = fread(chunk.data(), 1, chunk.size(), in)) > 0) {
+        raw.append(chunk.data(), n);
+    }
+    fclose(in);
+
+    if (!IsGzipData(raw)) {
+        data.swap(raw);
+        return true;
+    }
+
+    if (!GunzipData(raw, data, error)) {
+        error = path + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace tinylog
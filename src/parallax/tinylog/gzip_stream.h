@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Minimal gzip (RFC 1952 / DEFLATE RFC 1951) codec used to compress rotated
+// tinylog segments. Output is a standard .gz file, readable by any gzip tool.
+
+namespace tinylog {
+
+/**
+ * @brief Streaming gzip compressor
+ *
+ * LZ77 with hash chains over a 32 KB window, one step lazy matching and a
+ * dynamic Huffman block per 16K symbols. Input can be fed in pieces of any
+ * size; memory use is fixed (about 400 KB).
+ */
+class GzipWriter {
+ public:
+    GzipWriter();
+    ~GzipWriter();
+
+    bool Open(const std::string& path);
+
+    // Compress into memory, the stream is appended to output
+    bool Open(std::string* output);
+
+    bool Write(const char* data, size_t len);
+
+    // Finish the stream and close the file, returns false on any I/O error
+    bool Close();
+
+ private:
+    struct Token {
+        uint16_t litlen;  // Literal byte or match length
+        uint16_t dist;    // 0 for literals
+    };
+
+    void Start();
+    void Compress(bool flush);
+    int LongestMatch(size_t pos, size_t avail, int* dist);
+    void InsertHash(size_t pos);
+    void SlideWindow();
+    void FlushBlock(bool final);
+
+    void PutBits(uint32_t value, int count);
+    void AlignToByte();
+    void FlushOutput(bool force);
+
+    FILE* file_;
+    std::string* output_;  // Memory target instead of file_
+    bool ok_;
+
+    std::vector<uint8_t> window_;  // 2 x 32 KB, slid down when full
+    size_t fill_;                  // Valid bytes in window_
+    size_t pos_;                   // Next byte to compress
+    std::vector<int32_t> head_;    // Hash -> last position
+    std::vector<int32_t> prev_;    // Position -> previous with same hash
+
+    std::vector<Token> tokens_;
+
+    uint64_t bit_buffer_;
+    int bit_count_;
+    std::string out_;
+
+    uint32_t crc_;
+    uint32_t size_;  // Input size modulo 2^32
+};
+
+// Compress src into dst (dst is replaced), returns false on failure or when
+// cancel was set while compressing
+bool GzipFile(const std::string& src, const std::string& dst,
+              const std::atomic<bool>* cancel = nullptr);
+
+// Compress data into a gzip stream appended to out, writer is reused so
+// that its buffers are only allocated once
+bool GzipData(GzipWriter& writer, const char* data, size_t len,
+              std::string& out);
+
+// Data starts with the gzip magic bytes
+bool IsGzipData(const std::string& data);
+
+// Decompress a complete gzip stream (concatenated members are joined)
+bool GunzipData(const std::string& in, std::string& out, std::string& error);
+
+// Read a log file, decompressing it if it is gzip compressed
+bool ReadLogFile(const std::string& path, std::string& data,
+                 std::string& error);
+
+}  // namespace tinylog
@@ -0,0 +1,240 @@
+#include "log_forwarder.h"
+#include "platform.h"
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#else
+#include <errno.h>
+#include <netdb.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace tinylog {
+
+#ifdef _WIN32
+// Winsock is started once per process and never cleaned up, the sinks may
+// still be writing during static destruction
+static bool StartWinsock() {
+    static bool started = []() {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    return started;
+}
+#else
+// Writes give up after the send timeout, a closed peer must not raise
+// SIGPIPE where MSG_NOSIGNAL does not exist
+static void ConfigureSocket(int fd) {
+    struct timeval timeout = {CollectorConnection::kSendTimeoutMs / 1000, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+#endif
+
+CollectorConnection::CollectorConnection(const std::string& address)
+    : address_(address),
+#ifdef _WIN32
+      pipe_(INVALID_HANDLE_VALUE),
+      socket_(INVALID_SOCKET),
+#else
+      socket_(-1),
+#endif
+      next_connect_ms_(0) {
+}
+
+CollectorConnection::~CollectorConnection() { Disconnect(); }
+
+bool CollectorConnection::IsConnected() const {
+#ifdef _WIN32
+    return pipe_ != INVALID_HANDLE_VALUE || socket_ != INVALID_SOCKET;
+#else
+    return socket_ >= 0;
+#endif
+}
+
+bool CollectorConnection::Connect() {
+    if (IsConnected()) {
+        return true;
+    }
+
+    // Collector not running, do not retry on every write
+    uint64_t now = TickMs();
+    if (now < next_connect_ms_) {
+        return false;
+    }
+    next_connect_ms_ = now + kReconnectMs;
+
+    // "tcp:host:port", the port is after the last colon
+    if (address_.compare(0, 4, "tcp:") == 0) {
+        size_t colon = address_.rfind(':');
+        if (colon <= 4) {
+            return false;
+        }
+        return ConnectTcp(address_.substr(4, colon - 4),
+                          address_.substr(colon + 1));
+    }
+
+#ifdef _WIN32
+    HANDLE pipe = CreateFileA(address_.c_str(), GENERIC_WRITE, 0, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (pipe == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    pipe_ = pipe;
+#else
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (address_.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    memcpy(addr.sun_path, address_.c_str(), address_.size());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    ConfigureSocket(fd);
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                sizeof(addr)) != 0) {
+        close(fd);
+        return false;
+    }
+    socket_ = fd;
+#endif
+    return true;
+}
+
+bool CollectorConnection::ConnectTcp(const std::string& host,
+                                     const std::string& port) {
+#ifdef _WIN32
+    if (!StartWinsock()) {
+        return false;
+    }
+#endif
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* list = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &list) != 0) {
+        return false;
+    }
+
+    for (struct addrinfo* ai = list; ai; ai = ai->ai_next) {
+#ifdef _WIN32
+        SOCKET fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == INVALID_SOCKET) {
+            continue;
+        }
+        DWORD timeout = kSendTimeoutMs;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO,
+                   reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+        if (connect(fd, ai->ai_addr, static_cast<int>(ai->ai_addrlen)) != 0) {
+            closesocket(fd);
+            continue;
+        }
+#else
+        int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        ConfigureSocket(fd);
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            continue;
+        }
+#endif
+        socket_ = fd;
+        break;
+    }
+    freeaddrinfo(list);
+    return IsConnected();
+}
+
+void CollectorConnection::Disconnect() {
+#ifdef _WIN32
+    if (pipe_ != INVALID_HANDLE_VALUE) {
+        CloseHandle(pipe_);
+        pipe_ = INVALID_HANDLE_VALUE;
+    }
+    if (socket_ != INVALID_SOCKET) {
+        closesocket(socket_);
+        socket_ = INVALID_SOCKET;
+    }
+#else
+    if (socket_ >= 0) {
+        close(socket_);
+        socket_ = -1;
+    }
+#endif
+}
+
+bool CollectorConnection::Send(const char* data, size_t len) {
+    while (len > 0) {
+#ifdef _WIN32
+        DWORD written = 0;
+        if (socket_ != INVALID_SOCKET) {
+            int chunk = len > 1024 * 1024 ? 1024 * 1024 : static_cast<int>(len);
+            int sent = send(socket_, data, chunk, 0);
+            if (sent <= 0) {
+                Disconnect();
+                return false;
+            }
+            written = static_cast<DWORD>(sent);
+        } else if (!WriteFile(pipe_, data, static_cast<DWORD>(len), &written,
+                              nullptr)) {
+            Disconnect();
+            return false;
+        }
+#else
+#ifdef MSG_NOSIGNAL
+        ssize_t written = send(socket_, data, len, MSG_NOSIGNAL);
+#else
+        ssize_t written = send(socket_, data, len, 0);
+#endif
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            Disconnect();
+            return false;
+        }
+#endif
+        data += written;
+        len -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+ForwardSink::ForwardSink(const std::string& address, bool json)
+    : connection_(address), json_(json), closed_(false), dropped_(0) {}
+
+ForwardSink::~ForwardSink() { Close(); }
+
+void ForwardSink::Write(const LogRecord& record) {
+    const char* data = json_ ? record.json : record.text;
+    size_t len = json_ ? record.json_len : record.text_len;
+    if (!data) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_ || !connection_.Connect() || !connection_.Send(data, len)) {
+        dropped_++;
+    }
+}
+
+void ForwardSink::Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    connection_.Disconnect();
+}
+
+}  // namespace tinylog
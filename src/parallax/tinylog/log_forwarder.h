@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include "log_sink.h"
+
+// Sink that forwards tinylog records to a local collector process
+
+namespace tinylog {
+
+/**
+ * @brief Stream connection to a log collector
+ *
+ * The address is "tcp:host:port", or else a pipe name such as
+ * "\\\\.\\pipe\\parallax-log" on Windows and a Unix domain socket path
+ * elsewhere. Connect() is cheap to call before every write: it returns at
+ * once while connected and makes at most one attempt per kReconnectMs
+ * otherwise. Socket writes give up after kSendTimeoutMs. Not thread safe.
+ */
+class CollectorConnection {
+ public:
+    explicit CollectorConnection(const std::string& address);
+    ~CollectorConnection();
+
+    bool Connect();
+    void Disconnect();
+    bool IsConnected() const;
+
+    // Write all of data, disconnects and returns false on error
+    bool Send(const char* data, size_t len);
+
+    const std::string& GetAddress() const { return address_; }
+
+    static const int kReconnectMs = 1000;
+    static const int kSendTimeoutMs = 5000;
+
+ private:
+    bool ConnectTcp(const std::string& host, const std::string& port);
+
+    std::string address_;
+#ifdef _WIN32
+    void* pipe_;
+    uintptr_t socket_;  // SOCKET
+#else
+    int socket_;
+#endif
+    uint64_t next_connect_ms_;  // Earliest time of the next attempt
+};
+
+/**
+ * @brief Streams records to a collector, one write per record
+ *
+ * The connection is opened on the first record and reopened after errors
+ * (see CollectorConnection); records written while there is no connection
+ * are counted and dropped. Writes block while the collector is slow,
+ * register the sink as asynchronous. ShippingSink (log_shipper.h) batches
+ * and spools instead.
+ */
+class ForwardSink : public LogSink {
+ public:
+    // json: send the JSON rendering instead of the text line
+    ForwardSink(const std::string& address, bool json);
+    ~ForwardSink() override;
+
+    void Write(const LogRecord& record) override;
+    void Close() override;
+    unsigned GetNeeds() const override {
+        return json_ ? kSinkNeedsJson : kSinkNeedsText;
+    }
+
+    uint64_t GetDroppedCount() const { return dropped_.load(); }
+
+ private:
+    std::mutex mutex_;
+    CollectorConnection connection_;
+    bool json_;
+    bool closed_;
+    std::atomic<uint64_t> dropped_;
+};
+
+}  // namespace tinylog
@@ -0,0 +1,127 @@
+#include "log_index.h"
+#include "platform.h"
+#include <string.h>
+#include <algorithm>
+
+namespace tinylog {
+
+uint64_t LogTimeNow() {
+    return ToLocalFileTime(FileTimeNow()) / 10000;
+}
+
+uint64_t LogTimeFromCivil(int year, int month, int day, int hour, int minute,
+                          int second, int millis) {
+    // Days since 1970-01-01 of the proleptic Gregorian calendar
+    int y = year - (month <= 2 ? 1 : 0);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int64_t days = static_cast<int64_t>(era) * 146097 + doe - 719468;
+
+    // 1601-01-01 is 134774 days before 1970-01-01
+    int64_t ms = ((days + 134774) * 86400 + hour * 3600 + minute * 60 +
+                  second) * 1000LL +
+                 millis;
+    return ms > 0 ? static_cast<uint64_t>(ms) : 0;
+}
+
+bool ParseLogTime(const char* text, size_t len, uint64_t& time_ms) {
+    // "YYYY-MM-DD HH:MM:SS.mmm", digit positions and separators
+    static const char kPattern[] = "dddd-dd-dd dd:dd:dd.ddd";
+    const size_t kLength = sizeof(kPattern) - 1;
+    if (len < kLength) {
+        return false;
+    }
+    for (size_t i = 0; i < kLength; i++) {
+        if (kPattern[i] == 'd' ? (text[i] < '0' || text[i] > '9')
+                               : text[i] != kPattern[i]) {
+            return false;
+        }
+    }
+
+    auto number = [&](size_t pos, size_t digits) {
+        int value = 0;
+        for (size_t i = 0; i < digits; i++) {
+            value = value * 10 + (text[pos + i] - '0');
+        }
+        return value;
+    };
+    time_ms = LogTimeFromCivil(number(0, 4), number(5, 2), number(8, 2),
+                               number(11, 2), number(14, 2), number(17, 2),
+                               number(20, 3));
+    return true;
+}
+
+LogIndexWriter::LogIndexWriter() : file_(nullptr) {}
+
+LogIndexWriter::~LogIndexWriter() { Close(); }
+
+bool LogIndexWriter::Open(const std::string& path, bool append) {
+    Close();
+
+    file_ = fopen(path.c_str(), append ? "ab" : "wb");
+    if (!file_) {
+        return false;
+    }
+
+    // Unbuffered, entries are rare and readers should see them right away
+    setvbuf(file_, nullptr, _IONBF, 0);
+    if (fseek(file_, 0, SEEK_END) == 0 && ftell(file_) == 0) {
+        fwrite(kLogIndexMagic, 1, sizeof(kLogIndexMagic), file_);
+    }
+    return true;
+}
+
+void LogIndexWriter::Close() {
+    if (file_) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+void LogIndexWriter::Add(uint64_t time_ms, uint64_t offset) {
+    if (!file_) return;
+
+    LogIndexEntry entry = {time_ms, offset};
+    fwrite(&entry, sizeof(entry), 1, file_);
+}
+
+bool ReadLogIndex(const std::string& path,
+                  std::vector<LogIndexEntry>& entries) {
+    entries.clear();
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    char magic[sizeof(kLogIndexMagic)];
+    bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+              memcmp(magic, kLogIndexMagic, sizeof(magic)) == 0;
+    if (ok) {
+        LogIndexEntry entry;
+        while (fread(&entry, sizeof(entry), 1, file) == 1) {
+            entries.push_back(entry);
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+uint64_t FindLogIndexOffset(const std::vector<LogIndexEntry>& entries,
+                            uint64_t time_ms) {
+    // Records before an entry are no newer than its time, so the last entry
+    // stamped strictly before time_ms is a safe start
+    auto it = std::lower_bound(
+        entries.begin(), entries.end(), time_ms,
+        [](const LogIndexEntry& entry, uint64_t time) {
+            return entry.time_ms < time;
+        });
+    if (it == entries.begin()) {
+        return 0;
+    }
+    return (it - 1)->offset;
+}
+
+}  // namespace tinylog
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Sidecar time index of tinylog segments, "<segment>.idx" next to every
+// active and rotated segment (the index of a .gz segment stays uncompressed)
+
+namespace tinylog {
+
+// File layout: magic, then LogIndexEntry records in write order
+static const char kLogIndexMagic[8] = {'T', 'L', 'O', 'G',
+                                       'I', 'D', 'X', '1'};
+
+struct LogIndexEntry {
+    uint64_t time_ms;  // Local time (ms since 1601) the bytes at offset were
+                       // written, no earlier record is newer than this
+    uint64_t offset;   // Record boundary in the uncompressed segment
+};
+
+// Local time in ms since 1601, the clock of the record headers
+uint64_t LogTimeNow();
+
+// Local calendar time to ms since 1601, no range checks
+uint64_t LogTimeFromCivil(int year, int month, int day, int hour, int minute,
+                          int second, int millis);
+
+// Parse the "YYYY-MM-DD HH:MM:SS.mmm" timestamp of a record header
+bool ParseLogTime(const char* text, size_t len, uint64_t& time_ms);
+
+/**
+ * @brief Appends entries to the index of one segment
+ *
+ * Entries are unbuffered (one per interval of log data), so a reader always
+ * sees the index up to the last write.
+ */
+class LogIndexWriter {
+ public:
+    LogIndexWriter();
+    ~LogIndexWriter();
+
+    // append=false starts a new index (new segment)
+    bool Open(const std::string& path, bool append);
+    void Close();
+    bool IsOpen() const { return file_ != nullptr; }
+
+    void Add(uint64_t time_ms, uint64_t offset);
+
+ private:
+    FILE* file_;
+};
+
+// Read an index file, false if it is missing or not an index
+bool ReadLogIndex(const std::string& path,
+                  std::vector<LogIndexEntry>& entries);
+
+// Offset to start reading a segment at for records stamped time_ms or later:
+// every record before it is older. Binary search, 0 if nothing can be skipped.
+uint64_t FindLogIndexOffset(const std::vector<LogIndexEntry>& entries,
+                            uint64_t time_ms);
+
+}  // namespace tinylog
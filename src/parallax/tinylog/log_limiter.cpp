@@ -0,0 +1,116 @@
+#include "log_limiter.h"
+#include "platform.h"
+#include "tinylog.h"
+
+namespace tinylog {
+
+static const uint64_t kSummaryWindowMs = 1000;
+
+std::atomic<LogLimiter*> LogLimiter::s_head_{nullptr};
+
+LogLimiter::LogLimiter(const LogLimit& limit)
+    : limit_(limit),
+      tokens_(limit.burst),
+      last_refill_(TickMs()),
+      calls_(0),
+      suppressed_(0),
+      window_start_(0),
+      priority_(0),
+      format_(""),
+      next_(s_head_.load()) {
+    // Call site statics are never destroyed before exit, keep them listed
+    while (!s_head_.compare_exchange_weak(next_, this)) {
+    }
+}
+
+bool LogLimiter::Admit(int priority, const char* format) {
+    bool admit = true;
+    uint64_t summary = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t now = TickMs();
+        priority_ = priority;
+        format_ = format;
+
+        summary = TakeSummary(now, false);
+
+        if (limit_.sample_every > 0) {
+            admit = (calls_++ % limit_.sample_every) == 0;
+        }
+
+        if (admit && limit_.rate > 0) {
+            tokens_ += (now - last_refill_) * limit_.rate / 1000.0;
+            if (tokens_ > limit_.burst) {
+                tokens_ = limit_.burst;
+            }
+            last_refill_ = now;
+
+            if (tokens_ >= 1.0) {
+                tokens_ -= 1.0;
+            } else {
+                admit = false;
+            }
+        }
+
+        if (!admit) {
+            if (suppressed_ == 0) {
+                window_start_ = now;
+            }
+            suppressed_++;
+        }
+    }
+
+    if (summary > 0) {
+        WriteSummary(priority, format, summary, limit_.sample_every);
+    }
+    return admit;
+}
+
+void LogLimiter::ReportAll() {
+    for (LogLimiter* limiter = s_head_.load(); limiter;
+         limiter = limiter->next_) {
+        uint64_t summary = 0;
+        int priority = 0;
+        const char* format = "";
+        {
+            std::lock_guard<std::mutex> lock(limiter->mutex_);
+            summary = limiter->TakeSummary(TickMs(), true);
+            priority = limiter->priority_;
+            format = limiter->format_;
+        }
+
+        if (summary > 0) {
+            WriteSummary(priority, format, summary,
+                         limiter->limit_.sample_every);
+        }
+    }
+}
+
+uint64_t LogLimiter::TakeSummary(uint64_t now, bool force) {
+    if (suppressed_ == 0 ||
+        (!force && now - window_start_ < kSummaryWindowMs)) {
+        return 0;
+    }
+
+    uint64_t suppressed = suppressed_;
+    suppressed_ = 0;
+    return suppressed;
+}
+
+void LogLimiter::WriteSummary(int priority, const char* format,
+                              uint64_t suppressed, unsigned int sample_every) {
+    if (sample_every > 0) {
+        sys_log(0, priority, "", 0, "",
+                "tinylog: suppressed %llu messages (sampling 1 in %u) like "
+                "\"%.60s\"",
+                static_cast<unsigned long long>(suppressed), sample_every,
+                format);
+    } else {
+        sys_log(0, priority, "", 0, "",
+                "tinylog: suppressed %llu messages (rate limit) like "
+                "\"%.60s\"",
+                static_cast<unsigned long long>(suppressed), format);
+    }
+}
+
+}  // namespace tinylog
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+// Per call site rate limiting and sampling for the *_log_limited and
+// *_log_sampled macros in tinylog.h
+
+namespace tinylog {
+
+struct LogLimit {
+    double rate;                // Token refill, records per second (0 = off)
+    double burst;               // Bucket size, records admitted at once
+    unsigned int sample_every;  // Admit 1 in N calls (0 = off)
+};
+
+// Token bucket: up to burst records at once, refilled at rate per second
+constexpr LogLimit RateLimit(double rate, double burst) {
+    return {rate, burst, 0};
+}
+
+// Deterministic 1-in-N sampling
+constexpr LogLimit SampleEvery(unsigned int n) { return {0, 0, n}; }
+
+/**
+ * @brief Admission state of one log call site
+ *
+ * One static instance per call site, created by the macros. Calls that are
+ * not admitted are counted; the count is written as a summary record at
+ * the same level once the suppression window (1 s) has closed, either on
+ * the next call of the site or when tinylog shuts down.
+ */
+class LogLimiter {
+ public:
+    explicit LogLimiter(const LogLimit& limit);
+
+    // Decide whether the record may be written, emits the pending summary
+    bool Admit(int priority, const char* format);
+
+    // Emit summaries of every site with suppressed records (tinylog_uninit)
+    static void ReportAll();
+
+ private:
+    uint64_t TakeSummary(uint64_t now, bool force);
+    static void WriteSummary(int priority, const char* format,
+                             uint64_t suppressed, unsigned int sample_every);
+
+    const LogLimit limit_;
+
+    std::mutex mutex_;
+    double tokens_;
+    uint64_t last_refill_;   // TickMs() of the last refill
+    uint64_t calls_;         // Calls seen, for sampling
+    uint64_t suppressed_;    // Suppressed in the current window
+    uint64_t window_start_;  // First suppression of the current window
+    int priority_;           // Level and format of the last call, reused by
+    const char* format_;     // ReportAll()
+
+    LogLimiter* next_;  // Intrusive list of all limiters
+    static std::atomic<LogLimiter*> s_head_;
+};
+
+}  // namespace tinylog
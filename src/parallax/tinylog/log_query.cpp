@@ -0,0 +1,597 @@
+#include "log_query.h"
+#include "binary_log.h"
+#include "gzip_stream.h"
+#include "mapped_segment.h"
+#include "platform.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <string_view>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+#endif
+
+namespace tinylog {
+
+namespace {
+
+const char* const kLevelNames[] = {"CRIT", "ERROR", "WARN", "INFO", "DEBUG"};
+
+// Records reach the file up to this long after their timestamp (staging and
+// queue delay), a record this far past --until ends the query
+const uint64_t kUntilSlackMs = 60 * 1000;
+
+// Mapped segments change without file notifications, poll them this often
+const int kFollowPollMs = 250;
+
+const uint64_t kDayMs = 24 * 60 * 60 * 1000ULL;
+
+// "[pid-tid:idx] YYYY-MM-DD HH:MM:SS.mmm [LEVEL] - message"
+bool ParseRecordHeader(const char* line, size_t len, uint64_t& time_ms,
+                       int& level) {
+    if (len < 2 || line[0] != '[') {
+        return false;
+    }
+    const char* end = line + len;
+    const char* close =
+        static_cast<const char*>(memchr(line, ']', len < 48 ? len : 48));
+    if (!close || end - close < 2 || close[1] != ' ') {
+        return false;
+    }
+
+    const char* p = close + 2;
+    if (!ParseLogTime(p, static_cast<size_t>(end - p), time_ms)) {
+        return false;
+    }
+    p += 23;
+
+    // Unknown level names are treated as most severe
+    level = 0;
+    if (end - p > 2 && p[0] == ' ' && p[1] == '[') {
+        p += 2;
+        const char* name_end = static_cast<const char*>(
+            memchr(p, ']', static_cast<size_t>(end - p)));
+        if (name_end) {
+            std::string_view name(p, static_cast<size_t>(name_end - p));
+            for (int i = 0; i < 5; i++) {
+                if (name == kLevelNames[i]) {
+                    level = i;
+                    break;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// "HH:MM[:SS[.mmm]]", advances text past it
+bool ParseTimeOfDay(const char*& text, int& hour, int& minute, int& second,
+                    int& millis) {
+    int consumed = 0;
+    if (sscanf(text, "%2d:%2d%n", &hour, &minute, &consumed) != 2) {
+        return false;
+    }
+    const char* p = text + consumed;
+    if (p[0] == ':' && sscanf(p, ":%2d%n", &second, &consumed) == 1) {
+        p += consumed;
+        if (p[0] == '.' && sscanf(p, ".%3d%n", &millis, &consumed) == 1) {
+            // Fraction of a second, ".5" is 500 ms
+            for (int digits = consumed - 1; digits < 3; digits++) {
+                millis *= 10;
+            }
+            p += consumed;
+        }
+    }
+    if (hour > 23 || minute > 59 || second > 59 || millis < 0) {
+        return false;
+    }
+    text = p;
+    return true;
+}
+
+std::string DirectoryOf(const std::string& path) {
+    size_t slash = path.find_last_of("\\/");
+    if (slash == std::string::npos) {
+        return ".";
+    }
+    return slash == 0 ? path.substr(0, 1) : path.substr(0, slash);
+}
+
+/**
+ * @brief Read handle of the active segment that stays valid across the
+ * rename done by a rotation
+ */
+class FollowedFile {
+ public:
+    FollowedFile() = default;
+    ~FollowedFile() { Close(); }
+
+    bool Open(const std::string& path) {
+        Close();
+#ifdef _WIN32
+        // Delete sharing lets the writer rename the file while it is open
+        handle_ = CreateFileA(path.c_str(), GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE |
+                                  FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+        return handle_ != INVALID_HANDLE_VALUE;
+#else
+        fd_ = open(path.c_str(), O_RDONLY);
+        return fd_ >= 0;
+#endif
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (handle_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle_);
+            handle_ = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+#endif
+    }
+
+    bool IsOpen() const {
+#ifdef _WIN32
+        return handle_ != INVALID_HANDLE_VALUE;
+#else
+        return fd_ >= 0;
+#endif
+    }
+
+    size_t Read(uint64_t offset, char* buffer, size_t len) {
+#ifdef _WIN32
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD read = 0;
+        if (!ReadFile(handle_, buffer, static_cast<DWORD>(len), &read,
+                      &overlapped)) {
+            return 0;
+        }
+        return read;
+#else
+        ssize_t read = pread(fd_, buffer, len, static_cast<off_t>(offset));
+        return read > 0 ? static_cast<size_t>(read) : 0;
+#endif
+    }
+
+    // path still names the open file (false after a rotation renamed it)
+    bool IsCurrent(const std::string& path) const {
+#ifdef _WIN32
+        BY_HANDLE_FILE_INFORMATION open_info, path_info;
+        HANDLE handle = CreateFileA(path.c_str(), 0,
+                                    FILE_SHARE_READ | FILE_SHARE_WRITE |
+                                        FILE_SHARE_DELETE,
+                                    nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        bool same = GetFileInformationByHandle(handle_, &open_info) &&
+                    GetFileInformationByHandle(handle, &path_info) &&
+                    open_info.dwVolumeSerialNumber ==
+                        path_info.dwVolumeSerialNumber &&
+                    open_info.nFileIndexHigh == path_info.nFileIndexHigh &&
+                    open_info.nFileIndexLow == path_info.nFileIndexLow;
+        CloseHandle(handle);
+        return same;
+#else
+        struct stat open_st, path_st;
+        return fstat(fd_, &open_st) == 0 && stat(path.c_str(), &path_st) == 0 &&
+               open_st.st_dev == path_st.st_dev &&
+               open_st.st_ino == path_st.st_ino;
+#endif
+    }
+
+ private:
+#ifdef _WIN32
+    HANDLE handle_ = INVALID_HANDLE_VALUE;
+#else
+    int fd_ = -1;
+#endif
+};
+
+/**
+ * @brief Wakes up on changes in a directory (writes, renames), or after a
+ * timeout on platforms or file systems without notifications
+ */
+class DirectoryWatcher {
+ public:
+    DirectoryWatcher() = default;
+    ~DirectoryWatcher() {
+#ifdef _WIN32
+        if (handle_ != INVALID_HANDLE_VALUE) {
+            FindCloseChangeNotification(handle_);
+        }
+#elif defined(__linux__)
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+#endif
+    }
+
+    bool Open(const std::string& directory) {
+#ifdef _WIN32
+        handle_ = FindFirstChangeNotificationA(
+            directory.c_str(), FALSE,
+            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE |
+                FILE_NOTIFY_CHANGE_LAST_WRITE);
+        return handle_ != INVALID_HANDLE_VALUE;
+#elif defined(__linux__)
+        fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd_ < 0) {
+            return false;
+        }
+        return inotify_add_watch(fd_, directory.c_str(),
+                                 IN_MODIFY | IN_CREATE | IN_MOVED_FROM |
+                                     IN_MOVED_TO | IN_CLOSE_WRITE) >= 0;
+#else
+        (void)directory;
+        return true;
+#endif
+    }
+
+    void Wait(int timeout_ms) {
+#ifdef _WIN32
+        if (WaitForSingleObject(handle_, static_cast<DWORD>(timeout_ms)) ==
+            WAIT_OBJECT_0) {
+            FindNextChangeNotification(handle_);
+        }
+#elif defined(__linux__)
+        struct pollfd pfd = {fd_, POLLIN, 0};
+        if (poll(&pfd, 1, timeout_ms) > 0) {
+            // Only the wakeup matters, drain the events
+            char events[4096];
+            while (read(fd_, events, sizeof(events)) > 0) {
+            }
+        }
+#else
+        usleep(static_cast<useconds_t>(timeout_ms) * 1000);
+#endif
+    }
+
+ private:
+#ifdef _WIN32
+    HANDLE handle_ = INVALID_HANDLE_VALUE;
+#elif defined(__linux__)
+    int fd_ = -1;
+#endif
+};
+
+}  // namespace
+
+int ParseLogLevel(const std::string& text) {
+    if (text.size() == 1 && text[0] >= '0' && text[0] <= '4') {
+        return text[0] - '0';
+    }
+    for (int i = 0; i < 5; i++) {
+        if (EqualsNoCase(text.c_str(), kLevelNames[i])) {
+            return i;
+        }
+    }
+    if (EqualsNoCase(text.c_str(), "warning")) {
+        return 2;
+    }
+    return -1;
+}
+
+uint64_t ParseLogQueryTime(const std::string& text, uint64_t now_ms) {
+    const char* s = text.c_str();
+    int consumed = 0;
+
+    // Duration before now
+    unsigned long long amount = 0;
+    char unit = 0;
+    if (sscanf(s, "%llu%c%n", &amount, &unit, &consumed) == 2 &&
+        s[consumed] == '\0') {
+        uint64_t unit_ms = 0;
+        switch (unit) {
+            case 's': unit_ms = 1000; break;
+            case 'm': unit_ms = 60 * 1000; break;
+            case 'h': unit_ms = 60 * 60 * 1000; break;
+            case 'd': unit_ms = kDayMs; break;
+            default: return 0;
+        }
+        uint64_t delta = amount * unit_ms;
+        return delta < now_ms ? now_ms - delta : 0;
+    }
+
+    // Time of day, today
+    int hour = 0, minute = 0, second = 0, millis = 0;
+    if (ParseTimeOfDay(s, hour, minute, second, millis) && *s == '\0') {
+        return now_ms - now_ms % kDayMs +
+               (hour * 3600 + minute * 60 + second) * 1000ULL + millis;
+    }
+
+    // Date with optional time of day
+    int year = 0, month = 0, day = 0;
+    if (sscanf(s, "%4d-%2d-%2d%n", &year, &month, &day, &consumed) != 3 ||
+        year < 1601 || month < 1 || month > 12 || day < 1 || day > 31) {
+        return 0;
+    }
+    s += consumed;
+    if (*s == ' ' || *s == 'T') {
+        s++;
+        if (!ParseTimeOfDay(s, hour, minute, second, millis)) {
+            return 0;
+        }
+    }
+    if (*s != '\0') {
+        return 0;
+    }
+    return LogTimeFromCivil(year, month, day, hour, minute, second, millis);
+}
+
+LogQuery::LogQuery(const LogQueryOptions& options)
+    : options_(options),
+      record_match_(false),
+      done_(false),
+      active_read_(false),
+      active_offset_(0) {}
+
+std::vector<LogQuery::Segment> LogQuery::ListSegments() const {
+    std::vector<Segment> segments;
+    for (int i = options_.max_segments; i >= 0; --i) {
+        std::string name = options_.filename;
+        if (i > 0) {
+            name += "." + std::to_string(i);
+        }
+
+        Segment segment;
+        if (FileExists(name)) {
+            segment.path = name;
+            segment.compressed = false;
+        } else if (i > 0 && FileExists(name + ".gz")) {
+            // Rotated segments are usually compressed
+            segment.path = name + ".gz";
+            segment.compressed = true;
+        } else {
+            continue;
+        }
+        ReadLogIndex(name + ".idx", segment.index);
+        segments.push_back(segment);
+    }
+    return segments;
+}
+
+bool LogQuery::Run(FILE* out, std::string& error) {
+    std::vector<Segment> segments = ListSegments();
+
+    bool ok = true;
+    for (size_t i = 0; i < segments.size() && !done_; i++) {
+        const Segment& segment = segments[i];
+
+        // Every record of a segment was written before the next segment
+        // started, skip it if that was before --since
+        if (options_.since_ms > 0 && i + 1 < segments.size()) {
+            const std::vector<LogIndexEntry>& next = segments[i + 1].index;
+            if (!next.empty() && next.front().time_ms < options_.since_ms) {
+                continue;
+            }
+        }
+
+        // Segment started long after --until, so did all later ones
+        if (options_.until_ms > 0 && !segment.index.empty() &&
+            segment.index.front().offset == 0 &&
+            segment.index.front().time_ms > options_.until_ms + kUntilSlackMs) {
+            break;
+        }
+
+        std::string segment_error;
+        if (!ReadSegment(segment, i + 1 == segments.size(), out,
+                         segment_error)) {
+            if (!error.empty()) {
+                error += "\n";
+            }
+            error += segment_error;
+            ok = false;
+        }
+    }
+
+    fflush(out);
+    return ok;
+}
+
+bool LogQuery::ReadSegment(const Segment& segment, bool active, FILE* out,
+                           std::string& error) {
+    if (options_.binary) {
+        std::string text;
+        bool ok = DecodeBinaryLog(segment.path, text, error);
+        FilterLines(text.data(), text.size(), true, out);
+        return ok;
+    }
+
+    uint64_t start = FindLogIndexOffset(segment.index, options_.since_ms);
+
+    if (segment.compressed) {
+        std::string data;
+        if (!ReadLogFile(segment.path, data, error)) {
+            return false;
+        }
+        if (start > data.size()) {
+            start = 0;  // Index does not belong to this segment
+        }
+        FilterLines(data.data() + start, data.size() - start, true, out);
+        return true;
+    }
+
+    MappedFileView view;
+    if (!view.Open(segment.path)) {
+        error = "Failed to open " + segment.path;
+        return false;
+    }
+    const char* data = view.GetData();
+    size_t size = view.GetSize();
+    if (start > size) {
+        start = 0;
+    }
+
+    // Mapped segments end in zero bytes until they are closed
+    const char* zero = size > start ? static_cast<const char*>(memchr(
+                                          data + start, '\0', size - start))
+                                    : nullptr;
+    if (zero) {
+        size = static_cast<size_t>(zero - data);
+    }
+
+    // A partial last line of the active segment is still being written,
+    // Follow picks it up
+    size_t consumed = FilterLines(data + start, size - start, !active, out);
+    if (active) {
+        active_read_ = true;
+        active_offset_ = start + consumed;
+    }
+    return true;
+}
+
+size_t LogQuery::FilterLines(const char* data, size_t len, bool final,
+                             FILE* out) {
+    size_t pos = 0;
+    while (pos < len && !done_) {
+        const char* line = data + pos;
+        const char* newline =
+            static_cast<const char*>(memchr(line, '\n', len - pos));
+        size_t line_len;
+        if (newline) {
+            line_len = static_cast<size_t>(newline - line) + 1;
+        } else if (final) {
+            line_len = len - pos;
+        } else {
+            break;
+        }
+
+        if (MatchLine(line, line_len)) {
+            fwrite(line, 1, line_len, out);
+            if (!newline) {
+                fputc('\n', out);
+            }
+        }
+        pos += line_len;
+    }
+    return pos;
+}
+
+bool LogQuery::MatchLine(const char* line, size_t len) {
+    uint64_t time_ms = 0;
+    int level = 0;
+    if (!ParseRecordHeader(line, len, time_ms, level)) {
+        return record_match_;
+    }
+
+    if (options_.until_ms > 0 && time_ms > options_.until_ms) {
+        // Records are only roughly ordered, stop once well past the bound
+        if (time_ms > options_.until_ms + kUntilSlackMs) {
+            done_ = true;
+        }
+        record_match_ = false;
+        return false;
+    }
+
+    record_match_ =
+        time_ms >= options_.since_ms && level <= options_.level &&
+        (options_.grep.empty() ||
+         std::string_view(line, len).find(options_.grep) !=
+             std::string_view::npos);
+    return record_match_;
+}
+
+bool LogQuery::Follow(FILE* out, std::string& error) {
+    if (options_.binary) {
+        error = "Following is only supported for text logs";
+        return false;
+    }
+
+    DirectoryWatcher watcher;
+    if (!watcher.Open(DirectoryOf(options_.filename))) {
+        error = "Failed to watch " + DirectoryOf(options_.filename);
+        return false;
+    }
+
+    FollowedFile file;
+    uint64_t offset = active_read_ ? active_offset_ : 0;
+    bool at_end = active_read_;  // Without Run start at the current end
+    std::string pending;         // Partial last line
+    std::vector<char> buffer(64 * 1024);
+
+    // Print everything appended since the last call, returns false if
+    // nothing was read
+    auto read_appended = [&]() {
+        bool progressed = false;
+        while (!done_) {
+            size_t n = file.Read(offset, buffer.data(), buffer.size());
+            bool more = (n == buffer.size());
+
+            // Zero bytes are the unwritten tail of a mapped segment
+            const char* zero =
+                static_cast<const char*>(memchr(buffer.data(), '\0', n));
+            if (zero) {
+                n = static_cast<size_t>(zero - buffer.data());
+                more = false;
+            }
+            if (n == 0) {
+                break;
+            }
+
+            offset += n;
+            progressed = true;
+            if (at_end) {
+                pending.append(buffer.data(), n);
+                size_t used =
+                    FilterLines(pending.data(), pending.size(), false, out);
+                pending.erase(0, used);
+            }
+            if (!more) {
+                break;
+            }
+        }
+        return progressed;
+    };
+
+    while (!done_) {
+        if (!file.IsOpen()) {
+            if (!file.Open(options_.filename)) {
+                watcher.Wait(kFollowPollMs);  // Between rename and reopen
+                continue;
+            }
+            if (!at_end) {
+                read_appended();  // Skip existing content
+                at_end = true;
+            }
+        }
+
+        if (read_appended()) {
+            fflush(out);
+        }
+
+        if (!file.IsCurrent(options_.filename)) {
+            // Rotated: the writer closed the old segment before renaming it,
+            // finish it and continue with the new one from its start
+            read_appended();
+            FilterLines(pending.data(), pending.size(), true, out);
+            fflush(out);
+            pending.clear();
+            file.Close();
+            offset = 0;
+            continue;
+        }
+
+        watcher.Wait(kFollowPollMs);
+    }
+    return true;
+}
+
+}  // namespace tinylog
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "log_index.h"
+
+// Filtered reading of tinylog segments, the engine behind 'parallax logs'
+
+namespace tinylog {
+
+struct LogQueryOptions {
+    std::string filename;   // Active segment, rotated ones are filename.N[.gz]
+    int max_segments = 50;  // Highest rotated segment number looked at
+    bool binary = false;    // Segments hold binary records (decoded first)
+    uint64_t since_ms = 0;  // Local time in ms since 1601, 0 = no lower bound
+    uint64_t until_ms = 0;  // Same clock, 0 = no upper bound
+    int level = 4;          // Most verbose level shown (0=CRIT .. 4=DEBUG)
+    std::string grep;       // Plain text a record must contain, empty = any
+};
+
+// Parse "crit", "error", "warn", "info", "debug" or 0..4, -1 if invalid
+int ParseLogLevel(const std::string& text);
+
+// Parse a --since/--until argument to local ms since 1601: "YYYY-MM-DD",
+// "YYYY-MM-DD HH:MM[:SS[.mmm]]" (or with 'T'), "HH:MM[:SS]" for today, or a
+// duration before now such as "90s", "15m", "2h", "1d". 0 if invalid.
+uint64_t ParseLogQueryTime(const std::string& text, uint64_t now_ms);
+
+/**
+ * @brief Prints the records of a rotating log that match a filter
+ *
+ * Segments are read oldest first. Their sidecar indexes decide which
+ * segments can be skipped entirely and, by binary search, where reading
+ * starts inside a segment; records are then filtered one by one. Plain
+ * segments are mapped, compressed ones are decompressed and binary ones
+ * decoded in memory (the index only skips whole binary segments). Lines
+ * without a record header, the continuation of a multi-line message, share
+ * the decision made for their record.
+ */
+class LogQuery {
+ public:
+    explicit LogQuery(const LogQueryOptions& options);
+
+    // Print the matching records of all segments. Segments that cannot be
+    // read are reported in error, the others are still printed.
+    bool Run(FILE* out, std::string& error);
+
+    // Print matching records as they are appended to the active segment,
+    // continuing where Run stopped (or at the current end without Run), and
+    // follow the log across rotations. Returns only if the log cannot be
+    // watched. Text logs only.
+    bool Follow(FILE* out, std::string& error);
+
+ private:
+    struct Segment {
+        std::string path;
+        bool compressed;
+        std::vector<LogIndexEntry> index;
+    };
+
+    std::vector<Segment> ListSegments() const;
+    bool ReadSegment(const Segment& segment, bool active, FILE* out,
+                     std::string& error);
+
+    // Filter complete lines of data (and a trailing partial one if final),
+    // returns bytes consumed. Sets done_ on a record past the until bound.
+    size_t FilterLines(const char* data, size_t len, bool final, FILE* out);
+    bool MatchLine(const char* line, size_t len);
+
+    LogQueryOptions options_;
+    bool record_match_;       // Decision for continuation lines
+    bool done_;               // Past until, nothing later can match
+    bool active_read_;        // Run read the active segment up to
+    uint64_t active_offset_;  // this offset
+};
+
+}  // namespace tinylog
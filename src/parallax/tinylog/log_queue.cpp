@@ -0,0 +1,257 @@
+#include "log_queue.h"
+#include <string.h>
+#include <chrono>
+
+namespace tinylog {
+
+LogQueue::LogQueue()
+    : head_(0),
+      tail_(0),
+      used_(0),
+      closed_(true),
+      in_flight_(false),
+      in_flight_data_(nullptr),
+      in_flight_len_(0),
+      policy_(OverflowPolicy::kBlock),
+      dropped_(0) {}
+
+void LogQueue::Open(size_t capacity, OverflowPolicy policy) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    buffer_.assign(capacity, 0);
+    head_ = 0;
+    tail_ = 0;
+    used_ = 0;
+    closed_ = false;
+    in_flight_ = false;
+    policy_ = policy;
+    dropped_ = 0;
+}
+
+void LogQueue::Close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+    not_empty_.notify_all();
+    not_full_.notify_all();
+    drained_.notify_all();
+}
+
+// Entry header: u32 length, u32 record count
+static const size_t kEntryHeaderSize = 2 * sizeof(uint32_t);
+
+PushResult LogQueue::Push(const char* data, size_t len, size_t records,
+                          bool wait) {
+    const size_t need = kEntryHeaderSize + len;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (closed_) {
+        return PushResult::kClosed;
+    }
+
+    // Entry can never fit
+    if (need > buffer_.size()) {
+        if (policy_ == OverflowPolicy::kBlock) {
+            return PushResult::kTooLarge;
+        }
+        dropped_ += records;
+        return PushResult::kDropped;
+    }
+
+    if (buffer_.size() - used_ < need) {
+        if (!wait) {
+            return PushResult::kFull;
+        }
+
+        switch (policy_) {
+            case OverflowPolicy::kBlock:
+                not_full_.wait(lock, [&]() {
+                    return closed_ || buffer_.size() - used_ >= need;
+                });
+                if (closed_) {
+                    return PushResult::kClosed;
+                }
+                break;
+            case OverflowPolicy::kDropNewest:
+                dropped_ += records;
+                return PushResult::kDropped;
+            case OverflowPolicy::kDropOldest:
+                while (buffer_.size() - used_ < need) {
+                    dropped_ += DropFront();
+                }
+                break;
+        }
+    }
+
+    uint32_t header[2] = {static_cast<uint32_t>(len),
+                          static_cast<uint32_t>(records)};
+    WriteBytes(header, sizeof(header));
+    WriteBytes(data, len);
+
+    bool was_empty = (used_ == need);
+    lock.unlock();
+
+    // Writer only sleeps when the queue is empty
+    if (was_empty) {
+        not_empty_.notify_one();
+    }
+    return PushResult::kQueued;
+}
+
+size_t LogQueue::PopBatch(std::string& batch, size_t max_bytes,
+                          int timeout_ms) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto ready = [&]() { return closed_ || used_ > 0; };
+    if (timeout_ms < 0) {
+        not_empty_.wait(lock, ready);
+    } else {
+        not_empty_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                            ready);
+    }
+
+    size_t count = 0;
+    size_t start = batch.size();
+    while (used_ > 0) {
+        uint32_t len = PeekUint32(0);
+        if (batch.size() > start && batch.size() + len > max_bytes) {
+            break;
+        }
+
+        count += PeekUint32(sizeof(uint32_t));
+        ReadBytes(nullptr, kEntryHeaderSize);
+        size_t offset = batch.size();
+        batch.resize(offset + len);
+        ReadBytes(&batch[offset], len);
+    }
+
+    if (count > 0) {
+        in_flight_ = true;
+        in_flight_len_.store(batch.size() - start, std::memory_order_relaxed);
+        in_flight_data_.store(batch.data() + start, std::memory_order_release);
+    }
+    lock.unlock();
+
+    if (count > 0) {
+        not_full_.notify_all();
+    }
+    return count;
+}
+
+bool LogQueue::IsFinished() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return closed_ && used_ == 0;
+}
+
+void LogQueue::Commit() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_ = false;
+        in_flight_data_.store(nullptr, std::memory_order_relaxed);
+        if (used_ > 0) {
+            return;
+        }
+    }
+    drained_.notify_all();
+}
+
+void LogQueue::WaitDrained() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    drained_.wait(lock, [&]() {
+        return (used_ == 0 && !in_flight_) || (closed_ && used_ == 0);
+    });
+}
+
+void LogQueue::WriteBytes(const void* data, size_t len) {
+    const char* src = static_cast<const char*>(data);
+    size_t first = buffer_.size() - tail_;
+    if (first > len) {
+        first = len;
+    }
+
+    memcpy(&buffer_[tail_], src, first);
+    if (len > first) {
+        memcpy(&buffer_[0], src + first, len - first);
+    }
+
+    tail_ = (tail_ + len) % buffer_.size();
+    used_ += len;
+}
+
+void LogQueue::ReadBytes(void* data, size_t len) {
+    if (data) {
+        char* dst = static_cast<char*>(data);
+        size_t first = buffer_.size() - head_;
+        if (first > len) {
+            first = len;
+        }
+
+        memcpy(dst, &buffer_[head_], first);
+        if (len > first) {
+            memcpy(dst + first, &buffer_[0], len - first);
+        }
+    }
+
+    head_ = (head_ + len) % buffer_.size();
+    used_ -= len;
+}
+
+uint32_t LogQueue::PeekUint32(size_t offset) const {
+    return PeekUint32(head_, offset);
+}
+
+uint32_t LogQueue::PeekUint32(size_t head, size_t offset) const {
+    uint32_t value = 0;
+    char* dst = reinterpret_cast<char*>(&value);
+    for (size_t i = 0; i < sizeof(value); i++) {
+        dst[i] = buffer_[(head + offset + i) % buffer_.size()];
+    }
+    return value;
+}
+
+void LogQueue::CrashDrain(void (*write)(const char*, size_t)) const {
+    if (buffer_.empty()) {
+        return;
+    }
+
+    // Popped entries are older than the queued ones
+    const char* in_flight = in_flight_data_.load(std::memory_order_acquire);
+    if (in_flight) {
+        write(in_flight, in_flight_len_.load(std::memory_order_relaxed));
+    }
+
+    // Snapshot of the indices, the state may be inconsistent if another
+    // thread was interrupted inside Push/PopBatch. The writer thread may keep
+    // popping meanwhile, popped bytes stay in place until overwritten.
+    const size_t size = buffer_.size();
+    const size_t head = head_;
+    const size_t used = used_;
+    size_t offset = 0;
+    while (offset + kEntryHeaderSize <= used) {
+        uint32_t len = PeekUint32(head, offset);
+        offset += kEntryHeaderSize;
+        if (len > used - offset) {
+            break;
+        }
+
+        size_t start = (head + offset) % size;
+        size_t first = size - start;
+        if (first > len) {
+            first = len;
+        }
+        write(&buffer_[start], first);
+        if (len > first) {
+            write(&buffer_[0], len - first);
+        }
+        offset += len;
+    }
+}
+
+size_t LogQueue::DropFront() {
+    uint32_t len = PeekUint32(0);
+    uint32_t records = PeekUint32(sizeof(uint32_t));
+    ReadBytes(nullptr, kEntryHeaderSize + len);
+    return records;
+}
+
+}  // namespace tinylog
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Bounded record queue used by tinylog asynchronous write mode
+
+namespace tinylog {
+
+// What to do when a record does not fit into the queue
+enum class OverflowPolicy {
+    kBlock = 0,       // Producer waits until the writer frees space
+    kDropNewest = 1,  // Incoming record is discarded
+    kDropOldest = 2   // Oldest queued records are evicted to make room
+};
+
+enum class PushResult {
+    kQueued = 0,   // Record stored in the queue
+    kDropped = 1,  // Record discarded by overflow policy
+    kClosed = 2,   // Queue is not accepting records, caller must fall back
+    kFull = 3,     // No room and caller asked not to wait, nothing stored
+    kTooLarge = 4  // kBlock only: entry larger than the queue, nothing
+                   // stored, caller must write it itself (see Push)
+};
+
+/**
+ * @brief Bounded multi-producer queue of preformatted log records
+ *
+ * Entries are stored back to back in a byte ring buffer, each one prefixed
+ * with its length and the number of records it holds (producers may push a
+ * batch of records as one entry). Producers only hold the queue lock for a
+ * memcpy; the single consumer (writer thread) moves whole batches out so that
+ * the file can be written with one fwrite per batch.
+ */
+class LogQueue {
+ public:
+    LogQueue();
+    ~LogQueue() = default;
+
+    // (Re)allocate the ring buffer and start accepting records
+    void Open(size_t capacity, OverflowPolicy policy);
+
+    // Stop accepting records and wake up all waiters. Records already queued
+    // can still be popped.
+    void Close();
+
+    // Append an entry of one or more records. wait=false never blocks, a
+    // full queue then returns kFull regardless of the overflow policy. An
+    // entry that can never fit is dropped under the drop policies; kBlock
+    // promises no loss, so it returns kTooLarge and the caller writes the
+    // entry itself, after WaitDrained() to keep its own order.
+    PushResult Push(const char* data, size_t len, size_t records = 1,
+                    bool wait = true);
+
+    // Wait for entries and append up to max_bytes of them to batch (at least
+    // one entry if any is queued). Returns number of records moved, 0 after
+    // timeout_ms (-1 waits forever) or when the queue is closed and fully
+    // drained, see IsFinished().
+    size_t PopBatch(std::string& batch, size_t max_bytes, int timeout_ms = -1);
+
+    // Queue is closed and every entry has been popped
+    bool IsFinished();
+
+    // Called by the consumer once the last popped batch has been written,
+    // until then the batch must not be modified (see CrashDrain)
+    void Commit();
+
+    // Block until every record pushed so far has been written
+    void WaitDrained();
+
+    uint64_t GetDroppedCount() const { return dropped_.load(); }
+
+    // Crash handlers only: pass the uncommitted popped batch and the payload
+    // of every queued entry to write, without taking the lock or consuming
+    // anything
+    void CrashDrain(void (*write)(const char* data, size_t len)) const;
+
+ private:
+    void WriteBytes(const void* data, size_t len);
+    void ReadBytes(void* data, size_t len);
+    uint32_t PeekUint32(size_t offset) const;
+    uint32_t PeekUint32(size_t head, size_t offset) const;
+    size_t DropFront();
+
+    std::vector<char> buffer_;
+    size_t head_;  // Read position
+    size_t tail_;  // Write position
+    size_t used_;  // Bytes in use, including entry headers
+    bool closed_;
+    bool in_flight_;  // Consumer holds a batch that is not written yet
+    std::atomic<const char*> in_flight_data_;  // Popped part of that batch
+    std::atomic<size_t> in_flight_len_;
+    OverflowPolicy policy_;
+
+    std::atomic<uint64_t> dropped_;
+
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::condition_variable drained_;
+};
+
+}  // namespace tinylog
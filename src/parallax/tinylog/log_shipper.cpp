@@ -0,0 +1,229 @@
+#include "log_shipper.h"
+#include "platform.h"
+#include <string.h>
+#include <vector>
+
+namespace tinylog {
+
+ShippingSink::ShippingSink(const ShippingOptions& options)
+    : options_(options),
+      connection_(options.address),
+      spool_file_(nullptr),
+      spool_size_(0),
+      spool_read_(0),
+      dropped_(0),
+      shipped_(0) {
+    queue_.Open(options_.queue_size, OverflowPolicy::kDropNewest);
+
+    // Frames left by an earlier process are sent first
+    if (!options_.spool_path.empty()) {
+        FILE* file = fopen(options_.spool_path.c_str(), "rb");
+        if (file) {
+            if (fseek(file, 0, SEEK_END) == 0) {
+                long size = ftell(file);
+                spool_size_ = size > 0 ? static_cast<uint64_t>(size) : 0;
+            }
+            fclose(file);
+        }
+    }
+
+    thread_ = std::thread(&ShippingSink::ShipperProc, this);
+}
+
+ShippingSink::~ShippingSink() { Close(); }
+
+void ShippingSink::Write(const LogRecord& record) {
+    const char* data = options_.json ? record.json : record.text;
+    size_t len = options_.json ? record.json_len : record.text_len;
+    if (!data) return;
+
+    // Never waits for the shipper, a full or closed queue drops the record
+    if (queue_.Push(data, len, 1, false) != PushResult::kQueued) {
+        dropped_++;
+    }
+}
+
+void ShippingSink::Flush() { queue_.WaitDrained(); }
+
+void ShippingSink::Close() {
+    std::call_once(close_once_, [this]() {
+        queue_.Close();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        if (spool_file_) {
+            fclose(spool_file_);
+            spool_file_ = nullptr;
+        }
+        connection_.Disconnect();
+    });
+}
+
+void ShippingSink::ShipperProc() {
+    std::string batch;
+    std::string frame;
+    batch.reserve(options_.batch_bytes);
+
+    while (true) {
+        batch.clear();
+        size_t records =
+            queue_.PopBatch(batch, options_.batch_bytes, kIdleWaitMs);
+        if (records == 0) {
+            if (queue_.IsFinished()) {
+                break;
+            }
+            if (HasSpool()) {
+                SendSpool();  // Collector may be back
+            }
+            continue;
+        }
+
+        // Let the batch fill up for a while, one frame per record would
+        // defeat compression
+        uint64_t deadline = TickMs() + options_.batch_delay_ms;
+        while (batch.size() < options_.batch_bytes) {
+            uint64_t now = TickMs();
+            if (now >= deadline) {
+                break;
+            }
+            size_t more = queue_.PopBatch(batch, options_.batch_bytes,
+                                          static_cast<int>(deadline - now));
+            if (more == 0) {
+                break;
+            }
+            records += more;
+        }
+
+        BuildFrame(batch, records, frame);
+        Deliver(frame, records);
+        queue_.Commit();
+    }
+}
+
+void ShippingSink::BuildFrame(const std::string& batch, size_t records,
+                              std::string& frame) {
+    ShipFrameHeader header;
+    memcpy(header.magic, "PLXB", 4);
+    header.version = kShipFrameVersion;
+    header.flags = options_.json ? kShipFlagJson : 0;
+    header.reserved = 0;
+    header.records = static_cast<uint32_t>(records);
+
+    const std::string* payload = &batch;
+    if (options_.compress) {
+        payload_.clear();
+        if (GzipData(gzip_, batch.data(), batch.size(), payload_)) {
+            header.flags |= kShipFlagGzip;
+            payload = &payload_;
+        }
+    }
+    header.payload_len = static_cast<uint32_t>(payload->size());
+
+    frame.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+    frame.append(*payload);
+}
+
+void ShippingSink::Deliver(const std::string& frame, size_t records) {
+    // Keep the order: nothing new goes out before the spool is sent
+    if (HasSpool() && !SendSpool()) {
+        AppendSpool(frame, records);
+        return;
+    }
+
+    if (connection_.Connect() &&
+        connection_.Send(frame.data(), frame.size())) {
+        shipped_ += records;
+        return;
+    }
+    AppendSpool(frame, records);
+}
+
+void ShippingSink::AppendSpool(const std::string& frame, size_t records) {
+    if (options_.spool_path.empty() ||
+        spool_size_ + frame.size() > options_.spool_max_bytes) {
+        dropped_ += records;
+        return;
+    }
+
+    if (!spool_file_) {
+        spool_file_ = fopen(options_.spool_path.c_str(), "ab");
+        if (!spool_file_) {
+            dropped_ += records;
+            return;
+        }
+    }
+    if (fwrite(frame.data(), 1, frame.size(), spool_file_) != frame.size() ||
+        fflush(spool_file_) != 0) {
+        // Part of the frame may be in the file, start over rather than
+        // sending a torn frame later
+        dropped_ += records;
+        ResetSpool();
+        return;
+    }
+    spool_size_ += frame.size();
+}
+
+bool ShippingSink::SendSpool() {
+    if (!connection_.Connect()) {
+        return false;
+    }
+
+    FILE* file = fopen(options_.spool_path.c_str(), "rb");
+    if (!file) {
+        ResetSpool();
+        return true;
+    }
+    if (fseek(file, static_cast<long>(spool_read_), SEEK_SET) != 0) {
+        fclose(file);
+        return false;
+    }
+
+    std::vector<char> frame;
+    bool sent_all = true;
+    while (spool_read_ < spool_size_) {
+        ShipFrameHeader header;
+        if (fread(&header, sizeof(header), 1, file) != 1 ||
+            memcmp(header.magic, "PLXB", 4) != 0 ||
+            spool_read_ + sizeof(header) + header.payload_len > spool_size_) {
+            break;  // Damaged spool, the rest of it cannot be framed
+        }
+
+        frame.resize(sizeof(header) + header.payload_len);
+        memcpy(frame.data(), &header, sizeof(header));
+        if (header.payload_len > 0 &&
+            fread(frame.data() + sizeof(header), header.payload_len, 1,
+                  file) != 1) {
+            break;
+        }
+        if (!connection_.Send(frame.data(), frame.size())) {
+            sent_all = false;
+            break;
+        }
+        spool_read_ += frame.size();
+        shipped_ += header.records;
+    }
+    fclose(file);
+
+    if (!sent_all) {
+        return false;
+    }
+    ResetSpool();
+    return true;
+}
+
+void ShippingSink::ResetSpool() {
+    if (spool_file_) {
+        fclose(spool_file_);
+        spool_file_ = nullptr;
+    }
+    if (!options_.spool_path.empty()) {
+        FILE* file = fopen(options_.spool_path.c_str(), "wb");
+        if (file) {
+            fclose(file);
+        }
+    }
+    spool_size_ = 0;
+    spool_read_ = 0;
+}
+
+}  // namespace tinylog
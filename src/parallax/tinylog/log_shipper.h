@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "gzip_stream.h"
+#include "log_forwarder.h"
+#include "log_queue.h"
+#include "log_sink.h"
+
+// Sink that ships batches of tinylog records to a collector agent
+
+namespace tinylog {
+
+// Batch frame as sent to the collector and kept in the spool file. Integers
+// are little endian, the payload is the records' lines (text or JSON, each
+// ending in '\n'), gzip compressed if kShipFlagGzip is set.
+struct ShipFrameHeader {
+    char magic[4];         // "PLXB"
+    uint8_t version;       // kShipFrameVersion
+    uint8_t flags;         // kShipFlagXxx
+    uint16_t reserved;     // 0
+    uint32_t records;      // Records in the batch
+    uint32_t payload_len;  // Bytes following the header
+};
+
+static const uint8_t kShipFrameVersion = 1;
+static const uint8_t kShipFlagGzip = 1;  // Payload is a gzip stream
+static const uint8_t kShipFlagJson = 2;  // Lines are JSON objects
+
+struct ShippingOptions {
+    std::string address;  // See CollectorConnection
+    bool json = false;    // Ship the JSON rendering instead of text lines
+    bool compress = true;
+
+    // Batches that cannot be delivered are appended here (empty: dropped)
+    // until the file reaches spool_max_bytes
+    std::string spool_path;
+    size_t spool_max_bytes = 16 * 1024 * 1024;
+
+    size_t queue_size = 1024 * 1024;  // Records waiting for the shipper
+    size_t batch_bytes = 64 * 1024;   // Uncompressed batch size limit
+    int batch_delay_ms = 200;         // Max wait for a batch to fill up
+};
+
+/**
+ * @brief Ships records in compressed batches to a collector
+ *
+ * Write() copies the record into a bounded queue and never blocks; records
+ * are dropped when the queue is full. A shipper thread collects them into
+ * batches of up to batch_bytes or batch_delay_ms, compresses each batch
+ * and sends it as one frame over a CollectorConnection.
+ *
+ * While the collector is unreachable the frames are appended to the spool
+ * file, and once it is back the spool is sent, oldest first, before any new
+ * batch. A full spool drops further batches. The spool survives restarts
+ * and is replayed by the next process. Delivery is at least once: a frame
+ * cut short by a failed connection is sent again in full, the collector
+ * discards the partial frame of a closed connection.
+ */
+class ShippingSink : public LogSink {
+ public:
+    explicit ShippingSink(const ShippingOptions& options);
+    ~ShippingSink() override;
+
+    void Write(const LogRecord& record) override;
+
+    // Wait until queued records have been sent or spooled
+    void Flush() override;
+
+    // Send or spool the queued records and stop the thread
+    void Close() override;
+
+    unsigned GetNeeds() const override {
+        return options_.json ? kSinkNeedsJson : kSinkNeedsText;
+    }
+
+    // Records dropped on a full queue or spool
+    uint64_t GetDroppedCount() const { return dropped_.load(); }
+    uint64_t GetShippedCount() const { return shipped_.load(); }
+
+ private:
+    static const int kIdleWaitMs = 1000;  // Spool retry interval when idle
+
+    void ShipperProc();
+    void BuildFrame(const std::string& batch, size_t records,
+                    std::string& frame);
+    void Deliver(const std::string& frame, size_t records);
+
+    // Spool file, only used by the shipper thread
+    bool HasSpool() const { return spool_read_ < spool_size_; }
+    void AppendSpool(const std::string& frame, size_t records);
+    bool SendSpool();
+    void ResetSpool();
+
+    const ShippingOptions options_;
+    CollectorConnection connection_;
+    LogQueue queue_;
+    GzipWriter gzip_;
+    std::string payload_;  // Compressed batch, reused
+
+    FILE* spool_file_;     // Open for appending while there is a spool
+    uint64_t spool_size_;  // Bytes in the spool file
+    uint64_t spool_read_;  // Bytes of it already sent
+
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> shipped_;
+    std::thread thread_;
+    std::once_flag close_once_;
+};
+
+}  // namespace tinylog
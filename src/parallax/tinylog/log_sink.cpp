@@ -0,0 +1,348 @@
+#include "log_sink.h"
+#include <string.h>
+#include <algorithm>
+
+namespace tinylog {
+
+// Queue entry of AsyncSink: this header, then text_len + json_len bytes
+struct AsyncRecordHeader {
+    int32_t priority;
+    int32_t module;
+    uint32_t idx;
+    uint32_t header_len;
+    uint32_t text_len;
+    uint32_t json_len;
+};
+
+static const size_t kAsyncSinkBatchBytes = 64 * 1024;
+
+// Serialization buffer of the logging thread, reused across records
+static thread_local std::string t_async_entry;
+
+AsyncSink::AsyncSink(std::shared_ptr<LogSink> sink, size_t queue_size,
+                     OverflowPolicy policy)
+    : sink_(std::move(sink)),
+      needs_(sink_->GetNeeds() & (kSinkNeedsText | kSinkNeedsJson)) {
+    queue_.Open(queue_size, policy);
+    thread_ = std::thread(&AsyncSink::WriterProc, this);
+}
+
+AsyncSink::~AsyncSink() { Close(); }
+
+void AsyncSink::Write(const LogRecord& record) {
+    AsyncRecordHeader header;
+    header.priority = record.priority;
+    header.module = record.module;
+    header.idx = record.idx;
+    header.header_len = static_cast<uint32_t>(record.header_len);
+    header.text_len = record.text ? static_cast<uint32_t>(record.text_len) : 0;
+    header.json_len = record.json ? static_cast<uint32_t>(record.json_len) : 0;
+
+    std::string& entry = t_async_entry;
+    entry.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+    entry.append(record.text ? record.text : "", header.text_len);
+    entry.append(record.json ? record.json : "", header.json_len);
+
+    // Closed queue (sink removed meanwhile) drops the record. One larger
+    // than the queue is written here once the queue is drained, kBlock
+    // does not lose records.
+    if (queue_.Push(entry.data(), entry.size()) == PushResult::kTooLarge) {
+        queue_.WaitDrained();
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        sink_->Write(record);
+    }
+}
+
+void AsyncSink::Flush() { queue_.WaitDrained(); }
+
+void AsyncSink::Close() {
+    std::call_once(close_once_, [this]() {
+        queue_.Close();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        sink_->Close();
+    });
+}
+
+unsigned AsyncSink::GetNeeds() const { return needs_; }
+
+void AsyncSink::WriterProc() {
+    std::string batch;
+    batch.reserve(kAsyncSinkBatchBytes);
+
+    while (true) {
+        batch.clear();
+        if (queue_.PopBatch(batch, kAsyncSinkBatchBytes) == 0) {
+            if (queue_.IsFinished()) {
+                break;
+            }
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        size_t offset = 0;
+        while (offset + sizeof(AsyncRecordHeader) <= batch.size()) {
+            AsyncRecordHeader header;
+            memcpy(&header, batch.data() + offset, sizeof(header));
+            offset += sizeof(header);
+
+            LogRecord record = {};
+            record.priority = header.priority;
+            record.module = header.module;
+            record.idx = header.idx;
+            record.header_len = header.header_len;
+            if (header.text_len > 0) {
+                record.text = batch.data() + offset;
+                record.text_len = header.text_len;
+            }
+            offset += header.text_len;
+            if (header.json_len > 0) {
+                record.json = batch.data() + offset;
+                record.json_len = header.json_len;
+            }
+            offset += header.json_len;
+
+            sink_->Write(record);
+        }
+        sink_->Flush();
+        queue_.Commit();
+    }
+}
+
+MemorySink::MemorySink(size_t capacity)
+    : buffer_(capacity), head_(0), used_(0) {}
+
+void MemorySink::Write(const LogRecord& record) {
+    if (!record.text) return;
+
+    const uint32_t len = static_cast<uint32_t>(record.text_len);
+    const size_t need = sizeof(len) + len;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (need > buffer_.size()) {
+        return;
+    }
+
+    // Evict whole records from the front
+    while (buffer_.size() - used_ < need) {
+        uint32_t old_len = 0;
+        CopyOut(0, &old_len, sizeof(old_len));
+        head_ = (head_ + sizeof(old_len) + old_len) % buffer_.size();
+        used_ -= sizeof(old_len) + old_len;
+    }
+
+    CopyIn(&len, sizeof(len));
+    CopyIn(record.text, len);
+}
+
+void MemorySink::GetText(std::string& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t offset = 0;
+    while (offset < used_) {
+        uint32_t len = 0;
+        CopyOut(offset, &len, sizeof(len));
+        offset += sizeof(len);
+
+        size_t start = out.size();
+        out.resize(start + len);
+        CopyOut(offset, &out[start], len);
+        offset += len;
+    }
+}
+
+void MemorySink::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    head_ = 0;
+    used_ = 0;
+}
+
+void MemorySink::CopyIn(const void* data, size_t len) {
+    const char* src = static_cast<const char*>(data);
+    size_t tail = (head_ + used_) % buffer_.size();
+    size_t first = std::min(len, buffer_.size() - tail);
+    memcpy(&buffer_[tail], src, first);
+    if (len > first) {
+        memcpy(&buffer_[0], src + first, len - first);
+    }
+    used_ += len;
+}
+
+void MemorySink::CopyOut(size_t offset, void* data, size_t len) const {
+    char* dst = static_cast<char*>(data);
+    size_t start = (head_ + offset) % buffer_.size();
+    size_t first = std::min(len, buffer_.size() - start);
+    memcpy(dst, &buffer_[start], first);
+    if (len > first) {
+        memcpy(dst + first, &buffer_[0], len - first);
+    }
+}
+
+JsonFileSink::JsonFileSink(bool flush_each) : flush_each_(flush_each) {}
+
+bool JsonFileSink::Open(const char* filename, size_t max_file_size,
+                        int max_files, bool compress_rotated) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_.SetCompressRotated(compress_rotated);
+    return file_.Open(filename, max_file_size, max_files, true);
+}
+
+void JsonFileSink::Write(const LogRecord& record) {
+    if (!record.json) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_.Write(record.json, record.json_len);
+    if (flush_each_) {
+        file_.Flush();
+    }
+}
+
+void JsonFileSink::Flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_.Flush();
+}
+
+void JsonFileSink::Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_.Close();
+}
+
+SinkRegistry::SinkRegistry() : version_(0), next_id_(kFirstDynamicSinkId) {
+    Publish(std::vector<Entry>());
+}
+
+int SinkRegistry::Add(std::shared_ptr<LogSink> sink, int level, bool async,
+                      int id) {
+    if (!sink) return -1;
+
+    if (async) {
+        // 1 MB holds a few thousand typical records
+        sink = std::make_shared<AsyncSink>(sink, 1024 * 1024);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (id == 0) {
+        id = next_id_++;
+    }
+    for (const Entry& entry : sinks_->entries) {
+        if (entry.id == id) {
+            if (async) {
+                sink->Close();  // Stop the thread of the unused wrapper
+            }
+            return -1;
+        }
+    }
+
+    std::vector<Entry> entries = sinks_->entries;
+    entries.push_back({id, level, sink});
+    Publish(std::move(entries));
+    return id;
+}
+
+bool SinkRegistry::Remove(int id) {
+    std::shared_ptr<LogSink> removed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<Entry> entries;
+        for (const Entry& entry : sinks_->entries) {
+            if (entry.id == id) {
+                removed = entry.sink;
+            } else {
+                entries.push_back(entry);
+            }
+        }
+        if (!removed) {
+            return false;
+        }
+        Publish(std::move(entries));
+    }
+
+    // Outside the lock, an asynchronous sink drains its queue here
+    removed->Close();
+    return true;
+}
+
+bool SinkRegistry::SetLevel(int id, int level) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Entry> entries = sinks_->entries;
+    for (Entry& entry : entries) {
+        if (entry.id == id) {
+            entry.level = level;
+            Publish(std::move(entries));
+            return true;
+        }
+    }
+    return false;
+}
+
+int SinkRegistry::GetLevel(int id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const Entry& entry : sinks_->entries) {
+        if (entry.id == id) {
+            return entry.level;
+        }
+    }
+    return -1;
+}
+
+unsigned SinkRegistry::GetNeeds(int priority) {
+    if (priority < 0 || priority > 4) {
+        return 0;
+    }
+    return Current().needs[priority];
+}
+
+void SinkRegistry::Dispatch(const LogRecord& record) {
+    for (const Entry& entry : Current().entries) {
+        if (record.priority <= entry.level) {
+            entry.sink->Write(record);
+        }
+    }
+}
+
+void SinkRegistry::Flush() {
+    std::shared_ptr<const SinkList> sinks;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sinks = sinks_;
+    }
+    for (const Entry& entry : sinks->entries) {
+        entry.sink->Flush();
+    }
+}
+
+void SinkRegistry::Publish(std::vector<Entry> entries) {
+    auto sinks = std::make_shared<SinkList>();
+    sinks->entries = std::move(entries);
+    for (int priority = 0; priority < 5; priority++) {
+        unsigned needs = 0;
+        for (const Entry& entry : sinks->entries) {
+            if (priority <= entry.level) {
+                needs |= entry.sink->GetNeeds();
+            }
+        }
+        sinks->needs[priority] = needs;
+    }
+
+    sinks_ = sinks;
+    version_.fetch_add(1, std::memory_order_release);
+}
+
+const SinkRegistry::SinkList& SinkRegistry::Current() {
+    struct Cache {
+        const SinkRegistry* owner;
+        uint64_t version;
+        std::shared_ptr<const SinkList> sinks;
+    };
+    static thread_local Cache cache = {nullptr, 0, nullptr};
+
+    if (cache.owner != this ||
+        cache.version != version_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cache.owner = this;
+        cache.version = version_.load(std::memory_order_relaxed);
+        cache.sinks = sinks_;
+    }
+    return *cache.sinks;
+}
+
+}  // namespace tinylog
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log_queue.h"
+#include "rotating_file.h"
+
+// Sink interface of tinylog: every finished record is rendered once and
+// handed to all registered sinks
+
+namespace tinylog {
+
+// Renderings a sink reads from a LogRecord
+static const unsigned kSinkNeedsText = 1;    // text / text_len
+static const unsigned kSinkNeedsJson = 2;    // json / json_len
+static const unsigned kSinkNeedsBinary = 4;  // binary / binary_len
+
+/**
+ * @brief One finished record as seen by the sinks
+ *
+ * Only the renderings requested by at least one sink are filled in, the
+ * others are null. The pointers are valid for the duration of Write().
+ */
+struct LogRecord {
+    int priority;
+    int module;        // TINYLOG_MODULE_xxx
+    unsigned int idx;  // Displayed record index
+    const char* text;  // "[pid-tid:idx] date [LEVEL] - message\n"
+    size_t text_len;
+    size_t header_len;   // Bytes of text before the message
+    const char* json;    // One JSON object followed by a newline
+    size_t json_len;
+    const char* binary;  // Binary log record (see binary_log.h)
+    size_t binary_len;
+};
+
+/**
+ * @brief Destination of log records
+ *
+ * Write() is called by the logging threads, concurrently unless the sink is
+ * registered as asynchronous; implementations do their own locking. Once
+ * Close() has been called later writes must be ignored, threads that still
+ * hold the old sink list may deliver a few more records.
+ */
+class LogSink {
+ public:
+    virtual ~LogSink() {}
+
+    virtual void Write(const LogRecord& record) = 0;
+
+    // Push buffered records to their destination
+    virtual void Flush() {}
+
+    // Called when the sink is removed from the registry
+    virtual void Close() {}
+
+    // kSinkNeedsXxx flags of the renderings Write() reads, queried when the
+    // sink is registered
+    virtual unsigned GetNeeds() const { return kSinkNeedsText; }
+};
+
+/**
+ * @brief Runs another sink on its own thread
+ *
+ * Records are copied into a bounded queue and written by a writer thread,
+ * one Flush() of the wrapped sink per batch. The logging thread never
+ * blocks on the wrapped sink; with a full queue records are dropped
+ * (default) or the oldest ones evicted, see OverflowPolicy. Binary
+ * renderings are not passed on.
+ */
+class AsyncSink : public LogSink {
+ public:
+    AsyncSink(std::shared_ptr<LogSink> sink, size_t queue_size,
+              OverflowPolicy policy = OverflowPolicy::kDropNewest);
+    ~AsyncSink() override;
+
+    void Write(const LogRecord& record) override;
+
+    // Wait until queued records have been written
+    void Flush() override;
+
+    // Write queued records, stop the thread and close the wrapped sink
+    void Close() override;
+
+    unsigned GetNeeds() const override;
+
+    uint64_t GetDroppedCount() const { return queue_.GetDroppedCount(); }
+
+ private:
+    void WriterProc();
+
+    std::shared_ptr<LogSink> sink_;
+    unsigned needs_;
+    LogQueue queue_;
+    std::mutex write_mutex_;  // Writer thread vs. records too large to queue
+    std::thread thread_;
+    std::once_flag close_once_;
+};
+
+/**
+ * @brief Keeps the text of the most recent records in memory
+ *
+ * A byte ring of fixed capacity, the oldest whole records are evicted to
+ * make room. Records larger than the capacity are skipped.
+ */
+class MemorySink : public LogSink {
+ public:
+    explicit MemorySink(size_t capacity);
+
+    void Write(const LogRecord& record) override;
+
+    // Append the retained records to out, oldest first
+    void GetText(std::string& out) const;
+
+    void Clear();
+
+ private:
+    void CopyIn(const void* data, size_t len);
+    void CopyOut(size_t offset, void* data, size_t len) const;
+
+    mutable std::mutex mutex_;
+    std::vector<char> buffer_;
+    size_t head_;  // Offset of the oldest entry (u32 length + text)
+    size_t used_;
+};
+
+/**
+ * @brief Writes the JSON rendering of every record to a rotating file
+ *
+ * flush_each flushes after every record, meant for synchronous
+ * registration; as an asynchronous sink it is flushed once per batch.
+ */
+class JsonFileSink : public LogSink {
+ public:
+    explicit JsonFileSink(bool flush_each);
+
+    bool Open(const char* filename, size_t max_file_size, int max_files,
+              bool compress_rotated);
+
+    void Write(const LogRecord& record) override;
+    void Flush() override;
+    void Close() override;
+    unsigned GetNeeds() const override { return kSinkNeedsJson; }
+
+ private:
+    std::mutex mutex_;
+    RotatingFile file_;
+    bool flush_each_;
+};
+
+/**
+ * @brief Set of sinks a record fans out to
+ *
+ * Changes swap in a new immutable sink list. Logging threads keep a
+ * per-thread reference to the list and only take the lock when its version
+ * has changed, so delivering a record takes no shared lock.
+ */
+class SinkRegistry {
+ public:
+    SinkRegistry();
+
+    // Register sink under id (0 = next free id from kFirstDynamicSinkId),
+    // wrapped in an AsyncSink if async. level is the most verbose level it
+    // writes (0=CRIT .. 4=DEBUG). Returns the id, -1 if the id is taken.
+    int Add(std::shared_ptr<LogSink> sink, int level, bool async, int id = 0);
+
+    // Unregister and close a sink, false if there is none with that id
+    bool Remove(int id);
+
+    // Level of a sink, -1 / false if there is none with that id
+    bool SetLevel(int id, int level);
+    int GetLevel(int id);
+
+    // Renderings needed by the sinks that accept priority, 0 if none does
+    unsigned GetNeeds(int priority);
+
+    // Hand record to every sink that accepts its priority
+    void Dispatch(const LogRecord& record);
+
+    void Flush();
+
+    // Ids below are reserved for the built-in sinks (TINYLOG_SINK_xxx)
+    static const int kFirstDynamicSinkId = 16;
+
+ private:
+    struct Entry {
+        int id;
+        int level;
+        std::shared_ptr<LogSink> sink;
+    };
+    struct SinkList {
+        std::vector<Entry> entries;
+        unsigned needs[5];  // Union of GetNeeds() per record priority
+    };
+
+    // Swap in a new list, caller holds mutex_
+    void Publish(std::vector<Entry> entries);
+
+    // Sink list of the calling thread, refreshed when version_ changed
+    const SinkList& Current();
+
+    std::mutex mutex_;
+    std::shared_ptr<const SinkList> sinks_;
+    std::atomic<uint64_t> version_;
+    int next_id_;
+};
+
+// Sinks of the tinylog pipeline (defined in tinylog.cpp). Records reach a
+// sink only after passing their module level (PARALLAX_LOG) and then the
+// level of the sink.
+int AddSink(std::shared_ptr<LogSink> sink, int level, bool async);
+bool RemoveSink(int id);
+
+}  // namespace tinylog
@@ -0,0 +1,326 @@
+#include "mapped_segment.h"
+#include "binary_log.h"
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tinylog {
+
+MappedSegment::MappedSegment()
+    :
+#ifdef _WIN32
+      file_handle_(INVALID_HANDLE_VALUE),
+      mapping_handle_(nullptr),
+#else
+      fd_(-1),
+#endif
+      view_(nullptr),
+      capacity_(0),
+      size_(0),
+      binary_(false) {
+}
+
+MappedSegment::~MappedSegment() { Close(); }
+
+bool MappedSegment::Open(const std::string& filename, size_t capacity,
+                         bool binary) {
+    Close();
+    binary_ = binary;
+
+    uint64_t file_size = 0;
+#ifdef _WIN32
+    // No write sharing, appends of another process would be overwritten
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE,
+                              FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                              OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER current;
+    if (!GetFileSizeEx(file, &current)) {
+        CloseHandle(file);
+        return false;
+    }
+    file_handle_ = file;
+    file_size = static_cast<uint64_t>(current.QuadPart);
+#else
+    fd_ = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+        return false;
+    }
+    if (lockf(fd_, F_TLOCK, 0) != 0) {
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    file_size = static_cast<uint64_t>(st.st_size);
+#endif
+
+    // A crashed run may have left a preallocated file behind, map all of it
+    if (capacity < file_size) {
+        capacity = static_cast<size_t>(file_size);
+    }
+    if (!Map(capacity)) {
+        Close();
+        return false;
+    }
+
+    size_ = FindDataEnd(static_cast<size_t>(file_size));
+    return true;
+}
+
+void MappedSegment::Close() {
+    Unmap();
+
+    // Cut off the preallocated tail
+#ifdef _WIN32
+    if (file_handle_ != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER end;
+        end.QuadPart = static_cast<LONGLONG>(size_);
+        SetFilePointerEx(file_handle_, end, nullptr, FILE_BEGIN);
+        SetEndOfFile(file_handle_);
+        CloseHandle(file_handle_);
+        file_handle_ = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (fd_ >= 0) {
+        if (ftruncate(fd_, static_cast<off_t>(size_)) != 0) {
+            // Keep the zero tail, readers stop at it
+        }
+        close(fd_);
+        fd_ = -1;
+    }
+#endif
+    capacity_ = 0;
+    size_ = 0;
+}
+
+size_t MappedSegment::Write(const char* data, size_t len) {
+    if (!view_) return 0;
+
+    if (size_ + len > capacity_) {
+        // Unusually large segment, grow by doubling
+        size_t capacity = capacity_ * 2;
+        if (capacity < size_ + len) {
+            capacity = size_ + len;
+        }
+        Unmap();
+        if (!Map(capacity)) {
+            return 0;
+        }
+    }
+
+    memcpy(view_ + size_, data, len);
+    size_ += len;
+    return len;
+}
+
+size_t MappedSegment::CrashWrite(const char* data, size_t len) {
+    if (!view_ || size_ + len > capacity_) return 0;
+
+    memcpy(view_ + size_, data, len);
+    size_ += len;
+    return len;
+}
+
+bool MappedSegment::Map(size_t capacity) {
+#ifdef _WIN32
+    // Extend the file first, the new range reads as zeros
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>(capacity);
+    if (!SetFilePointerEx(file_handle_, end, nullptr, FILE_BEGIN) ||
+        !SetEndOfFile(file_handle_)) {
+        return false;
+    }
+
+    mapping_handle_ = CreateFileMappingA(file_handle_, nullptr,
+                                         PAGE_READWRITE, 0, 0, nullptr);
+    if (!mapping_handle_) {
+        return false;
+    }
+
+    view_ = static_cast<char*>(
+        MapViewOfFile(mapping_handle_, FILE_MAP_WRITE, 0, 0, capacity));
+    if (!view_) {
+        CloseHandle(mapping_handle_);
+        mapping_handle_ = nullptr;
+        return false;
+    }
+#else
+    // Reserve the blocks up front, fall back to a sparse extension on file
+    // systems without fallocate support
+    if (posix_fallocate(fd_, 0, static_cast<off_t>(capacity)) != 0 &&
+        ftruncate(fd_, static_cast<off_t>(capacity)) != 0) {
+        return false;
+    }
+
+    void* view = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd_, 0);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    view_ = static_cast<char*>(view);
+#endif
+    capacity_ = capacity;
+    return true;
+}
+
+void MappedSegment::Unmap() {
+    if (!view_) return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(view_);
+    CloseHandle(mapping_handle_);
+    mapping_handle_ = nullptr;
+#else
+    munmap(view_, capacity_);
+#endif
+    view_ = nullptr;
+}
+
+size_t MappedSegment::FindDataEnd(size_t file_size) const {
+    if (file_size > capacity_) {
+        file_size = capacity_;
+    }
+
+    if (!binary_) {
+        // Text never contains zero bytes, strip the preallocated tail
+        size_t end = file_size;
+        while (end > 0 && view_[end - 1] == '\0') {
+            end--;
+        }
+        return end;
+    }
+
+    // Binary records may end in zero bytes, walk the record headers until
+    // the zero filled tail (record type 0) or an incomplete record
+    if (file_size == 0) {
+        return 0;
+    }
+    if (file_size < sizeof(kBinaryLogMagic) ||
+        memcmp(view_, kBinaryLogMagic, sizeof(kBinaryLogMagic)) != 0) {
+        // Not a binary log, keep whatever is there
+        size_t end = file_size;
+        while (end > 0 && view_[end - 1] == '\0') {
+            end--;
+        }
+        return end;
+    }
+
+    size_t end = sizeof(kBinaryLogMagic);
+    while (end + kBinaryRecordHeaderSize <= file_size && view_[end] != 0) {
+        uint32_t payload = 0;
+        memcpy(&payload, view_ + end + 1, sizeof(payload));
+        if (end + kBinaryRecordHeaderSize + payload > file_size) {
+            break;
+        }
+        end += kBinaryRecordHeaderSize + payload;
+    }
+    return end;
+}
+
+MappedFileView::MappedFileView()
+    :
+#ifdef _WIN32
+      mapping_handle_(nullptr),
+#endif
+      view_(nullptr),
+      size_(0) {
+}
+
+MappedFileView::~MappedFileView() { Close(); }
+
+bool MappedFileView::Open(const std::string& filename) {
+    Close();
+
+#ifdef _WIN32
+    // Full sharing, the writer keeps appending and renames on rotation
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE |
+                                  FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+    if (size.QuadPart == 0) {
+        CloseHandle(file);
+        return true;  // Empty files cannot be mapped
+    }
+
+    mapping_handle_ =
+        CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping_handle_) {
+        return false;
+    }
+    view_ = static_cast<char*>(
+        MapViewOfFile(mapping_handle_, FILE_MAP_READ, 0, 0, 0));
+    if (!view_) {
+        Close();
+        return false;
+    }
+    size_ = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return true;  // Empty files cannot be mapped
+    }
+
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                      MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    view_ = static_cast<char*>(view);
+    size_ = static_cast<size_t>(st.st_size);
+#endif
+    return true;
+}
+
+void MappedFileView::Close() {
+#ifdef _WIN32
+    if (view_) {
+        UnmapViewOfFile(view_);
+    }
+    if (mapping_handle_) {
+        CloseHandle(mapping_handle_);
+        mapping_handle_ = nullptr;
+    }
+#else
+    if (view_) {
+        munmap(view_, size_);
+    }
+#endif
+    view_ = nullptr;
+    size_ = 0;
+}
+
+}  // namespace tinylog
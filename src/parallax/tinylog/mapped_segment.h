@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Memory mapped, preallocated log segment used by tinylog mapped file mode
+
+namespace tinylog {
+
+/**
+ * @brief Log segment written with memcpy into a file mapping
+ *
+ * The file is preallocated to the requested capacity when it is opened and
+ * truncated to the bytes actually written when it is closed. After a crash
+ * the file keeps its preallocated size; everything up to the last complete
+ * record is intact and followed by zero bytes, Open() skips that tail when
+ * it appends to the file again.
+ *
+ * The segment is opened for exclusive writing, a second process cannot map
+ * the same file.
+ */
+class MappedSegment {
+ public:
+    MappedSegment();
+    ~MappedSegment();
+
+    // binary: file holds binary tinylog records (affects tail recovery)
+    bool Open(const std::string& filename, size_t capacity, bool binary);
+    void Close();
+    bool IsOpen() const { return view_ != nullptr; }
+
+    // Copy data behind the last record, grows the mapping if needed.
+    // Returns bytes written.
+    size_t Write(const char* data, size_t len);
+
+    // Crash handlers only: copy data if it fits the current mapping, never
+    // remaps. Returns bytes written (0 or len).
+    size_t CrashWrite(const char* data, size_t len);
+
+    uint64_t GetSize() const { return size_; }
+
+ private:
+    bool Map(size_t capacity);
+    void Unmap();
+    size_t FindDataEnd(size_t file_size) const;
+
+#ifdef _WIN32
+    void* file_handle_;
+    void* mapping_handle_;
+#else
+    int fd_;
+#endif
+    char* view_;
+    size_t capacity_;  // Preallocated (mapped) bytes
+    size_t size_;      // Bytes written
+    bool binary_;
+};
+
+/**
+ * @brief Read-only mapping of a whole file, used by log readers
+ *
+ * Other processes may keep writing the file, the view covers the size the
+ * file had when it was opened. An empty file opens with no data.
+ */
+class MappedFileView {
+ public:
+    MappedFileView();
+    ~MappedFileView();
+
+    bool Open(const std::string& filename);
+    void Close();
+
+    const char* GetData() const { return view_; }
+    size_t GetSize() const { return size_; }
+
+ private:
+#ifdef _WIN32
+    void* mapping_handle_;
+#endif
+    char* view_;
+    size_t size_;
+};
+
+}  // namespace tinylog
@@ -0,0 +1,158 @@
+#include "platform.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace tinylog {
+
+#ifdef _WIN32
+static uint64_t FromFileTime(const FILETIME& ft) {
+    return (static_cast<uint64_t>(ft.dwHighDateTime) << 32) |
+           ft.dwLowDateTime;
+}
+
+static FILETIME ToFileTime(uint64_t value) {
+    FILETIME ft;
+    ft.dwLowDateTime = static_cast<DWORD>(value & 0xFFFFFFFF);
+    ft.dwHighDateTime = static_cast<DWORD>(value >> 32);
+    return ft;
+}
+
+uint64_t TickMs() { return GetTickCount64(); }
+
+uint64_t FileTimeNow() {
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    return FromFileTime(ft);
+}
+
+uint64_t ToLocalFileTime(uint64_t utc) {
+    FILETIME utc_ft = ToFileTime(utc);
+    FILETIME local_ft;
+    if (!FileTimeToLocalFileTime(&utc_ft, &local_ft)) {
+        return utc;
+    }
+    return FromFileTime(local_ft);
+}
+
+CivilTime ToCivilTime(uint64_t file_time) {
+    FILETIME ft = ToFileTime(file_time);
+    SYSTEMTIME st = {0};
+    FileTimeToSystemTime(&ft, &st);
+    return {st.wYear,   st.wMonth,  st.wDay,         st.wHour,
+            st.wMinute, st.wSecond, st.wMilliseconds};
+}
+
+uint32_t CurrentProcessId() {
+    return static_cast<uint32_t>(GetCurrentProcessId());
+}
+
+uint32_t CurrentThreadId() {
+    return static_cast<uint32_t>(GetCurrentThreadId());
+}
+
+bool FileExists(const std::string& path) {
+    return GetFileAttributesA(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+}
+
+bool MoveFileReplacing(const std::string& from, const std::string& to) {
+    return MoveFileExA(from.c_str(), to.c_str(),
+                       MOVEFILE_REPLACE_EXISTING) != FALSE;
+}
+
+void RemoveFile(const std::string& path) { DeleteFileA(path.c_str()); }
+
+bool EqualsNoCase(const char* a, const char* b) {
+    return _stricmp(a, b) == 0;
+}
+#else
+// FILETIME of the Unix epoch, and FILETIME units per second
+static const uint64_t kUnixEpochFileTime = 116444736000000000ULL;
+static const uint64_t kFileTimePerSecond = 10000000ULL;
+
+static time_t ToUnixSeconds(uint64_t file_time) {
+    return static_cast<time_t>(
+        (static_cast<int64_t>(file_time) -
+         static_cast<int64_t>(kUnixEpochFileTime)) /
+        static_cast<int64_t>(kFileTimePerSecond));
+}
+
+uint64_t TickMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint64_t FileTimeNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return kUnixEpochFileTime +
+           static_cast<uint64_t>(ts.tv_sec) * kFileTimePerSecond +
+           static_cast<uint64_t>(ts.tv_nsec) / 100;
+}
+
+uint64_t ToLocalFileTime(uint64_t utc) {
+    time_t seconds = ToUnixSeconds(utc);
+    struct tm local;
+    if (!localtime_r(&seconds, &local)) {
+        return utc;
+    }
+    return utc + static_cast<int64_t>(local.tm_gmtoff) *
+                     static_cast<int64_t>(kFileTimePerSecond);
+}
+
+CivilTime ToCivilTime(uint64_t file_time) {
+    time_t seconds = ToUnixSeconds(file_time);
+    struct tm fields = {};
+    gmtime_r(&seconds, &fields);
+    return {fields.tm_year + 1900,
+            fields.tm_mon + 1,
+            fields.tm_mday,
+            fields.tm_hour,
+            fields.tm_min,
+            fields.tm_sec,
+            static_cast<int>(file_time % kFileTimePerSecond / 10000)};
+}
+
+uint32_t CurrentProcessId() { return static_cast<uint32_t>(getpid()); }
+
+uint32_t CurrentThreadId() {
+#ifdef __linux__
+    return static_cast<uint32_t>(syscall(SYS_gettid));
+#else
+    return static_cast<uint32_t>((uintptr_t)pthread_self());
+#endif
+}
+
+bool FileExists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+bool MoveFileReplacing(const std::string& from, const std::string& to) {
+    return rename(from.c_str(), to.c_str()) == 0;
+}
+
+void RemoveFile(const std::string& path) { unlink(path.c_str()); }
+
+bool EqualsNoCase(const char* a, const char* b) {
+    while (*a && tolower(static_cast<unsigned char>(*a)) ==
+                     tolower(static_cast<unsigned char>(*b))) {
+        ++a;
+        ++b;
+    }
+    return *a == *b;
+}
+#endif
+
+}  // namespace tinylog
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+// The operating system calls of tinylog, implemented for Windows and POSIX
+
+namespace tinylog {
+
+// Milliseconds of a monotonic clock, for flush delays and timeouts
+uint64_t TickMs();
+
+// Wall clock as a Windows FILETIME: 100 ns units since 1601-01-01 UTC
+uint64_t FileTimeNow();
+
+// A FILETIME value moved into the local time zone
+uint64_t ToLocalFileTime(uint64_t utc);
+
+// Calendar fields of a FILETIME value, no time zone conversion
+struct CivilTime {
+    int year;
+    int month;  // 1-12
+    int day;
+    int hour;
+    int minute;
+    int second;
+    int millis;
+};
+CivilTime ToCivilTime(uint64_t file_time);
+
+uint32_t CurrentProcessId();
+uint32_t CurrentThreadId();
+
+bool FileExists(const std::string& path);
+
+// Rename from to to, replacing an existing file
+bool MoveFileReplacing(const std::string& from, const std::string& to);
+void RemoveFile(const std::string& path);
+
+// ASCII case insensitive comparison
+bool EqualsNoCase(const char* a, const char* b);
+
+}  // namespace tinylog
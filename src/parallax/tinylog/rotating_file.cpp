@@ -0,0 +1,261 @@
+#include "rotating_file.h"
+#include "gzip_stream.h"
+#include "platform.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace tinylog {
+
+RotatingFile::RotatingFile()
+    : file_(nullptr),
+      max_file_size_(0),
+      max_files_(0),
+      binary_(false),
+      mapped_(false),
+      compress_rotated_(false),
+      index_interval_(0),
+      next_index_offset_(0),
+      segment_size_(0),
+      generation_(0),
+      cancel_shift_(false) {}
+
+RotatingFile::~RotatingFile() { Close(); }
+
+bool RotatingFile::Open(const char* filename, size_t max_file_size,
+                        int max_files, bool binary, bool mapped) {
+    Close();
+
+    filename_ = filename ? filename : "";
+    max_file_size_ = max_file_size;
+    max_files_ = max_files;
+    binary_ = binary;
+    mapped_ = mapped;
+    segment_size_ = 0;
+
+    if (filename_.empty()) {
+        return false;
+    }
+
+    if (!OpenSegment(true)) {
+        return false;
+    }
+    generation_++;
+
+    // A segment parked by a rotation that never finished (crash during the
+    // cascade) would be overwritten by the next rotation, finish it now
+    if (FileExists(SegmentName(0))) {
+        shift_thread_ = std::thread(ShiftSegments, filename_, max_files_,
+                                    compress_rotated_, &cancel_shift_);
+    }
+    return true;
+}
+
+void RotatingFile::Close() {
+    CloseSegment();
+    WaitForShift();
+}
+
+bool RotatingFile::OpenSegment(bool append) {
+    if (!OpenSegmentFile(append)) {
+        return false;
+    }
+
+    // First write gets an entry, also when appending to an older segment
+    if (index_interval_ > 0) {
+        index_.Open(filename_ + ".idx", append);
+        next_index_offset_ = segment_size_;
+    }
+    return true;
+}
+
+bool RotatingFile::OpenSegmentFile(bool append) {
+    if (mapped_) {
+        // Room for the largest record written past the size limit
+        size_t capacity = max_file_size_ + 64 * 1024;
+        if (mapped_file_.Open(filename_, capacity, binary_)) {
+            segment_size_ = mapped_file_.GetSize();
+            return true;
+        }
+    }
+
+    if (append) {
+        file_ = fopen(filename_.c_str(), binary_ ? "ab" : "a");
+    } else {
+        file_ = fopen(filename_.c_str(), binary_ ? "wb" : "w");
+    }
+    if (!file_) {
+        return false;
+    }
+
+    // Seed size accounting once, every later write only adds to it
+    if (fseek(file_, 0, SEEK_END) == 0) {
+        long size = ftell(file_);
+        segment_size_ = size > 0 ? static_cast<uint64_t>(size) : 0;
+    }
+    return true;
+}
+
+void RotatingFile::CloseSegment() {
+    index_.Close();
+    mapped_file_.Close();
+    if (file_) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+void RotatingFile::Write(const char* data, size_t len) {
+    RotateIfNeeded();
+    Append(data, len);
+}
+
+bool RotatingFile::RotateIfNeeded() {
+    // Check file size, rotate if exceeds limit
+    if (!IsOpen() || segment_size_ <= max_file_size_) {
+        return false;
+    }
+
+    Rotate();
+    return IsOpen();
+}
+
+void RotatingFile::Append(const char* data, size_t len) {
+    if (!data) return;
+
+    if (index_.IsOpen() && segment_size_ >= next_index_offset_) {
+        index_.Add(LogTimeNow(), segment_size_);
+        next_index_offset_ = segment_size_ + index_interval_;
+    }
+
+    if (mapped_file_.IsOpen()) {
+        segment_size_ += mapped_file_.Write(data, len);
+    } else if (file_) {
+        segment_size_ += fwrite(data, 1, len, file_);
+    }
+}
+
+void RotatingFile::CrashWrite(const char* data, size_t len) {
+    if (mapped_file_.IsOpen()) {
+        segment_size_ += mapped_file_.CrashWrite(data, len);
+        return;
+    }
+    if (!file_) {
+        return;
+    }
+
+    // stdio buffer is empty here in practice, every write path flushes
+#ifdef _WIN32
+    HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file_)));
+    DWORD written = 0;
+    if (handle != INVALID_HANDLE_VALUE &&
+        WriteFile(handle, data, static_cast<DWORD>(len), &written, nullptr)) {
+        segment_size_ += written;
+    }
+#else
+    int fd = fileno(file_);
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written <= 0) {
+            break;
+        }
+        data += written;
+        len -= static_cast<size_t>(written);
+        segment_size_ += static_cast<uint64_t>(written);
+    }
+#endif
+}
+
+void RotatingFile::Flush() {
+    // Mapped segments need no flush, copied data is already in the page cache
+    if (file_) {
+        fflush(file_);
+    }
+}
+
+void RotatingFile::Rotate() {
+    // Mapped segments are truncated to their real length here
+    CloseSegment();
+
+    // Previous cascade has to be finished before name.0 is reused
+    WaitForShift();
+
+    // Only one rename on the logging path, then start the new segment
+    MoveFileReplacing(filename_, SegmentName(0));
+    if (index_interval_ > 0) {
+        MoveFileReplacing(filename_ + ".idx", SegmentName(0) + ".idx");
+    }
+    segment_size_ = 0;
+    OpenSegment(false);
+    generation_++;
+
+    shift_thread_ = std::thread(ShiftSegments, filename_, max_files_,
+                                compress_rotated_, &cancel_shift_);
+}
+
+void RotatingFile::WaitForShift() {
+    if (shift_thread_.joinable()) {
+        // Renames finish quickly, only compression is cut short
+        cancel_shift_ = true;
+        shift_thread_.join();
+        cancel_shift_ = false;
+    }
+}
+
+std::string RotatingFile::SegmentName(int index) const {
+    return filename_ + "." + std::to_string(index);
+}
+
+void RotatingFile::ShiftSegments(std::string filename, int max_files,
+                                 bool compress,
+                                 const std::atomic<bool>* cancel) {
+    // Rotate files (log.4 -> log.5, log.3 -> log.4, ..., log.1 -> log.2),
+    // a number holds either a plain or a compressed segment plus its index
+    static const char* const kSuffixes[] = {"", ".gz", ".idx"};
+    for (int i = max_files - 1; i > 0; i--) {
+        for (const char* suffix : kSuffixes) {
+            std::string old_name = filename + "." + std::to_string(i) + suffix;
+            std::string new_name =
+                filename + "." + std::to_string(i + 1) + suffix;
+
+            // Delete the last file
+            if (i == max_files - 1) {
+                RemoveFile(new_name);
+            }
+
+            MoveFileReplacing(old_name, new_name);
+        }
+    }
+
+    // Segment parked by Rotate() becomes log.1
+    MoveFileReplacing(filename + ".0", filename + ".1");
+    MoveFileReplacing(filename + ".0.idx", filename + ".1.idx");
+
+    if (!compress) {
+        return;
+    }
+
+    // Compress plain segments, including ones left by a cancelled run. The
+    // temporary name keeps readers from ever seeing a partial .gz file.
+    for (int i = 1; i <= max_files; i++) {
+        std::string name = filename + "." + std::to_string(i);
+        if (!FileExists(name)) {
+            continue;
+        }
+
+        std::string temp = name + ".gz.tmp";
+        if (!GzipFile(name, temp, cancel) ||
+            !MoveFileReplacing(temp, name + ".gz")) {
+            // Cancelled or failed (e.g. disk full), keep the plain segment
+            RemoveFile(temp);
+            return;
+        }
+        RemoveFile(name);
+    }
+}
+
+}  // namespace tinylog
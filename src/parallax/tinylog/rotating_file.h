@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include "log_index.h"
+#include "mapped_segment.h"
+
+// Size based rotating log file used by tinylog
+
+namespace tinylog {
+
+/**
+ * @brief Log file that rotates to name.1 .. name.N when it grows too large
+ *
+ * The size of the active segment is tracked in memory (seeded once when the
+ * file is opened), so writes never have to query the file position. On
+ * rotation only the active file is renamed to name.0 and reopened, the
+ * rename cascade of older segments runs on a background thread.
+ *
+ * In mapped mode segments are preallocated to max_file_size and written
+ * through a file mapping (see MappedSegment); if the file cannot be mapped
+ * the segment falls back to stdio.
+ *
+ * With compression enabled rotated segments are gzipped to name.N.gz by the
+ * same background thread; the active segment always stays uncompressed. A
+ * rotation cancels compression that is still running instead of waiting for
+ * it, the plain segment is picked up again by the next cascade.
+ *
+ * With an index interval set every segment gets a sidecar time index
+ * (name.idx, see log_index.h) that is renamed along with the segment.
+ *
+ * Not thread safe, callers serialize access.
+ */
+class RotatingFile {
+ public:
+    RotatingFile();
+    ~RotatingFile();
+
+    // binary: open without newline translation
+    // mapped: write segments through a preallocated file mapping
+    bool Open(const char* filename, size_t max_file_size, int max_files,
+              bool binary = false, bool mapped = false);
+    void Close();
+
+    // Gzip rotated segments, takes effect on the next rotation
+    void SetCompressRotated(bool compress) { compress_rotated_ = compress; }
+    bool IsOpen() const { return file_ != nullptr || mapped_file_.IsOpen(); }
+
+    // Add an index entry whenever at least bytes were appended since the last
+    // one (0 disables the index), takes effect on Open
+    void SetIndexInterval(size_t bytes) { index_interval_ = bytes; }
+
+    // Append data, rotating first if the active segment is full
+    void Write(const char* data, size_t len);
+    void Flush();
+
+    // Rotate if the active segment is full, returns true if a new segment
+    // was started
+    bool RotateIfNeeded();
+
+    // Append data to the active segment without checking its size, lets
+    // callers keep related records in one segment
+    void Append(const char* data, size_t len);
+
+    // Crash handlers only: append with a plain system call (or a copy into
+    // the mapping), bypassing stdio buffers and locks. Never rotates.
+    void CrashWrite(const char* data, size_t len);
+
+    const std::string& GetFilename() const { return filename_; }
+    uint64_t GetSegmentSize() const { return segment_size_; }
+
+    // Changes every time a segment is opened (Open or rotation)
+    uint64_t GetGeneration() const { return generation_; }
+
+ private:
+    void Rotate();
+    bool OpenSegment(bool append);
+    bool OpenSegmentFile(bool append);
+    void CloseSegment();
+    void WaitForShift();
+    std::string SegmentName(int index) const;
+
+    // name.0 -> name.1 -> ... -> name.N, runs on shift_thread_. Shifts
+    // plain and .gz segments and their indexes, then compresses plain
+    // segments newest first if compress is set.
+    static void ShiftSegments(std::string filename, int max_files,
+                              bool compress, const std::atomic<bool>* cancel);
+
+    std::string filename_;
+    FILE* file_;
+    size_t max_file_size_;
+    int max_files_;
+    bool binary_;
+    bool mapped_;
+    bool compress_rotated_;
+    MappedSegment mapped_file_;
+    size_t index_interval_;
+    LogIndexWriter index_;
+    uint64_t next_index_offset_;  // Segment size that triggers the next entry
+    uint64_t segment_size_;  // Bytes in the active segment
+    uint64_t generation_;
+    std::thread shift_thread_;
+    std::atomic<bool> cancel_shift_;  // Stop compressing, set by Rotate/Close
+};
+
+}  // namespace tinylog
@@ -0,0 +1,155 @@
+#include "staging_area.h"
+#include "platform.h"
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+namespace tinylog {
+
+struct StagingArea::ThreadBuffer {
+    // Owner thread and flushers take turns, in practice only the owner
+    std::atomic<bool> busy{false};
+    std::vector<char> data;
+    size_t used = 0;
+    size_t records = 0;
+    uint64_t first_tick = 0;  // TickMs() of the oldest record
+
+    void Lock() {
+        while (busy.exchange(true, std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+    bool TryLock() { return !busy.exchange(true, std::memory_order_acquire); }
+    void Unlock() { busy.store(false, std::memory_order_release); }
+};
+
+// Commits the remaining records when the thread exits
+struct ThreadBufferHolder {
+    StagingArea* area = nullptr;
+    StagingArea::ThreadBuffer* buffer = nullptr;
+
+    ~ThreadBufferHolder() {
+        if (area && buffer) {
+            area->Retire(buffer);
+        }
+    }
+};
+
+static thread_local ThreadBufferHolder t_holder;
+
+StagingArea::StagingArea(size_t batch_bytes, CommitFunc commit)
+    : batch_bytes_(batch_bytes), commit_(commit) {}
+
+StagingArea::ThreadBuffer* StagingArea::GetThreadBuffer() {
+    if (!t_holder.buffer) {
+        ThreadBuffer* buffer = new ThreadBuffer();
+        buffer->data.resize(batch_bytes_ * 2);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            buffers_.push_back(buffer);
+        }
+        t_holder.area = this;
+        t_holder.buffer = buffer;
+    }
+    return t_holder.buffer;
+}
+
+void StagingArea::Append(const char* data, size_t len) {
+    ThreadBuffer* buffer = GetThreadBuffer();
+    buffer->Lock();
+
+    // Make room, a single oversized record is passed through on its own
+    if (buffer->used + len > buffer->data.size()) {
+        CommitBuffer(buffer, true);
+        if (len > buffer->data.size()) {
+            buffer->Unlock();
+            commit_(data, len, 1, true);
+            return;
+        }
+    }
+
+    if (buffer->records == 0) {
+        buffer->first_tick = TickMs();
+    }
+    memcpy(&buffer->data[buffer->used], data, len);
+    buffer->used += len;
+    buffer->records++;
+
+    if (buffer->used >= batch_bytes_) {
+        CommitBuffer(buffer, true);
+    }
+    buffer->Unlock();
+}
+
+void StagingArea::CommitStale(uint64_t max_age_ms) {
+    // Producers may hold these locks while blocked on a full queue, which
+    // only the writer can drain, so nothing here may wait
+    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+
+    uint64_t now = TickMs();
+    for (ThreadBuffer* buffer : buffers_) {
+        if (!buffer->TryLock()) {
+            continue;
+        }
+        if (buffer->records > 0 && now - buffer->first_tick >= max_age_ms) {
+            CommitBuffer(buffer, false);
+        }
+        buffer->Unlock();
+    }
+}
+
+void StagingArea::CommitAll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (ThreadBuffer* buffer : buffers_) {
+        buffer->Lock();
+        CommitBuffer(buffer, true);
+        buffer->Unlock();
+    }
+}
+
+void StagingArea::CrashDrain(void (*write)(const char*, size_t)) {
+    // Reading without the lock is the lesser evil here, the interrupted
+    // thread may own it. used is only advanced after the copy.
+    bool locked = mutex_.try_lock();
+    for (ThreadBuffer* buffer : buffers_) {
+        if (buffer->used > 0 && buffer->used <= buffer->data.size()) {
+            write(buffer->data.data(), buffer->used);
+        }
+    }
+    if (locked) {
+        mutex_.unlock();
+    }
+}
+
+void StagingArea::Retire(ThreadBuffer* buffer) {
+    buffer->Lock();
+    CommitBuffer(buffer, true);
+    buffer->Unlock();
+
+    // Flushers only touch buffers while holding mutex_
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffers_.erase(std::remove(buffers_.begin(), buffers_.end(), buffer),
+                       buffers_.end());
+    }
+    delete buffer;
+}
+
+bool StagingArea::CommitBuffer(ThreadBuffer* buffer, bool wait) {
+    if (buffer->records == 0) {
+        return true;
+    }
+
+    if (!commit_(buffer->data.data(), buffer->used, buffer->records, wait)) {
+        return false;
+    }
+
+    buffer->used = 0;
+    buffer->records = 0;
+    return true;
+}
+
+}  // namespace tinylog
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Per-thread staging of log records for tinylog asynchronous write mode
+
+namespace tinylog {
+
+/**
+ * @brief Collects records in a buffer owned by the logging thread and hands
+ *        them to the shared sink in batches
+ *
+ * Appending only touches the calling thread's buffer. A buffer is committed
+ * when it reaches the batch size, when its oldest record is older than the
+ * writer's age limit (CommitStale) or on explicit flush (CommitAll). Records
+ * of one thread stay in order; ordering across threads is recovered from the
+ * global sequence number in every record.
+ *
+ * A process has a single staging area, the per-thread buffers are tied to it
+ * through thread local storage.
+ */
+class StagingArea {
+ public:
+    // Hand a batch of records to the shared sink. With wait=false the
+    // function must not block and returns false if the batch was not taken.
+    typedef bool (*CommitFunc)(const char* data, size_t len, size_t records,
+                               bool wait);
+
+    // batch_bytes: buffer size that triggers a commit
+    StagingArea(size_t batch_bytes, CommitFunc commit);
+    ~StagingArea() = default;
+
+    // Append one record to the calling thread's buffer
+    void Append(const char* data, size_t len);
+
+    // Commit buffers whose oldest record is at least max_age_ms old. Never
+    // blocks, meant for the writer thread.
+    void CommitStale(uint64_t max_age_ms);
+
+    // Commit every buffer, must not be called from the writer thread
+    void CommitAll();
+
+    // Crash handlers only: pass every buffer to write without waiting for
+    // locks or committing anything
+    void CrashDrain(void (*write)(const char* data, size_t len));
+
+ private:
+    struct ThreadBuffer;
+    friend struct ThreadBufferHolder;
+
+    ThreadBuffer* GetThreadBuffer();
+    void Retire(ThreadBuffer* buffer);
+    bool CommitBuffer(ThreadBuffer* buffer, bool wait);
+
+    const size_t batch_bytes_;
+    const CommitFunc commit_;
+
+    std::mutex mutex_;                    // Protects buffers_
+    std::vector<ThreadBuffer*> buffers_;  // Buffers of live threads
+};
+
+}  // namespace tinylog
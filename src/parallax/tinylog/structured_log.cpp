@@ -0,0 +1,133 @@
+#include "structured_log.h"
+#include <math.h>
+#include <string.h>
+#include <charconv>
+
+namespace tinylog {
+
+static void AppendSigned(std::string& out, long long value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+void AppendUnsigned(std::string& out, unsigned long long value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+// Shortest representation that round trips, JSON has no NaN/Inf
+static void AppendDouble(std::string& out, double value, bool json) {
+    if (!isfinite(value)) {
+        out.append(json ? "null" : (isnan(value) ? "nan" : "inf"));
+        return;
+    }
+    char digits[32];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+void AppendJsonString(std::string& out, const char* s, size_t len) {
+    static const char kHex[] = "0123456789abcdef";
+
+    out.push_back('"');
+    size_t run = 0;  // Bytes that need no escaping are copied in one go
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = static_cast<unsigned char>(s[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        out.append(s + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"':
+                out.append("\\\"");
+                break;
+            case '\\':
+                out.append("\\\\");
+                break;
+            case '\n':
+                out.append("\\n");
+                break;
+            case '\r':
+                out.append("\\r");
+                break;
+            case '\t':
+                out.append("\\t");
+                break;
+            default:
+                out.append("\\u00");
+                out.push_back(kHex[c >> 4]);
+                out.push_back(kHex[c & 0xF]);
+                break;
+        }
+    }
+    out.append(s + run, len - run);
+    out.push_back('"');
+}
+
+void LogField::AppendJson(std::string& out) const {
+    switch (type_) {
+        case Type::kNull:
+            out.append("null");
+            break;
+        case Type::kBool:
+            out.append(value_.b ? "true" : "false");
+            break;
+        case Type::kInt:
+            AppendSigned(out, value_.i);
+            break;
+        case Type::kUint:
+            AppendUnsigned(out, value_.u);
+            break;
+        case Type::kDouble:
+            AppendDouble(out, value_.d, true);
+            break;
+        case Type::kString:
+            AppendJsonString(out, value_.s.data, value_.s.len);
+            break;
+    }
+}
+
+void LogField::AppendText(std::string& out) const {
+    switch (type_) {
+        case Type::kString:
+            out.append(value_.s.data, value_.s.len);
+            break;
+        case Type::kDouble:
+            AppendDouble(out, value_.d, false);
+            break;
+        default:
+            AppendJson(out);
+            break;
+    }
+}
+
+void AppendFieldsText(std::string& out, const char* event,
+                      const LogFields& fields) {
+    out.append(event);
+    out.push_back(':');
+    bool first = true;
+    for (const LogField& field : fields) {
+        out.append(first ? " " : ", ");
+        out.append(field.key());
+        out.push_back('=');
+        field.AppendText(out);
+        first = false;
+    }
+}
+
+void AppendFieldsJson(std::string& out, const LogFields& fields) {
+    bool first = true;
+    for (const LogField& field : fields) {
+        if (!first) out.push_back(',');
+        AppendJsonString(out, field.key(), strlen(field.key()));
+        out.push_back(':');
+        field.AppendJson(out);
+        first = false;
+    }
+}
+
+}  // namespace tinylog
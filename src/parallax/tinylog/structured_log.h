@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include <initializer_list>
+#include <string>
+
+// Key/value fields for the *_kv structured log macros in tinylog.h. Values
+// are rendered directly (no printf) into the text log and the JSON-lines
+// sink.
+
+namespace tinylog {
+
+/**
+ * @brief One key/value pair of a structured record
+ *
+ * Built implicitly from brace pairs, e.g. {"duration_ms", 120}. Only
+ * references its key and string values, so it must not outlive the log
+ * call.
+ */
+class LogField {
+ public:
+    enum class Type { kNull, kBool, kInt, kUint, kDouble, kString };
+
+    LogField(const char* key, bool value) : key_(key), type_(Type::kBool) {
+        value_.b = value;
+    }
+    LogField(const char* key, int value) : LogField(key, (long long)value) {}
+    LogField(const char* key, long value) : LogField(key, (long long)value) {}
+    LogField(const char* key, long long value)
+        : key_(key), type_(Type::kInt) {
+        value_.i = value;
+    }
+    LogField(const char* key, unsigned int value)
+        : LogField(key, (unsigned long long)value) {}
+    LogField(const char* key, unsigned long value)
+        : LogField(key, (unsigned long long)value) {}
+    LogField(const char* key, unsigned long long value)
+        : key_(key), type_(Type::kUint) {
+        value_.u = value;
+    }
+    LogField(const char* key, double value)
+        : key_(key), type_(Type::kDouble) {
+        value_.d = value;
+    }
+    LogField(const char* key, const char* value)
+        : key_(key), type_(value ? Type::kString : Type::kNull) {
+        value_.s.data = value;
+        value_.s.len = value ? strlen(value) : 0;
+    }
+    LogField(const char* key, const std::string& value)
+        : key_(key), type_(Type::kString) {
+        value_.s.data = value.data();
+        value_.s.len = value.size();
+    }
+
+    const char* key() const { return key_; }
+    Type type() const { return type_; }
+
+    // Append the value as JSON / as plain text (strings unquoted)
+    void AppendJson(std::string& out) const;
+    void AppendText(std::string& out) const;
+
+ private:
+    const char* key_;
+    Type type_;
+    union {
+        bool b;
+        long long i;
+        unsigned long long u;
+        double d;
+        struct {
+            const char* data;
+            size_t len;
+        } s;
+    } value_;
+};
+
+typedef std::initializer_list<LogField> LogFields;
+
+// Append s as a quoted JSON string
+void AppendJsonString(std::string& out, const char* s, size_t len);
+
+// Append "event: key=value, key=value" (text log message)
+void AppendFieldsText(std::string& out, const char* event,
+                      const LogFields& fields);
+
+// Append "key":value pairs separated by commas (no braces)
+void AppendFieldsJson(std::string& out, const LogFields& fields);
+
+// Unsigned decimal
+void AppendUnsigned(std::string& out, unsigned long long value);
+
+}  // namespace tinylog
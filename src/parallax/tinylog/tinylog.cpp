@@ -1,5 +1,16 @@
 #include "tinylog.h"
-#include <windows.h>
+#include "binary_log.h"
+#include "console_writer.h"
+#include "flight_recorder.h"
+#include "log_limiter.h"
+#include "log_query.h"
+#include "log_shipper.h"
+#include "log_queue.h"
+#include "log_forwarder.h"
+#include "log_sink.h"
+#include "platform.h"
+#include "rotating_file.h"
+#include "staging_area.h"
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,115 +19,572 @@
 #include <string>
 #include <iostream>
 #include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
 
 // Log level strings
 static const char* const priorities[] = {"CRIT", "ERROR", "WARN",
                                          "INFO", "DEBUG", "TRACE"};
 
 // Global variables
-static char* g_filename = nullptr;
-static FILE* g_file = nullptr;
-static int g_log_max_level = 3;                 // Default INFO level
-static int g_console_output = 1;                // Default output to console
+static tinylog::RotatingFile g_log_file;        // Log file
+static std::atomic<int> g_log_max_level{3};     // Default INFO level
 static int g_sync_write = 1;                    // Default synchronous write
-static int g_quiet = 0;                         // Default not quiet
-static int g_max_file_size = 10 * 1024 * 1024;  // Default 10MB
-static int g_max_files = 5;                     // Default 5 files
-static std::mutex g_log_mutex;                  // Log mutex
-static bool g_initialized = false;
-static std::atomic<int> g_log_index{1};  // Log sequence number
+static std::atomic<int> g_quiet{0};             // Default not quiet
+static std::mutex g_log_mutex;                  // File mutex
+static std::atomic<bool> g_initialized{false};
+static std::atomic<unsigned long long> g_log_sequence{0};  // Never wraps
+static const unsigned long long kLogIndexWrap = 500000;  // Displayed index
 
-// Get current time string
-static void get_time_string(char* buffer, size_t buffer_size) {
-    SYSTEMTIME st;
-    GetLocalTime(&st);
-    snprintf(buffer, buffer_size, "%04d-%02d-%02d %02d:%02d:%02d.%03d",
-             st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond,
-             st.wMilliseconds);
+// Per-thread header cache, "[pid-tid:" is rendered once per thread and the
+// date part is only re-rendered when the clock moves past the cached second
+struct ThreadHeaderCache {
+    char id_prefix[32];
+    int id_prefix_len;
+    unsigned long long minute;  // Minutes since 1601 of the cached date
+    unsigned long long second;  // Seconds since 1601 of the cached date
+    char date[40];              // "YYYY-MM-DD HH:MM:SS."
+};
+static thread_local ThreadHeaderCache t_header_cache = {{0}, 0, 0, 0, {0}};
+
+// Every finished record fans out to the registered sinks: the log file,
+// the console, the JSON-lines file and whatever was added at runtime
+static tinylog::SinkRegistry g_sinks;
+
+// Console output (console_output=1), written by its own thread
+static const size_t kConsoleQueueSize = 4 * 1024 * 1024;
+static tinylog::ConsoleWriter g_console_writer;
+
+// Asynchronous write mode (sync_write=0)
+static const size_t kAsyncBatchBytes = 64 * 1024;  // Max bytes per fwrite
+static size_t g_async_queue_size = 4 * 1024 * 1024;  // Default 4MB queue
+static tinylog::OverflowPolicy g_overflow_policy =
+    tinylog::OverflowPolicy::kBlock;
+static tinylog::LogQueue g_async_queue;
+static std::atomic<bool> g_async_write{false};
+static std::thread g_writer_thread;
+
+// Per-thread staging in asynchronous mode, producers touch the shared queue
+// once per batch instead of once per record
+static const size_t kStagingBatchBytes = 16 * 1024;  // Commit threshold
+static const int kStagingMaxAgeMs = 100;  // Writer commits older batches
+static bool commit_staged(const char* data, size_t len, size_t records,
+                          bool wait);
+static tinylog::StagingArea g_staging(kStagingBatchBytes, commit_staged);
+
+// Set by tinylog_crash_flush once it owns the file (or gave up waiting for
+// it), from then on it writes everything still queued itself
+static std::atomic<bool> g_crash_started{false};
+static std::atomic<bool> g_crash_flushed{false};
+
+// Sidecar time index of the log file ("parallax logs --since" seeks with it),
+// one entry per 64 KB keeps a 10 MB segment's index at 2.5 KB
+static const size_t kLogIndexIntervalBytes = 64 * 1024;
+
+// File write mode (TINYLOG_FILE_xxx) and rotated segment compression,
+// applied on next init
+static int g_log_file_mode = TINYLOG_FILE_STDIO;
+static bool g_rotate_compression = false;
+
+// Binary file format (TINYLOG_FORMAT_BINARY)
+static int g_log_format = TINYLOG_FORMAT_TEXT;  // Applied on next init
+static std::atomic<bool> g_binary_format{false};
+static tinylog::BinaryLogWriter g_binary_writer(g_log_file);
+
+// JSON-lines sink (set_log_json_file)
+static std::string g_json_filename;  // Applied on next init
+
+// Flight recorder (set_log_flight_recorder): records enabled only for it,
+// DEBUG while the file gets INFO, stay in per-thread memory rings until an
+// ERROR record or a failed component writes them out. Modules with a level
+// of their own keep exactly that level.
+static const int kFlightRecorderLevel = 4;
+static const size_t kFlightRecorderMinBytes = 16 * 1024;
+static tinylog::FlightRecorder g_flight_recorder;
+
+// Per-thread buffers for structured and JSON records, reused so that a
+// record normally costs no allocation. printf-style records are rendered on
+// the stack and only go to the spill buffers when they do not fit there.
+// All of them keep the memory of the longest record up to
+// kRecordBufferMaxBytes, so long records do not allocate either.
+static const size_t kRecordBufferBytes = 4096;
+static const size_t kRecordBufferMaxBytes = 1024 * 1024;  // Shrink above
+static thread_local std::string t_text_buffer;
+static thread_local std::string t_json_buffer;
+static thread_local std::string t_text_spill;
+static thread_local std::string t_binary_spill;
+
+// Longest record (0: unlimited), see set_log_record_max_bytes. Cut records
+// end in " [N bytes truncated]".
+static const size_t kRecordMaxBytesMin = 1024;
+static const size_t kTruncationMarkerBytes = 40;  // Longest marker
+static std::atomic<size_t> g_record_max_bytes{1024 * 1024};
+
+// Next record index, keeps the historical 1..500000 display range. The modulo
+// is taken on a 64-bit counter so concurrent callers never race on a reset.
+static unsigned int next_log_index() {
+    return static_cast<unsigned int>(
+        g_log_sequence.fetch_add(1, std::memory_order_relaxed) %
+            kLogIndexWrap +
+        1);
 }
 
-// Get file size
-static long get_file_size(FILE* file) {
-    if (!file) return 0;
+// Render "YYYY-MM-DD HH:MM:SS.mmm" (23 chars, not terminated), returns length
+static int format_time(char* buffer) {
+    ThreadHeaderCache& cache = t_header_cache;
 
-    long current_pos = ftell(file);
-    fseek(file, 0, SEEK_END);
-    long size = ftell(file);
-    fseek(file, current_pos, SEEK_SET);
-    return size;
+    uint64_t file_time = tinylog::FileTimeNow();
+    unsigned long long ms = file_time / 10000;
+    unsigned long long second = ms / 1000;
+
+    if (second / 60 != cache.minute || cache.date[0] == 0) {
+        // Minute changed, render the whole date in local time
+        tinylog::CivilTime st =
+            tinylog::ToCivilTime(tinylog::ToLocalFileTime(file_time));
+        snprintf(cache.date, sizeof(cache.date),
+                 "%04d-%02d-%02d %02d:%02d:%02d.", st.year, st.month, st.day,
+                 st.hour, st.minute, st.second);
+        cache.minute = second / 60;
+        cache.second = second;
+    } else if (second != cache.second) {
+        // Same minute, only the seconds digits change
+        int sec = static_cast<int>(second % 60);
+        cache.date[17] = static_cast<char>('0' + sec / 10);
+        cache.date[18] = static_cast<char>('0' + sec % 10);
+        cache.second = second;
+    }
+
+    int millis = static_cast<int>(ms % 1000);
+    memcpy(buffer, cache.date, 20);
+    buffer[20] = static_cast<char>('0' + millis / 100);
+    buffer[21] = static_cast<char>('0' + millis / 10 % 10);
+    buffer[22] = static_cast<char>('0' + millis % 10);
+    return 23;
 }
 
-// Rotate log files
-static void rotate_log_files() {
-    if (!g_filename) return;
+// Render "[pid-tid:idx] YYYY-MM-DD HH:MM:SS.mmm [LEVEL] - " into buffer
+// (at least 128 bytes), returns length
+static int format_header(char* buffer, int a_priority, unsigned int idx) {
+    ThreadHeaderCache& cache = t_header_cache;
+    if (cache.id_prefix_len == 0) {
+        cache.id_prefix_len =
+            snprintf(cache.id_prefix, sizeof(cache.id_prefix), "[%d-%d:",
+                     (int)tinylog::CurrentProcessId(),
+                     (int)tinylog::CurrentThreadId());
+    }
 
-    // Close current file
-    if (g_file) {
-        fclose(g_file);
-        g_file = nullptr;
+    char* p = buffer;
+    memcpy(p, cache.id_prefix, cache.id_prefix_len);
+    p += cache.id_prefix_len;
+
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = static_cast<char>('0' + idx % 10);
+        idx /= 10;
+    } while (idx > 0);
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+    *p++ = ']';
+    *p++ = ' ';
+
+    p += format_time(p);
+
+    const char* level = (a_priority >= 0 && a_priority < 6)
+                            ? priorities[a_priority]
+                            : "UNKNOWN";
+    *p++ = ' ';
+    *p++ = '[';
+    size_t level_len = strlen(level);
+    memcpy(p, level, level_len);
+    p += level_len;
+    memcpy(p, "] - ", 4);
+    p += 4;
+
+    return static_cast<int>(p - buffer);
+}
+
+// Take a per-thread spill buffer of at least size bytes. Its memory stays
+// for the next long record unless it is oversized.
+static char* acquire_spill(std::string& spill, size_t size) {
+    if (spill.capacity() > kRecordBufferMaxBytes &&
+        size <= kRecordBufferMaxBytes) {
+        std::string().swap(spill);
+    }
+    if (spill.size() < size) {
+        spill.resize(size);
+    }
+    return &spill[0];
+}
+
+// Render header and message, terminated by "\n\0". The record is built in
+// buffer if it fits and in the thread's text spill buffer otherwise, *out
+// points to it. Messages over the record length limit are cut. Returns the
+// length or -1 on a format error, *header_len is the length of the header.
+static int format_record(char* buffer, size_t size, int a_priority,
+                         unsigned int idx, const char* a_format, va_list va,
+                         int* header_len, char** out) {
+    int len = format_header(buffer, a_priority, idx);
+    *header_len = len;
+    *out = buffer;
+
+    // A message that does not fit is formatted again into the spill buffer
+    va_list va_spill;
+    va_copy(va_spill, va);
+    int msg_len = vsnprintf(buffer + len, size - len - 1, a_format, va);
+    if (msg_len < 0) {
+        va_end(va_spill);
+        return -1;
     }
 
-    // Rotate files (log.4 -> log.5, log.3 -> log.4, ..., log.1 -> log.2)
-    for (int i = g_max_files - 1; i > 0; i--) {
-        char old_name[512], new_name[512];
-        snprintf(old_name, sizeof(old_name), "%s.%d", g_filename, i);
-        snprintf(new_name, sizeof(new_name), "%s.%d", g_filename, i + 1);
+    size_t keep = static_cast<size_t>(msg_len);
+    size_t cut = 0;
+    size_t max_bytes = g_record_max_bytes.load(std::memory_order_relaxed);
+    if (max_bytes > 0 && len + keep + 1 > max_bytes) {
+        keep = max_bytes - len - 1 - kTruncationMarkerBytes;
+        cut = msg_len - keep;
+    }
+
+    char* record = buffer;
+    size_t room = size - len - 2;  // Message space in front of "\n\0"
+    if (keep + (cut > 0 ? kTruncationMarkerBytes : 0) > room) {
+        record = acquire_spill(t_text_spill,
+                               len + keep + kTruncationMarkerBytes + 2);
+        memcpy(record, buffer, len);
+        vsnprintf(record + len, keep + 1, a_format, va_spill);
+    }
+    va_end(va_spill);
 
-        // Delete the last file
-        if (i == g_max_files - 1) {
-            DeleteFileA(new_name);
+    len += static_cast<int>(keep);
+    if (cut > 0) {
+        len += snprintf(record + len, kTruncationMarkerBytes + 1,
+                        " [%zu bytes truncated]", cut);
+    }
+    record[len++] = '\n';
+    record[len] = '\0';
+    *out = record;
+    return len;
+}
+
+// Cut a rendered record ending in '\n' to the record length limit
+static void truncate_record(std::string& text) {
+    size_t max_bytes = g_record_max_bytes.load(std::memory_order_relaxed);
+    if (max_bytes == 0 || text.size() <= max_bytes) {
+        return;
+    }
+    size_t keep = max_bytes - 1 - kTruncationMarkerBytes;
+    char marker[kTruncationMarkerBytes + 1];
+    int marker_len = snprintf(marker, sizeof(marker), " [%zu bytes truncated]",
+                              text.size() - 1 - keep);
+    text.resize(keep);
+    text.append(marker, marker_len);
+    text.push_back('\n');
+}
+
+// Encode a text record into binary, or into the thread's binary spill
+// buffer when it does not fit; *out points to the record
+static size_t encode_binary_text(char* binary, size_t size, int a_priority,
+                                 unsigned int idx, const char* text,
+                                 size_t len, char** out) {
+    if (len + tinylog::kBinaryTextOverhead > size) {
+        size = len + tinylog::kBinaryTextOverhead;
+        binary = acquire_spill(t_binary_spill, size);
+    }
+    *out = binary;
+    return tinylog::EncodeBinaryText(binary, size, a_priority, idx, text, len);
+}
+
+// Take a per-thread buffer, emptied and with the usual record size reserved
+static std::string& acquire_buffer(std::string& buffer) {
+    if (buffer.capacity() > kRecordBufferMaxBytes) {
+        std::string().swap(buffer);  // Drop memory of an oversized record
+    }
+    buffer.clear();
+    buffer.reserve(kRecordBufferBytes);
+    return buffer;
+}
+
+// Start a JSON record: {"ts":"...","level":"...","pid":..,"tid":..,"idx":..
+static void begin_json_record(std::string& out, int a_priority,
+                              unsigned int idx) {
+    char time[32];
+    int time_len = format_time(time);
+    time[10] = 'T';  // ISO 8601, local time
+
+    const char* level = (a_priority >= 0 && a_priority < 6)
+                            ? priorities[a_priority]
+                            : "UNKNOWN";
+    out.append("{\"ts\":\"");
+    out.append(time, time_len);
+    out.append("\",\"level\":\"");
+    out.append(level);
+    out.append("\",\"pid\":");
+    tinylog::AppendUnsigned(out, tinylog::CurrentProcessId());
+    out.append(",\"tid\":");
+    tinylog::AppendUnsigned(out, tinylog::CurrentThreadId());
+    out.append(",\"idx\":");
+    tinylog::AppendUnsigned(out, idx);
+}
+
+// Write records to file (caller holds g_log_mutex)
+static void write_records(const char* data, size_t len) {
+    if (g_binary_format) {
+        g_binary_writer.Write(data, len);
+    } else {
+        g_log_file.Write(data, len);
+    }
+}
+
+// Write log to file (caller holds g_log_mutex)
+static void write_to_file(const char* data, size_t len) {
+    write_records(data, len);
+    if (g_sync_write) {
+        g_log_file.Flush();
+    }
+}
+
+// Hand a staged batch to the writer thread, fall back to a synchronous
+// write if the queue has been closed concurrently or the record is larger
+// than the whole queue
+static bool commit_staged(const char* data, size_t len, size_t records,
+                          bool wait) {
+    tinylog::PushResult result = g_async_queue.Push(data, len, records, wait);
+    if (result == tinylog::PushResult::kFull) {
+        return false;
+    }
+
+    // Only single records passed through by their own thread are that
+    // large (staged batches are smaller than any queue). The writer thread
+    // must not wait for itself, it leaves the batch staged.
+    if (result == tinylog::PushResult::kTooLarge) {
+        if (!wait) {
+            return false;
         }
+        g_async_queue.WaitDrained();
+        std::lock_guard<std::mutex> lock(g_log_mutex);
+        write_to_file(data, len);
+        return true;
+    }
 
-        // Rename file
-        MoveFileA(old_name, new_name);
+    if (result == tinylog::PushResult::kClosed) {
+        std::lock_guard<std::mutex> lock(g_log_mutex);
+        write_to_file(data, len);
     }
+    return true;
+}
+
+// Append rendered records to the log file. They are staged for the writer
+// thread in asynchronous mode (crash safe, see tinylog_crash_flush),
+// otherwise written under g_log_mutex.
+static void write_file_data(const char* data, size_t len) {
+    if (!g_initialized) return;
 
-    // Rename current log file to .1
-    char backup_name[512];
-    snprintf(backup_name, sizeof(backup_name), "%s.1", g_filename);
-    MoveFileA(g_filename, backup_name);
+    if (g_async_write) {
+        g_staging.Append(data, len);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(g_log_mutex);
+    write_to_file(data, len);
+}
 
-    // Reopen new log file
-    g_file = fopen(g_filename, "w");
+// Append a text line to the log file, header included. Binary files keep
+// the whole line as the message of a text record.
+static void write_file_text(int a_priority, unsigned int idx,
+                            const char* text, size_t len) {
+    if (g_binary_format) {
+        char binary[4096];
+        char* record = nullptr;
+        size_t record_len = encode_binary_text(binary, sizeof(binary),
+                                               a_priority, idx, text, len,
+                                               &record);
+        write_file_data(record, record_len);
+    } else {
+        write_file_data(text, len);
+    }
 }
 
-// Write log to file
-static void write_to_file(const char* log_message) {
-    if (!g_file || !log_message) return;
+// Log file sink, binary or text depending on the file format
+class FileSink : public tinylog::LogSink {
+ public:
+    void Write(const tinylog::LogRecord& record) override {
+        const char* data = g_binary_format ? record.binary : record.text;
+        size_t len = g_binary_format ? record.binary_len : record.text_len;
+        if (data) {
+            write_file_data(data, len);
+        }
+    }
+
+    void Flush() override {
+        if (g_async_write) {
+            g_staging.CommitAll();
+            g_async_queue.WaitDrained();
+        }
+        std::lock_guard<std::mutex> lock(g_log_mutex);
+        g_log_file.Flush();
+    }
 
-    // Check file size, rotate if exceeds limit
-    if (get_file_size(g_file) > g_max_file_size) {
-        rotate_log_files();
+    unsigned GetNeeds() const override {
+        return g_binary_format ? tinylog::kSinkNeedsBinary
+                               : tinylog::kSinkNeedsText;
     }
+};
 
-    if (g_file) {
-        fputs(log_message, g_file);
-        if (g_sync_write) {
-            fflush(g_file);
+// Console sink, lines are queued for the console writer thread
+class ConsoleSink : public tinylog::LogSink {
+ public:
+    void Write(const tinylog::LogRecord& record) override {
+        if (record.text) {
+            g_console_writer.Write(record.priority, record.text,
+                                   record.text_len);
         }
     }
+
+    void Flush() override { g_console_writer.Flush(); }
+};
+
+// Console is the only sink before tinylog_init (console_output defaults to
+// on), tinylog_init registers the others
+static struct TinylogDefaultSinks {
+    TinylogDefaultSinks() {
+        g_sinks.Add(std::make_shared<ConsoleSink>(), 4, false,
+                    TINYLOG_SINK_CONSOLE);
+    }
+} g_default_sinks;
+
+// Writer thread for asynchronous mode, drains the queue in batches
+static void async_writer_proc() {
+    std::string batch;
+    batch.reserve(kAsyncBatchBytes);
+    unsigned long long reported_drops = 0;
+    unsigned long long last_stale_check = tinylog::TickMs();
+
+    while (true) {
+        // Batches of threads that stopped logging are picked up by age
+        unsigned long long now = tinylog::TickMs();
+        if (now - last_stale_check >= kStagingMaxAgeMs / 2) {
+            g_staging.CommitStale(kStagingMaxAgeMs);
+            last_stale_check = now;
+        }
+
+        batch.clear();
+        size_t count =
+            g_async_queue.PopBatch(batch, kAsyncBatchBytes, kStagingMaxAgeMs / 2);
+        if (count == 0) {
+            if (g_async_queue.IsFinished()) {
+                break;  // Queue closed and drained
+            }
+            continue;
+        }
+
+        // Records discarded since last batch are reported in the file so that
+        // gaps in the sequence numbers can be explained. Written on its own,
+        // the popped batch must stay unchanged until Commit.
+        char notice[256];
+        size_t notice_len = 0;
+        unsigned long long drops = g_async_queue.GetDroppedCount();
+        if (drops != reported_drops) {
+            char text[128];
+            int text_len = snprintf(
+                text, sizeof(text),
+                "tinylog: %llu records dropped on queue overflow\n",
+                drops - reported_drops);
+
+            if (g_binary_format) {
+                notice_len = tinylog::EncodeBinaryText(
+                    notice, sizeof(notice), 2, next_log_index(), text, text_len);
+            } else {
+                int len = format_header(notice, 2, next_log_index());
+                memcpy(notice + len, text, text_len);
+                notice_len = len + text_len;
+            }
+            reported_drops = drops;
+        }
+
+        {
+            // Committed under the file lock, so the crash path (which takes
+            // it too) sees the batch either written or still in the queue.
+            // After a crash flush batches are discarded, the crash path wrote
+            // them and the process is going down.
+            std::lock_guard<std::mutex> lock(g_log_mutex);
+            if (!g_crash_flushed) {
+                if (notice_len > 0) {
+                    write_records(notice, notice_len);
+                }
+                write_records(batch.data(), batch.size());
+                g_log_file.Flush();
+            }
+            g_async_queue.Commit();
+        }
+    }
+}
+
+// Stop writer thread after it has written every queued record
+static void stop_async_writer() {
+    if (!g_async_write.exchange(false)) {
+        return;
+    }
+
+    g_staging.CommitAll();
+    g_async_queue.Close();
+    if (g_writer_thread.joinable()) {
+        g_writer_thread.join();
+    }
 }
 
 // Initialize log system
 int tinylog_init(const char* filename, int max_file_size, int max_files,
                  int console_output, int sync_write) {
-    std::lock_guard<std::mutex> lock(g_log_mutex);
-
     if (g_initialized) {
         tinylog_uninit();
     }
 
-    g_max_file_size = max_file_size;
-    g_max_files = max_files;
-    g_console_output = console_output;
+    std::lock_guard<std::mutex> lock(g_log_mutex);
+
+    if (console_output) {
+        g_console_writer.Start(kConsoleQueueSize);
+        g_sinks.Add(std::make_shared<ConsoleSink>(), 4, false,
+                    TINYLOG_SINK_CONSOLE);
+    } else {
+        g_sinks.Remove(TINYLOG_SINK_CONSOLE);
+    }
     g_sync_write = sync_write;
+    g_binary_format = (g_log_format == TINYLOG_FORMAT_BINARY);
 
     if (filename) {
-        size_t len = strlen(filename) + 1;
-        g_filename = (char*)malloc(len);
-        if (g_filename) {
-            strcpy_s(g_filename, len, filename);
-            g_file = fopen(g_filename, "a");
+        g_log_file.SetCompressRotated(g_rotate_compression);
+        g_log_file.SetIndexInterval(kLogIndexIntervalBytes);
+        g_log_file.Open(filename, max_file_size > 0 ? max_file_size : 0,
+                        max_files, g_binary_format,
+                        g_log_file_mode == TINYLOG_FILE_MAPPED);
+    }
+
+    // Asynchronous mode only makes sense when there is a file to write
+    if (!sync_write && g_log_file.IsOpen()) {
+        g_async_queue.Open(g_async_queue_size, g_overflow_policy);
+        g_writer_thread = std::thread(async_writer_proc);
+        g_async_write = true;
+    }
+    if (g_log_file.IsOpen()) {
+        g_sinks.Add(std::make_shared<FileSink>(), 4, false, TINYLOG_SINK_FILE);
+    }
+
+    // Follows the write mode of the log file: flushed per record, or
+    // written and flushed per batch by its own thread, with the same queue
+    // size and overflow policy
+    if (!g_json_filename.empty()) {
+        std::shared_ptr<tinylog::LogSink> json_sink;
+        auto json_file = std::make_shared<tinylog::JsonFileSink>(sync_write);
+        if (json_file->Open(g_json_filename.c_str(),
+                            max_file_size > 0 ? max_file_size : 0, max_files,
+                            g_rotate_compression)) {
+            json_sink = json_file;
+            if (!sync_write) {
+                json_sink = std::make_shared<tinylog::AsyncSink>(
+                    json_file, g_async_queue_size, g_overflow_policy);
+            }
+            g_sinks.Add(json_sink, 4, false, TINYLOG_SINK_JSON);
         }
     }
 
@@ -126,31 +594,402 @@ int tinylog_init(const char* filename, int max_file_size, int max_files,
 
 // Uninitialize log system
 void tinylog_uninit() {
+    // Pending "suppressed N messages" summaries go out with the rest
+    if (g_initialized) {
+        tinylog::LogLimiter::ReportAll();
+    }
+
+    // Drain the queue first, writer thread needs g_log_mutex. Sinks added at
+    // runtime stay registered.
+    g_sinks.Remove(TINYLOG_SINK_JSON);
+    stop_async_writer();
+    g_console_writer.Stop();
+
     std::lock_guard<std::mutex> lock(g_log_mutex);
 
-    if (g_file) {
-        fclose(g_file);
-        g_file = nullptr;
+    g_sinks.Remove(TINYLOG_SINK_FILE);
+    g_log_file.Close();
+
+    g_initialized = false;
+}
+
+// Close the log at process exit so that queued records are written and
+// mapped segments are truncated. Defined after the other globals, so it is
+// destroyed before them.
+static struct TinylogShutdown {
+    ~TinylogShutdown() {
+        if (g_initialized) {
+            tinylog_uninit();
+        }
     }
+} g_shutdown;
+
+// Flush queued records
+void tinylog_flush() { g_sinks.Flush(); }
+
+// Crash path, runs in a signal handler or exception filter: no blocking
+// locks, no allocation, the interrupted thread may hold any of them
 
-    if (g_filename) {
-        free(g_filename);
-        g_filename = nullptr;
+// How long the crash path waits for the writer thread to finish its write
+#define CRASH_LOCK_WAIT_MS 200
+
+static void crash_write(const char* data, size_t len) {
+    if (g_binary_format) {
+        g_binary_writer.CrashWrite(data, len);
+    } else {
+        g_log_file.CrashWrite(data, len);
     }
+}
 
-    g_initialized = false;
+static void write_crash_reason(const char* reason) {
+    char line[256];
+    size_t len = 0;
+    const char* parts[] = {"tinylog: ", reason, ", pending records flushed\n"};
+    for (const char* part : parts) {
+        size_t part_len = strlen(part);
+        if (part_len > sizeof(line) - len) {
+            part_len = sizeof(line) - len;
+        }
+        memcpy(line + len, part, part_len);
+        len += part_len;
+    }
+
+    if (g_binary_format) {
+        char record[320];
+        size_t record_len = tinylog::EncodeBinaryText(
+            record, sizeof(record), 0, next_log_index(), line, len);
+        crash_write(record, record_len);
+    } else {
+        crash_write(line, len);
+    }
+}
+
+// Flush pending records after a crash
+void tinylog_crash_flush(const char* reason) {
+    if (!g_initialized || g_crash_started.exchange(true)) {
+        return;
+    }
+
+    // Other threads keep running: wait until the writer thread is between
+    // batches so both do not append to the segment at the same time, it
+    // discards its batches from then on. If the lock holder is the crashed
+    // thread, write anyway after the timeout.
+    unsigned long long start = tinylog::TickMs();
+    bool locked = g_log_mutex.try_lock();
+    while (!locked && tinylog::TickMs() - start < CRASH_LOCK_WAIT_MS) {
+        std::this_thread::yield();
+        locked = g_log_mutex.try_lock();
+    }
+    g_crash_flushed = true;
+
+    // Queued entries (including the batch the writer thread is waiting to
+    // write) are older than anything still staged. Synchronous mode has
+    // nothing pending, every record is flushed when it is written.
+    if (g_async_write) {
+        g_async_queue.CrashDrain(crash_write);
+        g_staging.CrashDrain(crash_write);
+    }
+
+    if (reason) {
+        write_crash_reason(reason);
+    }
+
+    if (locked) {
+        g_log_mutex.unlock();
+    }
+}
+
+// Configure asynchronous write mode
+void set_log_async_options(int queue_size, int overflow_policy) {
+    std::lock_guard<std::mutex> lock(g_log_mutex);
+
+    // Keep room for at least a few full size records
+    g_async_queue_size = queue_size > 64 * 1024 ? queue_size : 64 * 1024;
+
+    switch (overflow_policy) {
+        case TINYLOG_OVERFLOW_DROP_NEWEST:
+            g_overflow_policy = tinylog::OverflowPolicy::kDropNewest;
+            break;
+        case TINYLOG_OVERFLOW_DROP_OLDEST:
+            g_overflow_policy = tinylog::OverflowPolicy::kDropOldest;
+            break;
+        default:
+            g_overflow_policy = tinylog::OverflowPolicy::kBlock;
+            break;
+    }
+}
+
+unsigned long long get_log_dropped_count() {
+    return g_async_queue.GetDroppedCount();
+}
+
+// Select log file format
+void set_log_format(int format) {
+    std::lock_guard<std::mutex> lock(g_log_mutex);
+    g_log_format = format;
+}
+
+// Select log file write mode
+void set_log_file_mode(int mode) {
+    std::lock_guard<std::mutex> lock(g_log_mutex);
+    g_log_file_mode = mode;
+}
+
+// Compress rotated segments
+void set_log_rotate_compression(int enable) {
+    std::lock_guard<std::mutex> lock(g_log_mutex);
+    g_rotate_compression = enable != 0;
+}
+
+// Select JSON-lines file
+void set_log_json_file(const char* filename) {
+    std::lock_guard<std::mutex> lock(g_log_mutex);
+    g_json_filename = filename ? filename : "";
+}
+
+// Level gates read by the log macros, one per module. Each combines the
+// module level, the global level, quiet mode and the flight recorder so
+// that the check is a single load.
+std::atomic<int> tinylog::g_module_levels[TINYLOG_MODULE_COUNT] = {
+    {3}, {3}, {3}, {3}, {3}, {3}};
+
+// Most verbose level handed to the sinks per module, records between this
+// and the gate only go to the flight recorder
+static std::atomic<int> g_module_write_levels[TINYLOG_MODULE_COUNT] = {
+    {3}, {3}, {3}, {3}, {3}, {3}};
+
+// Module levels set explicitly, -1 = follow g_log_max_level
+static int g_module_max_level[TINYLOG_MODULE_COUNT] = {-1, -1, -1,
+                                                       -1, -1, -1};
+static std::mutex g_level_mutex;  // Serializes level updates
+
+static void update_enabled_levels() {
+    std::lock_guard<std::mutex> lock(g_level_mutex);
+    for (int module = 0; module < TINYLOG_MODULE_COUNT; module++) {
+        int level = g_module_max_level[module] >= 0
+                        ? g_module_max_level[module]
+                        : g_log_max_level.load();
+        int written = g_quiet ? -1 : level;
+        int enabled = written;
+        if (!g_quiet && g_flight_recorder.GetCapacity() > 0 &&
+            g_module_max_level[module] < 0 &&
+            enabled < kFlightRecorderLevel) {
+            enabled = kFlightRecorderLevel;
+        }
+        g_module_write_levels[module].store(written,
+                                            std::memory_order_relaxed);
+        tinylog::g_module_levels[module].store(enabled,
+                                               std::memory_order_relaxed);
+    }
 }
 
 // Set log level
-void set_log_level(int log_level) { g_log_max_level = log_level; }
+void set_log_level(int log_level) {
+    g_log_max_level = log_level;
+    update_enabled_levels();
+}
 
 int get_log_level() { return g_log_max_level; }
 
+// Set level of one module
+void set_log_module_level(int module, int log_level) {
+    if (module < 0 || module >= TINYLOG_MODULE_COUNT) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(g_level_mutex);
+        g_module_max_level[module] = log_level < 0 ? -1 : log_level;
+    }
+    update_enabled_levels();
+}
+
+int get_log_module_level(int module) {
+    if (module < 0 || module >= TINYLOG_MODULE_COUNT) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(g_level_mutex);
+    return g_module_max_level[module];
+}
+
+// Apply "MODULE=level,..." list
+int set_log_module_levels(const char* spec) {
+    if (!spec) {
+        return 0;
+    }
+
+    int result = 0;
+    std::string list = spec;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string entry = list.substr(start, end - start);
+        start = end + 1;
+
+        // Trim spaces around the entry and around '='
+        entry.erase(0, entry.find_first_not_of(" \t"));
+        entry.erase(entry.find_last_not_of(" \t") + 1);
+        if (entry.empty()) {
+            continue;
+        }
+        std::string name;
+        std::string value = entry;
+        size_t eq = entry.find('=');
+        if (eq != std::string::npos) {
+            name = entry.substr(0, eq);
+            name.erase(name.find_last_not_of(" \t") + 1);
+            value = entry.substr(eq + 1);
+            value.erase(0, value.find_first_not_of(" \t"));
+        }
+
+        int module = -1;
+        if (name.empty()) {
+            module = TINYLOG_MODULE_DEFAULT;
+        } else {
+            for (int i = 1; i < TINYLOG_MODULE_COUNT; i++) {
+                if (tinylog::EqualsNoCase(name.c_str(),
+                                          tinylog::kModuleNames[i])) {
+                    module = i;
+                    break;
+                }
+            }
+        }
+        bool follow = tinylog::EqualsNoCase(value.c_str(), "default");
+        int level = follow ? -1 : tinylog::ParseLogLevel(value);
+        if (module < 0 || (level < 0 && !follow) ||
+            (name.empty() && follow)) {
+            result = -1;
+            continue;
+        }
+
+        if (name.empty()) {
+            set_log_level(level);
+        } else {
+            set_log_module_level(module, level);
+        }
+    }
+    return result;
+}
+
 // Set quiet mode
-void set_log_quiet(int quiet) { g_quiet = quiet; }
+void set_log_quiet(int quiet) {
+    g_quiet = quiet;
+    update_enabled_levels();
+}
 
 int get_log_quiet() { return g_quiet; }
 
+// Flight recorder
+void set_log_flight_recorder(int bytes_per_thread) {
+    size_t bytes = 0;
+    if (bytes_per_thread > 0) {
+        bytes = static_cast<size_t>(bytes_per_thread);
+        if (bytes < kFlightRecorderMinBytes) {
+            bytes = kFlightRecorderMinBytes;
+        }
+    }
+    g_flight_recorder.SetCapacity(bytes);
+    update_enabled_levels();
+}
+
+int get_log_flight_recorder() {
+    return static_cast<int>(g_flight_recorder.GetCapacity());
+}
+
+// Write the records kept by the flight recorder to the log file between two
+// notice lines. They carry index 0, their own header shows when and on
+// which thread they were logged.
+static void dump_flight_recorder(const char* reason) {
+    if (!g_initialized) {
+        return;
+    }
+    std::vector<tinylog::FlightRecord> records;
+    if (g_flight_recorder.Dump(records) == 0) {
+        return;
+    }
+
+    char notice[384];
+    int header_len = format_header(notice, 3, next_log_index());
+    int len = header_len +
+              snprintf(notice + header_len, sizeof(notice) - header_len,
+                       "tinylog: flight recorder, %zu earlier records (%s)\n",
+                       records.size(), reason);
+    if (len >= (int)sizeof(notice)) {
+        len = sizeof(notice) - 1;
+        notice[len - 1] = '\n';
+    }
+    write_file_text(3, 0, notice, len);
+
+    for (const tinylog::FlightRecord& record : records) {
+        write_file_text(record.priority, 0, record.text.data(),
+                        record.text.size());
+    }
+
+    header_len = format_header(notice, 3, next_log_index());
+    len = header_len + snprintf(notice + header_len,
+                                sizeof(notice) - header_len,
+                                "tinylog: end of flight recorder\n");
+    write_file_text(3, 0, notice, len);
+}
+
+void set_log_record_max_bytes(int max_bytes) {
+    size_t bytes = max_bytes > 0 ? static_cast<size_t>(max_bytes) : 0;
+    if (bytes > 0 && bytes < kRecordMaxBytesMin) {
+        bytes = kRecordMaxBytesMin;
+    }
+    g_record_max_bytes.store(bytes, std::memory_order_relaxed);
+}
+
+int get_log_record_max_bytes() {
+    return static_cast<int>(g_record_max_bytes.load());
+}
+
+void tinylog_dump_flight_recorder(const char* reason) {
+    dump_flight_recorder(reason ? reason : "requested");
+}
+
+// Sink levels and runtime sinks
+int set_log_sink_level(int sink, int log_level) {
+    return g_sinks.SetLevel(sink, log_level) ? 0 : -1;
+}
+
+int get_log_sink_level(int sink) { return g_sinks.GetLevel(sink); }
+
+int tinylog_add_forward_sink(const char* address, int json, int log_level) {
+    if (!address || !*address) return -1;
+    return g_sinks.Add(std::make_shared<tinylog::ForwardSink>(address,
+                                                              json != 0),
+                       log_level, true);
+}
+
+int tinylog_add_shipping_sink(const char* address, int json, int compress,
+                              const char* spool_file, int spool_max_bytes,
+                              int log_level) {
+    if (!address || !*address) return -1;
+
+    tinylog::ShippingOptions options;
+    options.address = address;
+    options.json = json != 0;
+    options.compress = compress != 0;
+    if (spool_file && *spool_file && spool_max_bytes > 0) {
+        options.spool_path = spool_file;
+        options.spool_max_bytes = static_cast<size_t>(spool_max_bytes);
+    }
+    // Has its own thread, producers only copy into its queue
+    return g_sinks.Add(std::make_shared<tinylog::ShippingSink>(options),
+                       log_level, false);
+}
+
+int tinylog_remove_sink(int sink) { return g_sinks.Remove(sink) ? 0 : -1; }
+
+int tinylog::AddSink(std::shared_ptr<LogSink> sink, int level, bool async) {
+    return g_sinks.Add(std::move(sink), level, async);
+}
+
+bool tinylog::RemoveSink(int id) { return g_sinks.Remove(id); }
+
 // Core log function
 void sys_log(int id, int a_priority, const char* file, const int line,
              const char* func, const char* a_format, ...) {
@@ -164,75 +1003,205 @@ void sys_logv(int id, int a_priority, const char* file, const int line,
               const char* func, const char* a_format, va_list va) {
     (void)id;  // Unused parameter
 
-    // Check log level
-    if (a_priority > g_log_max_level || g_quiet) {
+    // Check log level, the format is not a constant for direct callers
+    int module = tinylog::ModuleOf(a_format);
+    if (!tinylog_level_enabled(module, a_priority)) {
         return;
     }
 
-    std::lock_guard<std::mutex> lock(g_log_mutex);
+    // Enabled for the flight recorder only, rendered with index 0
+    if (a_priority >
+        g_module_write_levels[module].load(std::memory_order_relaxed)) {
+        char text[4096];
+        char* rendered = nullptr;
+        int header_len = 0;
+        int len = format_record(text, sizeof(text), a_priority, 0, a_format,
+                                va, &header_len, &rendered);
+        if (len > 0) {
+            g_flight_recorder.Record(a_priority, rendered, len);
+        }
+        return;
+    }
+
+    // What led up to an error goes to the file ahead of it
+    if (a_priority <= 1 && g_flight_recorder.GetCapacity() > 0) {
+        dump_flight_recorder(a_priority == 0 ? "before CRIT" : "before ERROR");
+    }
 
-    // Get time
-    char time_str[64];
-    get_time_string(time_str, sizeof(time_str));
+    // Only the renderings some sink reads are produced, each exactly once
+    unsigned needs = g_sinks.GetNeeds(a_priority);
+    if (needs == 0) {
+        return;
+    }
 
-    // Format user message
-    char user_message[2048];
-    vsnprintf(user_message, sizeof(user_message), a_format, va);
+    tinylog::LogRecord record = {};
+    record.priority = a_priority;
+    record.module = module;
+    record.idx = next_log_index();
+
+    // Binary records keep the raw arguments, the text line is only rendered
+    // when another sink needs it or the format is not supported
+    char binary[4096];
+    if (needs & tinylog::kSinkNeedsBinary) {
+        size_t truncated = 0;
+        va_list va_copy_args;
+        va_copy(va_copy_args, va);
+        record.binary_len = tinylog::EncodeBinaryEvent(
+            binary, sizeof(binary), a_priority, record.idx, file, line, func,
+            a_format, va_copy_args, &truncated);
+        va_end(va_copy_args);
+        if (record.binary_len > 0) {
+            record.binary = binary;
+        }
 
-    // Get process ID, thread ID and log sequence number
-    int pid = GetCurrentProcessId();
-    int tid = GetCurrentThreadId();
-    int log_idx = g_log_index.fetch_add(1);
-    if (log_idx > 500000) {
-        g_log_index = 1;
-        log_idx = 1;
+        // Long string arguments, encode again with room for all of them
+        size_t size = sizeof(binary) + truncated;
+        size_t max_bytes = g_record_max_bytes.load(std::memory_order_relaxed);
+        if (max_bytes > 0 && size > max_bytes) {
+            size = max_bytes;
+        }
+        if (record.binary_len > 0 && size > sizeof(binary)) {
+            char* spill = acquire_spill(t_binary_spill, size);
+            va_copy(va_copy_args, va);
+            size_t spill_len = tinylog::EncodeBinaryEvent(
+                spill, size, a_priority, record.idx, file, line, func,
+                a_format, va_copy_args);
+            va_end(va_copy_args);
+            if (spill_len > 0) {
+                record.binary = spill;
+                record.binary_len = spill_len;
+            }
+        }
     }
 
-    // Assemble complete log message (completely following gradient project
-    // format)
     char log_message[4096];
-    snprintf(log_message, sizeof(log_message), "[%d-%d:%d] %s [%s] - %s\n", pid,
-             tid, log_idx, time_str,
-             (a_priority >= 0 && a_priority < 6) ? priorities[a_priority]
-                                                 : "UNKNOWN",
-             user_message);
-
-    // Output to console
-    if (g_console_output) {
-        // Use different colors based on log level
-        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-        WORD color = FOREGROUND_RED | FOREGROUND_GREEN |
-                     FOREGROUND_BLUE;  // Default white
-
-        switch (a_priority) {
-            case 0:  // CRIT - red background
-                color = FOREGROUND_RED | FOREGROUND_INTENSITY | BACKGROUND_RED;
-                break;
-            case 1:  // ERROR - red
-                color = FOREGROUND_RED | FOREGROUND_INTENSITY;
-                break;
-            case 2:  // WARN - yellow
-                color =
-                    FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY;
-                break;
-            case 3:  // INFO - white
-                color = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
-                break;
-            case 4:  // DEBUG - gray
-                color = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE |
-                        FOREGROUND_INTENSITY;
-                break;
-        }
-
-        SetConsoleTextAttribute(hConsole, color);
-        fputs(log_message, stdout);
-        SetConsoleTextAttribute(
-            hConsole, FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE);
-        fflush(stdout);
-    }
-
-    // Write to file
-    if (g_initialized) {
-        write_to_file(log_message);
+    if ((needs & (tinylog::kSinkNeedsText | tinylog::kSinkNeedsJson)) ||
+        ((needs & tinylog::kSinkNeedsBinary) && !record.binary)) {
+        // Header comes from the per-thread cache, the message is formatted
+        // directly behind it
+        char* rendered = nullptr;
+        int header_len = 0;
+        int log_len = format_record(log_message, sizeof(log_message),
+                                    a_priority, record.idx, a_format, va,
+                                    &header_len, &rendered);
+        if (log_len < 0) {
+            return;
+        }
+
+        record.text = rendered;
+        record.text_len = log_len;
+        record.header_len = header_len;
+
+        if ((needs & tinylog::kSinkNeedsBinary) && !record.binary) {
+            char* encoded = nullptr;
+            record.binary_len = encode_binary_text(
+                binary, sizeof(binary), a_priority, record.idx,
+                rendered + header_len, log_len - header_len, &encoded);
+            record.binary = encoded;
+        }
+    }
+
+    if (needs & tinylog::kSinkNeedsJson) {
+        std::string& line_buffer = acquire_buffer(t_json_buffer);
+        begin_json_record(line_buffer, a_priority, record.idx);
+        line_buffer.append(",\"msg\":");
+        tinylog::AppendJsonString(line_buffer, record.text + record.header_len,
+                                  record.text_len - record.header_len - 1);
+        line_buffer.append("}\n");
+        record.json = line_buffer.data();
+        record.json_len = line_buffer.size();
+    }
+
+    g_sinks.Dispatch(record);
+}
+
+// Text line of a structured record: the given message, else the fields
+static void append_kv_text(std::string& text, const char* event,
+                           const char* message,
+                           const tinylog::LogFields& fields) {
+    if (message) {
+        text.append(message);
+    } else {
+        tinylog::AppendFieldsText(text, event ? event : "", fields);
+    }
+    text.push_back('\n');
+}
+
+// Structured record, fields are rendered straight into per-thread buffers
+void tinylog::LogKV(int priority, int module, const char* event,
+                    const char* message, const char* file, int line,
+                    const char* func, LogFields fields) {
+    (void)file;
+    (void)line;
+    (void)func;
+
+    if (module < 0 || module >= TINYLOG_MODULE_COUNT) {
+        module = TINYLOG_MODULE_DEFAULT;
+    }
+    if (!tinylog_level_enabled(module, priority)) {
+        return;
+    }
+    if (priority >
+        g_module_write_levels[module].load(std::memory_order_relaxed)) {
+        std::string& text = acquire_buffer(t_text_buffer);
+        char header[128];
+        text.append(header, format_header(header, priority, 0));
+        append_kv_text(text, event, message, fields);
+        truncate_record(text);
+        g_flight_recorder.Record(priority, text.data(), text.size());
+        return;
+    }
+    if (priority <= 1 && g_flight_recorder.GetCapacity() > 0) {
+        dump_flight_recorder(priority == 0 ? "before CRIT" : "before ERROR");
+    }
+    unsigned needs = g_sinks.GetNeeds(priority);
+    if (needs == 0) {
+        return;
     }
+
+    LogRecord record = {};
+    record.priority = priority;
+    record.module = module;
+    record.idx = next_log_index();
+
+    // Text is also the source of the binary record
+    std::string& text = acquire_buffer(t_text_buffer);
+    char header[128];
+    int header_len = format_header(header, priority, record.idx);
+    text.append(header, header_len);
+    append_kv_text(text, event, message, fields);
+    truncate_record(text);
+    record.text = text.data();
+    record.text_len = text.size();
+    record.header_len = header_len;
+
+    if (needs & kSinkNeedsJson) {
+        std::string& line_buffer = acquire_buffer(t_json_buffer);
+        begin_json_record(line_buffer, priority, record.idx);
+        line_buffer.append(",\"event\":");
+        AppendJsonString(line_buffer, event ? event : "",
+                         event ? strlen(event) : 0);
+        line_buffer.append(",\"fields\":{");
+        AppendFieldsJson(line_buffer, fields);
+        line_buffer.append("}");
+        if (message) {
+            line_buffer.append(",\"msg\":");
+            AppendJsonString(line_buffer, message, strlen(message));
+        }
+        line_buffer.append("}\n");
+        record.json = line_buffer.data();
+        record.json_len = line_buffer.size();
+    }
+
+    // Binary files store the rendered message as a text record
+    char binary[4096];
+    if (needs & kSinkNeedsBinary) {
+        char* encoded = nullptr;
+        record.binary_len = encode_binary_text(
+            binary, sizeof(binary), priority, record.idx,
+            text.c_str() + header_len, text.size() - header_len, &encoded);
+        record.binary = encoded;
+    }
+
+    g_sinks.Dispatch(record);
 }
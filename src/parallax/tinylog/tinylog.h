@@ -2,6 +2,16 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <atomic>
+#include <type_traits>
+#include "format_check.h"
+#include "log_limiter.h"
+#include "structured_log.h"
+
+// SAL annotation of printf style format strings, MSVC only
+#if !defined(_MSC_VER) && !defined(_Printf_format_string_)
+#define _Printf_format_string_
+#endif
 
 // Simplified tinylog, specifically for parallax project use
 
@@ -15,16 +25,176 @@
 #define MACRO_FUNCTION __FUNCTION__
 #endif
 
-#define debug_log(format, ...) \
-    sys_log(0, 4, MACRO_FILE, MACRO_LINE, MACRO_FUNCTION, format, ##__VA_ARGS__)
-#define info_log(format, ...) \
-    sys_log(0, 3, MACRO_FILE, MACRO_LINE, MACRO_FUNCTION, format, ##__VA_ARGS__)
-#define warn_log(format, ...) \
-    sys_log(0, 2, MACRO_FILE, MACRO_LINE, MACRO_FUNCTION, format, ##__VA_ARGS__)
-#define error_log(format, ...) \
-    sys_log(0, 1, MACRO_FILE, MACRO_LINE, MACRO_FUNCTION, format, ##__VA_ARGS__)
-#define crit_log(format, ...) \
-    sys_log(0, 0, MACRO_FILE, MACRO_LINE, MACRO_FUNCTION, format, ##__VA_ARGS__)
+// Least severe level compiled into the binary (0=CRIT .. 4=DEBUG), set by
+// the PARALLAX_MIN_LOG_LEVEL CMake option. Macros above it expand to a no-op
+// that still type checks the call but never evaluates its arguments.
+#ifndef TINYLOG_COMPILED_LEVEL
+#define TINYLOG_COMPILED_LEVEL 4
+#endif
+
+// Log modules, a record belongs to the module whose tag starts its format
+// string ("[ENV] ...", see ENV_LOG_PREFIX), untagged records to the default
+// module. Every module has its own runtime level.
+#define TINYLOG_MODULE_DEFAULT 0
+#define TINYLOG_MODULE_ENV 1   // [ENV] environment check and installation
+#define TINYLOG_MODULE_PROC 2  // [PROC] process execution
+#define TINYLOG_MODULE_WSL 3   // [WSL] WSL processes and their output
+#define TINYLOG_MODULE_CFG 4   // [CFG] configuration file
+#define TINYLOG_MODULE_CLI 5   // [CLI] command line parsing and commands
+#define TINYLOG_MODULE_COUNT 6
+
+// Module of a format string literal as a compile time constant
+#define TINYLOG_MODULE_OF(format) \
+    (std::integral_constant<int, tinylog::ModuleOf(format)>::value)
+
+// Log macros, format must be a string literal. Arguments are only evaluated
+// if the record passes the runtime level check of its module.
+#define TINYLOG_LOG(priority, format, ...)                                \
+    (tinylog_level_enabled(TINYLOG_MODULE_OF(format), priority)            \
+         ? tinylog::Log(TINYLOG_FORMAT_STRING(format), priority, MACRO_FILE, \
+                        MACRO_LINE, MACRO_FUNCTION, ##__VA_ARGS__)        \
+         : (void)0)
+#define TINYLOG_DISCARD(format, ...)                                      \
+    ((void)(false && (tinylog::Discard(TINYLOG_FORMAT_STRING(format),      \
+                                       ##__VA_ARGS__),                    \
+                      true)))
+
+// Like TINYLOG_LOG with per call site admission control, limit is a constant
+// tinylog::LogLimit expression. Suppressed calls do not evaluate arguments.
+#define TINYLOG_LOG_LIMITED(priority, limit, format, ...)                 \
+    ((tinylog_level_enabled(TINYLOG_MODULE_OF(format), priority) &&        \
+      []() -> tinylog::LogLimiter& {                                       \
+          static tinylog::LogLimiter limiter(limit);                       \
+          return limiter;                                                  \
+      }().Admit(priority, format))                                         \
+         ? tinylog::Log(TINYLOG_FORMAT_STRING(format), priority, MACRO_FILE, \
+                        MACRO_LINE, MACRO_FUNCTION, ##__VA_ARGS__)        \
+         : (void)0)
+
+#if TINYLOG_COMPILED_LEVEL >= 4
+#define debug_log(format, ...) TINYLOG_LOG(4, format, ##__VA_ARGS__)
+#else
+#define debug_log(format, ...) TINYLOG_DISCARD(format, ##__VA_ARGS__)
+#endif
+#if TINYLOG_COMPILED_LEVEL >= 3
+#define info_log(format, ...) TINYLOG_LOG(3, format, ##__VA_ARGS__)
+#else
+#define info_log(format, ...) TINYLOG_DISCARD(format, ##__VA_ARGS__)
+#endif
+#if TINYLOG_COMPILED_LEVEL >= 2
+#define warn_log(format, ...) TINYLOG_LOG(2, format, ##__VA_ARGS__)
+#else
+#define warn_log(format, ...) TINYLOG_DISCARD(format, ##__VA_ARGS__)
+#endif
+#if TINYLOG_COMPILED_LEVEL >= 1
+#define error_log(format, ...) TINYLOG_LOG(1, format, ##__VA_ARGS__)
+#else
+#define error_log(format, ...) TINYLOG_DISCARD(format, ##__VA_ARGS__)
+#endif
+#define crit_log(format, ...) TINYLOG_LOG(0, format, ##__VA_ARGS__)
+
+// Rate limited variants for hot call sites: token bucket of burst records
+// refilled at rate records per second, or 1-in-n sampling. Suppressed calls
+// are summarized in a "tinylog: suppressed N messages" record.
+#if TINYLOG_COMPILED_LEVEL >= 4
+#define debug_log_limited(rate, burst, format, ...)                       \
+    TINYLOG_LOG_LIMITED(4, tinylog::RateLimit(rate, burst), format,        \
+                        ##__VA_ARGS__)
+#define debug_log_sampled(n, format, ...) \
+    TINYLOG_LOG_LIMITED(4, tinylog::SampleEvery(n), format, ##__VA_ARGS__)
+#else
+#define debug_log_limited(rate, burst, format, ...) \
+    TINYLOG_DISCARD(format, ##__VA_ARGS__)
+#define debug_log_sampled(n, format, ...) TINYLOG_DISCARD(format, ##__VA_ARGS__)
+#endif
+#if TINYLOG_COMPILED_LEVEL >= 3
+#define info_log_limited(rate, burst, format, ...)                        \
+    TINYLOG_LOG_LIMITED(3, tinylog::RateLimit(rate, burst), format,        \
+                        ##__VA_ARGS__)
+#else
+#define info_log_limited(rate, burst, format, ...) \
+    TINYLOG_DISCARD(format, ##__VA_ARGS__)
+#endif
+#if TINYLOG_COMPILED_LEVEL >= 2
+#define warn_log_limited(rate, burst, format, ...)                        \
+    TINYLOG_LOG_LIMITED(2, tinylog::RateLimit(rate, burst), format,        \
+                        ##__VA_ARGS__)
+#else
+#define warn_log_limited(rate, burst, format, ...) \
+    TINYLOG_DISCARD(format, ##__VA_ARGS__)
+#endif
+#if TINYLOG_COMPILED_LEVEL >= 1
+#define error_log_limited(rate, burst, format, ...)                       \
+    TINYLOG_LOG_LIMITED(1, tinylog::RateLimit(rate, burst), format,        \
+                        ##__VA_ARGS__)
+#else
+#define error_log_limited(rate, burst, format, ...) \
+    TINYLOG_DISCARD(format, ##__VA_ARGS__)
+#endif
+
+// Structured records: a module, an event name plus {"key", value} pairs,
+//   info_kv(TINYLOG_MODULE_ENV, "component_check", {"component", name},
+//           {"duration_ms", ms});
+// Written as "event: key=value, ..." to the log file and as an object with a
+// "fields" member to the JSON-lines file (set_log_json_file). Values are
+// rendered without printf. The level of module applies to the record.
+// The *_kv_msg variants write message to the log file instead, for records
+// whose text line other tools already parse; the JSON object gets the
+// fields and the message as "msg". Arguments are only evaluated if the
+// record passes the level check.
+#define TINYLOG_KV(priority, module, event, message, ...)                 \
+    (tinylog_level_enabled(module, priority)                               \
+         ? tinylog::LogKV(priority, module, event, message, MACRO_FILE,    \
+                          MACRO_LINE, MACRO_FUNCTION, {__VA_ARGS__})       \
+         : (void)0)
+#define TINYLOG_KV_DISCARD(event, message, ...)                           \
+    ((void)(false &&                                                       \
+            (tinylog::DiscardKV(event, message, {__VA_ARGS__}), true)))
+
+#if TINYLOG_COMPILED_LEVEL >= 4
+#define debug_kv(module, event, ...) \
+    TINYLOG_KV(4, module, event, nullptr, ##__VA_ARGS__)
+#define debug_kv_msg(module, event, message, ...) \
+    TINYLOG_KV(4, module, event, message, ##__VA_ARGS__)
+#else
+#define debug_kv(module, event, ...) \
+    TINYLOG_KV_DISCARD(event, nullptr, ##__VA_ARGS__)
+#define debug_kv_msg(module, event, message, ...) \
+    TINYLOG_KV_DISCARD(event, message, ##__VA_ARGS__)
+#endif
+#if TINYLOG_COMPILED_LEVEL >= 3
+#define info_kv(module, event, ...) \
+    TINYLOG_KV(3, module, event, nullptr, ##__VA_ARGS__)
+#define info_kv_msg(module, event, message, ...) \
+    TINYLOG_KV(3, module, event, message, ##__VA_ARGS__)
+#else
+#define info_kv(module, event, ...) \
+    TINYLOG_KV_DISCARD(event, nullptr, ##__VA_ARGS__)
+#define info_kv_msg(module, event, message, ...) \
+    TINYLOG_KV_DISCARD(event, message, ##__VA_ARGS__)
+#endif
+#if TINYLOG_COMPILED_LEVEL >= 2
+#define warn_kv(module, event, ...) \
+    TINYLOG_KV(2, module, event, nullptr, ##__VA_ARGS__)
+#define warn_kv_msg(module, event, message, ...) \
+    TINYLOG_KV(2, module, event, message, ##__VA_ARGS__)
+#else
+#define warn_kv(module, event, ...) \
+    TINYLOG_KV_DISCARD(event, nullptr, ##__VA_ARGS__)
+#define warn_kv_msg(module, event, message, ...) \
+    TINYLOG_KV_DISCARD(event, message, ##__VA_ARGS__)
+#endif
+#if TINYLOG_COMPILED_LEVEL >= 1
+#define error_kv(module, event, ...) \
+    TINYLOG_KV(1, module, event, nullptr, ##__VA_ARGS__)
+#define error_kv_msg(module, event, message, ...) \
+    TINYLOG_KV(1, module, event, message, ##__VA_ARGS__)
+#else
+#define error_kv(module, event, ...) \
+    TINYLOG_KV_DISCARD(event, nullptr, ##__VA_ARGS__)
+#define error_kv_msg(module, event, message, ...) \
+    TINYLOG_KV_DISCARD(event, message, ##__VA_ARGS__)
+#endif
 
 // Initialize log system
 // filename: Log file name
@@ -35,17 +205,137 @@
 int tinylog_init(const char* filename, int max_file_size, int max_files,
                  int console_output, int sync_write);
 
-// Uninitialize log system
+// Uninitialize log system, records queued in asynchronous mode are written
+// before the file is closed
 void tinylog_uninit();
 
-// Set log level (0=CRIT, 1=ERROR, 2=WARN, 3=INFO, 4=DEBUG)
+// Block until all queued records have been written to file
+void tinylog_flush();
+
+// Write records still held in memory (staging buffers, asynchronous queue)
+// to the log file with lock-free system calls, followed by a line with
+// reason (may be NULL). For crash handlers, only the first call writes.
+void tinylog_crash_flush(const char* reason);
+
+// Call tinylog_crash_flush on fatal errors: unhandled exception filter and
+// SIGABRT on Windows, SIGSEGV/SIGBUS/SIGFPE/SIGILL/SIGABRT elsewhere
+void tinylog_install_crash_handler();
+
+// Overflow policy for asynchronous write mode (sync_write=0)
+#define TINYLOG_OVERFLOW_BLOCK 0        // Wait for the writer thread
+#define TINYLOG_OVERFLOW_DROP_NEWEST 1  // Discard the incoming record
+#define TINYLOG_OVERFLOW_DROP_OLDEST 2  // Evict the oldest queued records
+
+// Configure asynchronous write mode, takes effect on next tinylog_init
+// queue_size: Queue capacity (bytes)
+// overflow_policy: One of TINYLOG_OVERFLOW_xxx
+void set_log_async_options(int queue_size, int overflow_policy);
+
+// Number of records discarded by the overflow policy since tinylog_init
+unsigned long long get_log_dropped_count();
+
+// Log file format
+#define TINYLOG_FORMAT_TEXT 0    // Formatted text lines
+#define TINYLOG_FORMAT_BINARY 1  // Call-site id + raw arguments, decode with
+                                 // 'parallax logs decode'
+
+// Select log file format, takes effect on next tinylog_init
+void set_log_format(int format);
+
+// Log file write mode
+#define TINYLOG_FILE_STDIO 0   // Buffered stdio appends
+#define TINYLOG_FILE_MAPPED 1  // Preallocated segments written through a
+                               // file mapping, truncated on rotation/close
+
+// Select log file write mode, takes effect on next tinylog_init
+void set_log_file_mode(int mode);
+
+// Gzip rotated segments to name.N.gz in the background, the active file stays
+// uncompressed. Takes effect on next tinylog_init.
+void set_log_rotate_compression(int enable);
+
+// Also write every record as one JSON object per line to filename (rotated
+// like the main log), NULL disables. Takes effect on next tinylog_init.
+void set_log_json_file(const char* filename);
+
+// Sinks: every record is rendered once and fanned out to all registered
+// sinks. The built-in ones are registered by tinylog_init, more can be
+// added at runtime (see also tinylog::AddSink in log_sink.h).
+#define TINYLOG_SINK_FILE 1     // Log file
+#define TINYLOG_SINK_CONSOLE 2  // Console (console_output=1, also before init)
+#define TINYLOG_SINK_JSON 3     // JSON-lines file (set_log_json_file)
+
+// Most verbose level a sink writes, records also have to pass their module
+// level. Returns -1 if no such sink is registered.
+int set_log_sink_level(int sink, int log_level);
+int get_log_sink_level(int sink);
+
+// Forward records to a named pipe (Windows, "\\\\.\\pipe\\name"), Unix
+// domain socket or "tcp:host:port" as text lines, or JSON lines if json is
+// set. Written by a background thread, records are dropped while the
+// collector is not listening. Returns the sink id, -1 on error.
+int tinylog_add_forward_sink(const char* address, int json, int log_level);
+
+// Ship records to a collector agent in batches of up to 64 KB or 200 ms,
+// gzip compressed if compress is set (frame format in log_shipper.h).
+// address is "tcp:host:port", a named pipe (Windows) or a Unix domain socket
+// path. Batches the collector does not take are appended to spool_file, up
+// to spool_max_bytes (NULL or 0: dropped), and sent before newer ones once
+// it is reachable again, also by the next process. Logging threads never
+// wait for the collector, records are dropped when the 1 MB queue is full.
+// Returns the sink id, -1 on error.
+int tinylog_add_shipping_sink(const char* address, int json, int compress,
+                              const char* spool_file, int spool_max_bytes,
+                              int log_level);
+
+// Remove and close a sink added at runtime (or a built-in one), -1 if there
+// is no such sink
+int tinylog_remove_sink(int sink);
+
+// Set log level (0=CRIT, 1=ERROR, 2=WARN, 3=INFO, 4=DEBUG), records above
+// TINYLOG_COMPILED_LEVEL stay disabled. Applies to every module without a
+// level of its own.
 void set_log_level(int log_level);
 int get_log_level();
 
+// Set the level of one module (TINYLOG_MODULE_xxx), -1 makes the module
+// follow set_log_level again
+void set_log_module_level(int module, int log_level);
+int get_log_module_level(int module);
+
+// Apply a level list such as "ENV=debug,WSL=warn" (PARALLAX_LOG format).
+// Module names are the tags without brackets, levels are crit, error, warn,
+// info, debug, 0..4 or "default" (follow set_log_level); an entry without a
+// module name sets the global level. Valid entries are applied even if
+// others are not, returns 0 if all entries were valid, -1 otherwise.
+int set_log_module_levels(const char* spec);
+
 // Set quiet mode
 void set_log_quiet(int quiet);
 int get_log_quiet();
 
+// Flight recorder: DEBUG records of modules that follow set_log_level, while
+// it is below DEBUG, are still formatted, but kept in a ring of
+// bytes_per_thread bytes (at least 16 KB) per thread instead of being
+// written. Modules with a level of their own (set_log_module_level) are not
+// formatted beyond it. The rings are written to the
+// log file, oldest record first, before the next ERROR or CRIT record and
+// on tinylog_dump_flight_recorder. Memory is bounded by the ring size times
+// the number of logging threads plus 8 rings of exited threads. 0 disables.
+void set_log_flight_recorder(int bytes_per_thread);
+int get_log_flight_recorder();
+
+// Write the records held by the flight recorder to the log file, e.g. when
+// an operation failed without logging an error. Records are written once.
+void tinylog_dump_flight_recorder(const char* reason);
+
+// Longest record in bytes, header included (default 1 MB, at least 1 KB,
+// 0: unlimited). Longer messages are cut and end in " [N bytes truncated]";
+// binary records cut their string arguments. Records longer than the 4 KB
+// stack buffer are rendered into per-thread buffers that are reused.
+void set_log_record_max_bytes(int max_bytes);
+int get_log_record_max_bytes();
+
 // Core log function
 void sys_log(int id, int a_priority, const char* file, const int line,
              const char* func, _Printf_format_string_ const char* a_format,
@@ -53,3 +343,63 @@ void sys_log(int id, int a_priority, const char* file, const int line,
 
 void sys_logv(int id, int a_priority, const char* file, const int line,
               const char* func, const char* a_format, va_list va);
+
+namespace tinylog {
+
+// Most verbose level that is currently logged per module (written, or kept
+// by the flight recorder), -1 in quiet mode. Maintained by set_log_level /
+// set_log_module_level / set_log_quiet / set_log_flight_recorder.
+extern std::atomic<int> g_module_levels[TINYLOG_MODULE_COUNT];
+
+// Tag of each module without brackets, "" for the default module
+constexpr const char* kModuleNames[TINYLOG_MODULE_COUNT] = {
+    "", "ENV", "PROC", "WSL", "CFG", "CLI"};
+
+// Module of a format string: "[" name "] " at its very start
+constexpr int ModuleOf(const char* format) {
+    if (format[0] != '[') {
+        return TINYLOG_MODULE_DEFAULT;
+    }
+    for (int module = 1; module < TINYLOG_MODULE_COUNT; module++) {
+        const char* name = kModuleNames[module];
+        int i = 0;
+        while (name[i] != '\0' && format[i + 1] == name[i]) {
+            i++;
+        }
+        if (name[i] == '\0' && format[i + 1] == ']') {
+            return module;
+        }
+    }
+    return TINYLOG_MODULE_DEFAULT;
+}
+
+// Type checked front end of the log macros
+template <typename Format, typename... Args>
+inline void Log(Format, int priority, const char* file, int line,
+                const char* func, const Args&... args) {
+    static_assert(ValidateFormat<Format, Args...>(), "");
+    sys_log(0, priority, file, line, func, Format::Get(), args...);
+}
+
+// Compiled out log call, only checks the format
+template <typename Format, typename... Args>
+inline void Discard(Format, const Args&...) {
+    static_assert(ValidateFormat<Format, Args...>(), "");
+}
+
+// Structured record, front end of the *_kv macros. message replaces the
+// rendered fields in the text line unless it is null.
+void LogKV(int priority, int module, const char* event, const char* message,
+           const char* file, int line, const char* func, LogFields fields);
+
+// Compiled out structured record
+inline void DiscardKV(const char*, const char*, LogFields) {}
+
+}  // namespace tinylog
+
+// Runtime level check used by the log macros before arguments are evaluated,
+// module is a constant so this is a single load
+inline bool tinylog_level_enabled(int module, int priority) {
+    return priority <=
+           tinylog::g_module_levels[module].load(std::memory_order_relaxed);
+}
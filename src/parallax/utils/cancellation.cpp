@@ -0,0 +1,116 @@
+#include "cancellation.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include <limits.h>
+#include <chrono>
+#include <thread>
+
+namespace parallax {
+namespace utils {
+
+static const uint64_t kNeverMs = ~0ULL;
+
+uint64_t MonotonicMs() {
+#ifdef _WIN32
+    return GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+Deadline::Deadline() : at_ms_(kNeverMs) {}
+
+Deadline::Deadline(uint64_t at_ms) : at_ms_(at_ms) {}
+
+Deadline Deadline::Never() { return Deadline(); }
+
+Deadline Deadline::In(int64_t ms) {
+    uint64_t now = MonotonicMs();
+    if (ms <= 0) {
+        return Deadline(now);
+    }
+    uint64_t at_ms = now + static_cast<uint64_t>(ms);
+    return Deadline(at_ms < now || at_ms == kNeverMs ? kNeverMs - 1 : at_ms);
+}
+
+Deadline Deadline::Min(const Deadline& other) const {
+    return other.at_ms_ < at_ms_ ? other : *this;
+}
+
+bool Deadline::IsNever() const { return at_ms_ == kNeverMs; }
+
+bool Deadline::HasPassed() const {
+    return !IsNever() && MonotonicMs() >= at_ms_;
+}
+
+int64_t Deadline::RemainingMs() const {
+    if (IsNever()) {
+        return -1;
+    }
+    uint64_t now = MonotonicMs();
+    return now >= at_ms_ ? 0 : static_cast<int64_t>(at_ms_ - now);
+}
+
+int Deadline::ToTimeoutMs() const {
+    int64_t remaining = RemainingMs();
+    if (remaining < 0) {
+        return 0;
+    }
+    if (remaining == 0) {
+        return 1;
+    }
+    return remaining > INT_MAX ? INT_MAX : static_cast<int>(remaining);
+}
+
+CancellationToken::CancellationToken()
+    : state_(std::make_shared<std::atomic<bool>>(false)) {}
+
+CancellationToken CancellationToken::None() {
+    CancellationToken token;
+    token.state_.reset();
+    return token;
+}
+
+void CancellationToken::Cancel() {
+    if (state_) {
+        state_->store(true);
+    }
+}
+
+bool CancellationToken::IsCancelled() const {
+    return state_ && state_->load();
+}
+
+void CancellationToken::Reset() {
+    if (state_) {
+        state_->store(false);
+    }
+}
+
+bool CancellationToken::WaitFor(int wait_ms) const {
+    if (!state_) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(wait_ms));
+        return false;
+    }
+    Deadline deadline = Deadline::In(wait_ms);
+    while (!IsCancelled()) {
+        int64_t remaining = deadline.RemainingMs();
+        if (remaining <= 0) {
+            return false;
+        }
+        int slice = kWaitIntervalMs;
+        if (remaining < slice) {
+            slice = static_cast<int>(remaining);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(slice));
+    }
+    return true;
+}
+
+}  // namespace utils
+}  // namespace parallax
@@ -0,0 +1,88 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+
+// Deadlines and cancellation of long operations, specifically for parallax
+// project
+
+namespace parallax {
+namespace utils {
+
+// Milliseconds of a monotonic clock, for timeouts and deadlines. Unaffected
+// by changes of the wall clock.
+uint64_t MonotonicMs();
+
+/**
+ * @brief Point in time by which an operation has to be done
+ *
+ * Kept as an absolute time of MonotonicMs() rather than as
+ * a timeout, so that it can be handed down through nested steps: a step
+ * limits itself to the earlier of its own budget and its parent's deadline
+ * (Min) and so gets at most what the parent has left. Never is later than
+ * any other deadline.
+ */
+class Deadline {
+ public:
+    Deadline();  // Never
+
+    static Deadline Never();
+
+    // ms from now, a deadline of 0 or less has already passed
+    static Deadline In(int64_t ms);
+
+    // The earlier of this deadline and other
+    Deadline Min(const Deadline& other) const;
+
+    bool IsNever() const;
+    bool HasPassed() const;
+
+    // Milliseconds left, 0 once passed, -1 for never
+    int64_t RemainingMs() const;
+
+    // RemainingMs() for APIs where a timeout of 0 means no limit: 0 for
+    // never, at least 1 for a deadline that has passed
+    int ToTimeoutMs() const;
+
+ private:
+    explicit Deadline(uint64_t at_ms);
+
+    uint64_t at_ms_;  // ~0: never
+};
+
+/**
+ * @brief Shared flag that asks the operations watching it to give up
+ *
+ * Copies share the flag, so whoever cancels and every layer that checks
+ * hold a copy of their own. Cancel() is a single atomic store and may be
+ * called from any thread, a console control handler included. None() is a
+ * token that is never cancelled, for callers without a way to cancel.
+ */
+class CancellationToken {
+ public:
+    CancellationToken();  // Not cancelled yet
+
+    static CancellationToken None();
+
+    void Cancel();
+    bool IsCancelled() const;
+
+    // Clear the flag for the next operation, on every copy
+    void Reset();
+
+    // False for None(), such a token need not be watched
+    bool CanBeCancelled() const { return state_ != nullptr; }
+
+    // Sleep up to wait_ms, returning early once cancelled. True if
+    // cancelled.
+    bool WaitFor(int wait_ms) const;
+
+    // Granularity of WaitFor()
+    static const int kWaitIntervalMs = 50;
+
+ private:
+    std::shared_ptr<std::atomic<bool>> state_;
+};
+
+}  // namespace utils
+}  // namespace parallax
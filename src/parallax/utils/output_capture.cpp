@@ -0,0 +1,237 @@
+#include "output_capture.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include <stdlib.h>
+#include <atomic>
+
+namespace parallax {
+namespace utils {
+
+CapturePolicy CapturePolicy::HeadTail(size_t keep_bytes) {
+    CapturePolicy policy;
+    policy.mode = CaptureMode::kHeadTail;
+    policy.keep_bytes = keep_bytes;
+    return policy;
+}
+
+CapturePolicy CapturePolicy::Spill(size_t keep_bytes) {
+    CapturePolicy policy;
+    policy.mode = CaptureMode::kSpill;
+    policy.keep_bytes = keep_bytes;
+    return policy;
+}
+
+CapturePolicy CapturePolicy::Discard() {
+    CapturePolicy policy;
+    policy.mode = CaptureMode::kDiscard;
+    return policy;
+}
+
+// Same test as ConvertPowerShellOutputToUtf8: ASCII characters with a zero
+// high byte at the start
+static bool LooksLikeUtf16(const std::string& data) {
+    int candidates = 0;
+    size_t check_bytes = data.size() < 20 ? data.size() : 20;
+    for (size_t i = 0; i + 1 < check_bytes; i += 2) {
+        unsigned char low = static_cast<unsigned char>(data[i]);
+        unsigned char high = static_cast<unsigned char>(data[i + 1]);
+        if (high == 0 && ((low >= 32 && low <= 126) || low == '\n' ||
+                          low == '\r' || low == '\t')) {
+            candidates++;
+        }
+    }
+    return candidates > 1;
+}
+
+static std::string GetSpillDirectory() {
+#ifdef _WIN32
+    char temp_path[MAX_PATH];
+    DWORD len = GetTempPathA(MAX_PATH, temp_path);
+    if (len > 0 && len <= MAX_PATH) {
+        return temp_path;
+    }
+    return "C:\\Temp\\";
+#else
+    const char* dir = getenv("TMPDIR");
+    std::string path = dir && *dir ? dir : "/tmp";
+    if (path.back() != '/') {
+        path += '/';
+    }
+    return path;
+#endif
+}
+
+static std::string JoinSpillPath(const std::string& dir, const char* name) {
+#ifdef _WIN32
+    const char separator = '\\';
+#else
+    const char separator = '/';
+#endif
+    if (dir.empty() || dir.back() == separator || dir.back() == '/') {
+        return dir + name;
+    }
+    return dir + separator + name;
+}
+
+static unsigned long CurrentProcessId() {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return static_cast<unsigned long>(getpid());
+#endif
+}
+
+OutputCapture::OutputCapture(const CapturePolicy& policy, const char* name)
+    : policy_(policy),
+      name_(name),
+      tail_pos_(0),
+      total_(0),
+      spill_file_(nullptr),
+      spill_failed_(false) {
+    // Even halves keep the cut on a UTF-16 character boundary
+    size_t keep = policy_.keep_bytes & ~static_cast<size_t>(1);
+    head_limit_ = (keep / 2) & ~static_cast<size_t>(1);
+    tail_limit_ = keep - head_limit_;
+}
+
+OutputCapture::~OutputCapture() { StopSpill(false); }
+
+void OutputCapture::Append(const char* data, size_t len) {
+    total_ += len;
+    switch (policy_.mode) {
+        case CaptureMode::kAll:
+            head_.append(data, len);
+            return;
+        case CaptureMode::kDiscard:
+            return;
+        case CaptureMode::kSpill:
+            if (!spill_file_ && !spill_failed_ &&
+                head_.size() + tail_.size() + len > head_limit_ + tail_limit_) {
+                StartSpill();
+            }
+            if (spill_file_ && fwrite(data, 1, len, spill_file_) != len) {
+                StopSpill(true);
+            }
+            break;
+        case CaptureMode::kHeadTail:
+            break;
+    }
+
+    size_t to_head = head_limit_ - head_.size();
+    if (to_head > len) {
+        to_head = len;
+    }
+    head_.append(data, to_head);
+    AppendTail(data + to_head, len - to_head);
+}
+
+void OutputCapture::AppendTail(const char* data, size_t len) {
+    if (len == 0 || tail_limit_ == 0) {
+        return;
+    }
+    if (len >= tail_limit_) {
+        tail_.assign(data + len - tail_limit_, tail_limit_);
+        tail_pos_ = 0;
+        return;
+    }
+
+    size_t fill = tail_limit_ - tail_.size();
+    if (fill > len) {
+        fill = len;
+    }
+    tail_.append(data, fill);
+    data += fill;
+    len -= fill;
+
+    // The ring is full, overwrite the oldest bytes
+    while (len > 0) {
+        size_t n = tail_limit_ - tail_pos_;
+        if (n > len) {
+            n = len;
+        }
+        tail_.replace(tail_pos_, n, data, n);
+        tail_pos_ = (tail_pos_ + n) % tail_limit_;
+        data += n;
+        len -= n;
+    }
+}
+
+void OutputCapture::Finish(std::string& output, CaptureInfo* info) {
+    StopSpill(false);
+
+    output.swap(head_);
+    head_.clear();
+    uint64_t omitted = total_ - output.size() - tail_.size();
+    if (policy_.mode == CaptureMode::kHeadTail ||
+        policy_.mode == CaptureMode::kSpill) {
+        // Oldest tail byte first
+        std::string tail = tail_.substr(tail_pos_) + tail_.substr(0, tail_pos_);
+        bool utf16 = LooksLikeUtf16(output);
+        if (omitted > 0) {
+            if (utf16 && omitted % 2 != 0) {
+                tail.erase(0, 1);
+                omitted++;
+            }
+            std::string marker = "\n... [" + std::to_string(omitted) +
+                                 " bytes omitted] ...\n";
+            if (utf16) {
+                for (char c : marker) {
+                    output += c;
+                    output += '\0';
+                }
+            } else {
+                output += marker;
+            }
+        }
+        output += tail;
+    }
+    tail_.clear();
+    tail_pos_ = 0;
+
+    if (info) {
+        info->total_bytes = total_;
+        info->omitted_bytes = omitted;
+        info->spill_path = spill_path_;
+    }
+}
+
+void OutputCapture::StartSpill() {
+    static std::atomic<unsigned> counter(0);
+    char name[96];
+    snprintf(name, sizeof(name), "parallax-%lu-%u-%s.log",
+             CurrentProcessId(), counter++, name_);
+    spill_path_ = JoinSpillPath(
+        policy_.spill_dir.empty() ? GetSpillDirectory() : policy_.spill_dir,
+        name);
+    spill_file_ = fopen(spill_path_.c_str(), "wb");
+    if (!spill_file_) {
+        spill_path_.clear();
+        spill_failed_ = true;
+        return;
+    }
+
+    // What came before is still all in memory, the ring has not wrapped yet
+    if (fwrite(head_.data(), 1, head_.size(), spill_file_) != head_.size() ||
+        fwrite(tail_.data(), 1, tail_.size(), spill_file_) != tail_.size()) {
+        StopSpill(true);
+    }
+}
+
+void OutputCapture::StopSpill(bool remove) {
+    if (!spill_file_) {
+        return;
+    }
+    bool ok = fclose(spill_file_) == 0;
+    spill_file_ = nullptr;
+    if (remove || !ok) {
+        ::remove(spill_path_.c_str());
+        spill_path_.clear();
+        spill_failed_ = true;
+    }
+}
+
+}  // namespace utils
+}  // namespace parallax
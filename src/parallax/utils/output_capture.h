@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+// Bounded collection of child process output, specifically for parallax
+// project
+
+namespace parallax {
+namespace utils {
+
+enum class CaptureMode {
+    kAll,       // Keep everything in memory
+    kHeadTail,  // Keep the first and the last bytes, count the rest
+    kSpill,     // kHeadTail, and the full stream goes to a temporary file
+    kDiscard,   // Keep nothing, only count
+};
+
+/**
+ * @brief How much of an output stream is kept
+ */
+struct CapturePolicy {
+    CaptureMode mode = CaptureMode::kAll;
+
+    // kHeadTail and kSpill: bytes kept in memory per stream, half of them
+    // from the start and half from the end
+    size_t keep_bytes = 64 * 1024;
+
+    // kSpill: directory of the spill files, empty for the temp directory
+    std::string spill_dir;
+
+    static CapturePolicy All() { return CapturePolicy(); }
+    static CapturePolicy HeadTail(size_t keep_bytes = 64 * 1024);
+    static CapturePolicy Spill(size_t keep_bytes = 64 * 1024);
+    static CapturePolicy Discard();
+};
+
+// What became of one captured stream
+struct CaptureInfo {
+    uint64_t total_bytes = 0;    // Written by the child
+    uint64_t omitted_bytes = 0;  // Not in the kept output
+
+    // kSpill: file with the full stream. Only created once the stream
+    // outgrows keep_bytes, and left for the caller to delete.
+    std::string spill_path;
+};
+
+/**
+ * @brief Collects one output stream under a CapturePolicy
+ *
+ * Memory use is bounded by keep_bytes for kHeadTail and kSpill: the head is
+ * kept as it arrives and the tail in a ring. Finish() joins them with a
+ * line saying how many bytes were left out, in UTF-16 LE if the head looks
+ * like UTF-16 (PowerShell and wsl.exe output) so that the encoding
+ * conversion still works, and the cut is then kept at an even offset.
+ * A spill file that cannot be created or written is given up and removed,
+ * the kept output is unaffected. Not thread safe.
+ */
+class OutputCapture {
+ public:
+    // name ends up in the spill file name, e.g. "stdout"
+    OutputCapture(const CapturePolicy& policy, const char* name);
+    ~OutputCapture();
+
+    OutputCapture(const OutputCapture&) = delete;
+    OutputCapture& operator=(const OutputCapture&) = delete;
+
+    void Append(const char* data, size_t len);
+
+    // Hand over the kept output and close the spill file
+    void Finish(std::string& output, CaptureInfo* info = nullptr);
+
+ private:
+    void StartSpill();
+    void StopSpill(bool remove);
+    void AppendTail(const char* data, size_t len);
+
+    const CapturePolicy policy_;
+    const char* name_;
+    size_t head_limit_;
+    size_t tail_limit_;
+    std::string head_;
+    std::string tail_;  // Ring once it is tail_limit_ long
+    size_t tail_pos_;   // Oldest byte of the full ring
+    uint64_t total_;
+    FILE* spill_file_;
+    std::string spill_path_;
+    bool spill_failed_;
+};
+
+}  // namespace utils
+}  // namespace parallax
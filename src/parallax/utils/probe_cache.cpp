@@ -0,0 +1,260 @@
+#include "probe_cache.h"
+#include "process.h"
+#include "tinylog/tinylog.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+namespace parallax {
+namespace utils {
+
+// First line of the store file
+static const char kStoreMagic[] = "PLXPROBE 1\n";
+
+static int64_t NowWallMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+static void RemoveFile(const std::string& path) {
+#ifdef _WIN32
+    DeleteFileA(path.c_str());
+#else
+    unlink(path.c_str());
+#endif
+}
+
+// Rename from to to, replacing an existing file
+static bool MoveReplacing(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(),
+                       MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+ProbeCache& ProbeCache::GetInstance() {
+    static ProbeCache instance;
+    return instance;
+}
+
+ProbeCache::ProbeCache() : enabled_(true) {}
+
+bool ProbeCache::Get(const std::string& key, int ttl_seconds,
+                     ProbeResult& result) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_ || ttl_seconds <= 0) {
+        return false;
+    }
+
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        return false;
+    }
+    int64_t age = NowWallMs() - it->second.saved_ms;
+    if (age < 0 || age > static_cast<int64_t>(ttl_seconds) * 1000) {
+        return false;
+    }
+    result = it->second.result;
+    return true;
+}
+
+void ProbeCache::Put(const std::string& key, const ProbeResult& result) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_ || result.stdout_output.size() > kMaxOutputBytes ||
+        result.stderr_output.size() > kMaxOutputBytes) {
+        return;
+    }
+
+    if (entries_.size() >= kMaxEntries && entries_.count(key) == 0) {
+        auto oldest = entries_.begin();
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->second.saved_ms < oldest->second.saved_ms) {
+                oldest = it;
+            }
+        }
+        entries_.erase(oldest);
+    }
+
+    Entry& entry = entries_[key];
+    entry.saved_ms = NowWallMs();
+    entry.result = result;
+    Save();
+}
+
+void ProbeCache::Invalidate() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    if (!store_path_.empty()) {
+        RemoveFile(store_path_);
+    }
+    debug_log("[PROC] Probe cache invalidated");
+}
+
+void ProbeCache::SetEnabled(bool enabled) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    enabled_ = enabled;
+    if (!enabled_) {
+        entries_.clear();
+    }
+}
+
+void ProbeCache::SetStorePath(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    store_path_ = path;
+    if (!store_path_.empty()) {
+        Load();
+    }
+}
+
+// Each entry is a line "<saved_ms> <exit_code> <key bytes> <stdout bytes>
+// <stderr bytes>" followed by the three strings
+void ProbeCache::Load() {
+    FILE* file = fopen(store_path_.c_str(), "rb");
+    if (!file) {
+        return;
+    }
+
+    char line[128];
+    if (!fgets(line, sizeof(line), file) || strcmp(line, kStoreMagic) != 0) {
+        fclose(file);
+        return;
+    }
+
+    size_t loaded = 0;
+    while (fgets(line, sizeof(line), file)) {
+        long long saved_ms = 0;
+        int exit_code = 0;
+        size_t key_len = 0, out_len = 0, err_len = 0;
+        if (sscanf(line, "%lld %d %zu %zu %zu", &saved_ms, &exit_code,
+                   &key_len, &out_len, &err_len) != 5 ||
+            key_len > 4096 || out_len > kMaxOutputBytes ||
+            err_len > kMaxOutputBytes) {
+            break;  // Damaged file, keep what was read so far
+        }
+
+        std::vector<char> data(key_len + out_len + err_len);
+        if (!data.empty() &&
+            fread(data.data(), data.size(), 1, file) != 1) {
+            break;
+        }
+
+        std::string key(data.data(), key_len);
+        if (entries_.count(key) != 0) {
+            continue;  // Results of this run are newer
+        }
+        if (exit_code != 0) {
+            continue;  // Failures kept by earlier builds
+        }
+        Entry& entry = entries_[key];
+        entry.saved_ms = saved_ms;
+        entry.result.exit_code = exit_code;
+        entry.result.stdout_output.assign(data.data() + key_len, out_len);
+        entry.result.stderr_output.assign(data.data() + key_len + out_len,
+                                          err_len);
+        loaded++;
+    }
+    fclose(file);
+
+    debug_log("[PROC] Loaded %zu probe results from %s", loaded,
+              store_path_.c_str());
+}
+
+void ProbeCache::Save() {
+    if (store_path_.empty()) {
+        return;
+    }
+
+    // Readers never see a partly written file
+    std::string temp_path = store_path_ + ".tmp";
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if (!file) {
+        return;
+    }
+
+    bool ok = fputs(kStoreMagic, file) >= 0;
+    for (const auto& item : entries_) {
+        const ProbeResult& result = item.second.result;
+        ok = ok &&
+             fprintf(file, "%lld %d %zu %zu %zu\n",
+                     static_cast<long long>(item.second.saved_ms),
+                     result.exit_code, item.first.size(),
+                     result.stdout_output.size(),
+                     result.stderr_output.size()) > 0 &&
+             fwrite(item.first.data(), 1, item.first.size(), file) ==
+                 item.first.size() &&
+             fwrite(result.stdout_output.data(), 1,
+                    result.stdout_output.size(),
+                    file) == result.stdout_output.size() &&
+             fwrite(result.stderr_output.data(), 1,
+                    result.stderr_output.size(),
+                    file) == result.stderr_output.size();
+    }
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok || !MoveReplacing(temp_path, store_path_)) {
+        RemoveFile(temp_path);
+    }
+}
+
+// The command of ExecProbeCommand when it is not answered from the cache
+static int RunProbeCommand(const std::string& cmd, int timeout,
+                           std::string& stdout_output,
+                           std::string& stderr_output,
+                           bool skip_encoding_conversion,
+                           const CancellationToken& cancel_token,
+                           const Deadline& deadline) {
+    if (timeout <= 0) {
+        return -1;
+    }
+    return ExecCommandUntil(cmd, Deadline::In(timeout * 1000LL).Min(deadline),
+                            cancel_token, stdout_output, stderr_output,
+                            skip_encoding_conversion);
+}
+
+int ExecProbeCommand(const std::string& cmd, int ttl_seconds, int timeout,
+                     std::string& stdout_output, std::string& stderr_output,
+                     bool skip_encoding_conversion,
+                     const CancellationToken& cancel_token,
+                     const Deadline& deadline) {
+    if (ttl_seconds <= 0) {
+        return RunProbeCommand(cmd, timeout, stdout_output, stderr_output,
+                               skip_encoding_conversion, cancel_token,
+                               deadline);
+    }
+
+    // Raw and converted output of the same command are different results
+    std::string key = (skip_encoding_conversion ? "raw " : "") + cmd;
+
+    ProbeCache& cache = ProbeCache::GetInstance();
+    ProbeResult cached;
+    if (cache.Get(key, ttl_seconds, cached)) {
+        debug_log("[PROC] Probe result from cache: %s", cmd.c_str());
+        stdout_output.swap(cached.stdout_output);
+        stderr_output.swap(cached.stderr_output);
+        return cached.exit_code;
+    }
+
+    int exit_code =
+        RunProbeCommand(cmd, timeout, stdout_output, stderr_output,
+                        skip_encoding_conversion, cancel_token, deadline);
+    if (exit_code == 0) {
+        ProbeResult result;
+        result.exit_code = exit_code;
+        result.stdout_output = stdout_output;
+        result.stderr_output = stderr_output;
+        cache.Put(key, result);
+    }
+    return exit_code;
+}
+
+}  // namespace utils
+}  // namespace parallax
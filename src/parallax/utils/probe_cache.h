@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include "cancellation.h"
+
+// Results of probe commands kept for reuse, specifically for parallax project
+
+namespace parallax {
+namespace utils {
+
+struct ProbeResult {
+    int exit_code = 0;
+    std::string stdout_output;
+    std::string stderr_output;
+};
+
+/**
+ * @brief Results of commands that only look at the system
+ *
+ * Checks ask the same questions many times (is the distribution listed by
+ * wsl --list, which driver does nvidia-smi report), and the answers only
+ * change when something is installed. Callers store the result of such a
+ * probe under its command line and reuse it while it is younger than the
+ * TTL they pass to Get(). Anything that installs or removes software must
+ * call Invalidate().
+ *
+ * Results live in memory and, with a store path set, also in a file that
+ * later runs load, so back to back checks skip the probes as well. Ages are
+ * wall clock times for that reason; a result from the future counts as
+ * stale. The file is rewritten (via a temporary and a rename) on every
+ * change, it is small. Thread safe.
+ */
+class ProbeCache {
+ public:
+    static ProbeCache& GetInstance();
+
+    // The result stored for key if it is at most ttl_seconds old
+    bool Get(const std::string& key, int ttl_seconds, ProbeResult& result);
+    void Put(const std::string& key, const ProbeResult& result);
+
+    // Forget every result, in memory and in the store file
+    void Invalidate();
+
+    // Off: Get() finds nothing and Put() keeps nothing (default: on)
+    void SetEnabled(bool enabled);
+
+    // Keep results in path between runs, empty for memory only. Loads the
+    // results already in the file.
+    void SetStorePath(const std::string& path);
+
+    // Larger results are not kept
+    static const size_t kMaxOutputBytes = 64 * 1024;
+    // The oldest result makes room beyond this many
+    static const size_t kMaxEntries = 64;
+
+ private:
+    struct Entry {
+        int64_t saved_ms;  // Wall clock, ms since the epoch
+        ProbeResult result;
+    };
+
+    ProbeCache();
+
+    void Load();
+    void Save();
+
+    std::mutex mutex_;
+    std::map<std::string, Entry> entries_;
+    std::string store_path_;
+    bool enabled_;
+};
+
+/**
+ * ExecCommandEx for probe commands: a result of cmd no older than
+ * ttl_seconds is returned from the ProbeCache without running it, 0 runs
+ * it uncached. Only commands that succeed (exit code 0) are cached: a
+ * failure is often the environment not being set up yet, which the user
+ * may fix outside of parallax, and the next run has to see that. A
+ * command that runs ends at the earlier of timeout seconds and deadline,
+ * or once cancel_token is cancelled, as with ExecCommandUntil.
+ */
+int ExecProbeCommand(const std::string& cmd, int ttl_seconds, int timeout,
+                     std::string& stdout_output, std::string& stderr_output,
+                     bool skip_encoding_conversion = false,
+                     const CancellationToken& cancel_token =
+                         CancellationToken::None(),
+                     const Deadline& deadline = Deadline::Never());
+
+}  // namespace utils
+}  // namespace parallax
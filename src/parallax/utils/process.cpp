@@ -1,14 +1,108 @@
 #include "process.h"
 #include "utils.h"
+#include "tinylog/tinylog.h"
+#ifdef _WIN32
 #include <windows.h>
-#include <iostream>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <cctype>
 #include <chrono>
+#include <random>
 #include <thread>
-#include <atomic>  // Added for std::atomic
+
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+#define PARALLAX_SPAWN_ADDCHDIR 1
+#endif
 
 namespace parallax {
 namespace utils {
 
+static const size_t kReadBufferBytes = 4096;
+
+// Reads per pipe and Poll(), so that a child writing without pause cannot
+// keep Poll() from returning to check the timeout and cancellation
+static const int kMaxReadsPerPoll = 16;
+
+static unsigned long CurrentProcessId() {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return static_cast<unsigned long>(getpid());
+#endif
+}
+
+// Split a command line at spaces outside double quotes, the quotes are
+// dropped. Good enough to find the program and its leading options.
+static std::vector<std::string> SplitCommandLine(const std::string& line) {
+    std::vector<std::string> args;
+    std::string arg;
+    bool in_arg = false, quoted = false;
+    for (char c : line) {
+        if (c == '"') {
+            quoted = !quoted;
+            in_arg = true;
+        } else if ((c == ' ' || c == '\t') && !quoted) {
+            if (in_arg) args.push_back(arg);
+            arg.clear();
+            in_arg = false;
+        } else {
+            arg.push_back(c);
+            in_arg = true;
+        }
+    }
+    if (in_arg) args.push_back(arg);
+    return args;
+}
+
+static bool FindWSLDistribution(const std::vector<std::string>& args,
+                                std::string& distribution) {
+    if (args.empty()) {
+        return false;
+    }
+    std::string program = args[0];
+    size_t slash = program.find_last_of("\\/");
+    if (slash != std::string::npos) {
+        program.erase(0, slash + 1);
+    }
+    std::transform(program.begin(), program.end(), program.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    if (program != "wsl" && program != "wsl.exe") {
+        return false;
+    }
+
+    for (size_t i = 1; i + 1 < args.size(); i++) {
+        if (args[i] == "-d" || args[i] == "--distribution") {
+            distribution = args[i + 1];
+            return true;
+        }
+        if (args[i] == "--" || args[i] == "-e" || args[i] == "--exec") {
+            break;  // The Linux command line starts
+        }
+    }
+    return false;
+}
+
+bool GetWSLDistribution(const std::string& command_line,
+                        std::string& distribution) {
+    return FindWSLDistribution(SplitCommandLine(command_line), distribution);
+}
+
+#ifdef _WIN32
 // Get system directory path
 static std::string GetSystemPath() {
     char system_path[MAX_PATH];
@@ -16,496 +110,1267 @@ static std::string GetSystemPath() {
     return std::string(system_path);
 }
 
-int ExecCommandEx(const std::string& cmd, int timeout,
-                  std::string& stdout_output, std::string& stderr_output,
-                  bool elevate /* = false*/,
-                  bool skip_encoding_conversion /* = false*/) {
-    if (cmd.empty() || timeout <= 0) {
-        return -1;
+// Quote an argument so that CommandLineToArgvW and the CRT give it back
+// unchanged
+static std::string QuoteArgument(const std::string& arg) {
+    if (!arg.empty() && arg.find_first_of(" \t\n\v\"") == std::string::npos) {
+        return arg;
+    }
+    std::string quoted = "\"";
+    for (size_t i = 0;; i++) {
+        size_t backslashes = 0;
+        while (i < arg.size() && arg[i] == '\\') {
+            i++;
+            backslashes++;
+        }
+        if (i == arg.size()) {
+            quoted.append(backslashes * 2, '\\');
+            break;
+        }
+        if (arg[i] == '"') {
+            quoted.append(backslashes * 2 + 1, '\\');
+        } else {
+            quoted.append(backslashes, '\\');
+        }
+        quoted.push_back(arg[i]);
     }
+    quoted.push_back('"');
+    return quoted;
+}
 
-    int ret = 0;
-    SECURITY_ATTRIBUTES sa = {sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE};
+static std::string BuildCommandLine(const ProcessOptions& options) {
+    if (!options.command.empty()) {
+        return "cmd /C " + options.command;
+    }
+    std::string cmdline;
+    for (const std::string& arg : options.argv) {
+        if (!cmdline.empty()) cmdline.push_back(' ');
+        cmdline += QuoteArgument(arg);
+    }
+    return cmdline;
+}
 
-    HANDLE hReadOut = nullptr, hWriteOut = nullptr;
-    HANDLE hReadErr = nullptr, hWriteErr = nullptr;
-    HANDLE hReadInput = nullptr, hWriteInput = nullptr;
+std::string BuildEnvironmentBlock(
+    const std::vector<std::pair<std::string, std::string>>& env) {
+    std::string block;
+    char* strings = GetEnvironmentStringsA();
+    for (const char* p = strings; p && *p; p += strlen(p) + 1) {
+        // Skip the first character, "=C:=C:\dir" entries start with '='
+        const char* equals = strchr(p + 1, '=');
+        size_t name_len = equals ? equals - p : strlen(p);
+        bool replaced = false;
+        for (const auto& var : env) {
+            if (var.first.size() == name_len &&
+                _strnicmp(var.first.c_str(), p, name_len) == 0) {
+                replaced = true;
+                break;
+            }
+        }
+        if (!replaced) {
+            block.append(p);
+            block.push_back('\0');
+        }
+    }
+    if (strings) FreeEnvironmentStringsA(strings);
 
-    stdout_output.clear();
-    stderr_output.clear();
+    for (const auto& var : env) {
+        block += var.first + "=" + var.second;
+        block.push_back('\0');
+    }
+    block.push_back('\0');
+    return block;
+}
 
-    std::string system_path = GetSystemPath();
-    STARTUPINFOA si = {sizeof(STARTUPINFOA)};
-    PROCESS_INFORMATION pi = {0};
-    std::atomic<bool> process_terminated(false);
-
-    // Create stdout pipe
-    if (!CreatePipe(&hReadOut, &hWriteOut, &sa, 0)) return -1;
-    // Create stderr pipe
-    if (!CreatePipe(&hReadErr, &hWriteErr, &sa, 0)) return -1;
-    // Create stdin pipe
-    if (!CreatePipe(&hReadInput, &hWriteInput, &sa, 0)) return -1;
-
-    // Prevent parent process from inheriting handles it shouldn't
-    SetHandleInformation(hReadOut, HANDLE_FLAG_INHERIT,
-                         0);  // Parent reads stdout
-    SetHandleInformation(hReadErr, HANDLE_FLAG_INHERIT,
-                         0);  // Parent reads stderr
-    SetHandleInformation(hWriteInput, HANDLE_FLAG_INHERIT,
-                         0);  // Parent writes stdin
-
-    // Set child process stdxxx
-    si.dwFlags = STARTF_USESTDHANDLES | STARTF_USESHOWWINDOW;
-    si.wShowWindow = SW_HIDE;
-    si.hStdOutput = hWriteOut;
-    si.hStdError = hWriteErr;
-    si.hStdInput = hReadInput;
-
-    std::string cmdline = "cmd /C " + cmd;
-    bool created = false;
-
-    // Create read thread (before process creation)
-    std::thread thread_read_out([&]() {
-        char buffer[4096];
-        DWORD bytesRead;
-        while (true) {
-            DWORD available = 0;
-            if (PeekNamedPipe(hReadOut, nullptr, 0, nullptr, &available,
-                              nullptr) &&
-                available > 0) {
-                if (ReadFile(hReadOut, buffer, sizeof(buffer), &bytesRead,
-                             nullptr)) {
-                    if (bytesRead > 0) {
-                        stdout_output.append(buffer, bytesRead);
-                        continue;
-                    }
-                } else {
-                    break;  // ReadFile failed (pipe closed)
-                }
+struct Process::Impl {
+    // Child output pipe read with overlapped I/O. Anonymous pipes cannot do
+    // that, so each one is a uniquely named pipe with an inheritable client
+    // end.
+    struct OutputPipe {
+        HANDLE read = INVALID_HANDLE_VALUE;   // Our end, overlapped
+        HANDLE write = INVALID_HANDLE_VALUE;  // Child's end
+        HANDLE event = nullptr;
+        OVERLAPPED overlapped;
+        bool pending = false;  // Read in flight
+        bool eof = false;
+        const ProcessOutputCallback* callback = nullptr;
+        char buffer[kReadBufferBytes];
+
+        bool Create(SECURITY_ATTRIBUTES* sa, const ProcessOutputCallback* cb) {
+            static std::atomic<unsigned> counter(0);
+            char name[64];
+            snprintf(name, sizeof(name), "\\\\.\\pipe\\parallax-exec-%lu-%u",
+                     CurrentProcessId(), counter++);
+
+            callback = cb;
+            read = CreateNamedPipeA(
+                name, PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED |
+                          FILE_FLAG_FIRST_PIPE_INSTANCE,
+                PIPE_TYPE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1, 0,
+                64 * 1024, 0, nullptr);
+            if (read == INVALID_HANDLE_VALUE) {
+                return false;
             }
+            write = CreateFileA(name, GENERIC_WRITE, 0, sa, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL, nullptr);
+            event = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+            return write != INVALID_HANDLE_VALUE && event != nullptr;
+        }
 
-            // If no data to read and termination flag set, try reading one more
-            // time
-            if (process_terminated.load()) {
-                DWORD available = 0;
-                if (PeekNamedPipe(hReadOut, nullptr, 0, nullptr, &available,
-                                  nullptr) &&
-                    available > 0) {
-                    if (ReadFile(hReadOut, buffer, sizeof(buffer), &bytesRead,
-                                 nullptr)) {
-                        if (bytesRead > 0) {
-                            stdout_output.append(buffer, bytesRead);
-                        }
-                    }
-                }
-                break;
+        void CloseWriteEnd() {
+            if (write != INVALID_HANDLE_VALUE) {
+                CloseHandle(write);
+                write = INVALID_HANDLE_VALUE;
             }
+        }
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        void Deliver(DWORD len) {
+            if (len > 0 && callback && *callback) {
+                (*callback)(buffer, len);
+            }
         }
-    });
 
-    std::thread thread_read_err([&]() {
-        char buffer[4096];
-        DWORD bytesRead;
-        while (true) {
-            DWORD available = 0;
-            if (PeekNamedPipe(hReadErr, nullptr, 0, nullptr, &available,
-                              nullptr) &&
-                available > 0) {
-                if (ReadFile(hReadErr, buffer, sizeof(buffer), &bytesRead,
-                             nullptr)) {
-                    if (bytesRead > 0) {
-                        stderr_output.append(buffer, bytesRead);
-                        continue;
-                    }
+        // A read is neither pending nor done: kMaxReadsPerPoll stopped
+        // StartRead() with data still to come
+        bool Readable() const { return !pending && !eof; }
+
+        // Read until a read is left pending, the pipe is at EOF or
+        // kMaxReadsPerPoll reads were delivered
+        void StartRead() {
+            for (int reads = 0; Readable() && reads < kMaxReadsPerPoll;
+                 reads++) {
+                memset(&overlapped, 0, sizeof(overlapped));
+                overlapped.hEvent = event;
+                DWORD bytes_read = 0;
+                if (ReadFile(read, buffer, sizeof(buffer), &bytes_read,
+                             &overlapped)) {
+                    Deliver(bytes_read);
+                } else if (GetLastError() == ERROR_IO_PENDING) {
+                    pending = true;
                 } else {
-                    break;  // ReadFile failed (pipe closed)
+                    eof = true;  // ERROR_BROKEN_PIPE, all writers are gone
                 }
             }
+        }
 
-            // If no data to read and termination flag set, try reading one more
-            // time
-            if (process_terminated.load()) {
-                DWORD available = 0;
-                if (PeekNamedPipe(hReadErr, nullptr, 0, nullptr, &available,
-                                  nullptr) &&
-                    available > 0) {
-                    if (ReadFile(hReadErr, buffer, sizeof(buffer), &bytesRead,
-                                 nullptr)) {
-                        if (bytesRead > 0) {
-                            stderr_output.append(buffer, bytesRead);
-                        }
-                    }
-                }
-                break;
+        // Collect the pending read once its event is signaled
+        void FinishRead() {
+            DWORD bytes_read = 0;
+            pending = false;
+            if (GetOverlappedResult(read, &overlapped, &bytes_read, FALSE)) {
+                Deliver(bytes_read);
+            } else {
+                eof = true;
             }
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            StartRead();
         }
-    });
 
-    // Wait briefly for threads to start
-    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        // Give up on the pipe, e.g. held open by a background process
+        void Cancel() {
+            if (pending) {
+                DWORD bytes_read = 0;
+                CancelIoEx(read, &overlapped);
+                GetOverlappedResult(read, &overlapped, &bytes_read, TRUE);
+                pending = false;
+            }
+            eof = true;
+        }
 
-    // Create process (simplified version, no token used)
-    created = CreateProcessA(nullptr, const_cast<char*>(cmdline.c_str()),
-                             nullptr, nullptr, TRUE, CREATE_NO_WINDOW, nullptr,
-                             system_path.c_str(), &si, &pi);
+        ~OutputPipe() {
+            Cancel();
+            CloseWriteEnd();
+            if (read != INVALID_HANDLE_VALUE) CloseHandle(read);
+            if (event) CloseHandle(event);
+        }
+    };
 
-    if (!created) {
-        ret = -1;
-        stderr_output =
-            "create process fail: " + std::to_string(GetLastError());
+    PROCESS_INFORMATION pi = {0};
+    HANDLE input = nullptr;  // Our end of the child's stdin
+    OutputPipe out;
+    OutputPipe err;
+    ProcessTree tree;
+    bool exited = false;
+    int exit_code = -1;
+
+    ~Impl() {
+        if (pi.hProcess && !exited) {
+            tree.Shutdown(ShutdownPolicy::Immediate(),
+                          [](int wait_ms) { Sleep(wait_ms); });
+        }
+        CloseInput();
+        if (pi.hThread) CloseHandle(pi.hThread);
+        if (pi.hProcess) CloseHandle(pi.hProcess);
+    }
 
-        // Process creation failed, need to clean up threads
-        process_terminated = true;
+    bool Spawn(const ProcessOptions& options, std::string& error) {
+        SECURITY_ATTRIBUTES sa = {sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE};
+        HANDLE child_input = nullptr;
+        if (!out.Create(&sa, &options.on_stdout) ||
+            !err.Create(&sa, &options.on_stderr) ||
+            !CreatePipe(&child_input, &input, &sa, 0)) {
+            error = "create pipe fail: " + std::to_string(GetLastError());
+            if (child_input) CloseHandle(child_input);
+            return false;
+        }
+        SetHandleInformation(input, HANDLE_FLAG_INHERIT, 0);
+
+        // The child inherits its three pipe ends and nothing else, a pipe
+        // handed to a concurrently started process would not see EOF
+        // until that one exits too
+        HANDLE inherit[3] = {out.write, err.write, child_input};
+        SIZE_T size = 0;
+        InitializeProcThreadAttributeList(nullptr, 1, 0, &size);
+        std::vector<char> attributes(size);
+        LPPROC_THREAD_ATTRIBUTE_LIST list =
+            reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attributes.data());
+        bool have_list =
+            InitializeProcThreadAttributeList(list, 1, 0, &size) != FALSE;
+
+        STARTUPINFOEXA si;
+        memset(&si, 0, sizeof(si));
+        si.StartupInfo.cb = sizeof(si);
+        si.StartupInfo.dwFlags = STARTF_USESTDHANDLES | STARTF_USESHOWWINDOW;
+        si.StartupInfo.wShowWindow = SW_HIDE;
+        si.StartupInfo.hStdOutput = out.write;
+        si.StartupInfo.hStdError = err.write;
+        si.StartupInfo.hStdInput = child_input;
+        // Suspended until it is in the job, so that nothing it starts
+        // escapes
+        DWORD flags = CREATE_NO_WINDOW | CREATE_SUSPENDED;
+        if (have_list &&
+            UpdateProcThreadAttribute(list, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST,
+                                      inherit, sizeof(inherit), nullptr,
+                                      nullptr)) {
+            si.lpAttributeList = list;
+            flags |= EXTENDED_STARTUPINFO_PRESENT;
+        }
 
-        // Close write end to let threads exit
-        if (hWriteOut) {
-            CloseHandle(hWriteOut);
-            hWriteOut = nullptr;
+        std::string cmdline = BuildCommandLine(options);
+        std::vector<std::pair<std::string, std::string>> env = options.env;
+        std::string distribution;
+        if (options.forward_to_wsl &&
+            FindWSLDistribution(options.command.empty()
+                                    ? options.argv
+                                    : SplitCommandLine(options.command),
+                                distribution)) {
+            tree.SetWSLDistribution(distribution);
+            tree.Tag(env);
+        }
+        std::string env_block;
+        if (!env.empty()) {
+            env_block = BuildEnvironmentBlock(env);
         }
-        if (hWriteErr) {
-            CloseHandle(hWriteErr);
-            hWriteErr = nullptr;
+        BOOL created = CreateProcessA(
+            nullptr, &cmdline[0], nullptr, nullptr, TRUE, flags,
+            env_block.empty() ? nullptr : &env_block[0],
+            options.cwd.empty() ? nullptr : options.cwd.c_str(),
+            &si.StartupInfo, &pi);
+        DWORD create_error = GetLastError();
+        if (have_list) {
+            DeleteProcThreadAttributeList(list);
         }
 
-        // Wait for threads to exit
-        thread_read_out.join();
-        thread_read_err.join();
+        // Only the child holds the write ends now, the pipes reach EOF when
+        // it and its children are gone
+        out.CloseWriteEnd();
+        err.CloseWriteEnd();
+        CloseHandle(child_input);
 
-        // Clean up remaining pipe resources
-        if (hReadInput) CloseHandle(hReadInput);
-        if (hWriteInput) CloseHandle(hWriteInput);
-        if (hReadOut) CloseHandle(hReadOut);
-        if (hReadErr) CloseHandle(hReadErr);
-        return ret;
+        if (!created) {
+            memset(&pi, 0, sizeof(pi));
+            error = "create process fail: " + std::to_string(create_error);
+            return false;
+        }
+        tree.Attach(pi.hProcess);
+        ResumeThread(pi.hThread);
+        if (!options.pipe_stdin) {
+            CloseInput();
+        }
+        out.StartRead();
+        err.StartRead();
+        return true;
     }
 
-    // Process created, now enter waiting logic
-    DWORD startTime = GetTickCount();
-    bool timeout_occurred = false;
+    bool Drained() const { return out.eof && err.eof; }
 
-    while (true) {
-        // Check if process exited naturally
-        DWORD waitResult = WaitForSingleObject(pi.hProcess, 100);
+    void StopReading() {
+        out.Cancel();
+        err.Cancel();
+    }
 
-        if (waitResult == WAIT_OBJECT_0) {
-            // Process has exited
-            break;
-        } else if (waitResult == WAIT_TIMEOUT) {
-            // Check if timeout occurred
-            if ((GetTickCount() - startTime) > (timeout * 1000)) {
-                timeout_occurred = true;
-                break;
-            }
-        } else {
-            // Wait error occurred
-            break;
+    void CheckExit() {
+        if (!exited && WaitForSingleObject(pi.hProcess, 0) == WAIT_OBJECT_0) {
+            DWORD code = 0;
+            GetExitCodeProcess(pi.hProcess, &code);
+            exit_code = static_cast<int>(code);
+            exited = true;
         }
     }
 
-    // If timeout, force terminate process
-    if (timeout_occurred) {
-        TerminateProcess(pi.hProcess, static_cast<UINT>(-1));
-        stderr_output =
-            "cmd is auto killed, timeout: " + std::to_string(timeout) + "\n>" +
-            stderr_output;
-        ret = -2;
-    }
+    // Wait for the next completed read or the exit and handle it
+    void Poll(int wait_ms) {
+        // Pipes the read limit left readable go on without waiting
+        if (out.Readable() || err.Readable()) {
+            if (out.Readable()) out.StartRead();
+            if (err.Readable()) err.StartRead();
+            CheckExit();
+            return;
+        }
 
-    // Notify read threads to stop
-    process_terminated = true;
+        HANDLE handles[3];
+        OutputPipe* owners[3] = {nullptr, nullptr, nullptr};
+        DWORD count = 0;
+        if (!exited) {
+            handles[count++] = pi.hProcess;
+        }
+        if (out.pending) {
+            owners[count] = &out;
+            handles[count++] = out.event;
+        }
+        if (err.pending) {
+            owners[count] = &err;
+            handles[count++] = err.event;
+        }
+        if (count == 0) {
+            return;
+        }
 
-    // Close write end
-    if (hWriteErr) {
-        CloseHandle(hWriteErr);
-        hWriteErr = nullptr;
-    }
-    if (hWriteOut) {
-        CloseHandle(hWriteOut);
-        hWriteOut = nullptr;
-    }
-    if (hWriteInput) {
-        CloseHandle(hWriteInput);
-        hWriteInput = nullptr;
+        DWORD result = WaitForMultipleObjects(
+            count, handles, FALSE, wait_ms < 0 ? INFINITE : wait_ms);
+        if (result >= WAIT_OBJECT_0 + count) {
+            return;  // Timeout or wait error
+        }
+        DWORD index = result - WAIT_OBJECT_0;
+        if (owners[index]) {
+            owners[index]->FinishRead();
+        } else {
+            CheckExit();
+        }
     }
 
-    // Wait for read threads to complete
-    thread_read_out.join();
-    thread_read_err.join();
+    void Kill() { tree.Signal(ProcessSignal::kKill); }
 
-    // Get process exit code
-    if (ret == 0) {
-        DWORD exit_code;
-        GetExitCodeProcess(pi.hProcess, &exit_code);
-        ret = static_cast<int>(exit_code);
+    bool WriteInput(const char* data, size_t len) {
+        while (input && len > 0) {
+            DWORD written = 0;
+            if (!WriteFile(input, data, static_cast<DWORD>(len), &written,
+                           nullptr)) {
+                return false;
+            }
+            data += written;
+            len -= written;
+        }
+        return input != nullptr;
     }
 
-    // Decide whether to perform encoding conversion based on parameters
-    if (!skip_encoding_conversion) {
-        // Ensure output is UTF-8 encoded
-        stdout_output = ConvertPowerShellOutputToUtf8(stdout_output);
-        stderr_output = ConvertPowerShellOutputToUtf8(stderr_output);
+    void CloseInput() {
+        if (input) {
+            CloseHandle(input);
+            input = nullptr;
+        }
     }
+};
+#else
+// Pipe whose ends are not inherited by processes spawned meanwhile
+static bool OpenPipe(int fds[2]) {
+#ifdef __linux__
+    return pipe2(fds, O_CLOEXEC) == 0;
+#else
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#endif
+}
 
-    // Clean up resources
-    if (hReadInput) CloseHandle(hReadInput);
-    if (hReadOut) CloseHandle(hReadOut);
-    if (hReadErr) CloseHandle(hReadErr);
-    if (pi.hThread) CloseHandle(pi.hThread);
-    if (pi.hProcess) CloseHandle(pi.hProcess);
-
-    return ret;
+static void CloseFd(int& fd) {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
 }
 
-int ExecCommandEx2(const std::string& cmd, int timeout,
-                   std::string& stdout_output, std::string& stderr_output,
-                   std::function<bool()> check_callback, bool elevate,
-                   bool skip_encoding_conversion) {
-    if (cmd.empty() || timeout <= 0) {
-        return -1;
+struct Process::Impl {
+    pid_t pid = -1;
+    int process_fd = -1;  // pidfd, readable at the exit (Linux 5.3+)
+    int input = -1;       // Our end of the child's stdin
+    int out = -1;         // Our ends of stdout/stderr, -1 at EOF
+    int err = -1;
+    const ProcessOutputCallback* on_stdout = nullptr;
+    const ProcessOutputCallback* on_stderr = nullptr;
+    ProcessTree tree;
+    bool exited = false;
+    int exit_code = -1;
+
+    ~Impl() {
+        if (pid > 0 && !exited) {
+            // The leader counts as part of the tree until it is reaped
+            tree.Shutdown(ShutdownPolicy::Immediate(), [this](int wait_ms) {
+                CheckExit();
+                std::this_thread::sleep_for(std::chrono::milliseconds(wait_ms));
+            });
+            if (!exited) {
+                waitpid(pid, nullptr, 0);
+            }
+        }
+        CloseFd(process_fd);
+        CloseFd(input);
+        CloseFd(out);
+        CloseFd(err);
     }
 
-    int ret = 0;
-    SECURITY_ATTRIBUTES sa = {sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE};
+    bool Spawn(const ProcessOptions& options, std::string& error) {
+        std::vector<std::string> args = options.argv;
+        if (!options.command.empty()) {
+            args = {"/bin/sh", "-c", options.command};
+        }
+        if (args.empty()) {
+            error = "create process fail: no command";
+            return false;
+        }
+#ifndef PARALLAX_SPAWN_ADDCHDIR
+        // No chdir file action, a shell changes directory first
+        if (!options.cwd.empty()) {
+            args.insert(args.begin(), {"/bin/sh", "-c",
+                                       "cd -- \"$0\" && exec \"$@\"",
+                                       options.cwd});
+        }
+#endif
+
+        int out_fds[2] = {-1, -1};
+        int err_fds[2] = {-1, -1};
+        int in_fds[2] = {-1, -1};
+        if (!OpenPipe(out_fds) || !OpenPipe(err_fds) || !OpenPipe(in_fds)) {
+            error = std::string("create pipe fail: ") + strerror(errno);
+            for (int fd : {out_fds[0], out_fds[1], err_fds[0], err_fds[1],
+                           in_fds[0], in_fds[1]}) {
+                if (fd >= 0) close(fd);
+            }
+            return false;
+        }
 
-    HANDLE hReadOut = nullptr, hWriteOut = nullptr;
-    HANDLE hReadErr = nullptr, hWriteErr = nullptr;
-    HANDLE hReadInput = nullptr, hWriteInput = nullptr;
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, in_fds[0], 0);
+        posix_spawn_file_actions_adddup2(&actions, out_fds[1], 1);
+        posix_spawn_file_actions_adddup2(&actions, err_fds[1], 2);
+#ifdef PARALLAX_SPAWN_ADDCHDIR
+        if (!options.cwd.empty()) {
+            posix_spawn_file_actions_addchdir_np(&actions,
+                                                 options.cwd.c_str());
+        }
+#endif
 
-    stdout_output.clear();
-    stderr_output.clear();
+        std::vector<char*> argv;
+        for (std::string& arg : args) {
+            argv.push_back(&arg[0]);
+        }
+        argv.push_back(nullptr);
+
+        std::vector<std::pair<std::string, std::string>> env = options.env;
+        std::string distribution;
+        if (options.forward_to_wsl &&
+            FindWSLDistribution(options.command.empty()
+                                    ? options.argv
+                                    : SplitCommandLine(options.command),
+                                distribution)) {
+            tree.SetWSLDistribution(distribution);
+            tree.Tag(env);
+        }
 
-    std::string system_path = GetSystemPath();
-    STARTUPINFOA si = {sizeof(STARTUPINFOA)};
-    PROCESS_INFORMATION pi = {0};
-    std::atomic<bool> process_terminated(false);
-
-    // Create stdout pipe
-    if (!CreatePipe(&hReadOut, &hWriteOut, &sa, 0)) return -1;
-    // Create stderr pipe
-    if (!CreatePipe(&hReadErr, &hWriteErr, &sa, 0)) return -1;
-    // Create stdin pipe
-    if (!CreatePipe(&hReadInput, &hWriteInput, &sa, 0)) return -1;
-
-    // Prevent parent process from inheriting handles it shouldn't
-    SetHandleInformation(hReadOut, HANDLE_FLAG_INHERIT, 0);
-    SetHandleInformation(hReadErr, HANDLE_FLAG_INHERIT, 0);
-    SetHandleInformation(hWriteInput, HANDLE_FLAG_INHERIT, 0);
-
-    // Set child process stdxxx
-    si.dwFlags = STARTF_USESTDHANDLES | STARTF_USESHOWWINDOW;
-    si.wShowWindow = SW_HIDE;
-    si.hStdOutput = hWriteOut;
-    si.hStdError = hWriteErr;
-    si.hStdInput = hReadInput;
-
-    std::string cmdline = "cmd /C " + cmd;
-    bool created = false;
-
-    // Create read thread
-    std::thread thread_read_out([&]() {
-        char buffer[4096];
-        DWORD bytesRead;
-        while (true) {
-            DWORD available = 0;
-            if (PeekNamedPipe(hReadOut, nullptr, 0, nullptr, &available,
-                              nullptr) &&
-                available > 0) {
-                if (ReadFile(hReadOut, buffer, sizeof(buffer), &bytesRead,
-                             nullptr)) {
-                    if (bytesRead > 0) {
-                        stdout_output.append(buffer, bytesRead);
-                        continue;
+        // Our environment with the variables of env replaced or added
+        std::vector<std::string> env_strings;
+        std::vector<char*> envp;
+        if (!env.empty()) {
+            for (char** p = environ; *p; p++) {
+                const char* equals = strchr(*p, '=');
+                size_t name_len = equals ? equals - *p : strlen(*p);
+                bool replaced = false;
+                for (const auto& var : env) {
+                    if (var.first.size() == name_len &&
+                        strncmp(var.first.c_str(), *p, name_len) == 0) {
+                        replaced = true;
+                        break;
                     }
-                } else {
-                    break;
                 }
+                if (!replaced) env_strings.push_back(*p);
+            }
+            for (const auto& var : env) {
+                env_strings.push_back(var.first + "=" + var.second);
             }
+            for (std::string& var : env_strings) {
+                envp.push_back(&var[0]);
+            }
+            envp.push_back(nullptr);
+        }
 
-            if (process_terminated.load()) {
-                DWORD available = 0;
-                if (PeekNamedPipe(hReadOut, nullptr, 0, nullptr, &available,
-                                  nullptr) &&
-                    available > 0) {
-                    if (ReadFile(hReadOut, buffer, sizeof(buffer), &bytesRead,
-                                 nullptr)) {
-                        if (bytesRead > 0) {
-                            stdout_output.append(buffer, bytesRead);
-                        }
-                    }
+        // The child leads a process group, which its descendants join
+        posix_spawnattr_t attributes;
+        posix_spawnattr_init(&attributes);
+        posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+        posix_spawnattr_setpgroup(&attributes, 0);
+
+        int spawn_error = posix_spawnp(&pid, argv[0], &actions, &attributes,
+                                       argv.data(),
+                                       envp.empty() ? environ : envp.data());
+        posix_spawnattr_destroy(&attributes);
+        posix_spawn_file_actions_destroy(&actions);
+        close(in_fds[0]);
+        close(out_fds[1]);
+        close(err_fds[1]);
+        input = in_fds[1];
+        out = out_fds[0];
+        err = err_fds[0];
+        fcntl(out, F_SETFL, O_NONBLOCK);
+        fcntl(err, F_SETFL, O_NONBLOCK);
+
+        if (spawn_error != 0) {
+            pid = -1;
+            error = std::string("create process fail: ") +
+                    strerror(spawn_error);
+            return false;
+        }
+        if (!options.pipe_stdin) {
+            CloseInput();
+        }
+        on_stdout = &options.on_stdout;
+        on_stderr = &options.on_stderr;
+        tree.Attach(pid);
+#ifdef SYS_pidfd_open
+        process_fd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#endif
+        return true;
+    }
+
+    bool Drained() const { return out < 0 && err < 0; }
+
+    void StopReading() {
+        CloseFd(out);
+        CloseFd(err);
+    }
+
+    // Read what is available, up to kMaxReadsPerPoll reads; the next poll()
+    // finds the rest. Closes the pipe at EOF.
+    void ReadPipe(int& fd, const ProcessOutputCallback* callback) {
+        char buffer[kReadBufferBytes];
+        for (int reads = 0; reads < kMaxReadsPerPoll; reads++) {
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                if (*callback) {
+                    (*callback)(buffer, static_cast<size_t>(n));
                 }
-                break;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n == 0 || errno != EAGAIN) {
+                CloseFd(fd);
             }
+            return;
+        }
+    }
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    void CheckExit() {
+        int status = 0;
+        if (exited || waitpid(pid, &status, WNOHANG) != pid) {
+            return;
         }
-    });
+        exit_code = WIFEXITED(status) ? WEXITSTATUS(status)
+                                      : 128 + WTERMSIG(status);
+        exited = true;
+        CloseFd(process_fd);
+    }
 
-    std::thread thread_read_err([&]() {
-        char buffer[4096];
-        DWORD bytesRead;
-        while (true) {
-            DWORD available = 0;
-            if (PeekNamedPipe(hReadErr, nullptr, 0, nullptr, &available,
-                              nullptr) &&
-                available > 0) {
-                if (ReadFile(hReadErr, buffer, sizeof(buffer), &bytesRead,
-                             nullptr)) {
-                    if (bytesRead > 0) {
-                        stderr_output.append(buffer, bytesRead);
-                        continue;
-                    }
-                } else {
-                    break;
+    // Wait for output or the exit and handle what is ready
+    void Poll(int wait_ms) {
+        struct pollfd fds[3];
+        int count = 0;
+        if (out >= 0) fds[count++] = {out, POLLIN, 0};
+        if (err >= 0) fds[count++] = {err, POLLIN, 0};
+        if (!exited && process_fd >= 0) fds[count++] = {process_fd, POLLIN, 0};
+        if (exited && count == 0) {
+            return;
+        }
+
+        // Without a process descriptor the exit is only seen by waitpid
+        if (!exited && process_fd < 0 && (wait_ms < 0 || wait_ms > 10)) {
+            wait_ms = 10;
+        }
+        if (poll(fds, count, wait_ms) > 0) {
+            for (int i = 0; i < count; i++) {
+                if (fds[i].revents == 0 || fds[i].fd == process_fd) {
+                    continue;
+                }
+                if (fds[i].fd == out) {
+                    ReadPipe(out, on_stdout);
+                } else if (fds[i].fd == err) {
+                    ReadPipe(err, on_stderr);
                 }
             }
+        }
+        CheckExit();
+    }
 
-            if (process_terminated.load()) {
-                DWORD available = 0;
-                if (PeekNamedPipe(hReadErr, nullptr, 0, nullptr, &available,
-                                  nullptr) &&
-                    available > 0) {
-                    if (ReadFile(hReadErr, buffer, sizeof(buffer), &bytesRead,
-                                 nullptr)) {
-                        if (bytesRead > 0) {
-                            stderr_output.append(buffer, bytesRead);
-                        }
-                    }
-                }
+    void Kill() { tree.Signal(ProcessSignal::kKill); }
+
+    bool WriteInput(const char* data, size_t len) {
+        if (input < 0) {
+            return false;
+        }
+
+        // A child that closed its stdin must not raise SIGPIPE here
+        sigset_t pipe_signal, old_mask;
+        sigemptyset(&pipe_signal);
+        sigaddset(&pipe_signal, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &pipe_signal, &old_mask);
+        bool ok = true;
+        while (len > 0) {
+            ssize_t n = write(input, data, len);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                ok = false;
                 break;
             }
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            data += n;
+            len -= static_cast<size_t>(n);
         }
-    });
+        if (!ok && errno == EPIPE) {
+            struct timespec no_wait = {0, 0};
+            sigtimedwait(&pipe_signal, nullptr, &no_wait);
+        }
+        pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+        return ok;
+    }
 
-    // Wait briefly for threads to start
-    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    void CloseInput() { CloseFd(input); }
+};
+#endif
 
-    // Create process
-    created = CreateProcessA(nullptr, const_cast<char*>(cmdline.c_str()),
-                             nullptr, nullptr, TRUE, CREATE_NO_WINDOW, nullptr,
-                             system_path.c_str(), &si, &pi);
+// Variable carrying the tag of a tree into WSL
+static const char kTreeTagVariable[] = "PARALLAX_TREE";
 
-    if (!created) {
-        ret = -1;
-        stderr_output =
-            "create process fail: " + std::to_string(GetLastError());
+// How long forwarding a signal into a distribution may take
+static const int kWSLSignalTimeoutMs = 15000;
 
-        // Process creation failed, clean up threads
-        process_terminated = true;
+// Interval of the kill -0 checks in the distribution, "sleep 0.1"
+static const int kWSLCheckIntervalMs = 100;
 
-        if (hWriteOut) {
-            CloseHandle(hWriteOut);
-            hWriteOut = nullptr;
+// ShutdownPolicy::Default()
+static std::atomic<int> g_interrupt_grace_ms(
+    ShutdownPolicy().interrupt_grace_ms);
+static std::atomic<int> g_terminate_grace_ms(
+    ShutdownPolicy().terminate_grace_ms);
+
+ShutdownPolicy ShutdownPolicy::Immediate() {
+    ShutdownPolicy policy;
+    policy.interrupt_grace_ms = 0;
+    policy.terminate_grace_ms = 0;
+    return policy;
+}
+
+ShutdownPolicy ShutdownPolicy::Prompt() {
+    ShutdownPolicy policy = Default();
+    int prompt_ms = kPromptGraceMs;
+    if (policy.interrupt_grace_ms > prompt_ms) {
+        policy.interrupt_grace_ms = prompt_ms;
+    }
+    policy.terminate_grace_ms = 0;
+    return policy;
+}
+
+ShutdownPolicy ShutdownPolicy::Default() {
+    ShutdownPolicy policy;
+    policy.interrupt_grace_ms = g_interrupt_grace_ms;
+    policy.terminate_grace_ms = g_terminate_grace_ms;
+    return policy;
+}
+
+void ShutdownPolicy::SetDefault(const ShutdownPolicy& policy) {
+    g_interrupt_grace_ms = policy.interrupt_grace_ms;
+    g_terminate_grace_ms = policy.terminate_grace_ms;
+}
+
+bool ShutdownPolicy::Parse(const std::string& value, ShutdownPolicy& policy) {
+    int interrupt_seconds = 0, terminate_seconds = 0;
+    char rest = 0;
+    if (sscanf(value.c_str(), "%d,%d%c", &interrupt_seconds,
+               &terminate_seconds, &rest) != 2 ||
+        interrupt_seconds < 0 || interrupt_seconds > 600 ||
+        terminate_seconds < 0 || terminate_seconds > 600) {
+        return false;
+    }
+    policy.interrupt_grace_ms = interrupt_seconds * 1000;
+    policy.terminate_grace_ms = terminate_seconds * 1000;
+    return true;
+}
+
+static const char* SignalName(ProcessSignal signal) {
+    switch (signal) {
+        case ProcessSignal::kInterrupt:
+            return "INT";
+        case ProcessSignal::kTerminate:
+            return "TERM";
+        case ProcessSignal::kKill:
+            break;
+    }
+    return "KILL";
+}
+
+#ifdef _WIN32
+ProcessTree::ProcessTree()
+    : wsl_gone_(false), job_(nullptr), process_(nullptr) {}
+
+ProcessTree::~ProcessTree() {
+    if (job_) CloseHandle(job_);
+    if (process_) CloseHandle(process_);
+}
+
+bool ProcessTree::Attach(HANDLE process) {
+    job_ = CreateJobObjectA(nullptr, nullptr);
+    if (job_ && AssignProcessToJobObject(job_, process)) {
+        return true;
+    }
+    warn_log("[PROC] Process not put in a job object, error: %lu",
+             GetLastError());
+    if (job_) {
+        CloseHandle(job_);
+        job_ = nullptr;
+    }
+    DuplicateHandle(GetCurrentProcess(), process, GetCurrentProcess(),
+                    &process_, 0, FALSE, DUPLICATE_SAME_ACCESS);
+    return false;
+}
+
+bool ProcessTree::IsLocalEmpty() {
+    if (job_) {
+        JOBOBJECT_BASIC_ACCOUNTING_INFORMATION info;
+        if (QueryInformationJobObject(job_, JobObjectBasicAccountingInformation,
+                                      &info, sizeof(info), nullptr)) {
+            return info.ActiveProcesses == 0;
         }
-        if (hWriteErr) {
-            CloseHandle(hWriteErr);
-            hWriteErr = nullptr;
+        return false;
+    }
+    return !process_ || WaitForSingleObject(process_, 0) == WAIT_OBJECT_0;
+}
+
+void ProcessTree::SignalLocal(ProcessSignal signal) {
+    // Windows processes only understand the kill
+    if (signal == ProcessSignal::kKill) {
+        if (job_) {
+            TerminateJobObject(job_, static_cast<UINT>(-1));
+        } else if (process_) {
+            TerminateProcess(process_, static_cast<UINT>(-1));
         }
+    }
+}
+#else
+ProcessTree::ProcessTree() : wsl_gone_(false), pgid_(-1) {}
+
+ProcessTree::~ProcessTree() {}
 
-        thread_read_out.join();
-        thread_read_err.join();
+void ProcessTree::Attach(pid_t pgid) { pgid_ = pgid; }
 
-        // Clean up remaining resources
-        if (hReadInput) CloseHandle(hReadInput);
-        if (hWriteInput) CloseHandle(hWriteInput);
-        if (hReadOut) CloseHandle(hReadOut);
-        if (hReadErr) CloseHandle(hReadErr);
-        return ret;
+bool ProcessTree::IsLocalEmpty() {
+    // An exited leader counts until it is reaped
+    return pgid_ <= 0 || (kill(-pgid_, 0) != 0 && errno == ESRCH);
+}
+
+void ProcessTree::SignalLocal(ProcessSignal signal) {
+    if (pgid_ > 0) {
+        int number = signal == ProcessSignal::kInterrupt   ? SIGINT
+                     : signal == ProcessSignal::kTerminate ? SIGTERM
+                                                           : SIGKILL;
+        kill(-pgid_, number);
     }
+}
+#endif
 
-    // Process created, enter waiting logic (with callback support)
-    DWORD startTime = GetTickCount();
-    bool callback_result = false;
-    bool timeout_occurred = false;
+void ProcessTree::Signal(ProcessSignal signal) {
+    SignalLocal(signal);
+    if (MayHaveWSLPart() && SignalWSL(SignalName(signal)) <= 0 &&
+        IsLocalEmpty()) {
+        wsl_gone_ = true;
+    }
+}
 
-    while (true) {
-        // Check if process exited naturally
-        DWORD waitResult = WaitForSingleObject(pi.hProcess, 100);
+void ProcessTree::SetWSLDistribution(const std::string& distribution) {
+    distribution_ = distribution;
+}
 
-        if (waitResult == WAIT_OBJECT_0) {
-            // Process has exited
-            break;
-        } else if (waitResult == WAIT_TIMEOUT) {
-            // Check if timeout occurred
-            if ((GetTickCount() - startTime) > (timeout * 1000)) {
-                timeout_occurred = true;
-                break;
-            }
+void ProcessTree::Tag(std::vector<std::pair<std::string, std::string>>& env) {
+    if (distribution_.empty()) {
+        return;
+    }
+    static std::atomic<unsigned> counter(0);
+    char tag[64];
+    snprintf(tag, sizeof(tag), "%lu-%u-%08x",
+             CurrentProcessId(), counter++,
+             static_cast<unsigned>(std::random_device{}()));
+    tag_ = tag;
+    env.emplace_back(kTreeTagVariable, tag_);
+
+    // wsl.exe only passes on variables listed in WSLENV
+    const char* wslenv = getenv("WSLENV");
+    std::string list = wslenv && *wslenv ? std::string(wslenv) + ":" : "";
+    env.emplace_back("WSLENV", list + kTreeTagVariable + "/u");
+}
 
-            // Call callback function to check if termination is needed
-            if (check_callback && check_callback()) {
-                callback_result = true;
-                break;
+bool ProcessTree::MayHaveWSLPart() const {
+    return !distribution_.empty() && !tag_.empty() && !wsl_gone_;
+}
+
+ProcessOptions ProcessTree::WSLSignalOptions(const char* signal,
+                                             int wait_ms) const {
+    // Neither quotes nor backslashes, it passes wsl.exe's command line
+    // parsing unchanged. The processes are looked up again for every
+    // check, children started in the meantime count as well.
+    int checks = wait_ms > 0 ? wait_ms / kWSLCheckIntervalMs : 0;
+    std::string script =
+        "scan() { n=0; for f in /proc/[0-9]*/environ; do "
+        "grep -qzx " + std::string(kTreeTagVariable) + "=" + tag_ +
+        " $f 2>/dev/null || continue; p=${f#/proc/}; "
+        "kill -$1 ${p%/environ} 2>/dev/null && n=$((n+1)); done; }; "
+        "scan " + signal + "; i=0; "
+        "while [ $n -gt 0 ] && [ $i -lt " + std::to_string(checks) +
+        " ]; do sleep 0.1; scan 0; i=$((i+1)); done; echo $n";
+
+    ProcessOptions options;
+    options.argv = {"wsl", "-d", distribution_, "-u", "root", "--exec",
+                    "sh", "-c", script};
+#ifdef _WIN32
+    options.cwd = GetSystemPath();
+#endif
+    options.timeout_ms = kWSLSignalTimeoutMs + wait_ms;
+    options.shutdown = ShutdownPolicy::Immediate();
+    options.forward_to_wsl = false;
+    return options;
+}
+
+int ProcessTree::SignalWSL(const char* signal) {
+    std::string out, err;
+    ProcessResult result =
+        CaptureProcess(WSLSignalOptions(signal, 0), out, err);
+    if (result.status != ProcessStatus::kExited || result.exit_code != 0) {
+        warn_log("[PROC] Sending SIG%s into WSL failed (%d): %s %s", signal,
+                 result.exit_code, result.error.c_str(), err.c_str());
+        return -1;
+    }
+    int found = atoi(out.c_str());
+    debug_log("[PROC] SIG%s sent to %d processes in WSL", signal, found);
+    return found;
+}
+
+void ProcessTree::StartWSLSignal(const char* signal, int wait_ms) {
+    wsl_signal_.reset(new Process());
+    wsl_output_.clear();
+    wsl_error_.clear();
+    ProcessOptions options = WSLSignalOptions(signal, wait_ms);
+    options.on_stdout = [this](const char* data, size_t len) {
+        wsl_output_.append(data, len);
+    };
+    options.on_stderr = [this](const char* data, size_t len) {
+        wsl_error_.append(data, len);
+    };
+    if (!wsl_signal_->Start(options)) {
+        warn_log("[PROC] Sending SIG%s into WSL failed: %s", signal,
+                 wsl_signal_->GetError().c_str());
+        wsl_signal_.reset();
+        return;
+    }
+    debug_log("[PROC] SIG%s sent into WSL, waiting up to %d ms", signal,
+              wait_ms);
+}
+
+int ProcessTree::FinishWSLSignal() {
+    if (!wsl_signal_) {
+        return -1;
+    }
+    ProcessResult result = wsl_signal_->Wait();
+    wsl_signal_.reset();
+    if (result.status != ProcessStatus::kExited || result.exit_code != 0) {
+        warn_log("[PROC] Waiting for processes in WSL failed (%d): %s",
+                 result.exit_code, wsl_error_.c_str());
+        return -1;
+    }
+    int left = atoi(wsl_output_.c_str());
+    debug_log("[PROC] %d processes left in WSL", left);
+    return left;
+}
+
+bool ProcessTree::IsEmpty() {
+    // A failed check is taken as empty, waiting would not change it
+    if (!IsLocalEmpty()) {
+        return false;
+    }
+    if (MayHaveWSLPart() && SignalWSL("0") > 0) {
+        return false;
+    }
+    wsl_gone_ = true;
+    return true;
+}
+
+bool ProcessTree::WaitEmpty(int wait_ms,
+                            const std::function<void(int)>& wait) {
+    const int kLocalCheckIntervalMs = 20;
+    uint64_t now = MonotonicMs();
+    uint64_t deadline = now + wait_ms;
+    // The script ends once its processes are gone or after wait_ms. One
+    // that failed or could not be started is taken as empty like in
+    // IsEmpty(), one that left processes is not asked again.
+    bool wsl_empty = !MayHaveWSLPart() || !wsl_signal_;
+    while (true) {
+        if (!wsl_empty && wsl_signal_ && !wsl_signal_->Poll(0)) {
+            wsl_empty = FinishWSLSignal() <= 0;
+        }
+        bool local_empty = IsLocalEmpty();
+        if (local_empty && wsl_empty) {
+            if (MayHaveWSLPart()) {
+                wsl_gone_ = true;
             }
-        } else {
-            // Wait error occurred
-            break;
+            return true;
+        }
+
+        // wsl.exe takes a while to start, the script gets its own wait_ms
+        // once the local part is gone
+        now = MonotonicMs();
+        if (now >= deadline &&
+            (!local_empty || !wsl_signal_ ||
+             now >= deadline + kWSLSignalTimeoutMs)) {
+            wsl_signal_.reset();
+            return false;
         }
+        uint64_t left = now < deadline ? deadline - now : 0;
+        wait(static_cast<int>(left > 0 && left < kLocalCheckIntervalMs
+                                  ? left
+                                  : kLocalCheckIntervalMs));
     }
+}
 
-    // If timeout or callback requests termination, force terminate the process
-    if (timeout_occurred || callback_result) {
-        TerminateProcess(pi.hProcess, static_cast<UINT>(-1));
+bool ProcessTree::Shutdown(const ShutdownPolicy& policy,
+                           const std::function<void(int)>& wait) {
+    const ProcessSignal steps[] = {ProcessSignal::kInterrupt,
+                                   ProcessSignal::kTerminate,
+                                   ProcessSignal::kKill};
+    for (ProcessSignal signal : steps) {
+        int wait_ms = kKillWaitMs;
+        if (signal == ProcessSignal::kInterrupt) {
+            wait_ms = policy.interrupt_grace_ms;
+        } else if (signal == ProcessSignal::kTerminate) {
+            wait_ms = policy.terminate_grace_ms;
+        }
+        if (wait_ms <= 0) {
+            continue;
+        }
+#ifdef _WIN32
+        // Nothing would receive it
+        if (signal != ProcessSignal::kKill && distribution_.empty()) {
+            continue;
+        }
+#endif
+        if (IsLocalEmpty() && !MayHaveWSLPart()) {
+            return true;
+        }
+        debug_log("[PROC] Stopping process tree: SIG%s, waiting %d ms",
+                  SignalName(signal), wait_ms);
+        SignalLocal(signal);
+        if (MayHaveWSLPart()) {
+            StartWSLSignal(SignalName(signal), wait_ms);
+        }
+        if (WaitEmpty(wait_ms, wait)) {
+            return true;
+        }
+    }
+    warn_log("[PROC] Processes of the tree still run after the kill");
+    return false;
+}
 
-        if (timeout_occurred) {
-            stderr_output =
-                "cmd is auto killed, timeout: " + std::to_string(timeout) +
-                "\n>" + stderr_output;
-            ret = -2;
-        } else {
-            stderr_output = "cmd is terminated by callback\n>" + stderr_output;
-            ret = -3;
+Process::Process() : drain_deadline_(0), finished_(true) {}
+
+Process::~Process() {}
+
+bool Process::Start(const ProcessOptions& options) {
+    impl_.reset();
+    options_ = options;
+    error_.clear();
+    drain_deadline_ = 0;
+    finished_ = false;
+
+    impl_.reset(new Impl());
+    if (!impl_->Spawn(options_, error_)) {
+        impl_.reset();
+        finished_ = true;
+        return false;
+    }
+    return true;
+}
+
+bool Process::Poll(int wait_ms) {
+    if (finished_) {
+        return false;
+    }
+
+    if (!impl_->exited) {
+        impl_->CheckExit();
+        if (impl_->exited) {
+            drain_deadline_ = MonotonicMs() + kDrainMs;
         }
     }
 
-    // Notify read threads to stop
-    process_terminated = true;
+    // After the exit only the rest of the output is waited for
+    if (impl_->exited) {
+        uint64_t now = MonotonicMs();
+        if (impl_->Drained() || now >= drain_deadline_) {
+            impl_->StopReading();
+            finished_ = true;
+            return false;
+        }
+        int left = static_cast<int>(drain_deadline_ - now);
+        if (wait_ms < 0 || wait_ms > left) {
+            wait_ms = left;
+        }
+    }
+
+    bool was_running = !impl_->exited;
+    impl_->Poll(wait_ms);
+    if (was_running && impl_->exited) {
+        drain_deadline_ = MonotonicMs() + kDrainMs;
+    }
+    if (impl_->exited && impl_->Drained()) {
+        finished_ = true;
+        return false;
+    }
+    return true;
+}
+
+ProcessResult Process::Wait() {
+    ProcessResult result;
+    if (!impl_) {
+        result.error = error_;
+        return result;
+    }
+
+    result.status = ProcessStatus::kExited;
+    const uint64_t kNever = ~0ULL;
+    uint64_t now = MonotonicMs();
+    uint64_t deadline =
+        options_.timeout_ms > 0 ? now + options_.timeout_ms : kNever;
+    uint64_t next_check = now + kCancelIntervalMs;
+    const bool polled =
+        options_.cancel || options_.cancel_token.CanBeCancelled();
 
-    // Close write end
-    if (hWriteErr) {
-        CloseHandle(hWriteErr);
-        hWriteErr = nullptr;
+    while (true) {
+        // Limits apply until the process is killed for one of them
+        int wait_ms = -1;
+        if (IsRunning() && result.status == ProcessStatus::kExited) {
+            now = MonotonicMs();
+            if (now >= deadline) {
+                result.status = ProcessStatus::kTimedOut;
+                Stop();
+            } else if (options_.cancel_token.IsCancelled()) {
+                result.status = ProcessStatus::kCancelled;
+                Stop(options_.cancel_shutdown);
+            } else if (now >= next_check) {
+                next_check = now + kCancelIntervalMs;
+                if (options_.cancel && options_.cancel()) {
+                    result.status = ProcessStatus::kCancelled;
+                    Stop();
+                }
+            }
+
+            uint64_t wake = deadline;
+            if (polled && next_check < wake) {
+                wake = next_check;
+            }
+            if (result.status == ProcessStatus::kExited && wake != kNever) {
+                wait_ms = wake > now ? static_cast<int>(wake - now) : 0;
+            }
+        }
+        if (!Poll(wait_ms)) {
+            break;
+        }
     }
-    if (hWriteOut) {
-        CloseHandle(hWriteOut);
-        hWriteOut = nullptr;
+
+    result.exit_code = GetExitCode();
+    return result;
+}
+
+bool Process::WriteInput(const char* data, size_t len) {
+    return impl_ && !finished_ && impl_->WriteInput(data, len);
+}
+
+void Process::CloseInput() {
+    if (impl_) impl_->CloseInput();
+}
+
+bool Process::Stop() { return Stop(options_.shutdown); }
+
+bool Process::Stop(const ShutdownPolicy& policy) {
+    if (!impl_) {
+        return true;
     }
-    if (hWriteInput) {
-        CloseHandle(hWriteInput);
-        hWriteInput = nullptr;
+    return impl_->tree.Shutdown(policy, [this](int wait_ms) {
+        if (!Poll(wait_ms)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(wait_ms));
+        }
+    });
+}
+
+void Process::Kill() {
+    if (impl_) impl_->Kill();
+}
+
+bool Process::IsRunning() const { return impl_ && !impl_->exited; }
+
+int Process::GetExitCode() const {
+    return impl_ && impl_->exited ? impl_->exit_code : -1;
+}
+
+ProcessResult CaptureProcess(ProcessOptions options,
+                             std::string& stdout_output,
+                             std::string& stderr_output,
+                             const CapturePolicy& capture,
+                             CaptureInfo* stdout_info,
+                             CaptureInfo* stderr_info) {
+    OutputCapture stdout_capture(capture, "stdout");
+    OutputCapture stderr_capture(capture, "stderr");
+    options.on_stdout = [&stdout_capture](const char* data, size_t len) {
+        stdout_capture.Append(data, len);
+    };
+    options.on_stderr = [&stderr_capture](const char* data, size_t len) {
+        stderr_capture.Append(data, len);
+    };
+
+    ProcessResult result;
+    Process process;
+    if (process.Start(options)) {
+        result = process.Wait();
+    } else {
+        result.error = process.GetError();
     }
+    stdout_capture.Finish(stdout_output, stdout_info);
+    stderr_capture.Finish(stderr_output, stderr_info);
+    return result;
+}
 
-    // Wait for read threads to complete
-    thread_read_out.join();
-    thread_read_err.join();
+int ExecCommandEx(const std::string& cmd, int timeout,
+                  std::string& stdout_output, std::string& stderr_output,
+                  bool elevate /* = false*/,
+                  bool skip_encoding_conversion /* = false*/,
+                  const CapturePolicy& capture, CaptureInfo* stdout_info,
+                  CaptureInfo* stderr_info) {
+    return ExecCommandEx2(cmd, timeout, stdout_output, stderr_output,
+                          nullptr, elevate, skip_encoding_conversion, capture,
+                          stdout_info, stderr_info);
+}
 
-    // Get process exit code
-    if (ret == 0) {
-        DWORD exit_code;
-        GetExitCodeProcess(pi.hProcess, &exit_code);
-        ret = static_cast<int>(exit_code);
+// Shared by ExecCommandEx2 and ExecCommandUntil: run cmd through the shell
+// with the limits in options and report like ExecCommandEx. timeout_text
+// and cancel_text describe the limit that stopped it.
+static int ExecShellCommand(const std::string& cmd, ProcessOptions& options,
+                            const std::string& timeout_text,
+                            const char* cancel_text,
+                            std::string& stdout_output,
+                            std::string& stderr_output,
+                            bool skip_encoding_conversion,
+                            const CapturePolicy& capture,
+                            CaptureInfo* stdout_info,
+                            CaptureInfo* stderr_info) {
+    options.command = cmd;
+#ifdef _WIN32
+    options.cwd = GetSystemPath();
+#endif
+
+    ProcessResult result = CaptureProcess(options, stdout_output,
+                                          stderr_output, capture, stdout_info,
+                                          stderr_info);
+    int ret = result.exit_code;
+    switch (result.status) {
+        case ProcessStatus::kFailedToStart:
+            stderr_output = result.error;
+            ret = -1;
+            break;
+        case ProcessStatus::kTimedOut:
+            stderr_output = "cmd is auto killed, timeout: " + timeout_text +
+                            "\n>" + stderr_output;
+            ret = -2;
+            break;
+        case ProcessStatus::kCancelled:
+            stderr_output = std::string("cmd is terminated by ") +
+                            cancel_text + "\n>" + stderr_output;
+            ret = -3;
+            break;
+        case ProcessStatus::kExited:
+            break;
     }
 
+#ifdef _WIN32
     // Decide whether to perform encoding conversion based on parameters
     if (!skip_encoding_conversion) {
         // Ensure output is UTF-8 encoded
         stdout_output = ConvertPowerShellOutputToUtf8(stdout_output);
         stderr_output = ConvertPowerShellOutputToUtf8(stderr_output);
     }
+#else
+    (void)skip_encoding_conversion;  // Output of POSIX shells is UTF-8
+#endif
+    return ret;
+}
+
+int ExecCommandEx2(const std::string& cmd, int timeout,
+                   std::string& stdout_output, std::string& stderr_output,
+                   std::function<bool()> check_callback, bool elevate,
+                   bool skip_encoding_conversion, const CapturePolicy& capture,
+                   CaptureInfo* stdout_info, CaptureInfo* stderr_info) {
+    (void)elevate;
+    if (cmd.empty() || timeout <= 0) {
+        return -1;
+    }
 
-    // Clean up resources
-    if (hReadInput) CloseHandle(hReadInput);
-    if (hReadOut) CloseHandle(hReadOut);
-    if (hReadErr) CloseHandle(hReadErr);
-    if (pi.hThread) CloseHandle(pi.hThread);
-    if (pi.hProcess) CloseHandle(pi.hProcess);
+    stdout_output.clear();
+    stderr_output.clear();
 
-    return ret;
+    ProcessOptions options;
+    options.timeout_ms = timeout * 1000;
+    options.cancel = check_callback;
+    return ExecShellCommand(cmd, options, std::to_string(timeout), "callback",
+                            stdout_output, stderr_output,
+                            skip_encoding_conversion, capture, stdout_info,
+                            stderr_info);
+}
+
+int ExecCommandUntil(const std::string& cmd, const Deadline& deadline,
+                     const CancellationToken& cancel_token,
+                     std::string& stdout_output, std::string& stderr_output,
+                     bool skip_encoding_conversion,
+                     const CapturePolicy& capture, CaptureInfo* stdout_info,
+                     CaptureInfo* stderr_info) {
+    if (cmd.empty()) {
+        return -1;
+    }
+
+    stdout_output.clear();
+    stderr_output.clear();
+
+    if (cancel_token.IsCancelled()) {
+        stderr_output = "cmd is not run, operation cancelled";
+        return -3;
+    }
+    if (deadline.HasPassed()) {
+        stderr_output = "cmd is not run, no time left";
+        return -2;
+    }
+
+    ProcessOptions options;
+    options.timeout_ms = deadline.ToTimeoutMs();
+    options.cancel_token = cancel_token;
+    return ExecShellCommand(
+        cmd, options, std::to_string(options.timeout_ms) + " ms",
+        "cancellation", stdout_output, stderr_output,
+        skip_encoding_conversion, capture, stdout_info, stderr_info);
 }
 
 }  // namespace utils
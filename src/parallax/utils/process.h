@@ -1,15 +1,313 @@
 #pragma once
+#include <stdint.h>
 #include <string>
 #include <functional>
 #include <atomic>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <utility>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#endif
+#include "cancellation.h"
+#include "output_capture.h"
 
 // Simplified process module, specifically for parallax project
 
 namespace parallax {
 namespace utils {
 
+// Receives a chunk of child output as it arrives
+using ProcessOutputCallback = std::function<void(const char* data, size_t len)>;
+
+enum class ProcessSignal {
+    kInterrupt,  // SIGINT, what Ctrl+C sends
+    kTerminate,  // SIGTERM
+    kKill,       // SIGKILL, TerminateJobObject on Windows
+};
+
+/**
+ * @brief Grace periods of the shutdown ladder
+ *
+ * A process tree is stopped by interrupting it, terminating it if it is
+ * still there interrupt_grace_ms later and killing it if it is still there
+ * terminate_grace_ms after that. A step without a grace period is skipped.
+ */
+struct ShutdownPolicy {
+    int interrupt_grace_ms = 3000;
+    int terminate_grace_ms = 2000;
+
+    // Straight to the kill
+    static ShutdownPolicy Immediate();
+
+    // For a stop someone waits on (Ctrl+C): the interrupt step of Default()
+    // cut to kPromptGraceMs and no terminate step, so the tree is gone
+    // within about a second even if it ignores the interrupt
+    static ShutdownPolicy Prompt();
+
+    // Policy of new ProcessOptions and of WSLProcess, set at startup from
+    // the shutdown_grace configuration
+    static ShutdownPolicy Default();
+    static void SetDefault(const ShutdownPolicy& policy);
+
+    // "<interrupt seconds>,<terminate seconds>", e.g. "3,2"
+    static bool Parse(const std::string& value, ShutdownPolicy& policy);
+
+    static const int kPromptGraceMs = 500;
+};
+
+/**
+ * @brief How a Process is started and supervised
+ */
+struct ProcessOptions {
+    // Program and arguments, the program is searched in PATH. Used when
+    // command is empty.
+    std::vector<std::string> argv;
+
+    // Command line run by the shell: cmd /C on Windows, /bin/sh -c elsewhere
+    std::string command;
+
+    std::string cwd;  // Working directory, empty to inherit ours
+
+    // Variables set for the child on top of the inherited environment
+    std::vector<std::pair<std::string, std::string>> env;
+
+    int timeout_ms = 0;  // Wait() stops the process after this, 0: no limit
+
+    // Polled by Wait() while the process runs, returning true stops it
+    std::function<bool()> cancel;
+
+    // Wait() stops the process once this is cancelled, checked as often as
+    // cancel is polled
+    CancellationToken cancel_token = CancellationToken::None();
+
+    // How Wait() ends the process tree for cancel_token
+    ShutdownPolicy cancel_shutdown = ShutdownPolicy::Prompt();
+
+    // How Stop(), and Wait() on a timeout or the cancel callback, end the
+    // process tree
+    ShutdownPolicy shutdown = ShutdownPolicy::Default();
+
+    // A command running wsl.exe -d <distribution> has its Linux processes
+    // tagged so that stopping the tree reaches them as well
+    bool forward_to_wsl = true;
+
+    // Output as it arrives, called on the thread in Poll() / Wait()
+    ProcessOutputCallback on_stdout;
+    ProcessOutputCallback on_stderr;
+
+    // Keep stdin open for WriteInput(), otherwise the child sees EOF
+    bool pipe_stdin = false;
+};
+
+enum class ProcessStatus {
+    kFailedToStart,
+    kExited,
+    kTimedOut,   // Stopped by Wait() after timeout_ms
+    kCancelled,  // Stopped by Wait() because of cancel or cancel_token
+};
+
+struct ProcessResult {
+    ProcessStatus status = ProcessStatus::kFailedToStart;
+
+    // Exit code of the process. A process ended by a POSIX signal reports
+    // 128 + the signal number like shells do.
+    int exit_code = -1;
+
+    std::string error;  // Why the process could not be started
+};
+
+/**
+ * @brief A child process and everything it starts, stopped as a whole
+ *
+ * On Windows the child is put in a job object before it runs, elsewhere it
+ * leads a process group of its own. Descendants inherit either, so they
+ * are still reached once the child is gone; only a POSIX process that
+ * moves to another group or session gets away.
+ *
+ * A tree that enters a WSL distribution through wsl.exe goes on there out
+ * of reach of the job object. Its Linux processes inherit a tag from the
+ * child's environment (wsl.exe passes it on as listed in WSLENV), and
+ * signals are forwarded by running kill in the distribution on every
+ * process carrying the tag. Windows processes cannot be interrupted from
+ * outside, on Windows only the WSL part of a tree sees the interrupt and
+ * terminate steps. Each step of the shutdown ladder starts one wsl.exe,
+ * which sends the signal and then waits in the distribution for the
+ * tagged processes to exit. Once none is left there and the local part is
+ * gone, the distribution is not asked again. Not thread safe.
+ */
+class Process;
+
+class ProcessTree {
+ public:
+    ProcessTree();
+    ~ProcessTree();
+
+    ProcessTree(const ProcessTree&) = delete;
+    ProcessTree& operator=(const ProcessTree&) = delete;
+
+    // Also signal the tagged processes in distribution, before Tag()
+    void SetWSLDistribution(const std::string& distribution);
+
+    // Add the tag to a child's environment, nothing without a distribution
+    void Tag(std::vector<std::pair<std::string, std::string>>& env);
+
+#ifdef _WIN32
+    // Put a child created with CREATE_SUSPENDED in the job before it is
+    // resumed. Without a job (false) only the child itself is reached.
+    bool Attach(HANDLE process);
+#else
+    // The child was spawned as leader of process group pgid
+    void Attach(pid_t pgid);
+#endif
+
+    void Signal(ProcessSignal signal);
+
+    // No process of the tree is left, the distribution is only asked once
+    // the local part is gone and while it may still hold processes
+    bool IsEmpty();
+
+    // Run the shutdown ladder and return once the tree is gone, calling
+    // wait(wait_ms) to pass the time (e.g. delivering output). False if
+    // processes are still there kKillWaitMs after the kill.
+    bool Shutdown(const ShutdownPolicy& policy,
+                  const std::function<void(int wait_ms)>& wait);
+
+    static const int kKillWaitMs = 10000;
+
+ private:
+    bool IsLocalEmpty();
+    void SignalLocal(ProcessSignal signal);
+
+    // Processes of the tree may be left in the distribution
+    bool MayHaveWSLPart() const;
+
+    // Script for the distribution: kill -<signal> on the tagged processes,
+    // then up to wait_ms of kill -0 checks until they are gone. Prints how
+    // many are left.
+    ProcessOptions WSLSignalOptions(const char* signal, int wait_ms) const;
+
+    // Run the script to completion. Returns how many processes are left,
+    // -1 if it could not be run.
+    int SignalWSL(const char* signal);
+
+    // Start the script with wait_ms in the background, and collect its
+    // result once it has ended (same as SignalWSL)
+    void StartWSLSignal(const char* signal, int wait_ms);
+    int FinishWSLSignal();
+
+    // Wait up to wait_ms for the local part to exit and for the started
+    // script to report the WSL part gone
+    bool WaitEmpty(int wait_ms, const std::function<void(int)>& wait);
+
+    std::string distribution_;
+    std::string tag_;
+    bool wsl_gone_;  // No tagged process left and none can be started
+    std::unique_ptr<Process> wsl_signal_;  // Started script
+    std::string wsl_output_;
+    std::string wsl_error_;
+#ifdef _WIN32
+    HANDLE job_;
+    HANDLE process_;  // Only without a job
+#else
+    pid_t pgid_;
+#endif
+};
+
+/**
+ * @brief Child process with piped stdin, stdout and stderr
+ *
+ * Output is delivered to the callbacks from Poll() or Wait(), which sleep
+ * until output arrives or the process exits; nothing polls on a timer
+ * except the cancel callback. The backend uses overlapped named pipes on
+ * Windows and posix_spawn with poll() elsewhere. The child inherits only
+ * its own three pipe ends, so concurrent processes do not keep each other's
+ * pipes open. The child and its descendants form a ProcessTree, which
+ * Stop() and Kill() end as a whole. Not thread safe, one thread drives a
+ * Process.
+ */
+class Process {
+ public:
+    Process();
+    ~Process();  // Kills the process tree if the process still runs
+
+    Process(const Process&) = delete;
+    Process& operator=(const Process&) = delete;
+
+    // Start the process, false if it could not be started (see GetError)
+    bool Start(const ProcessOptions& options);
+
+    // Wait up to wait_ms (-1: no limit) for output or the exit and hand the
+    // output to the callbacks, at most 64 KB per pipe and call so that a
+    // child that never stops writing cannot hold the caller. Returns false
+    // once the process has exited and its output has been delivered.
+    bool Poll(int wait_ms);
+
+    // Deliver output until the process exits, enforcing timeout_ms, cancel
+    // and cancel_token from the options by stopping the tree
+    ProcessResult Wait();
+
+    // Write to the child's stdin (pipe_stdin), false if it is gone
+    bool WriteInput(const char* data, size_t len);
+    void CloseInput();
+
+    // Run the shutdown ladder of the options over the process tree,
+    // delivering output meanwhile, and return once the tree is gone. False
+    // if processes survived the kill.
+    bool Stop();
+    bool Stop(const ShutdownPolicy& policy);
+
+    // Kill the process tree at once, its remaining output is still
+    // delivered
+    void Kill();
+
+    bool IsRunning() const;
+    int GetExitCode() const;  // -1 while running
+    const std::string& GetError() const { return error_; }
+
+    // Output still in the pipes is delivered for this long after the exit.
+    // Pipes stay open beyond it only if the process left a child of its
+    // own holding them.
+    static const int kDrainMs = 100;
+
+    // Interval at which Wait() polls the cancel callback and token
+    static const int kCancelIntervalMs = 100;
+
+ private:
+    struct Impl;
+
+    std::unique_ptr<Impl> impl_;
+    ProcessOptions options_;
+    std::string error_;
+    uint64_t drain_deadline_;  // Set at the exit
+    bool finished_;
+};
+
+// The distribution of a command line that runs wsl.exe -d <distribution>
+bool GetWSLDistribution(const std::string& command_line,
+                        std::string& distribution);
+
+#ifdef _WIN32
+// Environment block for CreateProcess: ours with the variables of env
+// replaced or added
+std::string BuildEnvironmentBlock(
+    const std::vector<std::pair<std::string, std::string>>& env);
+#endif
+
+// Run a process to completion and collect its output under capture (the
+// output callbacks in options are replaced). The infos, if given, report
+// what was left out and where it was spilled.
+ProcessResult CaptureProcess(ProcessOptions options,
+                             std::string& stdout_output,
+                             std::string& stderr_output,
+                             const CapturePolicy& capture = CapturePolicy(),
+                             CaptureInfo* stdout_info = nullptr,
+                             CaptureInfo* stderr_info = nullptr);
+
 /**
  * Execute command line and get output result (synchronous version)
  *
@@ -21,11 +319,17 @@ namespace utils {
  * not used)
  * @param skip_encoding_conversion Whether to skip encoding conversion
  * (optional)
+ * @param capture How much of the output is kept (default: all of it)
+ * @param stdout_info What became of stdout, e.g. its spill file (optional)
+ * @param stderr_info What became of stderr (optional)
  * @return Command execution return code, <0 indicates execution failure
  */
 int ExecCommandEx(const std::string& cmd, int timeout,
                   std::string& stdout_output, std::string& stderr_output,
-                  bool elevate = false, bool skip_encoding_conversion = false);
+                  bool elevate = false, bool skip_encoding_conversion = false,
+                  const CapturePolicy& capture = CapturePolicy(),
+                  CaptureInfo* stdout_info = nullptr,
+                  CaptureInfo* stderr_info = nullptr);
 
 /**
  * Execute command line and support callback to check if process should be
@@ -40,13 +344,46 @@ int ExecCommandEx(const std::string& cmd, int timeout,
  * @param elevate Whether to run with elevated privileges (parameter kept but
  * not used)
  * @param skip_encoding_conversion Whether to skip encoding conversion
+ * @param capture How much of the output is kept (default: all of it)
+ * @param stdout_info What became of stdout, e.g. its spill file (optional)
+ * @param stderr_info What became of stderr (optional)
  * @return Command execution return code, <0 indicates execution failure, -3
  * indicates terminated by callback
  */
 int ExecCommandEx2(const std::string& cmd, int timeout,
                    std::string& stdout_output, std::string& stderr_output,
                    std::function<bool()> check_callback, bool elevate = false,
-                   bool skip_encoding_conversion = false);
+                   bool skip_encoding_conversion = false,
+                   const CapturePolicy& capture = CapturePolicy(),
+                   CaptureInfo* stdout_info = nullptr,
+                   CaptureInfo* stderr_info = nullptr);
+
+/**
+ * ExecCommandEx for a step of a longer operation, limited by the deadline
+ * of the step instead of a timeout of its own and stopped once the token
+ * of the operation is cancelled
+ *
+ * @param cmd Command to execute
+ * @param deadline The command is stopped when it passes (never: no limit),
+ * it is not started if it has passed already
+ * @param cancel_token The command is stopped once it is cancelled, it is
+ * not started if it already is
+ * @param stdout_output Standard output content
+ * @param stderr_output Standard error output content
+ * @param skip_encoding_conversion Whether to skip encoding conversion
+ * @param capture How much of the output is kept (default: all of it)
+ * @param stdout_info What became of stdout, e.g. its spill file (optional)
+ * @param stderr_info What became of stderr (optional)
+ * @return Command execution return code, <0 indicates execution failure, -2
+ * the deadline passed, -3 the token was cancelled
+ */
+int ExecCommandUntil(const std::string& cmd, const Deadline& deadline,
+                     const CancellationToken& cancel_token,
+                     std::string& stdout_output, std::string& stderr_output,
+                     bool skip_encoding_conversion = false,
+                     const CapturePolicy& capture = CapturePolicy(),
+                     CaptureInfo* stdout_info = nullptr,
+                     CaptureInfo* stderr_info = nullptr);
 
 }  // namespace utils
 }  // namespace parallax
@@ -0,0 +1,255 @@
+#include "shell_session.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+
+namespace parallax {
+namespace utils {
+
+// Quote text as one single quoted shell word
+static std::string QuoteShellWord(const std::string& text) {
+    std::string quoted = "'";
+    for (char c : text) {
+        if (c == '\'') {
+            quoted += "'\\''";
+        } else {
+            quoted += c;
+        }
+    }
+    quoted += "'";
+    return quoted;
+}
+
+// Move the output in buffer ahead of mark to capture. True once mark has
+// been found, it then starts the buffer; until then only as much is left as
+// could be the start of it.
+static bool TakeUntilMark(std::string& buffer, const std::string& mark,
+                          OutputCapture& capture) {
+    size_t pos = buffer.find(mark);
+    size_t take = pos;
+    if (pos == std::string::npos) {
+        take = buffer.size() >= mark.size() ? buffer.size() - mark.size() + 1
+                                            : 0;
+    }
+    capture.Append(buffer.data(), take);
+    buffer.erase(0, take);
+    return pos != std::string::npos;
+}
+
+ShellSession::ShellSession(const std::vector<std::string>& shell_argv)
+    : shell_argv_(shell_argv),
+      started_(false),
+      start_count_(0),
+      sequence_(0),
+      nonce_(0) {}
+
+ShellSession::~ShellSession() { Close(); }
+
+ShellSessionResult ShellSession::Run(const std::string& script,
+                                     int timeout_ms,
+                                     const CapturePolicy& capture,
+                                     const CancellationToken& cancel_token) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // A shell that died since the last command is replaced before this one
+    ShellSessionResult result;
+    if (cancel_token.IsCancelled()) {
+        result.status = ShellSessionStatus::kCancelled;
+        result.error = "Cancelled before it ran";
+        return result;
+    }
+    if (started_ && !process_.Poll(0)) {
+        Stop();
+    }
+    if (!started_ && !Start(result.error)) {
+        return result;
+    }
+
+    // The subshell keeps cd, exit and variables of one command from
+    // affecting the next, /dev/null keeps it off the command stream
+    std::string token = NextToken();
+    std::string line = "(eval " + QuoteShellWord(script) +
+                       ") </dev/null; printf '%s %d\\n' " + token +
+                       " $?; printf '%s\\n' " + token + " >&2\n";
+    return Exchange(line, token, timeout_ms, capture, cancel_token);
+}
+
+void ShellSession::Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!started_) {
+        return;
+    }
+
+    // The shell exits at the end of its input, give it a moment to do so
+    process_.CloseInput();
+    uint64_t deadline = MonotonicMs() + 1000;
+    while (process_.IsRunning()) {
+        uint64_t now = MonotonicMs();
+        if (now >= deadline) {
+            break;
+        }
+        process_.Poll(static_cast<int>(deadline - now));
+    }
+    Stop();
+}
+
+uint64_t ShellSession::GetStartCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return start_count_;
+}
+
+bool ShellSession::Start(std::string& error) {
+    ProcessOptions options;
+    options.argv = shell_argv_;
+#ifdef _WIN32
+    char system_path[MAX_PATH];
+    if (GetSystemDirectoryA(system_path, MAX_PATH) > 0) {
+        options.cwd = system_path;
+    }
+#endif
+    options.pipe_stdin = true;
+    options.on_stdout = [this](const char* data, size_t len) {
+        stdout_buffer_.append(data, len);
+    };
+    options.on_stderr = [this](const char* data, size_t len) {
+        stderr_buffer_.append(data, len);
+    };
+
+    if (!process_.Start(options)) {
+        error = process_.GetError();
+        return false;
+    }
+    started_ = true;
+    start_count_++;
+    nonce_ = (static_cast<uint64_t>(std::random_device{}()) << 32) ^
+             std::random_device{}() ^ MonotonicMs();
+
+    // A launcher can start and then fail (wsl.exe with an unknown
+    // distribution), only an answer proves there is a shell behind it
+    std::string token = NextToken();
+    std::string line = "printf '%s 0\\n' " + token + "; printf '%s\\n' " +
+                       token + " >&2\n";
+    ShellSessionResult result =
+        Exchange(line, token, kStartTimeoutMs, CapturePolicy(),
+                 CancellationToken::None());
+    if (result.status != ShellSessionStatus::kCompleted) {
+        error = "Shell did not start: " + result.error;
+        if (!result.stderr_output.empty()) {
+            error += "\n" + result.stderr_output;
+        }
+        Stop();
+        return false;
+    }
+    return true;
+}
+
+void ShellSession::Stop(const ShutdownPolicy& policy) {
+    // Takes down the command that runs as well, also inside WSL
+    process_.CloseInput();
+    if (process_.IsRunning()) {
+        process_.Stop(policy);
+    }
+    while (process_.Poll(-1)) {
+    }
+    started_ = false;
+}
+
+std::string ShellSession::NextToken() {
+    char token[64];
+    snprintf(token, sizeof(token), "__parallax_%016llx_%llu",
+             static_cast<unsigned long long>(nonce_),
+             static_cast<unsigned long long>(++sequence_));
+    return token;
+}
+
+ShellSessionResult ShellSession::Exchange(
+    const std::string& line, const std::string& token, int timeout_ms,
+    const CapturePolicy& capture, const CancellationToken& cancel_token) {
+    ShellSessionResult result;
+    OutputCapture stdout_capture(capture, "stdout");
+    OutputCapture stderr_capture(capture, "stderr");
+
+    // Anything left over is late output of an earlier command
+    stdout_buffer_.clear();
+    stderr_buffer_.clear();
+
+    if (!process_.WriteInput(line.data(), line.size())) {
+        // A command line only runs once it is complete, nothing ran
+        result.status = ShellSessionStatus::kNotRun;
+        result.error = "Shell is gone";
+        Stop();
+    } else {
+        const uint64_t kNever = ~0ULL;
+        uint64_t deadline =
+            timeout_ms > 0 ? MonotonicMs() + timeout_ms : kNever;
+        const std::string stdout_mark = token + " ";
+        const std::string stderr_mark = token + "\n";
+        bool stdout_marked = false;
+        bool stderr_marked = false;
+
+        while (true) {
+            if (!stdout_marked) {
+                stdout_marked =
+                    TakeUntilMark(stdout_buffer_, stdout_mark, stdout_capture);
+            }
+            if (!stderr_marked) {
+                stderr_marked =
+                    TakeUntilMark(stderr_buffer_, stderr_mark, stderr_capture);
+            }
+            // The exit code follows the stdout sentinel up to the newline
+            if (stdout_marked && stderr_marked &&
+                stdout_buffer_.find('\n') != std::string::npos) {
+                result.status = ShellSessionStatus::kCompleted;
+                result.exit_code =
+                    atoi(stdout_buffer_.c_str() + stdout_mark.size());
+                stdout_buffer_.clear();
+                stderr_buffer_.clear();
+                break;
+            }
+
+            if (cancel_token.IsCancelled()) {
+                result.status = ShellSessionStatus::kCancelled;
+                result.error = "Command cancelled";
+                Stop(ShutdownPolicy::Prompt());
+                break;
+            }
+
+            int wait_ms = -1;
+            if (deadline != kNever) {
+                uint64_t now = MonotonicMs();
+                if (now >= deadline) {
+                    result.status = ShellSessionStatus::kTimedOut;
+                    result.error = "Command timed out after " +
+                                   std::to_string(timeout_ms) + " ms";
+                    Stop();
+                    break;
+                }
+                wait_ms = static_cast<int>(deadline - now);
+            }
+            int check_ms = Process::kCancelIntervalMs;
+            if (cancel_token.CanBeCancelled() &&
+                (wait_ms < 0 || wait_ms > check_ms)) {
+                wait_ms = check_ms;
+            }
+            if (!process_.Poll(wait_ms)) {
+                result.status = ShellSessionStatus::kLost;
+                result.error = "Shell exited with code " +
+                               std::to_string(process_.GetExitCode());
+                Stop();
+                break;
+            }
+        }
+    }
+
+    // Whatever an unfinished command left in the buffers is its output
+    stdout_capture.Append(stdout_buffer_.data(), stdout_buffer_.size());
+    stderr_capture.Append(stderr_buffer_.data(), stderr_buffer_.size());
+    stdout_buffer_.clear();
+    stderr_buffer_.clear();
+    stdout_capture.Finish(result.stdout_output, &result.stdout_info);
+    stderr_capture.Finish(result.stderr_output, &result.stderr_info);
+    return result;
+}
+
+}  // namespace utils
+}  // namespace parallax
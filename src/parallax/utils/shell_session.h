@@ -0,0 +1,103 @@
+#pragma once
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "process.h"
+
+// Long-lived shell that runs many commands, specifically for parallax project
+
+namespace parallax {
+namespace utils {
+
+enum class ShellSessionStatus {
+    kCompleted,  // The command ran, exit_code is its exit code
+    kNotRun,     // The shell could not be started, the command never ran
+    kTimedOut,   // The command overran its timeout, the shell was stopped
+    kCancelled,  // The token was cancelled, the shell was stopped
+    kLost,       // The shell died while the command ran
+};
+
+struct ShellSessionResult {
+    ShellSessionStatus status = ShellSessionStatus::kNotRun;
+    int exit_code = -1;
+    std::string stdout_output;  // As kept by the CapturePolicy
+    std::string stderr_output;
+    CaptureInfo stdout_info;
+    CaptureInfo stderr_info;
+    std::string error;  // Why the command did not complete
+};
+
+/**
+ * @brief One shell process that runs commands sent over its stdin
+ *
+ * Starting a shell per command is expensive where the shell sits behind a
+ * launcher (wsl.exe boots its session machinery every time); a session
+ * pays that once. Each command is written to the shell's stdin as one line
+ * that runs it in a subshell with stdin from /dev/null and then prints a
+ * sentinel carrying the exit code to stdout and a sentinel to stderr. The
+ * sentinels hold a token unique to the command, Run() reads both streams
+ * until it has seen them and hands back what came before, kept according
+ * to a CapturePolicy.
+ *
+ * The shell is started on the first Run(), after a dead or timed out shell
+ * the next Run() starts a new one. A command is only retried by the caller:
+ * kNotRun means it never reached a shell and is safe to run another way,
+ * after kLost it may have run in part. Output written by background jobs a
+ * command leaves behind can end up in a later command's output.
+ *
+ * The shell must read commands from stdin and understand POSIX sh syntax,
+ * e.g. {"/bin/bash", "--noprofile", "--norc"}. Run() is thread safe,
+ * commands run one at a time.
+ */
+class ShellSession {
+ public:
+    explicit ShellSession(const std::vector<std::string>& shell_argv);
+    ~ShellSession();  // Closes the shell
+
+    ShellSession(const ShellSession&) = delete;
+    ShellSession& operator=(const ShellSession&) = delete;
+
+    // Run script in a subshell of the session, timeout_ms 0: no limit.
+    // Cancelling cancel_token stops the command with ShutdownPolicy::Prompt,
+    // it is checked every Process::kCancelIntervalMs.
+    ShellSessionResult Run(const std::string& script, int timeout_ms,
+                           const CapturePolicy& capture = CapturePolicy(),
+                           const CancellationToken& cancel_token =
+                               CancellationToken::None());
+
+    // End the shell, the next Run() starts a new one
+    void Close();
+
+    // Shells started so far, more than one means restarts
+    uint64_t GetStartCount() const;
+
+    // Time the shell has to answer its first command before it is given up
+    static const int kStartTimeoutMs = 60000;
+
+ private:
+    bool Start(std::string& error);
+    void Stop(const ShutdownPolicy& policy = ShutdownPolicy::Default());
+    std::string NextToken();
+
+    // Send line and collect output until both sentinels of token have been
+    // seen or the shell ends or timeout_ms passes or cancel_token is
+    // cancelled
+    ShellSessionResult Exchange(const std::string& line,
+                                const std::string& token, int timeout_ms,
+                                const CapturePolicy& capture,
+                                const CancellationToken& cancel_token);
+
+    mutable std::mutex mutex_;
+    const std::vector<std::string> shell_argv_;
+    Process process_;
+    bool started_;
+    uint64_t start_count_;
+    uint64_t sequence_;
+    uint64_t nonce_;  // Random part of the tokens, new per shell
+    std::string stdout_buffer_;
+    std::string stderr_buffer_;
+};
+
+}  // namespace utils
+}  // namespace parallax
@@ -1,4 +1,5 @@
 #include "utils.h"
+#include "probe_cache.h"
 #include "process.h"
 #include "../config/config_manager.h"
 #include <windows.h>
@@ -630,11 +631,12 @@ CUDAInfo GetCUDAInfo() {
     CUDAInfo cuda_info = {};
     cuda_info.is_valid_version = false;
 
-    // First get driver version
+    // First get driver version (driver and toolkit only change when they
+    // are installed, which invalidates the probe cache)
     std::string stdout_output, stderr_output;
-    int exit_code = ExecCommandEx(
+    int exit_code = ExecProbeCommand(
         "nvidia-smi --query-gpu=driver_version --format=csv,noheader,nounits",
-        30, stdout_output, stderr_output, false, true);
+        300, 30, stdout_output, stderr_output, true);
 
     if (exit_code == 0 && !stdout_output.empty()) {
         cuda_info.driver_version = stdout_output;
@@ -646,8 +648,8 @@ CUDAInfo GetCUDAInfo() {
     }
 
     // Check CUDA toolkit version
-    exit_code = ExecCommandEx("nvcc --version", 30, stdout_output,
-                              stderr_output, false, true);
+    exit_code = ExecProbeCommand("nvcc --version", 300, 30, stdout_output,
+                                 stderr_output, true);
 
     if (exit_code == 0 && !stdout_output.empty()) {
         // Parse CUDA version number, format like: Cuda compilation tools,
@@ -39,21 +39,40 @@ WSLProcess::~WSLProcess() {
 }
 
 int WSLProcess::Execute(const std::string& wsl_command) {
+    return Execute(wsl_command, parallax::utils::CancellationToken::None(),
+                   parallax::utils::Deadline::Never());
+}
+
+int WSLProcess::Execute(const std::string& wsl_command,
+                        const parallax::utils::CancellationToken& cancel_token,
+                        const parallax::utils::Deadline& deadline) {
     if (running_) {
-        error_log("WSLProcess is already running");
+        error_log("[WSL] WSLProcess is already running");
         return 1;
     }
+    if (cancel_token.IsCancelled()) {
+        info_log("[WSL] Not executing WSL command, operation cancelled");
+        return -3;
+    }
+    if (deadline.HasPassed()) {
+        error_log("[WSL] Not executing WSL command, no time left");
+        return -2;
+    }
 
-    info_log("Executing WSL command: %s", wsl_command.c_str());
+    info_log("[WSL] Executing WSL command: %s", wsl_command.c_str());
 
-    // Set up console control handler for Ctrl+C
-    if (!SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE)) {
-        error_log("Failed to set console control handler");
+    // Set up console control handler for Ctrl+C, unless the caller cancels
+    // through the token
+    const bool handleCtrlC = !cancel_token.CanBeCancelled();
+    if (handleCtrlC && !SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE)) {
+        error_log("[WSL] Failed to set console control handler");
     }
 
     // Create WSL process
     if (!CreateWSLProcess(wsl_command)) {
-        SetConsoleCtrlHandler(ConsoleCtrlHandler, FALSE);
+        if (handleCtrlC) {
+            SetConsoleCtrlHandler(ConsoleCtrlHandler, FALSE);
+        }
         return 1;
     }
 
@@ -64,9 +83,27 @@ int WSLProcess::Execute(const std::string& wsl_command) {
     // Start I/O thread
     ioThread_ = std::thread([this]() { IOReaderThread(); });
 
-    // Wait for process to complete
+    // Wait for process to complete, checking the token and the deadline
+    // meanwhile. Stop() returns once the tree is gone.
+    int stopCode = 0;
     if (processHandle_ != INVALID_HANDLE_VALUE) {
-        WaitForSingleObject(processHandle_, INFINITE);
+        const bool limited = cancel_token.CanBeCancelled() ||
+                             !deadline.IsNever();
+        DWORD checkMs = parallax::utils::Process::kCancelIntervalMs;
+        while (WaitForSingleObject(processHandle_,
+                                   limited && stopCode == 0
+                                       ? checkMs
+                                       : INFINITE) == WAIT_TIMEOUT) {
+            if (cancel_token.IsCancelled()) {
+                info_log("[WSL] WSL command cancelled");
+                stopCode = -3;
+                Stop(parallax::utils::ShutdownPolicy::Prompt());
+            } else if (deadline.HasPassed()) {
+                error_log("[WSL] WSL command ran out of time");
+                stopCode = -2;
+                Stop();
+            }
+        }
 
         DWORD processExitCode = 0;
         if (GetExitCodeProcess(processHandle_, &processExitCode)) {
@@ -74,9 +111,15 @@ int WSLProcess::Execute(const std::string& wsl_command) {
         }
     }
 
+    // wsl.exe goes before the Linux processes, a Stop() in progress is
+    // waited for
+    {
+        std::lock_guard<std::mutex> lock(stopMutex_);
+        running_ = false;
+    }
+
     // Stop I/O thread
     shouldStop_ = true;
-    running_ = false;
 
     if (exitEvent_ != INVALID_HANDLE_VALUE) {
         SetEvent(exitEvent_);
@@ -87,41 +130,37 @@ int WSLProcess::Execute(const std::string& wsl_command) {
     }
 
     CleanupProcess();
+    tree_.reset();
 
     // Remove console control handler
-    SetConsoleCtrlHandler(ConsoleCtrlHandler, FALSE);
+    if (handleCtrlC) {
+        SetConsoleCtrlHandler(ConsoleCtrlHandler, FALSE);
+    }
+    if (stopCode != 0) {
+        exitCode_ = stopCode;
+    }
 
-    info_log("WSL command completed with exit code: %d", exitCode_.load());
+    info_log("[WSL] WSL command completed with exit code: %d",
+             exitCode_.load());
     return exitCode_;
 }
 
-void WSLProcess::Stop() {
-    if (!running_) {
-        return;
-    }
-
-    info_log("Stopping WSL process");
-
-    shouldStop_ = true;
-    running_ = false;
+void WSLProcess::Stop() { Stop(parallax::utils::ShutdownPolicy::Default()); }
 
-    // Signal the exit event to wake up the I/O thread
-    if (exitEvent_ != INVALID_HANDLE_VALUE) {
-        SetEvent(exitEvent_);
+void WSLProcess::Stop(const parallax::utils::ShutdownPolicy& policy) {
+    std::lock_guard<std::mutex> lock(stopMutex_);
+    if (!running_ || !tree_) {
+        return;
     }
 
-    // Terminate the child process
-    if (processHandle_ != INVALID_HANDLE_VALUE) {
-        TerminateProcess(processHandle_, 1);
-        WaitForSingleObject(processHandle_, 1000);
-    }
+    info_log("[WSL] Stopping WSL process tree");
 
-    // Wait for I/O thread to finish
-    if (ioThread_.joinable()) {
-        ioThread_.join();
+    // Killing wsl.exe alone leaves the Linux processes running (e.g. a
+    // server holding GPU memory). The I/O thread keeps showing their
+    // output while they shut down, Execute() cleans up once wsl.exe exits.
+    if (!tree_->Shutdown(policy, [](int wait_ms) { Sleep(wait_ms); })) {
+        error_log("[WSL] WSL processes are still running after the kill");
     }
-
-    CleanupProcess();
 }
 
 bool WSLProcess::IsRunning() const { return running_.load(); }
@@ -134,23 +173,25 @@ bool WSLProcess::CreateWSLProcess(const std::string& command) {
 
     // Create pipes for stdout
     if (!CreatePipe(&stdoutRead_, &stdoutWrite_, &saAttr, 0)) {
-        error_log("Failed to create stdout pipe: %lu", GetLastError());
+        error_log("[WSL] Failed to create stdout pipe: %lu", GetLastError());
         return false;
     }
     if (!SetHandleInformation(stdoutRead_, HANDLE_FLAG_INHERIT, 0)) {
-        error_log("Failed to set stdout handle info: %lu", GetLastError());
+        error_log("[WSL] Failed to set stdout handle info: %lu",
+                  GetLastError());
         CleanupProcess();
         return false;
     }
 
     // Create pipes for stderr
     if (!CreatePipe(&stderrRead_, &stderrWrite_, &saAttr, 0)) {
-        error_log("Failed to create stderr pipe: %lu", GetLastError());
+        error_log("[WSL] Failed to create stderr pipe: %lu", GetLastError());
         CleanupProcess();
         return false;
     }
     if (!SetHandleInformation(stderrRead_, HANDLE_FLAG_INHERIT, 0)) {
-        error_log("Failed to set stderr handle info: %lu", GetLastError());
+        error_log("[WSL] Failed to set stderr handle info: %lu",
+                  GetLastError());
         CleanupProcess();
         return false;
     }
@@ -167,28 +208,43 @@ bool WSLProcess::CreateWSLProcess(const std::string& command) {
     char cmdLine[2048];
     strcpy_s(cmdLine, sizeof(cmdLine), command.c_str());
 
-    // Create process
+    // The Linux processes are tagged so that Stop() reaches them
+    tree_.reset(new parallax::utils::ProcessTree());
+    std::string distribution;
+    std::vector<std::pair<std::string, std::string>> env;
+    if (parallax::utils::GetWSLDistribution(command, distribution)) {
+        tree_->SetWSLDistribution(distribution);
+        tree_->Tag(env);
+    }
+    std::string envBlock;
+    if (!env.empty()) {
+        envBlock = parallax::utils::BuildEnvironmentBlock(env);
+    }
+
+    // Create process, suspended until it is in the job object
     BOOL result = CreateProcessA(
-        nullptr,           // No module name (use command line)
-        cmdLine,           // Command line
-        nullptr,           // Process handle not inheritable
-        nullptr,           // Thread handle not inheritable
-        TRUE,              // Set handle inheritance to TRUE
-        CREATE_NO_WINDOW,  // Creation flags
-        nullptr,           // Use parent's environment block
-        nullptr,           // Use parent's starting directory
-        &startupInfo_,     // Pointer to STARTUPINFO structure
-        &processInfo_      // Pointer to PROCESS_INFORMATION structure
+        nullptr,  // No module name (use command line)
+        cmdLine,  // Command line
+        nullptr,  // Process handle not inheritable
+        nullptr,  // Thread handle not inheritable
+        TRUE,     // Set handle inheritance to TRUE
+        CREATE_NO_WINDOW | CREATE_SUSPENDED,        // Creation flags
+        envBlock.empty() ? nullptr : &envBlock[0],  // Tagged environment
+        nullptr,        // Use parent's starting directory
+        &startupInfo_,  // Pointer to STARTUPINFO structure
+        &processInfo_   // Pointer to PROCESS_INFORMATION structure
     );
 
     if (!result) {
-        error_log("Failed to create WSL process: %lu", GetLastError());
+        error_log("[WSL] Failed to create WSL process: %lu", GetLastError());
         CleanupProcess();
         return false;
     }
 
     processHandle_ = processInfo_.hProcess;
     threadHandle_ = processInfo_.hThread;
+    tree_->Attach(processHandle_);
+    ResumeThread(threadHandle_);
 
     // Close write ends of pipes in parent process
     CloseHandle(stderrWrite_);
@@ -196,7 +252,7 @@ bool WSLProcess::CreateWSLProcess(const std::string& command) {
     stderrWrite_ = INVALID_HANDLE_VALUE;
     stdoutWrite_ = INVALID_HANDLE_VALUE;
 
-    info_log("WSL process created successfully, PID: %lu",
+    info_log("[WSL] WSL process created successfully, PID: %lu",
              processInfo_.dwProcessId);
     return true;
 }
@@ -247,7 +303,7 @@ void WSLProcess::IOReaderThread() {
     handles[1] = stdoutRead_;  // Stdout pipe
     handles[2] = stderrRead_;  // Stderr pipe
 
-    info_log("WSL I/O reader thread started");
+    info_log("[WSL] WSL I/O reader thread started");
 
     while (!shouldStop_ && IsRunning()) {
         // Wait for any handle to be signaled
@@ -325,14 +381,14 @@ void WSLProcess::IOReaderThread() {
                     error == ERROR_INVALID_HANDLE) {
                     // Normal pipe closure
                 } else {
-                    error_log("WaitForMultipleObjects error: %lu", error);
+                    error_log("[WSL] WaitForMultipleObjects error: %lu", error);
                 }
                 goto exit_loop;
         }
     }
 
 exit_loop:
-    info_log("WSL I/O reader thread finished");
+    info_log("[WSL] WSL I/O reader thread finished");
 }
 
 bool WSLProcess::ReadFromPipe(HANDLE pipeHandle, std::vector<uint8_t>& buffer,
@@ -347,7 +403,7 @@ bool WSLProcess::ReadFromPipe(HANDLE pipeHandle, std::vector<uint8_t>& buffer,
     if (!result) {
         DWORD error = GetLastError();
         if (error != ERROR_BROKEN_PIPE && error != ERROR_INVALID_HANDLE) {
-            error_log("%s read error: %lu", pipeName, error);
+            error_log("[WSL] %s read error: %lu", pipeName, error);
         }
         return false;
     }
@@ -367,8 +423,11 @@ void WSLProcess::ProcessOutput(const std::vector<uint8_t>& buffer,
     bool is_stderr = (strcmp(source, "Stderr") == 0);
     std::string convertedOutput =
         parallax::utils::ConvertWslOutputToUtf8(outputStr, is_stderr);
-    debug_log("WSL original output: %s", outputStr.c_str());
-    debug_log("WSL output: %s", convertedOutput.c_str());
+    // Long running commands (pip install) stream output for minutes, keep
+    // the debug log bounded
+    debug_log_limited(5, 50, "[WSL] WSL original output: %s",
+                      outputStr.c_str());
+    debug_log_limited(5, 50, "[WSL] WSL output: %s", convertedOutput.c_str());
     if (convertedOutput.empty()) {
         convertedOutput = outputStr;
     }
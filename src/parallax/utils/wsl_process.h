@@ -6,9 +6,12 @@
 #include <thread>
 #include <atomic>
 #include <functional>
+#include <mutex>
 
 #include <windows.h>
 
+#include "process.h"
+
 // WSL process executor with real-time output
 class WSLProcess {
  public:
@@ -18,8 +21,19 @@ class WSLProcess {
     // Execute WSL command with real-time output
     int Execute(const std::string& wsl_command);
 
-    // Stop the running process (for Ctrl+C handling)
+    // Execute as a step of a longer operation: the command is stopped once
+    // cancel_token is cancelled (-3, with ShutdownPolicy::Prompt) or
+    // deadline passes (-2). Ctrl+C is left to the caller, who cancels the
+    // token.
+    int Execute(const std::string& wsl_command,
+                const parallax::utils::CancellationToken& cancel_token,
+                const parallax::utils::Deadline& deadline);
+
+    // Stop the running process and everything it started, in WSL as well,
+    // with the default shutdown ladder (for Ctrl+C handling) or policy.
+    // Returns once they are all gone.
     void Stop();
+    void Stop(const parallax::utils::ShutdownPolicy& policy);
 
     // Check if process is running
     bool IsRunning() const;
@@ -56,6 +70,11 @@ class WSLProcess {
     PROCESS_INFORMATION processInfo_;
     STARTUPINFOA startupInfo_;
 
+    // The WSL process and its descendants, on both sides
+    std::unique_ptr<parallax::utils::ProcessTree> tree_;
+    // Held by Stop(), Execute() returns only after a Stop() in progress
+    std::mutex stopMutex_;
+
     // I/O thread
     std::thread ioThread_;
     HANDLE exitEvent_;  // Event handle for graceful shutdown